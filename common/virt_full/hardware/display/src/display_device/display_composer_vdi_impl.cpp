@@ -37,43 +37,35 @@ int32_t DisplayComposerVdiImpl::RegHotPlugCallback(HotPlugCallback cb, void* dat
 
 int32_t DisplayComposerVdiImpl::GetDisplayCapability(uint32_t devId, DisplayCapability& info)
 {
-    std::lock_guard<std::mutex> lock(mMutex);
-    int32_t ec = HdiSession::GetInstance().CallDisplayFunction(devId, &HdiDisplay::GetDisplayCapability, &info);
+    int32_t ec = HdiSession::GetInstance().QueryDisplayFunction(devId, &HdiDisplay::GetDisplayCapability, &info);
     DISPLAY_CHK_RETURN(ec != DISPLAY_SUCCESS, HDF_FAILURE, DISPLAY_LOGE("failed, ec=%{public}d", ec));
     return HDF_SUCCESS;
 }
 
 int32_t DisplayComposerVdiImpl::GetDisplaySupportedModes(uint32_t devId, std::vector<DisplayModeInfo>& modes)
 {
-    std::lock_guard<std::mutex> lock(mMutex);
-    DisplayModeInfo* placeHoler = nullptr;
-    uint32_t num = 0;
-    int32_t ec = HdiSession::GetInstance().CallDisplayFunction(devId, &HdiDisplay::GetDisplaySupportedModes,
-        &num, placeHoler);
-    if (ec != DISPLAY_SUCCESS) {
-        DISPLAY_LOGE("failed, ec=%{public}d", ec);
-        return HDF_FAILURE;
-    }
-    if (num != 0) {
-        modes.resize(num);
-        ec = HdiSession::GetInstance().CallDisplayFunction(devId, &HdiDisplay::GetDisplaySupportedModes, &num,
-            modes.data());
-    }
+    int32_t ec = HdiSession::GetInstance().QueryDisplay(devId, [&modes](HdiDisplay &display) {
+        uint32_t num = 0;
+        int32_t ret = display.GetDisplaySupportedModes(&num, nullptr);
+        if ((ret == DISPLAY_SUCCESS) && (num != 0)) {
+            modes.resize(num);
+            ret = display.GetDisplaySupportedModes(&num, modes.data());
+        }
+        return ret;
+    });
     DISPLAY_CHK_RETURN(ec != DISPLAY_SUCCESS, HDF_FAILURE, DISPLAY_LOGE("failed, ec=%{public}d", ec));
     return HDF_SUCCESS;
 }
 
 int32_t DisplayComposerVdiImpl::GetDisplayMode(uint32_t devId, uint32_t& modeId)
 {
-    std::lock_guard<std::mutex> lock(mMutex);
-    int32_t ec = HdiSession::GetInstance().CallDisplayFunction(devId, &HdiDisplay::GetDisplayMode, &modeId);
+    int32_t ec = HdiSession::GetInstance().QueryDisplayFunction(devId, &HdiDisplay::GetDisplayMode, &modeId);
     DISPLAY_CHK_RETURN(ec != DISPLAY_SUCCESS, HDF_FAILURE, DISPLAY_LOGE("failed, ec=%{public}d", ec));
     return HDF_SUCCESS;
 }
 
 int32_t DisplayComposerVdiImpl::SetDisplayMode(uint32_t devId, uint32_t modeId)
 {
-    std::lock_guard<std::mutex> lock(mMutex);
     int32_t ec = HdiSession::GetInstance().CallDisplayFunction(devId, &HdiDisplay::SetDisplayMode, modeId);
     DISPLAY_CHK_RETURN(ec != DISPLAY_SUCCESS, HDF_FAILURE, DISPLAY_LOGE("failed, ec=%{public}d", ec));
     return HDF_SUCCESS;
@@ -81,15 +73,13 @@ int32_t DisplayComposerVdiImpl::SetDisplayMode(uint32_t devId, uint32_t modeId)
 
 int32_t DisplayComposerVdiImpl::GetDisplayPowerStatus(uint32_t devId, DispPowerStatus& status)
 {
-    std::lock_guard<std::mutex> lock(mMutex);
-    int32_t ec = HdiSession::GetInstance().CallDisplayFunction(devId, &HdiDisplay::GetDisplayPowerStatus, &status);
+    int32_t ec = HdiSession::GetInstance().QueryDisplayFunction(devId, &HdiDisplay::GetDisplayPowerStatus, &status);
     DISPLAY_CHK_RETURN(ec != DISPLAY_SUCCESS, HDF_FAILURE, DISPLAY_LOGE("failed, ec=%{public}d", ec));
     return HDF_SUCCESS;
 }
 
 int32_t DisplayComposerVdiImpl::SetDisplayPowerStatus(uint32_t devId, DispPowerStatus status)
 {
-    std::lock_guard<std::mutex> lock(mMutex);
     int32_t ec = HdiSession::GetInstance().CallDisplayFunction(devId, &HdiDisplay::SetDisplayPowerStatus, status);
     DISPLAY_CHK_RETURN(ec != DISPLAY_SUCCESS, HDF_FAILURE, DISPLAY_LOGE("failed, ec=%{public}d", ec));
     return HDF_SUCCESS;
@@ -97,15 +87,13 @@ int32_t DisplayComposerVdiImpl::SetDisplayPowerStatus(uint32_t devId, DispPowerS
 
 int32_t DisplayComposerVdiImpl::GetDisplayBacklight(uint32_t devId, uint32_t& level)
 {
-    std::lock_guard<std::mutex> lock(mMutex);
-    int32_t ec = HdiSession::GetInstance().CallDisplayFunction(devId, &HdiDisplay::GetDisplayBacklight, &level);
+    int32_t ec = HdiSession::GetInstance().QueryDisplayFunction(devId, &HdiDisplay::GetDisplayBacklight, &level);
     DISPLAY_CHK_RETURN(ec != DISPLAY_SUCCESS, HDF_FAILURE, DISPLAY_LOGE("failed, ec=%{public}d", ec));
     return HDF_SUCCESS;
 }
 
 int32_t DisplayComposerVdiImpl::SetDisplayBacklight(uint32_t devId, uint32_t level)
 {
-    std::lock_guard<std::mutex> lock(mMutex);
     int32_t ec = HdiSession::GetInstance().CallDisplayFunction(devId, &HdiDisplay::SetDisplayBacklight, level);
     DISPLAY_CHK_RETURN(ec != DISPLAY_SUCCESS, HDF_FAILURE, DISPLAY_LOGE("failed, ec=%{public}d", ec));
     return HDF_SUCCESS;
@@ -120,31 +108,30 @@ int32_t DisplayComposerVdiImpl::GetDisplayProperty(uint32_t devId, uint32_t id,
 int32_t DisplayComposerVdiImpl::GetDisplayCompChange(uint32_t devId, std::vector<uint32_t>& layers,
     std::vector<int32_t>& types)
 {
-    std::lock_guard<std::mutex> lock(mMutex);
-    uint32_t* layersHoler = nullptr;
-    int32_t* typesHoler = nullptr;
-    uint32_t num = 0;
-    int32_t ec = HdiSession::GetInstance().CallDisplayFunction(devId, &HdiDisplay::GetDisplayCompChange, &num,
-        layersHoler, typesHoler);
-    if (ec == HDF_SUCCESS && num != 0) {
-        layers.resize(num);
-        types.resize(num);
-        ec = HdiSession::GetInstance().CallDisplayFunction(devId, &HdiDisplay::GetDisplayCompChange, &num,
-            layers.data(), types.data());
-    }
+    int32_t ec = HdiSession::GetInstance().QueryDisplay(devId, [&layers, &types](HdiDisplay &display) {
+        uint32_t num = 0;
+        int32_t ret = display.GetDisplayCompChange(&num, nullptr, nullptr);
+        if ((ret == DISPLAY_SUCCESS) && (num != 0)) {
+            layers.resize(num);
+            types.resize(num);
+            ret = display.GetDisplayCompChange(&num, layers.data(), types.data());
+        }
+        return ret;
+    });
     DISPLAY_CHK_RETURN(ec != DISPLAY_SUCCESS, HDF_FAILURE, DISPLAY_LOGE("failed, ec=%{public}d", ec));
     return HDF_SUCCESS;
 }
 
 int32_t DisplayComposerVdiImpl::SetDisplayClientCrop(uint32_t devId, const IRect& rect)
 {
-    DISPLAY_LOGE("%s is not supported", __func__);
-    return HDF_ERR_NOT_SUPPORT;
+    int32_t ec = HdiSession::GetInstance().CallDisplayFunction(devId, &HdiDisplay::SetDisplayClientCrop,
+        const_cast<IRect*>(&rect));
+    DISPLAY_CHK_RETURN(ec != DISPLAY_SUCCESS, HDF_FAILURE, DISPLAY_LOGE("failed, ec=%{public}d", ec));
+    return HDF_SUCCESS;
 }
 
 int32_t DisplayComposerVdiImpl::SetDisplayClientBuffer(uint32_t devId, const BufferHandle& buffer, int32_t fence)
 {
-    std::lock_guard<std::mutex> lock(mMutex);
     int32_t ec = HdiSession::GetInstance().CallDisplayFunction(devId, &HdiDisplay::SetDisplayClientBuffer, &buffer,
         fence);
     DISPLAY_CHK_RETURN(ec != DISPLAY_SUCCESS, HDF_FAILURE, DISPLAY_LOGE("failed, ec=%{public}d", ec));
@@ -153,13 +140,14 @@ int32_t DisplayComposerVdiImpl::SetDisplayClientBuffer(uint32_t devId, const Buf
 
 int32_t DisplayComposerVdiImpl::SetDisplayClientDamage(uint32_t devId, std::vector<IRect>& rects)
 {
-    DISPLAY_LOGE("%s is not supported", __func__);
-    return HDF_ERR_NOT_SUPPORT;
+    int32_t ec = HdiSession::GetInstance().CallDisplayFunction(devId, &HdiDisplay::SetDisplayClientDamage,
+        static_cast<uint32_t>(rects.size()), rects.data());
+    DISPLAY_CHK_RETURN(ec != DISPLAY_SUCCESS, HDF_FAILURE, DISPLAY_LOGE("failed, ec=%{public}d", ec));
+    return HDF_SUCCESS;
 }
 
 int32_t DisplayComposerVdiImpl::SetDisplayVsyncEnabled(uint32_t devId, bool enabled)
 {
-    std::lock_guard<std::mutex> lock(mMutex);
     int32_t ec = HdiSession::GetInstance().CallDisplayFunction(devId, &HdiDisplay::SetDisplayVsyncEnabled, enabled);
     DISPLAY_CHK_RETURN(ec != DISPLAY_SUCCESS, HDF_FAILURE, DISPLAY_LOGE("failed, ec=%{public}d", ec));
     return HDF_SUCCESS;
@@ -167,7 +155,6 @@ int32_t DisplayComposerVdiImpl::SetDisplayVsyncEnabled(uint32_t devId, bool enab
 
 int32_t DisplayComposerVdiImpl::RegDisplayVBlankCallback(uint32_t devId, VBlankCallback cb, void* data)
 {
-    std::lock_guard<std::mutex> lock(mMutex);
     int32_t ec = HdiSession::GetInstance().CallDisplayFunction(devId, &HdiDisplay::RegDisplayVBlankCallback, cb, data);
     DISPLAY_CHK_RETURN(ec != DISPLAY_SUCCESS, HDF_FAILURE, DISPLAY_LOGE("failed, ec=%{public}d", ec));
     return HDF_SUCCESS;
@@ -176,38 +163,40 @@ int32_t DisplayComposerVdiImpl::RegDisplayVBlankCallback(uint32_t devId, VBlankC
 int32_t DisplayComposerVdiImpl::GetDisplayReleaseFence(uint32_t devId, std::vector<uint32_t>& layers,
     std::vector<int32_t>& fences)
 {
-    std::lock_guard<std::mutex> lock(mMutex);
-    uint32_t* layersHoler = nullptr;
-    int32_t* typesHoler = nullptr;
-    uint32_t num = 0;
-    int32_t ec = HdiSession::GetInstance().CallDisplayFunction(devId, &HdiDisplay::GetDisplayReleaseFence, &num,
-        layersHoler, typesHoler);
-    if (ec == HDF_SUCCESS && num != 0) {
-        layers.resize(num);
-        fences.resize(num);
-        ec = HdiSession::GetInstance().CallDisplayFunction(devId, &HdiDisplay::GetDisplayReleaseFence, &num,
-            layers.data(), fences.data());
-    }
+    int32_t ec = HdiSession::GetInstance().QueryDisplay(devId, [&layers, &fences](HdiDisplay &display) {
+        uint32_t num = 0;
+        int32_t ret = display.GetDisplayReleaseFence(&num, nullptr, nullptr);
+        if ((ret == DISPLAY_SUCCESS) && (num != 0)) {
+            layers.resize(num);
+            fences.resize(num);
+            ret = display.GetDisplayReleaseFence(&num, layers.data(), fences.data());
+        }
+        return ret;
+    });
     DISPLAY_CHK_RETURN(ec != DISPLAY_SUCCESS, HDF_FAILURE, DISPLAY_LOGE("failed, ec=%{public}d", ec));
     return HDF_SUCCESS;
 }
 
 int32_t DisplayComposerVdiImpl::CreateVirtualDisplay(uint32_t width, uint32_t height, int32_t& format, uint32_t& devId)
 {
-    DISPLAY_LOGE("%s is not supported", __func__);
-    return HDF_ERR_NOT_SUPPORT;
+    int32_t ec = HdiSession::GetInstance().CreateVirtualDisplay(width, height, &format, &devId);
+    DISPLAY_CHK_RETURN(ec != DISPLAY_SUCCESS, HDF_FAILURE, DISPLAY_LOGE("failed, ec=%{public}d", ec));
+    return HDF_SUCCESS;
 }
 
 int32_t DisplayComposerVdiImpl::DestroyVirtualDisplay(uint32_t devId)
 {
-    DISPLAY_LOGE("%s is not supported", __func__);
-    return HDF_ERR_NOT_SUPPORT;
+    int32_t ec = HdiSession::GetInstance().DestroyVirtualDisplay(devId);
+    DISPLAY_CHK_RETURN(ec != DISPLAY_SUCCESS, HDF_FAILURE, DISPLAY_LOGE("failed, ec=%{public}d", ec));
+    return HDF_SUCCESS;
 }
 
 int32_t DisplayComposerVdiImpl::SetVirtualDisplayBuffer(uint32_t devId, const BufferHandle& buffer, const int32_t fence)
 {
-    DISPLAY_LOGE("%s is not supported", __func__);
-    return HDF_ERR_NOT_SUPPORT;
+    int32_t ec = HdiSession::GetInstance().CallDisplayFunction(devId, &HdiDisplay::SetVirtualDisplayBuffer, &buffer,
+        static_cast<int32_t>(fence));
+    DISPLAY_CHK_RETURN(ec != DISPLAY_SUCCESS, HDF_FAILURE, DISPLAY_LOGE("failed, ec=%{public}d", ec));
+    return HDF_SUCCESS;
 }
 
 int32_t DisplayComposerVdiImpl::SetDisplayProperty(uint32_t devId, uint32_t id, uint64_t value)
@@ -218,7 +207,6 @@ int32_t DisplayComposerVdiImpl::SetDisplayProperty(uint32_t devId, uint32_t id,
 
 int32_t DisplayComposerVdiImpl::Commit(uint32_t devId, int32_t& fence)
 {
-    std::lock_guard<std::mutex> lock(mMutex);
     int32_t ec = HdiSession::GetInstance().CallDisplayFunction(devId, &HdiDisplay::Commit, &fence);
     DISPLAY_CHK_RETURN(ec != DISPLAY_SUCCESS, HDF_FAILURE, DISPLAY_LOGE("failed, ec=%{public}d", ec));
     return HDF_SUCCESS;
@@ -226,7 +214,6 @@ int32_t DisplayComposerVdiImpl::Commit(uint32_t devId, int32_t& fence)
 
 int32_t DisplayComposerVdiImpl::CreateLayer(uint32_t devId, const LayerInfo& layerInfo, uint32_t& layerId)
 {
-    std::lock_guard<std::mutex> lock(mMutex);
     int32_t ec = HdiSession::GetInstance().CallDisplayFunction(devId, &HdiDisplay::CreateLayer, &layerInfo, &layerId);
     DISPLAY_CHK_RETURN(ec != DISPLAY_SUCCESS, HDF_FAILURE, DISPLAY_LOGE("failed, ec=%{public}d", ec));
     return HDF_SUCCESS;
@@ -234,7 +221,6 @@ int32_t DisplayComposerVdiImpl::CreateLayer(uint32_t devId, const LayerInfo& lay
 
 int32_t DisplayComposerVdiImpl::DestroyLayer(uint32_t devId, uint32_t layerId)
 {
-    std::lock_guard<std::mutex> lock(mMutex);
     int32_t ec = HdiSession::GetInstance().CallDisplayFunction(devId, &HdiDisplay::DestroyLayer, layerId);
     DISPLAY_CHK_RETURN(ec != DISPLAY_SUCCESS, HDF_FAILURE, DISPLAY_LOGE("failed, ec=%{public}d", ec));
     return HDF_SUCCESS;
@@ -242,7 +228,6 @@ int32_t DisplayComposerVdiImpl::DestroyLayer(uint32_t devId, uint32_t layerId)
 
 int32_t DisplayComposerVdiImpl::PrepareDisplayLayers(uint32_t devId, bool& needFlushFb)
 {
-    std::lock_guard<std::mutex> lock(mMutex);
     int32_t ec = HdiSession::GetInstance().CallDisplayFunction(devId, &HdiDisplay::PrepareDisplayLayers, &needFlushFb);
     DISPLAY_CHK_RETURN(ec != DISPLAY_SUCCESS, HDF_FAILURE, DISPLAY_LOGE("failed, ec=%{public}d", ec));
     return HDF_SUCCESS;
@@ -250,7 +235,6 @@ int32_t DisplayComposerVdiImpl::PrepareDisplayLayers(uint32_t devId, bool& needF
 
 int32_t DisplayComposerVdiImpl::SetLayerAlpha(uint32_t devId, uint32_t layerId, const LayerAlpha& alpha)
 {
-    std::lock_guard<std::mutex> lock(mMutex);
     int32_t ec = HdiSession::GetInstance().CallLayerFunction(devId, layerId, &HdiLayer::SetLayerAlpha,
         const_cast<LayerAlpha*>(&alpha));
     DISPLAY_CHK_RETURN(ec != DISPLAY_SUCCESS, HDF_FAILURE, DISPLAY_LOGE("failed, ec=%{public}d", ec));
@@ -259,7 +243,6 @@ int32_t DisplayComposerVdiImpl::SetLayerAlpha(uint32_t devId, uint32_t layerId,
 
 int32_t DisplayComposerVdiImpl::SetLayerRegion(uint32_t devId, uint32_t layerId, const IRect& rect)
 {
-    std::lock_guard<std::mutex> lock(mMutex);
     int32_t ec = HdiSession::GetInstance().CallLayerFunction(devId, layerId, &HdiLayer::SetLayerRegion,
         const_cast<IRect*>(&rect));
     DISPLAY_CHK_RETURN(ec != DISPLAY_SUCCESS, HDF_FAILURE, DISPLAY_LOGE("failed, ec=%{public}d", ec));
@@ -268,7 +251,6 @@ int32_t DisplayComposerVdiImpl::SetLayerRegion(uint32_t devId, uint32_t layerId,
 
 int32_t DisplayComposerVdiImpl::SetLayerCrop(uint32_t devId, uint32_t layerId, const IRect& rect)
 {
-    std::lock_guard<std::mutex> lock(mMutex);
     int32_t ec = HdiSession::GetInstance().CallLayerFunction(devId, layerId, &HdiLayer::SetLayerCrop,
         const_cast<IRect*>(&rect));
     DISPLAY_CHK_RETURN(ec != DISPLAY_SUCCESS, HDF_FAILURE, DISPLAY_LOGE("failed, ec=%{public}d", ec));
@@ -277,7 +259,6 @@ int32_t DisplayComposerVdiImpl::SetLayerCrop(uint32_t devId, uint32_t layerId, c
 
 int32_t DisplayComposerVdiImpl::SetLayerZorder(uint32_t devId, uint32_t layerId, uint32_t zorder)
 {
-    std::lock_guard<std::mutex> lock(mMutex);
     int32_t ec = HdiSession::GetInstance().CallDisplayFunction(devId, &HdiDisplay::SetLayerZorder, layerId, zorder);
     DISPLAY_CHK_RETURN(ec != DISPLAY_SUCCESS, HDF_FAILURE, DISPLAY_LOGE("failed, ec=%{public}d", ec));
     return HDF_SUCCESS;
@@ -285,7 +266,6 @@ int32_t DisplayComposerVdiImpl::SetLayerZorder(uint32_t devId, uint32_t layerId,
 
 int32_t DisplayComposerVdiImpl::SetLayerPreMulti(uint32_t devId, uint32_t layerId, bool preMul)
 {
-    std::lock_guard<std::mutex> lock(mMutex);
     int32_t ec = HdiSession::GetInstance().CallLayerFunction(devId, layerId, &HdiLayer::SetLayerPreMulti, preMul);
     DISPLAY_CHK_RETURN(ec != DISPLAY_SUCCESS, HDF_FAILURE, DISPLAY_LOGE("failed, ec=%{public}d", ec));
     return HDF_SUCCESS;
@@ -293,7 +273,6 @@ int32_t DisplayComposerVdiImpl::SetLayerPreMulti(uint32_t devId, uint32_t layerI
 
 int32_t DisplayComposerVdiImpl::SetLayerTransformMode(uint32_t devId, uint32_t layerId, TransformType type)
 {
-    std::lock_guard<std::mutex> lock(mMutex);
     int32_t ec = HdiSession::GetInstance().CallLayerFunction(devId, layerId, &HdiLayer::SetLayerTransformMode, type);
     DISPLAY_CHK_RETURN(ec != DISPLAY_SUCCESS, HDF_FAILURE, DISPLAY_LOGE("failed, ec=%{public}d", ec));
     return HDF_SUCCESS;
@@ -301,23 +280,23 @@ int32_t DisplayComposerVdiImpl::SetLayerTransformMode(uint32_t devId, uint32_t l
 
 int32_t DisplayComposerVdiImpl::SetLayerDirtyRegion(uint32_t devId, uint32_t layerId, const std::vector<IRect>& rects)
 {
-    std::lock_guard<std::mutex> lock(mMutex);
     int32_t ec = HdiSession::GetInstance().CallLayerFunction(devId, layerId, &HdiLayer::SetLayerDirtyRegion,
-        const_cast<IRect*>(rects.data()));
+        static_cast<uint32_t>(rects.size()), const_cast<IRect*>(rects.data()));
     DISPLAY_CHK_RETURN(ec != DISPLAY_SUCCESS, HDF_FAILURE, DISPLAY_LOGE("failed, ec=%{public}d", ec));
     return HDF_SUCCESS;
 }
 
 int32_t DisplayComposerVdiImpl::SetLayerVisibleRegion(uint32_t devId, uint32_t layerId, std::vector<IRect>& rects)
 {
-    DISPLAY_LOGE("%s is not supported", __func__);
-    return HDF_ERR_NOT_SUPPORT;
+    int32_t ec = HdiSession::GetInstance().CallLayerFunction(devId, layerId, &HdiLayer::SetLayerVisibleRegion,
+        static_cast<uint32_t>(rects.size()), rects.data());
+    DISPLAY_CHK_RETURN(ec != DISPLAY_SUCCESS, HDF_FAILURE, DISPLAY_LOGE("failed, ec=%{public}d", ec));
+    return HDF_SUCCESS;
 }
 
 int32_t DisplayComposerVdiImpl::SetLayerBuffer(uint32_t devId, uint32_t layerId, const BufferHandle& buffer,
     int32_t fence)
 {
-    std::lock_guard<std::mutex> lock(mMutex);
     const BufferHandle* holder = &buffer;
     int32_t ec = HdiSession::GetInstance().CallLayerFunction(devId, layerId, &HdiLayer::SetLayerBuffer, holder, fence);
     DISPLAY_CHK_RETURN(ec != DISPLAY_SUCCESS, HDF_FAILURE, DISPLAY_LOGE("failed, ec=%{public}d", ec));
@@ -326,7 +305,6 @@ int32_t DisplayComposerVdiImpl::SetLayerBuffer(uint32_t devId, uint32_t layerId,
 
 int32_t DisplayComposerVdiImpl::SetLayerCompositionType(uint32_t devId, uint32_t layerId, CompositionType type)
 {
-    std::lock_guard<std::mutex> lock(mMutex);
     int32_t ec = HdiSession::GetInstance().CallLayerFunction(devId, layerId, &HdiLayer::SetLayerCompositionType, type);
     DISPLAY_CHK_RETURN(ec != DISPLAY_SUCCESS, HDF_FAILURE, DISPLAY_LOGE("failed, ec=%{public}d", ec));
     return HDF_SUCCESS;
@@ -334,7 +312,6 @@ int32_t DisplayComposerVdiImpl::SetLayerCompositionType(uint32_t devId, uint32_t
 
 int32_t DisplayComposerVdiImpl::SetLayerBlendType(uint32_t devId, uint32_t layerId, BlendType type)
 {
-    std::lock_guard<std::mutex> lock(mMutex);
     int32_t ec = HdiSession::GetInstance().CallLayerFunction(devId, layerId, &HdiLayer::SetLayerBlendType, type);
     DISPLAY_CHK_RETURN(ec != DISPLAY_SUCCESS, HDF_FAILURE, DISPLAY_LOGE("failed, ec=%{public}d", ec));
     return HDF_SUCCESS;
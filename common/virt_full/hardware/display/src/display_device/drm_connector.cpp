@@ -319,7 +319,7 @@ bool DrmConnector::HandleHotplug(IdMapPtr<DrmEncoder> &encoders,
         }
         DISPLAY_LOGD("get crtc id %{public}d ", crtc_id);
 
-        DrmVsyncWorker::GetInstance().EnableVsync(plugIn);
+        DrmVsyncWorker::GetInstance().EnableVsync(crtc->GetPipe(), plugIn);
         drmModeCreatePropertyBlob(drmFd, &c->modes[0],
             sizeof(c->modes[0]), &blob_id);
         ret = drmModeAtomicAddProperty(pset, crtc->GetId(), crtc->GetActivePropId(), (int)plugIn);
@@ -332,6 +332,9 @@ bool DrmConnector::HandleHotplug(IdMapPtr<DrmEncoder> &encoders,
         DISPLAY_CHK_RETURN((ret < 0), DISPLAY_FAILURE,
             DISPLAY_LOGE("can not add the crtc id prop %{public}d", errno));
         drmModeAtomicFree(pset);
+        // committed behind the composition's back
+        crtc->GetCommittedState().Invalidate();
+        mCommittedState.Invalidate();
 
         mConnectState = c->connection;
         InitModes(*c);
@@ -108,6 +108,10 @@ public:
         bool plugIn, drmModeConnectorPtr c, int *crtc_id);
     int32_t GetBrightness(uint32_t& level);
     int32_t SetBrightness(uint32_t level);
+    DrmObjectState &GetCommittedState()
+    {
+        return mCommittedState;
+    }
 
 private:
     static void ConvertTypeToName(uint32_t type, std::string &name);
@@ -119,7 +123,7 @@ private:
     uint32_t mPhyWidth;
     uint32_t mPhyHeight;
     uint32_t mSupportLayers = 0;
-    uint32_t mVirtualDispCount = 0;
+    uint32_t mVirtualDispCount = MAX_VIRTUAL_DISPLAY_COUNT;
     bool mSupportWriteBack = false;
     uint32_t mPropertyCount = 0;
     uint32_t mEncoderId;
@@ -133,6 +137,7 @@ private:
     uint32_t mBrightnessLevel = 0;
     std::unordered_map<int32_t, DrmMode> mModes;
     int32_t mPreferenceId = INVALID_MODE_ID;
+    DrmObjectState mCommittedState;
 
     FdPtr mDrmFdPtr;
 };
@@ -72,6 +72,10 @@ public:
     {
         mNeedModeSet = false;
     }
+    DrmObjectState &GetCommittedState()
+    {
+        return mCommittedState;
+    }
 
 private:
     uint32_t mId = 0;
@@ -82,6 +86,7 @@ private:
     uint32_t mPipe = 0;
     int32_t mActiveModeId = INVALID_MODE_ID;
     bool mNeedModeSet = false;
+    DrmObjectState mCommittedState;
 };
 } // namespace OHOS
 } // namespace HDI
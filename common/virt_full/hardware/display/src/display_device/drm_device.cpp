@@ -108,17 +108,25 @@ int32_t DrmDevice::GetProperty(uint32_t objId, uint32_t objType, const std::stri
     drmModeObjectPropertiesPtr props = drmModeObjectGetProperties(GetDrmFd(), objId, objType);
     DISPLAY_CHK_RETURN((!props), DISPLAY_FAILURE, DISPLAY_LOGE("can not get properties"));
     bool found = false;
-    for (uint32_t i = 0; i < props->count_props; i++) {
-        drmModePropertyPtr p = drmModeGetProperty(GetDrmFd(), props->props[i]);
-        if (strcmp(p->name, name.c_str()) == 0) {
+    for (uint32_t i = 0; (i < props->count_props) && !found; i++) {
+        // property ids are device wide, only the values belong to the object
+        auto iter = mPropInfos.find(props->props[i]);
+        if (iter == mPropInfos.end()) {
+            drmModePropertyPtr p = drmModeGetProperty(GetDrmFd(), props->props[i]);
+            if (p == nullptr) {
+                continue;
+            }
+            DrmPropInfo info = { p->name, p->flags };
+            iter = mPropInfos.emplace(props->props[i], info).first;
+            drmModeFreeProperty(p);
+        }
+        if (iter->second.name == name) {
             found = true;
-            prop.propId = p->prop_id;
+            prop.propId = iter->first;
             prop.value = props->prop_values[i];
-            prop.name = p->name;
-            prop.flags = p->flags;
-
+            prop.name = iter->second.name;
+            prop.flags = iter->second.flags;
         }
-        drmModeFreeProperty(p);
     }
     drmModeFreeObjectProperties(props);
     return found ? DISPLAY_SUCCESS : DISPLAY_NOT_SUPPORT;
@@ -17,6 +17,7 @@
 #define DRM_DEVICE_H
 #include <unordered_map>
 #include <memory>
+#include <mutex>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 #include "drm_connector.h"
@@ -63,6 +64,11 @@ public:
     ~DrmDevice() override {}
 
     std::vector<std::shared_ptr<DrmPlane>> GetDrmPlane(uint32_t pipe, uint32_t type);
+    // planes may serve several crtcs, binding and committing them is serialised across the displays
+    std::mutex &GetPlaneMutex()
+    {
+        return mPlaneMutex;
+    }
 
     int32_t GetCrtcProperty(const DrmCrtc &crtc, const std::string &name, DrmProperty &prop);
     int32_t GetConnectorProperty(const DrmConnector &connector, const std::string &name, DrmProperty &prop);
@@ -92,6 +98,12 @@ private:
     IdMapPtr<DrmConnector> mConnectors;
     std::vector<std::shared_ptr<DrmPlane>> mPlanes;
     std::unordered_map<uint32_t, uint32_t> dispConnectorIdMaps_;
+    struct DrmPropInfo {
+        std::string name;
+        uint32_t flags;
+    };
+    std::unordered_map<uint32_t, DrmPropInfo> mPropInfos;
+    std::mutex mPlaneMutex;
 };
 } // namespace OHOS
 } // namespace HDI
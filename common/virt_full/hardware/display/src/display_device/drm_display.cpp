@@ -94,7 +94,27 @@ int32_t DrmDisplay::GetDisplayMode(uint32_t *modeId)
 
 int32_t DrmDisplay::SetDisplayMode(uint32_t modeId)
 {
-    return mCrtc->SetActivieMode(modeId);
+    int32_t ret = mCrtc->SetActivieMode(modeId);
+    if (ret == DISPLAY_SUCCESS) {
+        UpdateVsyncPeriod();
+    }
+    return ret;
+}
+
+void DrmDisplay::UpdateVsyncPeriod()
+{
+    uint64_t period = DEFAULT_VSYNC_PERIOD;
+    DrmMode mode;
+    if (mConnector->GetModeFromId(mCrtc->GetActiveModeId(), mode) == DISPLAY_SUCCESS) {
+        drmModeModeInfoPtr info = mode.GetModeInfoPtr();
+        // the clock is in kHz
+        if ((info->clock != 0) && (info->htotal != 0) && (info->vtotal != 0)) {
+            period = static_cast<uint64_t>(info->htotal) * info->vtotal * 1000000 / info->clock;
+        } else if (info->vrefresh != 0) {
+            period = 1000000000 / info->vrefresh;
+        }
+    }
+    DrmVsyncWorker::GetInstance().UpdatePipe(mCrtc->GetPipe(), mCrtc->GetId(), period);
 }
 
 int32_t DrmDisplay::GetDisplayPowerStatus(DispPowerStatus *status)
@@ -111,6 +131,8 @@ int32_t DrmDisplay::SetDisplayPowerStatus(DispPowerStatus status)
     DISPLAY_CHK_RETURN((ret != DISPLAY_SUCCESS), DISPLAY_PARAM_ERR,
         DISPLAY_LOGE("unknown power status %{public}d", status));
     mConnector->SetDpmsState(drmPowerState);
+    // dpms changes ACTIVE behind the atomic commits, let the next commit assert the crtc again
+    mCrtc->GetCommittedState().Invalidate();
     return DISPLAY_SUCCESS;
 }
 
@@ -170,13 +192,8 @@ std::unique_ptr<HdiLayer> DrmDisplay::CreateHdiLayer(LayerType type)
 
 int32_t DrmDisplay::WaitForVBlank(uint64_t *ns)
 {
-    struct timespec curTime = {0, 0};
-    clock_gettime(CLOCK_MONOTONIC, &curTime);
-    usleep(16666);
-    // 1000000000 is used for transfer second to nsec
-    uint64_t duration = static_cast<uint64_t>(curTime.tv_sec) * 1000000 + static_cast<uint64_t>(curTime.tv_nsec);
-    *ns = static_cast<uint64_t>(duration);
-    return DISPLAY_SUCCESS;
+    DISPLAY_CHK_RETURN((ns == nullptr), DISPLAY_NULL_PTR, DISPLAY_LOGE("ns is nullptr"));
+    return DrmVsyncWorker::GetInstance().WaitNextVBlank(mCrtc->GetPipe(), *ns);
 }
 
 bool DrmDisplay::IsConnected()
@@ -239,7 +256,7 @@ int32_t DrmDisplay::RegDisplayVBlankCallback(VBlankCallback cb, void *data)
 int32_t DrmDisplay::SetDisplayVsyncEnabled(bool enabled)
 {
     DISPLAY_LOGD("enable %{public}d", enabled);
-    DrmVsyncWorker::GetInstance().EnableVsync(enabled);
+    DrmVsyncWorker::GetInstance().EnableVsync(mCrtc->GetPipe(), enabled);
     return DISPLAY_SUCCESS;
 }
 
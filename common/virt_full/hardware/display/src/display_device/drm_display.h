@@ -55,6 +55,7 @@ protected:
 
 private:
     int32_t PushFirstFrame();
+    void UpdateVsyncPeriod();
     int32_t ConvertToHdiPowerState(uint32_t drmPowerState, DispPowerStatus &hdiPowerState);
     int32_t ConvertToDrmPowerState(DispPowerStatus hdiPowerState, uint32_t &drmPowerState);
     std::shared_ptr<DrmDevice> mDrmDevice;
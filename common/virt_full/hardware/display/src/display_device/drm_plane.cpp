@@ -14,6 +14,7 @@
  */
 
 #include "drm_plane.h"
+#include <algorithm>
 #include "drm_device.h"
 
 namespace OHOS {
@@ -94,6 +95,11 @@ int  DrmPlane::GetSrcProp(DrmDevice &drmDevice)
     return 0;
 }
 
+bool DrmPlane::IsFormatSupported(uint32_t format) const
+{
+    return std::find(mFormats.begin(), mFormats.end(), format) != mFormats.end();
+}
+
 int32_t DrmPlane::Init(DrmDevice &drmDevice)
 {
     DISPLAY_LOGD();
@@ -111,6 +117,13 @@ int32_t DrmPlane::Init(DrmDevice &drmDevice)
     ret = drmDevice.GetPlaneProperty(*this, PROP_CRTC_ID, prop);
     DISPLAY_CHK_RETURN((ret != DISPLAY_SUCCESS), DISPLAY_FAILURE, DISPLAY_LOGE("cat not get pane crtc prop id"));
     mPropCrtcId = prop.propId;
+    // optional, without it every commit updates the whole framebuffer
+    ret = drmDevice.GetPlaneProperty(*this, PROP_FB_DAMAGE_CLIPS, prop);
+    mPropFbDamageClipsId = (ret == DISPLAY_SUCCESS) ? prop.propId : DRM_INVALID_ID;
+    // optional, without it the stacking order of the planes is unknown
+    ret = drmDevice.GetPlaneProperty(*this, PROP_ZPOS, prop);
+    mHasZpos = (ret == DISPLAY_SUCCESS);
+    mZpos = mHasZpos ? prop.value : 0;
 
     ret = drmDevice.GetPlaneProperty(*this, PROP_TYPE, prop);
     DISPLAY_CHK_RETURN((ret != DISPLAY_SUCCESS), DISPLAY_FAILURE, DISPLAY_LOGE("cat not get pane crtc prop id"));
@@ -20,6 +20,7 @@
 #include <vector>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
+#include "hdi_device_common.h"
 
 namespace OHOS {
 namespace HDI {
@@ -37,6 +38,8 @@ const std::string PROP_FBID = "FB_ID";
 const std::string PROP_IN_FENCE_FD = "IN_FENCE_FD";
 const std::string PROP_CRTC_ID = "CRTC_ID";
 const std::string PROP_TYPE = "type";
+const std::string PROP_FB_DAMAGE_CLIPS = "FB_DAMAGE_CLIPS";
+const std::string PROP_ZPOS = "zpos";
 
 const std::string PROP_CRTC_X_ID = "CRTC_X";
 const std::string PROP_CRTC_Y_ID = "CRTC_Y";
@@ -105,6 +108,10 @@ public:
     {
         return mPropCrtcId;
     }
+    uint32_t GetPropFbDamageClipsId() const
+    {
+        return mPropFbDamageClipsId;
+    }
     uint32_t GetPossibleCrtcs() const
     {
         return mPossibleCrtcs;
@@ -113,6 +120,15 @@ public:
     {
         return mType;
     }
+    // DRM only guarantees the stacking of planes that report a zpos
+    bool HasZpos() const
+    {
+        return mHasZpos;
+    }
+    uint64_t GetZpos() const
+    {
+        return mZpos;
+    }
     void BindToPipe(uint32_t pipe)
     {
         mPipe = pipe;
@@ -125,6 +141,11 @@ public:
     {
         return (mPipe == 0);
     }
+    bool IsFormatSupported(uint32_t format) const;
+    DrmObjectState &GetCommittedState()
+    {
+        return mCommittedState;
+    }
     uint32_t GetCrtcId()
     {
         return mCrtcId;
@@ -145,6 +166,7 @@ private:
     uint32_t mPropFbId = 0;
     uint32_t mPropFenceInId = 0;
     uint32_t mPropCrtcId = 0;
+    uint32_t mPropFbDamageClipsId = DRM_INVALID_ID;
     std::string mName;
 
     uint32_t mPropCrtc_xId = 0;
@@ -160,7 +182,10 @@ private:
 
     uint32_t mPipe = 0;
     uint32_t mType = 0;
+    bool mHasZpos = false;
+    uint64_t mZpos = 0;
     std::vector<uint32_t> mFormats;
+    DrmObjectState mCommittedState;
 };
 } // namespace OHOS
 } // namespace HDI
@@ -14,13 +14,36 @@
  */
 
 #include "drm_vsync_worker.h"
-#include <chrono>
+#include <cerrno>
+#include <ctime>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <xf86drm.h>
 #include "display_log.h"
 #include "drm_device.h"
 
 namespace OHOS {
 namespace HDI {
 namespace DISPLAY {
+namespace {
+constexpr uint64_t NSEC_PER_SEC = 1000000000;
+constexpr uint64_t NSEC_PER_USEC = 1000;
+constexpr int EVENT_CONTEXT_VERSION = 3; // the first version with page_flip_handler2
+
+uint64_t GetMonotonicNs()
+{
+    struct timespec ts = {0, 0};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * NSEC_PER_SEC + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+uint64_t ToNs(uint64_t sec, uint64_t usec)
+{
+    return sec * NSEC_PER_SEC + usec * NSEC_PER_USEC;
+}
+} // namespace
+
 DrmVsyncWorker::DrmVsyncWorker() {}
 
 int32_t DrmVsyncWorker::Init(int fd)
@@ -28,9 +51,11 @@ int32_t DrmVsyncWorker::Init(int fd)
     DISPLAY_CHK_RETURN((fd < 0), DISPLAY_FAILURE, DISPLAY_LOGE("the fd is invalid"));
     mDrmFd = fd;
     DISPLAY_LOGD("the drm fd is %{public}d", fd);
+    mWakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    DISPLAY_CHK_RETURN((mWakeFd < 0), DISPLAY_FAILURE, DISPLAY_LOGE("can not create eventfd errno %{public}d", errno));
+    mRunning = true;
     mThread = std::make_unique<std::thread>([this]() { WorkThread(); });
     DISPLAY_CHK_RETURN((mThread == nullptr), DISPLAY_FAILURE, DISPLAY_LOGE("can not create thread"));
-    mRunning = true;
     return DISPLAY_SUCCESS;
 }
 
@@ -54,54 +79,238 @@ DrmVsyncWorker::~DrmVsyncWorker()
         std::lock_guard<std::mutex> lg(mMutex);
         mRunning = false;
     }
-    DISPLAY_LOGD();
-    mCondition.notify_one();
+    Wakeup();
     if (mThread != nullptr) {
         mThread->join();
     }
+    if (mWakeFd >= 0) {
+        close(mWakeFd);
+    }
     DISPLAY_LOGD();
 }
 
-bool DrmVsyncWorker::WaitSignalAndCheckRuning()
+void DrmVsyncWorker::Wakeup()
+{
+    uint64_t one = 1;
+    if ((mWakeFd >= 0) && (write(mWakeFd, &one, sizeof(one)) != sizeof(one))) {
+        DISPLAY_LOGE("can not wake the vsync thread errno %{public}d", errno);
+    }
+}
+
+uint32_t DrmVsyncWorker::PipeToVBlankType(uint32_t pipe)
+{
+    if (pipe == 1) {
+        return DRM_VBLANK_SECONDARY;
+    }
+    if (pipe > 1) {
+        return (pipe << DRM_VBLANK_HIGH_CRTC_SHIFT) & DRM_VBLANK_HIGH_CRTC_MASK;
+    }
+    return 0;
+}
+
+// the first vblank after now that is in phase with the last known one
+uint64_t DrmVsyncWorker::NextDeadline(const VsyncPipe &vsyncPipe, uint64_t now)
 {
-    std::unique_lock<std::mutex> ul(mMutex);
-    mCondition.wait(ul, [this]() { return (mEnable || !mRunning); });
-    return mRunning;
+    uint64_t anchor = (vsyncPipe.anchor != 0) ? vsyncPipe.anchor : now;
+    if (anchor > now) {
+        return anchor;
+    }
+    return anchor + ((now - anchor) / vsyncPipe.period + 1) * vsyncPipe.period;
 }
 
+void DrmVsyncWorker::FallbackToTimer(uint32_t pipe, VsyncPipe &vsyncPipe, uint64_t now)
+{
+    DISPLAY_LOGI("pipe %{public}u has no vblank events errno %{public}d, use the timer", pipe, errno);
+    vsyncPipe.hardware = false;
+    vsyncPipe.pending = false;
+    vsyncPipe.deadline = NextDeadline(vsyncPipe, now);
+}
+
+// queue the vblank events, collect the due timer vblanks and return how long the thread may sleep
+int64_t DrmVsyncWorker::PrepareWait(uint64_t now)
+{
+    int64_t timeout = -1;
+    for (auto &pipePair : mPipes) {
+        VsyncPipe &vsyncPipe = pipePair.second;
+        if (!vsyncPipe.enable) {
+            continue;
+        }
+        if (vsyncPipe.hardware && !vsyncPipe.pending) {
+            drmVBlank vbl = {};
+            vbl.request.type = static_cast<drmVBlankSeqType>(DRM_VBLANK_RELATIVE | DRM_VBLANK_EVENT |
+                PipeToVBlankType(pipePair.first));
+            vbl.request.sequence = 1;
+            vbl.request.signal = pipePair.first;
+            if (drmWaitVBlank(mDrmFd, &vbl) == 0) {
+                vsyncPipe.pending = true;
+            } else {
+                FallbackToTimer(pipePair.first, vsyncPipe, now);
+            }
+        }
+        if (vsyncPipe.hardware) {
+            continue;
+        }
+        if (vsyncPipe.deadline <= now) {
+            // report the latest vblank that has passed, counting the ones slept through
+            uint64_t missed = (now - vsyncPipe.deadline) / vsyncPipe.period;
+            uint64_t ns = vsyncPipe.deadline + missed * vsyncPipe.period;
+            vsyncPipe.sequence += static_cast<unsigned int>(missed + 1);
+            vsyncPipe.anchor = ns;
+            vsyncPipe.deadline = ns + vsyncPipe.period;
+            if (vsyncPipe.callBack != nullptr) {
+                mEvents.push_back({vsyncPipe.callBack, vsyncPipe.sequence, ns});
+            }
+        }
+        int64_t wait = static_cast<int64_t>(vsyncPipe.deadline - now);
+        timeout = ((timeout < 0) || (wait < timeout)) ? wait : timeout;
+    }
+    return timeout;
+}
 
-uint64_t DrmVsyncWorker::WaitNextVBlank(unsigned int &sq)
+void DrmVsyncWorker::VBlankHandler(int fd, unsigned int sequence, unsigned int sec, unsigned int usec, void *data)
 {
-    struct timespec curTime = {0, 0};
-    clock_gettime(CLOCK_MONOTONIC, &curTime);
-    usleep(16666);
-    // 1000000000 is used for transfer second to nsec
-    uint64_t duration = static_cast<uint64_t>(curTime.tv_sec) * 1000000 + static_cast<uint64_t>(curTime.tv_nsec);
-    return (uint64_t)(duration);
+    (void)fd;
+    uint32_t pipe = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(data));
+    GetInstance().OnVBlank(pipe, sequence, ToNs(sec, usec));
 }
 
+void DrmVsyncWorker::PageFlipHandler(int fd, unsigned int sequence, unsigned int sec, unsigned int usec,
+    unsigned int crtcId, void *data)
+{
+    (void)fd;
+    (void)sequence;
+    (void)data;
+    GetInstance().OnPageFlip(crtcId, ToNs(sec, usec));
+}
 
-void DrmVsyncWorker::EnableVsync(bool enable)
+void DrmVsyncWorker::OnVBlank(uint32_t pipe, unsigned int sequence, uint64_t ns)
 {
-    DISPLAY_LOGD();
+    std::lock_guard<std::mutex> lg(mMutex);
+    auto iter = mPipes.find(pipe);
+    DISPLAY_CHK_RETURN_NOT_VALUE((iter == mPipes.end()), DISPLAY_LOGE("vblank of unknown pipe %{public}u", pipe));
+    VsyncPipe &vsyncPipe = iter->second;
+    vsyncPipe.pending = false;
+    vsyncPipe.anchor = ns;
+    vsyncPipe.sequence = sequence;
+    if (vsyncPipe.enable && (vsyncPipe.callBack != nullptr)) {
+        mEvents.push_back({vsyncPipe.callBack, sequence, ns});
+    }
+}
+
+void DrmVsyncWorker::OnPageFlip(uint32_t crtcId, uint64_t ns)
+{
+    std::lock_guard<std::mutex> lg(mMutex);
+    for (auto &pipePair : mPipes) {
+        VsyncPipe &vsyncPipe = pipePair.second;
+        if ((vsyncPipe.crtcId != crtcId) || vsyncPipe.hardware || (ns == 0)) {
+            continue;
+        }
+        // a flip completes on a real vblank, keep the timer in phase with it
+        vsyncPipe.anchor = ns;
+        vsyncPipe.deadline = NextDeadline(vsyncPipe, GetMonotonicNs());
+    }
+}
+
+int32_t DrmVsyncWorker::WaitNextVBlank(uint32_t pipe, uint64_t &ns)
+{
+    bool hardware;
+    {
+        std::lock_guard<std::mutex> lg(mMutex);
+        hardware = mPipes[pipe].hardware;
+    }
+    if (hardware) {
+        drmVBlank vbl = {};
+        vbl.request.type = static_cast<drmVBlankSeqType>(DRM_VBLANK_RELATIVE | PipeToVBlankType(pipe));
+        vbl.request.sequence = 1;
+        if (drmWaitVBlank(mDrmFd, &vbl) == 0) {
+            ns = ToNs(vbl.reply.tval_sec, vbl.reply.tval_usec);
+            return DISPLAY_SUCCESS;
+        }
+        std::lock_guard<std::mutex> lg(mMutex);
+        FallbackToTimer(pipe, mPipes[pipe], GetMonotonicNs());
+    }
+
+    uint64_t next;
+    {
+        std::lock_guard<std::mutex> lg(mMutex);
+        next = NextDeadline(mPipes[pipe], GetMonotonicNs());
+    }
+    struct timespec ts = {static_cast<time_t>(next / NSEC_PER_SEC), static_cast<long>(next % NSEC_PER_SEC)};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+    }
+    ns = next;
+    return DISPLAY_SUCCESS;
+}
+
+void DrmVsyncWorker::EnableVsync(uint32_t pipe, bool enable)
+{
+    DISPLAY_LOGD("pipe %{public}u enable %{public}d", pipe, enable);
+    {
+        std::lock_guard<std::mutex> lg(mMutex);
+        VsyncPipe &vsyncPipe = mPipes[pipe];
+        vsyncPipe.enable = enable;
+        if (enable && !vsyncPipe.hardware) {
+            vsyncPipe.deadline = NextDeadline(vsyncPipe, GetMonotonicNs());
+        }
+    }
+    Wakeup();
+}
+
+void DrmVsyncWorker::UpdatePipe(uint32_t pipe, uint32_t crtcId, uint64_t period)
+{
+    DISPLAY_LOGD("pipe %{public}u crtc %{public}u period %{public}" PRIu64 "", pipe, crtcId, period);
     {
         std::lock_guard<std::mutex> lg(mMutex);
-        mEnable = enable;
+        VsyncPipe &vsyncPipe = mPipes[pipe];
+        vsyncPipe.crtcId = crtcId;
+        vsyncPipe.period = (period != 0) ? period : DEFAULT_VSYNC_PERIOD;
+        if (!vsyncPipe.hardware) {
+            vsyncPipe.deadline = NextDeadline(vsyncPipe, GetMonotonicNs());
+        }
     }
-    mCondition.notify_one();
+    Wakeup();
 }
 
 void DrmVsyncWorker::WorkThread()
 {
     DISPLAY_LOGD();
-    unsigned int seq = 0;
-    while (WaitSignalAndCheckRuning()) {
-        // wait the vblank
-        uint64_t time = WaitNextVBlank(seq);
-        if (mCallBack != nullptr) {
-            mCallBack->Vsync(seq, time);
-        } else {
-            DISPLAY_LOGE("the callbac is nullptr");
+    drmEventContext context = {};
+    context.version = EVENT_CONTEXT_VERSION;
+    context.vblank_handler = VBlankHandler;
+    context.page_flip_handler2 = PageFlipHandler;
+    std::vector<VsyncEvent> events;
+    while (true) {
+        int64_t timeout;
+        {
+            std::lock_guard<std::mutex> lg(mMutex);
+            if (!mRunning) {
+                break;
+            }
+            timeout = PrepareWait(GetMonotonicNs());
+            events.swap(mEvents);
+        }
+        for (auto &event : events) {
+            event.callBack->Vsync(event.sequence, event.ns);
+        }
+        if (!events.empty()) {
+            events.clear();
+            continue;
+        }
+
+        struct pollfd fds[] = {{mDrmFd, POLLIN, 0}, {mWakeFd, POLLIN, 0}};
+        struct timespec ts = {static_cast<time_t>(timeout / static_cast<int64_t>(NSEC_PER_SEC)),
+            static_cast<long>(timeout % static_cast<int64_t>(NSEC_PER_SEC))};
+        int ret = ppoll(fds, sizeof(fds) / sizeof(fds[0]), (timeout < 0) ? nullptr : &ts, nullptr);
+        if (ret < 0) {
+            DISPLAY_CHK_RETURN_NOT_VALUE((errno != EINTR), DISPLAY_LOGE("poll failed errno %{public}d", errno));
+            continue;
+        }
+        if (fds[1].revents & POLLIN) {
+            uint64_t count;
+            (void)read(mWakeFd, &count, sizeof(count));
+        }
+        if (fds[0].revents & POLLIN) {
+            drmHandleEvent(mDrmFd, &context);
         }
     }
 }
@@ -110,7 +319,8 @@ void DrmVsyncWorker::ReqesterVBlankCb(std::shared_ptr<VsyncCallBack> &cb)
 {
     DISPLAY_LOGD();
     DISPLAY_CHK_RETURN_NOT_VALUE((cb == nullptr), DISPLAY_LOGE("the VBlankCallback is nullptr "));
-    mCallBack = cb;
+    std::lock_guard<std::mutex> lg(mMutex);
+    mPipes[cb->GetPipe()].callBack = cb;
 }
 } // namespace OHOS
 } // namespace HDI
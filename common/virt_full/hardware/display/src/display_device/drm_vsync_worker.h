@@ -15,15 +15,24 @@
 
 #ifndef DRM_VSYNC_WORKER_H
 #define DRM_VSYNC_WORKER_H
+#include <atomic>
 #include <memory>
 #include <mutex>
 #include <thread>
-#include <condition_variable>
+#include <unordered_map>
+#include <vector>
 #include "hdi_device_common.h"
 
 namespace OHOS {
 namespace HDI {
 namespace DISPLAY {
+const uint64_t DEFAULT_VSYNC_PERIOD = 16666667; // ns, 60Hz
+
+/*
+ * Drives the vblank callbacks of every display from the events of the drm fd. Pipes whose driver
+ * can not deliver vblank events are paced by a timer running at the refresh period of the mode,
+ * re-anchored on each page flip.
+ */
 class DrmVsyncWorker {
 public:
     DrmVsyncWorker();
@@ -31,20 +40,51 @@ public:
     int32_t Init(int fd);
     static DrmVsyncWorker &GetInstance();
 
-    void EnableVsync(bool enable);
+    void EnableVsync(uint32_t pipe, bool enable);
     void WorkThread();
-    uint64_t WaitNextVBlank(unsigned int &sq);
-    bool WaitSignalAndCheckRuning();
+    // blocks until the next vblank of the pipe, ns is its CLOCK_MONOTONIC timestamp
+    int32_t WaitNextVBlank(uint32_t pipe, uint64_t &ns);
     void ReqesterVBlankCb(std::shared_ptr<VsyncCallBack> &cb);
+    void UpdatePipe(uint32_t pipe, uint32_t crtcId, uint64_t period);
+    bool IsRunning() const
+    {
+        return mRunning;
+    }
 
 private:
-    int mDrmFd = 0;
+    struct VsyncPipe {
+        std::shared_ptr<VsyncCallBack> callBack;
+        uint32_t crtcId = 0;
+        bool enable = false;
+        bool hardware = true; // the driver delivers vblank events
+        bool pending = false; // a vblank event is queued
+        uint64_t period = DEFAULT_VSYNC_PERIOD;
+        uint64_t anchor = 0; // timestamp of the last known vblank
+        uint64_t deadline = 0; // next software vblank
+        unsigned int sequence = 0;
+    };
+    struct VsyncEvent {
+        std::shared_ptr<VsyncCallBack> callBack;
+        unsigned int sequence;
+        uint64_t ns;
+    };
+    static void VBlankHandler(int fd, unsigned int sequence, unsigned int sec, unsigned int usec, void *data);
+    static void PageFlipHandler(int fd, unsigned int sequence, unsigned int sec, unsigned int usec,
+        unsigned int crtcId, void *data);
+    static uint32_t PipeToVBlankType(uint32_t pipe);
+    static uint64_t NextDeadline(const VsyncPipe &vsyncPipe, uint64_t now);
+    void FallbackToTimer(uint32_t pipe, VsyncPipe &vsyncPipe, uint64_t now);
+    void OnVBlank(uint32_t pipe, unsigned int sequence, uint64_t ns);
+    void OnPageFlip(uint32_t crtcId, uint64_t ns);
+    int64_t PrepareWait(uint64_t now);
+    void Wakeup();
+    int mDrmFd = -1;
+    int mWakeFd = -1;
     std::unique_ptr<std::thread> mThread;
-    bool mEnable = false;
     std::mutex mMutex;
-    std::condition_variable mCondition;
-    std::shared_ptr<VsyncCallBack> mCallBack;
-    bool mRunning = false;
+    std::unordered_map<uint32_t, VsyncPipe> mPipes;
+    std::vector<VsyncEvent> mEvents;
+    std::atomic<bool> mRunning { false };
 };
 } // namespace OHOS
 } // namespace HDI
@@ -24,15 +24,22 @@ HdiComposer::HdiComposer(std::unique_ptr<HdiComposition> pre, std::unique_ptr<Hd
     mPostComp = std::move(post);
 }
 
-int32_t HdiComposer::Prepare(std::vector<HdiLayer *> &layers, HdiLayer &clientLayer)
+int32_t HdiComposer::Prepare(const std::vector<HdiLayer *> &layers, HdiLayer &clientLayer)
 {
-    int ret = mPreComp->SetLayers(layers, clientLayer);
-    DISPLAY_CHK_RETURN((ret != DISPLAY_SUCCESS), DISPLAY_FAILURE, DISPLAY_LOGE("pre composition prepare failed"));
-    ret = mPostComp->SetLayers(layers, clientLayer);
+    // the post composition claims the layers it can present directly, the pre composition takes the rest
+    int ret = mPostComp->SetLayers(layers, clientLayer);
     DISPLAY_CHK_RETURN((ret != DISPLAY_SUCCESS), DISPLAY_FAILURE, DISPLAY_LOGE("post composition prepare failed"));
+    ret = mPreComp->SetLayers(layers, clientLayer);
+    DISPLAY_CHK_RETURN((ret != DISPLAY_SUCCESS), DISPLAY_FAILURE, DISPLAY_LOGE("pre composition prepare failed"));
     return DISPLAY_SUCCESS;
 }
 
+void HdiComposer::SetDamage(const std::vector<IRect> &damage)
+{
+    mPreComp->SetDamage(damage);
+    mPostComp->SetDamage(damage);
+}
+
 int32_t HdiComposer::Commit(bool modeSet)
 {
     int ret = mPreComp->Apply(modeSet);
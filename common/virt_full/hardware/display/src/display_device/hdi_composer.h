@@ -29,7 +29,7 @@ public:
     {
         return DISPLAY_SUCCESS;
     };
-    virtual int32_t SetLayers(std::vector<HdiLayer *> &layers, HdiLayer &clientLayer)
+    virtual int32_t SetLayers(const std::vector<HdiLayer *> &layers, HdiLayer &clientLayer)
     {
         return DISPLAY_SUCCESS;
     }
@@ -37,18 +37,25 @@ public:
     {
         return DISPLAY_SUCCESS;
     }
+    // the display area changed by the layers since the last commit, the client damage is kept on the client layer
+    void SetDamage(const std::vector<IRect> &damage)
+    {
+        mDamage = damage;
+    }
     virtual ~HdiComposition() {}
 
 protected:
     std::vector<HdiLayer *> mCompLayers;
+    std::vector<IRect> mDamage;
 };
 
 class HdiComposer {
 public:
     HdiComposer(std::unique_ptr<HdiComposition> pre, std::unique_ptr<HdiComposition> post);
     virtual ~HdiComposer() {};
-    int32_t Prepare(std::vector<HdiLayer *> &layers, HdiLayer &clientLayer);
+    int32_t Prepare(const std::vector<HdiLayer *> &layers, HdiLayer &clientLayer);
     int32_t Commit(bool modeSet);
+    void SetDamage(const std::vector<IRect> &damage);
     HdiComposition *GetPreCompostion()
     {
         return mPreComp.get();
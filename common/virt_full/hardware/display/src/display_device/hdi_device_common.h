@@ -24,7 +24,29 @@ namespace HDI {
 namespace DISPLAY {
 const int32_t INVALID_MODE_ID = -1;
 const uint32_t DRM_INVALID_ID = 0xFFFFFFFF;
+const uint32_t MAX_VIRTUAL_DISPLAY_COUNT = 4;
 template<typename T> using IdMapPtr = std::unordered_map<uint32_t, std::shared_ptr<T>>;
+
+// the property values last committed to a drm object, so unchanged ones can be left out of the next commit
+class DrmObjectState {
+public:
+    bool IsCommitted(uint32_t propId, uint64_t value) const
+    {
+        auto iter = mProps.find(propId);
+        return (iter != mProps.end()) && (iter->second == value);
+    }
+    void Update(uint32_t propId, uint64_t value)
+    {
+        mProps[propId] = value;
+    }
+    void Invalidate()
+    {
+        mProps.clear();
+    }
+
+private:
+    std::unordered_map<uint32_t, uint64_t> mProps;
+};
 class DrmEncoder;
 class DrmCrtc;
 class DrmPlane;
@@ -14,6 +14,7 @@
  */
 
 #include "hdi_display.h"
+#include <algorithm>
 #include <vector>
 #include "display_log.h"
 
@@ -22,9 +23,11 @@ namespace HDI {
 namespace DISPLAY {
 uint32_t HdiDisplay::mIdleId = 0;
 std::unordered_set<uint32_t> HdiDisplay::mIdSets;
+std::mutex HdiDisplay::mIdMutex;
 
 uint32_t HdiDisplay::GetIdleId()
 {
+    std::lock_guard<std::mutex> lock(mIdMutex);
     const uint32_t oldIdleId = mIdleId;
     uint32_t id = INVALIDE_DISPLAY_ID;
     // ensure the mIdleId not INVALIDE_DISPLAY_ID
@@ -59,6 +62,7 @@ int32_t HdiDisplay::Init()
 
 HdiDisplay::~HdiDisplay()
 {
+    std::lock_guard<std::mutex> lock(mIdMutex);
     mIdSets.erase(mId);
 }
 
@@ -68,24 +72,31 @@ int32_t HdiDisplay::SetLayerZorder(uint32_t layerId, uint32_t zorder)
     auto iter = mLayersMap.find(layerId);
     DISPLAY_CHK_RETURN((iter == mLayersMap.end()), DISPLAY_FAILURE,
         DISPLAY_LOGE("can not find the layer %{public}d", layerId));
-    auto layer = mLayersMap[layerId].get();
+    HdiLayer *layer = iter->second.get();
     if (layer->GetZorder() == zorder) {
         DISPLAY_LOGD("zorder no change layerId %{public}d, zorder %{public}d", layerId, zorder);
         return DISPLAY_SUCCESS;
     }
-    // reset to sort
-    auto zRange = mLayers.equal_range(layer);
-    for (auto c = zRange.first; c != zRange.second; c++) {
-        if (*c == layer) {
-            mLayers.erase(c);
-            break;
-        }
-    }
+    RemoveLayer(layer);
     layer->SetLayerZorder(zorder);
-    mLayers.emplace(layer);
+    InsertLayer(layer);
     return DISPLAY_SUCCESS;
 }
 
+// after the layers of the same zorder, as a multiset would
+void HdiDisplay::InsertLayer(HdiLayer *layer)
+{
+    mLayers.insert(std::upper_bound(mLayers.begin(), mLayers.end(), layer, SortLayersByZ()), layer);
+}
+
+void HdiDisplay::RemoveLayer(HdiLayer *layer)
+{
+    auto iter = std::find(mLayers.begin(), mLayers.end(), layer);
+    if (iter != mLayers.end()) {
+        mLayers.erase(iter);
+    }
+}
+
 int32_t HdiDisplay::CreateLayer(const LayerInfo *layerInfo, uint32_t *layerId)
 {
     DISPLAY_LOGD();
@@ -97,7 +108,7 @@ int32_t HdiDisplay::CreateLayer(const LayerInfo *layerInfo, uint32_t *layerId)
     ret = layer->Init();
     DISPLAY_CHK_RETURN((ret != DISPLAY_SUCCESS), DISPLAY_FAILURE, DISPLAY_LOGE("Layer Init failed"));
     *layerId = layer->GetId();
-    mLayers.insert(layer.get());
+    InsertLayer(layer.get());
     mLayersMap.emplace(layer->GetId(), std::move(layer));
     DISPLAY_LOGD("mLayers size %{public}zu", mLayers.size());
     DISPLAY_LOGD("mLayerMap size %{public}zu", mLayersMap.size());
@@ -117,8 +128,10 @@ int32_t HdiDisplay::DestroyLayer(uint32_t layerId)
     auto iter = mLayersMap.find(layerId);
     DISPLAY_CHK_RETURN((iter == mLayersMap.end()), DISPLAY_FAILURE,
         DISPLAY_LOGE("can not find the layer id %{public}d", layerId));
-    mLayers.erase(iter->second.get());
-    mLayersMap.erase(layerId);
+    // what the layer covered has to be composed again
+    iter->second->GetCoveredRegion(mRemovedRegion);
+    RemoveLayer(iter->second.get());
+    mLayersMap.erase(iter);
     return DISPLAY_SUCCESS;
 }
 
@@ -168,19 +181,15 @@ int32_t HdiDisplay::PrepareDisplayLayers(bool *needFlushFb)
 {
     DISPLAY_LOGD();
     mChangeLayers.clear();
-    std::vector<HdiLayer *> layers;
-    for (auto c : mLayers) {
-        layers.push_back(c);
-    }
-    DISPLAY_LOGD(" mLayers  size %{public}zu layers size %{public}zu", mLayers.size(), layers.size());
+    DISPLAY_LOGD(" mLayers  size %{public}zu", mLayers.size());
 
     /* Set the target layer to the top.
      *  It would not by cover by other layer.
      */
 
-    mComposer->Prepare(layers, *mClientLayer);
+    mComposer->Prepare(mLayers, *mClientLayer);
     // get the change layers
-    for (auto &layer : layers) {
+    for (auto &layer : mLayers) {
         if (layer->GetDeviceSelect() != layer->GetCompositionType()) {
             DISPLAY_LOGD("layer change");
             layer->SetLayerCompositionType(layer->GetDeviceSelect());
@@ -194,7 +203,20 @@ int32_t HdiDisplay::PrepareDisplayLayers(bool *needFlushFb)
 int32_t HdiDisplay::Commit(int32_t *fence)
 {
     DISPLAY_LOGD();
+    mFrameDamage.assign(mRemovedRegion.begin(), mRemovedRegion.end());
+    for (auto layer : mLayers) {
+        // a layer scanned out on its own plane only matters to the client buffer when it moves in or out
+        if (!layer->IsDirectPresent() || layer->IsGeometryChanged()) {
+            layer->GetDisplayDamage(mFrameDamage);
+        }
+    }
+    mComposer->SetDamage(mFrameDamage);
     mComposer->Commit(false);
+    for (auto layer : mLayers) {
+        layer->ResetDamage();
+    }
+    mClientLayer->ResetDamage();
+    mRemovedRegion.clear();
     *fence = dup(mClientLayer->GetReleaseFenceFd());
     DISPLAY_LOGD("the release fence is %{public}d", *fence);
     return DISPLAY_SUCCESS;
@@ -210,6 +232,17 @@ int32_t HdiDisplay::SetDisplayClientBuffer(const BufferHandle *buffer, int32_t f
     return DISPLAY_SUCCESS;
 }
 
+int32_t HdiDisplay::SetDisplayClientCrop(IRect *rect)
+{
+    DISPLAY_CHK_RETURN((rect == nullptr), DISPLAY_NULL_PTR, DISPLAY_LOGE("rect is nullptr"));
+    return mClientLayer->SetLayerCrop(rect);
+}
+
+int32_t HdiDisplay::SetDisplayClientDamage(uint32_t num, IRect *rects)
+{
+    return mClientLayer->SetLayerDirtyRegion(num, rects);
+}
+
 HdiLayer *HdiDisplay::GetHdiLayer(uint32_t id)
 {
     DISPLAY_LOGD("id : %{public}d", id);
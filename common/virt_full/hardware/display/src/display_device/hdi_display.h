@@ -15,7 +15,8 @@
 
 #ifndef HDI_DISPLAY_H
 #define HDI_DISPLAY_H
-#include <set>
+#include <mutex>
+#include <shared_mutex>
 #include <unordered_map>
 #include <unordered_set>
 #include <memory.h>
@@ -107,11 +108,26 @@ public:
     }
     virtual int32_t GetDisplayReleaseFence(uint32_t *num, uint32_t *layers, int32_t *fences);
     virtual int32_t SetDisplayClientBuffer(const BufferHandle *buffer, int32_t fence);
+    virtual int32_t SetDisplayClientCrop(IRect *rect);
+    virtual int32_t SetDisplayClientDamage(uint32_t num, IRect *rects);
     virtual int32_t WaitForVBlank(uint64_t *ns)
     {
         return DISPLAY_NOT_SUPPORT;
     }
+    virtual int32_t SetVirtualDisplayBuffer(const BufferHandle *buffer, int32_t fence)
+    {
+        return DISPLAY_NOT_SUPPORT;
+    }
+    virtual bool IsVirtual() const
+    {
+        return false;
+    }
     HdiLayer *GetHdiLayer(uint32_t id);
+    // exclusive for the calls changing the display or its layers, shared for the queries
+    std::shared_mutex &GetMutex()
+    {
+        return mMutex;
+    }
 
 protected:
     virtual std::unique_ptr<HdiLayer> CreateHdiLayer(LayerType type);
@@ -120,11 +136,22 @@ protected:
     static uint32_t GetIdleId();
     static uint32_t mIdleId;
     static std::unordered_set<uint32_t> mIdSets;
+    static std::mutex mIdMutex;
     uint32_t mId = INVALIDE_DISPLAY_ID;
     std::unordered_map<uint32_t, std::unique_ptr<HdiLayer>> mLayersMap;
-    std::multiset<HdiLayer *, SortLayersByZ> mLayers;
+    // sorted by zorder, the layers of one zorder in the order they got it, handed to the composer as it is
+    std::vector<HdiLayer *> mLayers;
     std::unique_ptr<HdiLayer> mClientLayer;
     std::vector<HdiLayer *> mChangeLayers;
+    // the areas uncovered by destroyed layers
+    std::vector<IRect> mRemovedRegion;
+    // the damage of the frame being committed, kept to reuse its memory
+    std::vector<IRect> mFrameDamage;
+
+private:
+    void InsertLayer(HdiLayer *layer);
+    void RemoveLayer(HdiLayer *layer);
+    std::shared_mutex mMutex;
 };
 } // namespace OHOS
 } // namespace HDI
@@ -14,12 +14,57 @@
  */
 
 #include "hdi_drm_composition.h"
+#include <algorithm>
 #include <cerrno>
+#include "drm_vsync_worker.h"
 #include "hdi_drm_layer.h"
 
 namespace OHOS {
 namespace HDI {
 namespace DISPLAY {
+namespace {
+constexpr int32_t MAX_PLANE_SCALE = 4; // up or down, per axis
+constexpr uint64_t DEFAULT_CURSOR_SIZE = 64;
+
+bool IsAlphaFormat(int32_t format)
+{
+    switch (format) {
+        case PIXEL_FMT_RGBA_8888:
+        case PIXEL_FMT_BGRA_8888:
+        case PIXEL_FMT_RGBA_4444:
+        case PIXEL_FMT_BGRA_4444:
+        case PIXEL_FMT_RGBA_5551:
+        case PIXEL_FMT_BGRA_5551:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool IsScaleInRange(int32_t src, int32_t dst)
+{
+    return (dst * MAX_PLANE_SCALE >= src) && (dst <= src * MAX_PLANE_SCALE);
+}
+
+// an unset crop means the whole buffer
+IRect GetSourceRect(HdiLayer &layer, const HdiLayerBuffer &buffer)
+{
+    IRect crop = layer.GetLayerCrop();
+    if ((crop.w <= 0) || (crop.h <= 0)) {
+        crop = {0, 0, buffer.GetWight(), buffer.GetHeight()};
+    }
+    return crop;
+}
+
+void SortByZpos(std::vector<std::shared_ptr<DrmPlane>> &planes)
+{
+    std::stable_sort(planes.begin(), planes.end(),
+        [](const std::shared_ptr<DrmPlane> &a, const std::shared_ptr<DrmPlane> &b) {
+            return a->GetZpos() < b->GetZpos();
+        });
+}
+} // namespace
+
 HdiDrmComposition::HdiDrmComposition(const std::shared_ptr<DrmConnector> &connector,
                                      const std::shared_ptr<DrmCrtc> &crtc,
                                      const std::shared_ptr<DrmDevice> &drmDevice)
@@ -33,99 +78,243 @@ int32_t HdiDrmComposition::Init()
     DISPLAY_LOGD();
     mPrimPlanes.clear();
     mOverlayPlanes.clear();
+    mCursorPlanes.clear();
     mPlanes.clear();
     DISPLAY_CHK_RETURN((mCrtc == nullptr), DISPLAY_FAILURE, DISPLAY_LOGE("crtc is null"));
     DISPLAY_CHK_RETURN((mConnector == nullptr), DISPLAY_FAILURE, DISPLAY_LOGE("connector is null"));
     DISPLAY_CHK_RETURN((mDrmDevice == nullptr), DISPLAY_FAILURE, DISPLAY_LOGE("drmDevice is null"));
     mPrimPlanes = mDrmDevice->GetDrmPlane(mCrtc->GetPipe(), DRM_PLANE_TYPE_PRIMARY);
     mOverlayPlanes = mDrmDevice->GetDrmPlane(mCrtc->GetPipe(), DRM_PLANE_TYPE_OVERLAY);
+    mCursorPlanes = mDrmDevice->GetDrmPlane(mCrtc->GetPipe(), DRM_PLANE_TYPE_CURSOR);
     mPlanes.insert(mPlanes.end(), mPrimPlanes.begin(), mPrimPlanes.end());
     mPlanes.insert(mPlanes.end(), mOverlayPlanes.begin(), mOverlayPlanes.end());
+    mPlanes.insert(mPlanes.end(), mCursorPlanes.begin(), mCursorPlanes.end());
+    mZposKnown = std::all_of(mPlanes.begin(), mPlanes.end(),
+        [](const std::shared_ptr<DrmPlane> &drmPlane) { return drmPlane->HasZpos(); });
+    if (mZposKnown) {
+        SortByZpos(mPrimPlanes);
+        SortByZpos(mOverlayPlanes);
+        SortByZpos(mCursorPlanes);
+        SortByZpos(mPlanes);
+    }
+    if (drmGetCap(mDrmDevice->GetDrmFd(), DRM_CAP_CURSOR_WIDTH, &mCursorWidth) != 0) {
+        mCursorWidth = DEFAULT_CURSOR_SIZE;
+    }
+    if (drmGetCap(mDrmDevice->GetDrmFd(), DRM_CAP_CURSOR_HEIGHT, &mCursorHeight) != 0) {
+        mCursorHeight = DEFAULT_CURSOR_SIZE;
+    }
+    DISPLAY_LOGD("primary %{public}zd overlay %{public}zd cursor %{public}zd zpos %{public}d", mPrimPlanes.size(),
+        mOverlayPlanes.size(), mCursorPlanes.size(), mZposKnown);
     return DISPLAY_SUCCESS;
 }
 
-int32_t HdiDrmComposition::SetLayers(std::vector<HdiLayer *> &layers, HdiLayer &clientLayer)
+bool HdiDrmComposition::CanPresentDirect(HdiLayer &layer, DrmPlane &drmPlane)
+{
+    CompositionType type = layer.GetCompositionType();
+    if ((type != COMPOSITION_DEVICE) && (type != COMPOSITION_VIDEO) && (type != COMPOSITION_CURSOR)) {
+        return false;
+    }
+    HdiLayerBuffer *buffer = layer.GetCurrentBuffer();
+    if (buffer == nullptr) {
+        return false;
+    }
+    // planes can not rotate or flip
+    TransformType transform = layer.GetTransFormType();
+    if ((transform != ROTATE_NONE) && (transform != ROTATE_BUTT)) {
+        return false;
+    }
+    // planes are scanned out opaque, so the layer must not need blending
+    const LayerAlpha &alpha = layer.GetAlpha();
+    if (alpha.enGlobalAlpha && (alpha.gAlpha != 0xff)) {
+        return false;
+    }
+    BlendType blend = layer.GetLayerBlenType();
+    if (IsAlphaFormat(buffer->GetFormat()) && (blend != BLEND_NONE) && (blend != BLEND_SRC)) {
+        return false;
+    }
+    uint32_t drmFormat = DrmDevice::ConvertToDrmFormat(static_cast<PixelFormat>(buffer->GetFormat()));
+    if ((drmFormat == DRM_FORMAT_INVALID) || !drmPlane.IsFormatSupported(drmFormat)) {
+        return false;
+    }
+
+    IRect src = GetSourceRect(layer, *buffer);
+    const IRect &dst = layer.GetLayerDisplayRect();
+    if ((src.x < 0) || (src.y < 0) || (src.x + src.w > buffer->GetWight()) || (src.y + src.h > buffer->GetHeight()) ||
+        (dst.w <= 0) || (dst.h <= 0)) {
+        return false;
+    }
+    if (drmPlane.GetType() == DRM_PLANE_TYPE_CURSOR) {
+        return (src.w == dst.w) && (src.h == dst.h) && (static_cast<uint64_t>(dst.w) <= mCursorWidth) &&
+            (static_cast<uint64_t>(dst.h) <= mCursorHeight);
+    }
+    return IsScaleInRange(src.w, dst.w) && IsScaleInRange(src.h, dst.h);
+}
+
+bool HdiDrmComposition::IsStackedInRange(const DrmPlane &drmPlane) const
+{
+    if (!mZposKnown) {
+        return drmPlane.GetType() == DRM_PLANE_TYPE_CURSOR;
+    }
+    return (drmPlane.GetZpos() > mZposFloor) && (drmPlane.GetZpos() < mZposCeiling);
+}
+
+std::shared_ptr<DrmPlane> HdiDrmComposition::TakeFreePlane(std::vector<std::shared_ptr<DrmPlane>> &planes,
+    HdiLayer *layer)
+{
+    // the planes are sorted by zpos when it is known, the layers are placed from the top
+    for (auto it = planes.rbegin(); it != planes.rend(); ++it) {
+        auto &drmPlane = *it;
+        if (!drmPlane->IsIdle() || ((drmPlane->GetCrtcId() != 0) && (drmPlane->GetCrtcId() != mCrtc->GetId()))) {
+            continue;
+        }
+        if ((layer != nullptr) && (!IsStackedInRange(*drmPlane) || !CanPresentDirect(*layer, *drmPlane))) {
+            continue;
+        }
+        /* mark the plane is used by crtc */
+        drmPlane->BindToPipe(1 << mCrtc->GetPipe());
+        return drmPlane;
+    }
+    return nullptr;
+}
+
+void HdiDrmComposition::ReleasePlanes()
+{
+    for (auto &drmPlane : mPlanes) {
+        if (drmPlane->GetPipe() == static_cast<uint32_t>(1 << mCrtc->GetPipe())) {
+            drmPlane->UnBindPipe();
+        }
+    }
+}
+
+int32_t HdiDrmComposition::SetLayers(const std::vector<HdiLayer *> &layers, HdiLayer &clientLayer)
 {
-    // now we do not surpport present direct
     DISPLAY_LOGD();
+    std::lock_guard<std::mutex> lock(mDrmDevice->GetPlaneMutex());
     mCompLayers.clear();
+    mCompPlanes.clear();
+    ReleasePlanes();
+    for (auto &layer : layers) {
+        layer->SetDirectPresent(false);
+    }
+
+    std::shared_ptr<DrmPlane> primary = TakeFreePlane(mPrimPlanes, nullptr);
+    if (primary == nullptr) {
+        primary = TakeFreePlane(mPlanes, nullptr);
+    }
+    DISPLAY_CHK_RETURN((primary == nullptr), DISPLAY_FAILURE, DISPLAY_LOGE("no plane for the client layer"));
     mCompLayers.push_back(&clientLayer);
+    mCompPlanes.push_back(primary);
+    mZposFloor = primary->GetZpos();
+    mZposCeiling = UINT64_MAX;
+
+    /*
+     * The planes sit above the client buffer, so only the layers above everything that
+     * still needs composition can be presented directly. Walk down from the top layer.
+     */
+    for (auto it = layers.rbegin(); it != layers.rend(); ++it) {
+        HdiLayer *layer = *it;
+        std::shared_ptr<DrmPlane> drmPlane;
+        if ((it == layers.rbegin()) && (layer->GetCompositionType() == COMPOSITION_CURSOR)) {
+            drmPlane = TakeFreePlane(mCursorPlanes, layer);
+        }
+        if (drmPlane == nullptr) {
+            drmPlane = TakeFreePlane(mOverlayPlanes, layer);
+        }
+        if (drmPlane == nullptr) {
+            break;
+        }
+        DISPLAY_LOGD("layer %{public}d present on plane %{public}d", layer->GetId(), drmPlane->GetId());
+        mZposCeiling = drmPlane->GetZpos();
+        layer->SetDirectPresent(true);
+        layer->SetDeviceSelect(layer->GetCompositionType());
+        mCompLayers.push_back(layer);
+        mCompPlanes.push_back(drmPlane);
+    }
     return DISPLAY_SUCCESS;
 }
 
-int32_t HdiDrmComposition::SetCrtcProperty(DrmPlane &drmPlane,
-                                           drmModeAtomicReqPtr pset,
-                                           int32_t bufferW,
-                                           int32_t bufferH)
+int HdiDrmComposition::AddStateProperty(drmModeAtomicReqPtr pset, uint32_t objId, DrmObjectState &state,
+    uint32_t propId, uint64_t value)
+{
+    if (state.IsCommitted(propId, value)) {
+        return 0;
+    }
+    mPendingState.push_back({&state, propId, value});
+    return drmModeAtomicAddProperty(pset, objId, propId, value);
+}
+
+void HdiDrmComposition::UpdateCommittedState()
+{
+    for (auto &pending : mPendingState) {
+        pending.state->Update(pending.propId, pending.value);
+    }
+    mPendingState.clear();
+}
+
+int32_t HdiDrmComposition::SetCrtcProperty(DrmPlane &drmPlane, drmModeAtomicReqPtr pset, const IRect &dst)
 {
     int ret;
 
-    ret = drmModeAtomicAddProperty(pset, drmPlane.GetId(), drmPlane.GetPropCrtc_xId(), 0);
+    ret = AddStateProperty(pset, drmPlane, drmPlane.GetPropCrtc_xId(), dst.x);
     DISPLAY_LOGD("set the fb planeid %{public}d, GetPropCrtc_xId %{public}d, crop.x %{public}d", drmPlane.GetId(),
-        drmPlane.GetPropCrtc_xId(), 0);
+        drmPlane.GetPropCrtc_xId(), dst.x);
     DISPLAY_CHK_RETURN((ret < 0), DISPLAY_FAILURE, DISPLAY_LOGE("set the fb planeid fialed errno : %{public}d", errno));
 
-    ret = drmModeAtomicAddProperty(pset, drmPlane.GetId(), drmPlane.GetPropCrtc_yId(), 0);
+    ret = AddStateProperty(pset, drmPlane, drmPlane.GetPropCrtc_yId(), dst.y);
     DISPLAY_LOGD("set the fb planeid %{public}d, GetPropCrtc_yId %{public}d, crop.y %{public}d", drmPlane.GetId(),
-        drmPlane.GetPropCrtc_yId(), 0);
+        drmPlane.GetPropCrtc_yId(), dst.y);
     DISPLAY_CHK_RETURN((ret < 0), DISPLAY_FAILURE, DISPLAY_LOGE("set the fb planeid fialed errno : %{public}d", errno));
 
-    ret = drmModeAtomicAddProperty(pset, drmPlane.GetId(), drmPlane.GetPropCrtc_wId(), bufferW);
+    ret = AddStateProperty(pset, drmPlane, drmPlane.GetPropCrtc_wId(), dst.w);
     DISPLAY_LOGD("set the fb planeid %{public}d, GetPropCrtc_wId %{public}d, crop.w %{public}d", drmPlane.GetId(),
-        drmPlane.GetPropCrtc_wId(), bufferW);
+        drmPlane.GetPropCrtc_wId(), dst.w);
     DISPLAY_CHK_RETURN((ret < 0), DISPLAY_FAILURE, DISPLAY_LOGE("set the fb planeid fialed errno : %{public}d", errno));
 
-    ret = drmModeAtomicAddProperty(pset, drmPlane.GetId(), drmPlane.GetPropCrtc_hId(), bufferH);
+    ret = AddStateProperty(pset, drmPlane, drmPlane.GetPropCrtc_hId(), dst.h);
     DISPLAY_LOGD("set the fb planeid %{public}d, GetPropCrtc_hId %{public}d, crop.h %{public}d", drmPlane.GetId(),
-        drmPlane.GetPropCrtc_xId(), bufferH);
+        drmPlane.GetPropCrtc_hId(), dst.h);
     DISPLAY_CHK_RETURN((ret < 0), DISPLAY_FAILURE, DISPLAY_LOGE("set the fb planeid fialed errno : %{public}d", errno));
 
     return DISPLAY_SUCCESS;
 }
 
-int32_t HdiDrmComposition::SetSrcProperty(DrmPlane &drmPlane,
-                                          drmModeAtomicReqPtr pset,
-                                          int32_t bufferW,
-                                          int32_t bufferH)
+int32_t HdiDrmComposition::SetSrcProperty(DrmPlane &drmPlane, drmModeAtomicReqPtr pset, const IRect &src)
 {
     int ret;
 
-    ret = drmModeAtomicAddProperty(pset, drmPlane.GetId(), drmPlane.GetPropSrc_xId(), 0 << 16); // 16:shift left 16 bits
+    ret = AddStateProperty(pset, drmPlane, drmPlane.GetPropSrc_xId(),
+        static_cast<uint64_t>(src.x) << 16); // 16:shift left 16 bits
     DISPLAY_LOGD("set the fb planeid %{public}d, GetPropSrc_xId %{public}d, displayRect.x %{public}d",
-        drmPlane.GetId(), drmPlane.GetPropSrc_xId(), 0);
+        drmPlane.GetId(), drmPlane.GetPropSrc_xId(), src.x);
     DISPLAY_CHK_RETURN((ret < 0), DISPLAY_FAILURE, DISPLAY_LOGE("set the fb planeid fialed errno : %{public}d", errno));
 
-    ret = drmModeAtomicAddProperty(pset, drmPlane.GetId(), drmPlane.GetPropSrc_yId(), 0 << 16); // 16:shift left 16 bits
+    ret = AddStateProperty(pset, drmPlane, drmPlane.GetPropSrc_yId(),
+        static_cast<uint64_t>(src.y) << 16); // 16:shift left 16 bits
     DISPLAY_LOGD("set the fb planeid %{public}d, GetPropSrc_yId %{public}d, displayRect.y %{public}d",
-        drmPlane.GetId(), drmPlane.GetPropSrc_yId(), 0);
+        drmPlane.GetId(), drmPlane.GetPropSrc_yId(), src.y);
     DISPLAY_CHK_RETURN((ret < 0), DISPLAY_FAILURE, DISPLAY_LOGE("set the fb planeid fialed errno : %{public}d", errno));
 
-    ret = drmModeAtomicAddProperty(pset, drmPlane.GetId(), drmPlane.GetPropSrc_wId(),
-                                   bufferW << 16); // 16:shift left 16 bits
+    ret = AddStateProperty(pset, drmPlane, drmPlane.GetPropSrc_wId(),
+                                   static_cast<uint64_t>(src.w) << 16); // 16:shift left 16 bits
     DISPLAY_LOGD("set the fb planeid %{public}d, GetPropCrtc_wId %{public}d, displayRect.w %{public}d",
-        drmPlane.GetId(), drmPlane.GetPropSrc_wId(), bufferW);
+        drmPlane.GetId(), drmPlane.GetPropSrc_wId(), src.w);
     DISPLAY_CHK_RETURN((ret < 0), DISPLAY_FAILURE, DISPLAY_LOGE("set the fb planeid fialed errno : %{public}d", errno));
 
-    ret = drmModeAtomicAddProperty(pset, drmPlane.GetId(), drmPlane.GetPropSrc_hId(),
-        bufferH << 16); // 16:shift left 16 bits
+    ret = AddStateProperty(pset, drmPlane, drmPlane.GetPropSrc_hId(),
+        static_cast<uint64_t>(src.h) << 16); // 16:shift left 16 bits
     DISPLAY_LOGD("set the fb planeid %{public}d, GetPropSrc_hId %{public}d, displayRect.h %{public}d",
-        drmPlane.GetId(), drmPlane.GetPropSrc_hId(), bufferH);
+        drmPlane.GetId(), drmPlane.GetPropSrc_hId(), src.h);
     DISPLAY_CHK_RETURN((ret < 0), DISPLAY_FAILURE, DISPLAY_LOGE("set the fb planeid fialed errno : %{public}d", errno));
 
     return DISPLAY_SUCCESS;
 }
 
-int32_t HdiDrmComposition::ApplyPlane(HdiDrmLayer &layer,
-                                      HdiLayer &hlayer,
-                                      DrmPlane &drmPlane,
-                                      drmModeAtomicReqPtr pset)
+int32_t HdiDrmComposition::ApplyPlane(HdiDrmLayer &layer, DrmPlane &drmPlane, const IRect &src, const IRect &dst,
+    drmModeAtomicReqPtr pset)
 {
     int ret;
     int fenceFd = layer.GetAcquireFenceFd();
     int propId = drmPlane.GetPropFenceInId();
-    HdiLayerBuffer *layerBuffer = hlayer.GetCurrentBuffer();
-    int32_t bufferW = layerBuffer->GetWight();
-    int32_t bufferH = layerBuffer->GetHeight();
 
     DISPLAY_LOGD();
     if (propId != 0) {
@@ -138,10 +327,10 @@ int32_t HdiDrmComposition::ApplyPlane(HdiDrmLayer &layer,
         }
     }
 
-    ret = SetCrtcProperty(drmPlane, pset, bufferW, bufferH);
+    ret = SetCrtcProperty(drmPlane, pset, dst);
     DISPLAY_CHK_RETURN((ret < 0), DISPLAY_FAILURE, DISPLAY_LOGE("set Crtc fialed errno : %{public}d", errno));
 
-    ret = SetSrcProperty(drmPlane, pset, bufferW, bufferH);
+    ret = SetSrcProperty(drmPlane, pset, src);
     DISPLAY_CHK_RETURN((ret < 0), DISPLAY_FAILURE, DISPLAY_LOGE("set Src fialed errno : %{public}d", errno));
 
 
@@ -149,13 +338,13 @@ int32_t HdiDrmComposition::ApplyPlane(HdiDrmLayer &layer,
     DrmGemBuffer *gemBuffer = layer.GetGemBuffer();
     DISPLAY_CHK_RETURN((gemBuffer == nullptr), DISPLAY_FAILURE, DISPLAY_LOGE("current gemBuffer is nullptr"));
     DISPLAY_CHK_RETURN((!gemBuffer->IsValid()), DISPLAY_FAILURE, DISPLAY_LOGE("the DrmGemBuffer is invalid"));
-    ret = drmModeAtomicAddProperty(pset, drmPlane.GetId(), drmPlane.GetPropFbId(), gemBuffer->GetFbId());
+    ret = AddStateProperty(pset, drmPlane, drmPlane.GetPropFbId(), gemBuffer->GetFbId());
     DISPLAY_LOGD("set the fb planeid %{public}d, propId %{public}d, fbId %{public}d",
         drmPlane.GetId(), drmPlane.GetPropFbId(), gemBuffer->GetFbId());
     DISPLAY_CHK_RETURN((ret < 0), DISPLAY_FAILURE, DISPLAY_LOGE("set fb id fialed errno : %{public}d", errno));
 
     // set crtc id
-    ret = drmModeAtomicAddProperty(pset, drmPlane.GetId(), drmPlane.GetPropCrtcId(), mCrtc->GetId());
+    ret = AddStateProperty(pset, drmPlane, drmPlane.GetPropCrtcId(), mCrtc->GetId());
     DISPLAY_LOGD("set the crtc planeId %{public}d, propId %{public}d, crtcId %{public}d",
         drmPlane.GetId(), drmPlane.GetPropCrtcId(), mCrtc->GetId());
     DISPLAY_CHK_RETURN((ret < 0), DISPLAY_FAILURE, DISPLAY_LOGE("set crtc id fialed errno : %{public}d", errno));
@@ -169,22 +358,26 @@ int32_t HdiDrmComposition::UpdateMode(std::unique_ptr<DrmModeBlock> &modeBlock)
     if (mCrtc->NeedModeSet()) {
         int drmFd = mDrmDevice->GetDrmFd();
         drmModeAtomicReqPtr pset = drmModeAtomicAlloc();
+        DISPLAY_CHK_RETURN((pset == nullptr), DISPLAY_NULL_PTR,
+            DISPLAY_LOGE("drm atomic alloc failed errno %{public}d", errno));
+        AtomicReqPtr atomicReqPtr = AtomicReqPtr(pset);
+        mPendingState.clear();
         modeBlock = mConnector->GetModeBlockFromId(mCrtc->GetActiveModeId());
         if ((modeBlock != nullptr) && (modeBlock->GetBlockId() != DRM_INVALID_ID)) {
             // set to active
             DISPLAY_LOGD("set crtc to active");
-            int ret = drmModeAtomicAddProperty(pset, mCrtc->GetId(), mCrtc->GetActivePropId(), 1);
+            int ret = AddStateProperty(pset, *mCrtc, mCrtc->GetActivePropId(), 1);
             DISPLAY_CHK_RETURN((ret < 0), DISPLAY_FAILURE,
                 DISPLAY_LOGE("can not add the active prop errno %{public}d", errno));
 
             // set the mode id
             DISPLAY_LOGD("set the mode");
-            ret = drmModeAtomicAddProperty(pset, mCrtc->GetId(), mCrtc->GetModePropId(), modeBlock->GetBlockId());
+            ret = AddStateProperty(pset, *mCrtc, mCrtc->GetModePropId(), modeBlock->GetBlockId());
             DISPLAY_LOGD("set the mode planeId %{public}d, propId %{public}d, GetBlockId: %{public}d",
                 mCrtc->GetId(), mCrtc->GetModePropId(), modeBlock->GetBlockId());
             DISPLAY_CHK_RETURN((ret < 0), DISPLAY_FAILURE,
                 DISPLAY_LOGE("can not add the mode prop errno %{public}d", errno));
-            ret = drmModeAtomicAddProperty(pset, mConnector->GetId(), mConnector->GetPropCrtcId(), mCrtc->GetId());
+            ret = AddStateProperty(pset, *mConnector, mConnector->GetPropCrtcId(), mCrtc->GetId());
             DISPLAY_LOGD("set the connector id: %{public}d, propId %{public}d, crtcId %{public}d",
                 mConnector->GetId(), mConnector->GetPropCrtcId(), mCrtc->GetId());
             DISPLAY_CHK_RETURN((ret < 0), DISPLAY_FAILURE,
@@ -194,6 +387,7 @@ int32_t HdiDrmComposition::UpdateMode(std::unique_ptr<DrmModeBlock> &modeBlock)
             ret = drmModeAtomicCommit(drmFd, pset, flags, nullptr);
             DISPLAY_CHK_RETURN((ret != 0), DISPLAY_FAILURE,
                 DISPLAY_LOGE("drmModeAtomicCommit failed %{public}d errno %{public}d", ret, errno));
+            UpdateCommittedState();
             mCrtc->ClearModeSet();
         }
     }
@@ -208,38 +402,102 @@ int32_t HdiDrmComposition::RemoveUnusePlane(drmModeAtomicReqPtr pset)
         auto &drmPlane = mPlanes[j];
         if (drmPlane->GetPipe() == 0) {
             DISPLAY_LOGD("no used plane id %{public}d", drmPlane->GetId());
-            ret = drmModeAtomicAddProperty(pset, drmPlane->GetId(), drmPlane->GetPropFbId(), 0);
-            ret = drmModeAtomicAddProperty(pset, drmPlane->GetId(), drmPlane->GetPropFbId(), 0);
-            drmPlane->UnBindPipe();
+            ret = AddStateProperty(pset, *drmPlane, drmPlane->GetPropFbId(), 0);
+            ret = AddStateProperty(pset, *drmPlane, drmPlane->GetPropCrtcId(), 0);
+        }
+    }
+    return DISPLAY_SUCCESS;
+}
+
+// false when the whole framebuffer of the plane is to be updated
+bool HdiDrmComposition::GetPlaneDamage(HdiLayer &layer, bool client, std::vector<IRect> &clips)
+{
+    if (layer.IsGeometryChanged()) {
+        return false;
+    }
+    // the composed area is in display coordinates, which a client crop moves away from the buffer's
+    if (client && !mDamage.empty() && !IsRectEmpty(layer.GetLayerCrop())) {
+        return false;
+    }
+    if (layer.IsContentChanged()) {
+        if (!layer.HasBufferDamage()) {
+            return false;
+        }
+        clips = layer.GetBufferDamage();
+    }
+    if (client) {
+        for (const auto &rect : mDamage) {
+            AddRect(clips, rect);
+        }
+    }
+    return true;
+}
+
+int32_t HdiDrmComposition::SetDamageProperty(DrmPlane &drmPlane, drmModeAtomicReqPtr pset, bool partial,
+    const std::vector<IRect> &clips)
+{
+    uint32_t propId = drmPlane.GetPropFbDamageClipsId();
+    if (propId == DRM_INVALID_ID) {
+        return DISPLAY_SUCCESS;
+    }
+    uint32_t blobId = 0;
+    if (partial) {
+        std::vector<drm_mode_rect> rects;
+        for (const auto &rect : clips) {
+            rects.push_back({rect.x, rect.y, rect.x + rect.w, rect.y + rect.h});
+        }
+        if (rects.empty()) {
+            rects.push_back({0, 0, 0, 0}); // nothing of the framebuffer changed
+        }
+        int ret = drmModeCreatePropertyBlob(mDrmDevice->GetDrmFd(), rects.data(),
+            rects.size() * sizeof(drm_mode_rect), &blobId);
+        if (ret != 0) {
+            DISPLAY_LOGE("can not create the damage blob errno %{public}d", errno);
+            blobId = 0;
+        } else {
+            mDamageBlobs.push_back(blobId);
         }
     }
+    // the damage belongs to this commit only, 0 updates the whole framebuffer
+    int ret = drmModeAtomicAddProperty(pset, drmPlane.GetId(), propId, blobId);
+    DISPLAY_CHK_RETURN((ret < 0), DISPLAY_FAILURE, DISPLAY_LOGE("set the damage clips failed errno %{public}d", errno));
     return DISPLAY_SUCCESS;
 }
 
+void HdiDrmComposition::ReleaseDamageBlobs()
+{
+    for (auto blobId : mDamageBlobs) {
+        drmModeDestroyPropertyBlob(mDrmDevice->GetDrmFd(), blobId);
+    }
+    mDamageBlobs.clear();
+}
+
 int32_t HdiDrmComposition::FindPlaneAndApply(drmModeAtomicReqPtr pset)
 {
     int32_t ret = 0;
+    // the kernel holds its own reference on the blobs it has committed
+    ReleaseDamageBlobs();
     for (uint32_t i = 0; i < mCompLayers.size(); i++) {
         HdiDrmLayer *layer = static_cast<HdiDrmLayer *>(mCompLayers[i]);
-        HdiLayer *hlayer = mCompLayers[i];
-        for (uint32_t j = 0; j < mPlanes.size(); j++) {
-            auto &drmPlane = mPlanes[j];
-            if (drmPlane->GetPipe() != 0 && drmPlane->GetPipe() != (1 << mCrtc->GetPipe())) {
-                DISPLAY_LOGD("plane %{public}d used pipe %{public}d crtc pipe %{public}d", drmPlane->GetId(),
-                    drmPlane->GetPipe(), mCrtc->GetPipe());
-                continue;
-            }
-
-            if (drmPlane->GetCrtcId() == mCrtc->GetId() || drmPlane->GetCrtcId() == 0) {
-                ret = ApplyPlane(*layer, *hlayer, *drmPlane, pset);
-                if (ret != DISPLAY_SUCCESS) {
-                    DISPLAY_LOGE("apply plane failed");
-                    break;
-                }
-                /* mark the plane is used by crtc */
-                drmPlane->BindToPipe(1 << mCrtc->GetPipe());
-                break;
-            }
+        HdiLayerBuffer *buffer = layer->GetCurrentBuffer();
+        if (buffer == nullptr) {
+            DISPLAY_LOGE("layer %{public}d has no buffer", layer->GetId());
+            continue;
+        }
+        // the client layer always covers the whole display, its crop selects the part of the buffer
+        IRect full = {0, 0, buffer->GetWight(), buffer->GetHeight()};
+        IRect src = GetSourceRect(*layer, *buffer);
+        IRect dst = (i == 0) ? full : layer->GetLayerDisplayRect();
+        ret = ApplyPlane(*layer, *mCompPlanes[i], src, dst, pset);
+        if (ret != DISPLAY_SUCCESS) {
+            DISPLAY_LOGE("apply plane %{public}d failed", mCompPlanes[i]->GetId());
+            continue;
+        }
+        std::vector<IRect> clips;
+        bool partial = GetPlaneDamage(*layer, (i == 0), clips);
+        ret = SetDamageProperty(*mCompPlanes[i], pset, partial, clips);
+        if (ret != DISPLAY_SUCCESS) {
+            DISPLAY_LOGE("set the damage of plane %{public}d failed", mCompPlanes[i]->GetId());
         }
     }
     return DISPLAY_SUCCESS;
@@ -261,8 +519,10 @@ int32_t HdiDrmComposition::Apply(bool modeSet)
     DISPLAY_CHK_RETURN((pset == nullptr), DISPLAY_NULL_PTR,
         DISPLAY_LOGE("drm atomic alloc failed errno %{public}d", errno));
     AtomicReqPtr atomicReqPtr = AtomicReqPtr(pset);
+    std::lock_guard<std::mutex> lock(mDrmDevice->GetPlaneMutex());
+    mPendingState.clear();
 
-    // set the outFence property
+    // set the outFence property, it belongs to this commit only
     ret = drmModeAtomicAddProperty(atomicReqPtr.Get(), mCrtc->GetId(), mCrtc->GetOutFencePropId(),
         (uint64_t)&crtcOutFence);
 
@@ -280,7 +540,7 @@ int32_t HdiDrmComposition::Apply(bool modeSet)
     /* Remove useless planes from the drm */
     RemoveUnusePlane(atomicReqPtr.Get());
 
-    ret = drmModeAtomicAddProperty(pset, mConnector->GetId(), mConnector->GetPropCrtcId(), mCrtc->GetId());
+    ret = AddStateProperty(pset, *mConnector, mConnector->GetPropCrtcId(), mCrtc->GetId());
     DISPLAY_LOGD("set the connector id: %{public}d, propId %{public}d, crtcId %{public}d", mConnector->GetId(),
         mConnector->GetPropCrtcId(), mCrtc->GetId());
     DISPLAY_CHK_RETURN((ret < 0), DISPLAY_FAILURE,
@@ -288,18 +548,24 @@ int32_t HdiDrmComposition::Apply(bool modeSet)
 
     // set to active
     DISPLAY_LOGD("set crtc to active");
-    ret = drmModeAtomicAddProperty(pset, mCrtc->GetId(), mCrtc->GetActivePropId(), 1);
+    ret = AddStateProperty(pset, *mCrtc, mCrtc->GetActivePropId(), 1);
     DISPLAY_CHK_RETURN((ret < 0), DISPLAY_FAILURE,
         DISPLAY_LOGE("can not add the active prop errno %{public}d", errno));
 
     uint32_t flags = DRM_MODE_ATOMIC_NONBLOCK;
+    // the flip completion keeps the software vsync of this crtc in phase, the vsync thread reads it
+    if (DrmVsyncWorker::GetInstance().IsRunning()) {
+        flags |= DRM_MODE_PAGE_FLIP_EVENT;
+    }
 
     ret = drmModeAtomicCommit(drmFd, atomicReqPtr.Get(), flags, nullptr);
     DISPLAY_CHK_RETURN((ret != 0), DISPLAY_FAILURE,
         DISPLAY_LOGE("drmModeAtomicCommit failed %{public}d errno %{public}d", ret, errno));
-    // set the release fence
-    for (auto layer : mCompLayers) {
-        layer->SetReleaseFence(static_cast<int>(crtcOutFence));
+    UpdateCommittedState();
+    // set the release fence, every layer owns its own fd
+    for (uint32_t i = 0; i < mCompLayers.size(); i++) {
+        int fence = static_cast<int>(crtcOutFence);
+        mCompLayers[i]->SetReleaseFence((i == 0) ? fence : dup(fence));
     }
 
     return DISPLAY_SUCCESS;
@@ -49,24 +49,64 @@ public:
     HdiDrmComposition(const std::shared_ptr<DrmConnector> &connector,
                                       const std::shared_ptr<DrmCrtc> &crtc,
                                       const std::shared_ptr<DrmDevice> &drmDevice);
-    ~HdiDrmComposition() override {}
+    ~HdiDrmComposition() override
+    {
+        ReleaseDamageBlobs();
+    }
     int32_t Init() override;
-    int32_t SetLayers(std::vector<HdiLayer *> &layers, HdiLayer &clientLayer) override;
+    int32_t SetLayers(const std::vector<HdiLayer *> &layers, HdiLayer &clientLayer) override;
     int32_t Apply(bool modeSet) override;
     int32_t UpdateMode(std::unique_ptr<DrmModeBlock> &modeBlock);
 
 private:
-    int32_t ApplyPlane(HdiDrmLayer &layer, HdiLayer &hlayer, DrmPlane &drmPlane, drmModeAtomicReqPtr pset);
-    int32_t SetSrcProperty(DrmPlane &drmPlane, drmModeAtomicReqPtr pset, int32_t bufferW, int32_t bufferH);
-    int32_t SetCrtcProperty(DrmPlane &drmPlane, drmModeAtomicReqPtr pset, int32_t bufferW, int32_t bufferH);
+    int32_t ApplyPlane(HdiDrmLayer &layer, DrmPlane &drmPlane, const IRect &src, const IRect &dst,
+        drmModeAtomicReqPtr pset);
+    int32_t SetSrcProperty(DrmPlane &drmPlane, drmModeAtomicReqPtr pset, const IRect &src);
+    int32_t SetCrtcProperty(DrmPlane &drmPlane, drmModeAtomicReqPtr pset, const IRect &dst);
     int32_t RemoveUnusePlane(drmModeAtomicReqPtr pset);
     int32_t FindPlaneAndApply(drmModeAtomicReqPtr pset);
+    bool CanPresentDirect(HdiLayer &layer, DrmPlane &drmPlane);
+    std::shared_ptr<DrmPlane> TakeFreePlane(std::vector<std::shared_ptr<DrmPlane>> &planes, HdiLayer *layer);
+    bool IsStackedInRange(const DrmPlane &drmPlane) const;
+    void ReleasePlanes();
+    bool GetPlaneDamage(HdiLayer &layer, bool client, std::vector<IRect> &clips);
+    int32_t SetDamageProperty(DrmPlane &drmPlane, drmModeAtomicReqPtr pset, bool partial,
+        const std::vector<IRect> &clips);
+    void ReleaseDamageBlobs();
+    // only adds the property when it differs from what the object last committed
+    int AddStateProperty(drmModeAtomicReqPtr pset, uint32_t objId, DrmObjectState &state, uint32_t propId,
+        uint64_t value);
+    template<typename T>
+    int AddStateProperty(drmModeAtomicReqPtr pset, T &object, uint32_t propId, uint64_t value)
+    {
+        return AddStateProperty(pset, object.GetId(), object.GetCommittedState(), propId, value);
+    }
+    void UpdateCommittedState();
     std::shared_ptr<DrmDevice> mDrmDevice;
     std::shared_ptr<DrmConnector> mConnector;
     std::shared_ptr<DrmCrtc> mCrtc;
     std::vector<std::shared_ptr<DrmPlane>> mPrimPlanes;
     std::vector<std::shared_ptr<DrmPlane>> mOverlayPlanes;
+    std::vector<std::shared_ptr<DrmPlane>> mCursorPlanes;
     std::vector<std::shared_ptr<DrmPlane>> mPlanes;
+    // the plane each of mCompLayers is presented on
+    std::vector<std::shared_ptr<DrmPlane>> mCompPlanes;
+    struct PendingProperty {
+        DrmObjectState *state;
+        uint32_t propId;
+        uint64_t value;
+    };
+    // the state properties of the request being built, applied once it is committed
+    std::vector<PendingProperty> mPendingState;
+    // the FB_DAMAGE_CLIPS blobs of the last commit
+    std::vector<uint32_t> mDamageBlobs;
+    uint64_t mCursorWidth = 0;
+    uint64_t mCursorHeight = 0;
+    // every plane reports a zpos, otherwise only the cursor plane is known to be above the client plane
+    bool mZposKnown = false;
+    // a layer plane must stack strictly between these, the client plane and the plane of the layer above
+    uint64_t mZposFloor = 0;
+    uint64_t mZposCeiling = UINT64_MAX;
 };
 } // OHOS
 } // HDI
@@ -22,12 +22,40 @@
 namespace OHOS {
 namespace HDI {
 namespace DISPLAY {
+std::mutex DrmGemBuffer::mGemMutex;
+std::unordered_map<uint32_t, uint32_t> DrmGemBuffer::mGemRefs;
+
 DrmGemBuffer::DrmGemBuffer(int drmFd, HdiLayerBuffer &hdl) : mDrmFd(drmFd)
 {
     DISPLAY_LOGD();
     Init(mDrmFd, hdl);
 }
 
+int32_t DrmGemBuffer::ImportGemHandle(int drmFd, int primeFd, uint32_t &handle)
+{
+    std::lock_guard<std::mutex> lock(mGemMutex);
+    int ret = drmPrimeFDToHandle(drmFd, primeFd, &handle);
+    DISPLAY_CHK_RETURN((ret != 0), DISPLAY_FAILURE, DISPLAY_LOGE("can not get handle errno %{public}d", errno));
+    mGemRefs[handle]++;
+    return DISPLAY_SUCCESS;
+}
+
+void DrmGemBuffer::ReleaseGemHandle(int drmFd, uint32_t handle)
+{
+    std::lock_guard<std::mutex> lock(mGemMutex);
+    auto iter = mGemRefs.find(handle);
+    DISPLAY_CHK_RETURN_NOT_VALUE((iter == mGemRefs.end()), DISPLAY_LOGE("unknown gem handle %{public}d", handle));
+    if (--iter->second > 0) {
+        return;
+    }
+    mGemRefs.erase(iter);
+    struct drm_gem_close gemClose = { 0 };
+    gemClose.handle = handle;
+    if (drmIoctl(drmFd, DRM_IOCTL_GEM_CLOSE, &gemClose)) {
+        DISPLAY_LOGD("can not free gem handle %{public}d errno : %{public}d", handle, errno);
+    }
+}
+
 void DrmGemBuffer::Init(int drmFd, HdiLayerBuffer &hdl)
 {
     int ret;
@@ -38,13 +66,45 @@ void DrmGemBuffer::Init(int drmFd, HdiLayerBuffer &hdl)
     DISPLAY_LOGD("hdl %{public}" PRIx64 "", hdl.GetPhysicalAddr());
     DISPLAY_CHK_RETURN_NOT_VALUE((drmFd < 0), DISPLAY_LOGE("can not init drmfd %{public}d", drmFd));
     mDrmFormat = DrmDevice::ConvertToDrmFormat(static_cast<PixelFormat>(hdl.GetFormat()));
-    ret = drmPrimeFDToHandle(drmFd, hdl.GetFb(), &mGemHandle);
-    DISPLAY_CHK_RETURN_NOT_VALUE((ret != 0), DISPLAY_LOGE("can not get handle errno %{public}d", errno));
+    ret = ImportGemHandle(drmFd, hdl.GetFb(), mGemHandle);
+    DISPLAY_CHK_RETURN_NOT_VALUE((ret != DISPLAY_SUCCESS), DISPLAY_LOGE("can not import the buffer"));
 
-    pitches[0] = hdl.GetStride();
+    uint32_t stride = static_cast<uint32_t>(hdl.GetStride());
+    uint32_t lumaSize = stride * static_cast<uint32_t>(hdl.GetHeight());
+    pitches[0] = stride;
     gemHandles[0] = mGemHandle;
     offsets[0] = 0;
-    ret = drmModeAddFB2(drmFd, hdl.GetWight(), hdl.GetHeight(), DRM_FORMAT_XRGB8888, gemHandles, pitches, offsets, &mFdId, 0);
+    // the chroma planes follow the luma plane in the same buffer
+    switch (mDrmFormat) {
+        case DRM_FORMAT_NV12:
+        case DRM_FORMAT_NV21:
+        case DRM_FORMAT_NV16:
+        case DRM_FORMAT_NV61:
+            pitches[1] = stride;
+            gemHandles[1] = mGemHandle;
+            offsets[1] = lumaSize;
+            break;
+        case DRM_FORMAT_YUV420:
+        case DRM_FORMAT_YVU420:
+        case DRM_FORMAT_YUV422:
+        case DRM_FORMAT_YVU422: {
+            uint32_t chromaRows = static_cast<uint32_t>(hdl.GetHeight());
+            if ((mDrmFormat == DRM_FORMAT_YUV420) || (mDrmFormat == DRM_FORMAT_YVU420)) {
+                chromaRows = (chromaRows + 1) / 2; // 2: vertically subsampled
+            }
+            pitches[1] = pitches[2] = stride / 2; // 2: horizontally subsampled
+            gemHandles[1] = gemHandles[2] = mGemHandle;
+            offsets[1] = lumaSize;
+            offsets[2] = lumaSize + pitches[1] * chromaRows; // 2: the second chroma plane
+            break;
+        }
+        case DRM_FORMAT_INVALID:
+            mDrmFormat = DRM_FORMAT_XRGB8888;
+            break;
+        default:
+            break;
+    }
+    ret = drmModeAddFB2(drmFd, hdl.GetWight(), hdl.GetHeight(), mDrmFormat, gemHandles, pitches, offsets, &mFdId, 0);
     DISPLAY_LOGD("mGemHandle %{public}d  mFdId %{public}d", mGemHandle, mFdId);
     DISPLAY_LOGD("w: %{public}d  h: %{public}d mDrmFormat : %{public}d gemHandles: %{public}d pitches: %{public}d "
         "offsets: %{public}d",
@@ -62,11 +122,7 @@ DrmGemBuffer::~DrmGemBuffer()
     }
 
     if (mGemHandle) {
-        struct drm_gem_close gemClose = { 0 };
-        gemClose.handle = mGemHandle;
-        if (drmIoctl(mDrmFd, DRM_IOCTL_GEM_CLOSE, &gemClose)) {
-            DISPLAY_LOGD("can not free gem handle %{public}d errno : %{public}d", mGemHandle, errno);
-        }
+        ReleaseGemHandle(mDrmFd, mGemHandle);
     }
 }
 
@@ -79,11 +135,51 @@ bool DrmGemBuffer::IsValid()
 DrmGemBuffer *HdiDrmLayer::GetGemBuffer()
 {
     DISPLAY_LOGD();
-    std::unique_ptr<DrmGemBuffer> ptr = std::make_unique<DrmGemBuffer>(DrmDevice::GetDrmFd(), *GetCurrentBuffer());
-    mLastBuffer = std::move(mCurrentBuffer);
-    mCurrentBuffer = std::move(ptr);
+    HdiLayerBuffer *buffer = GetCurrentBuffer();
+    DISPLAY_CHK_RETURN((buffer == nullptr), nullptr, DISPLAY_LOGE("the layer has no buffer"));
+    DISPLAY_CHK_RETURN((buffer->GetIno() == 0), nullptr,
+        DISPLAY_LOGE("the buffer fd %{public}d is not valid", buffer->GetFb()));
+    DrmBufferKey key;
+    key.dev = buffer->GetDev();
+    key.ino = buffer->GetIno();
+    key.width = buffer->GetWight();
+    key.height = buffer->GetHeight();
+    key.stride = buffer->GetStride();
+    key.format = buffer->GetFormat();
+
+    std::shared_ptr<DrmGemBuffer> gemBuffer;
+    for (auto iter = mGemCache.begin(); iter != mGemCache.end(); ++iter) {
+        if (iter->first == key) {
+            gemBuffer = iter->second;
+            mGemCache.splice(mGemCache.begin(), mGemCache, iter);
+            break;
+        }
+    }
+    if (gemBuffer == nullptr) {
+        gemBuffer = std::make_shared<DrmGemBuffer>(DrmDevice::GetDrmFd(), *buffer);
+        if (gemBuffer->IsValid()) {
+            mGemCache.emplace_front(key, gemBuffer);
+            if (mGemCache.size() > GEM_BUFFER_CACHE_SIZE) {
+                // the fb is only removed once the layer stops presenting it
+                mGemCache.pop_back();
+            }
+        }
+    }
+    if (gemBuffer != mCurrentBuffer) {
+        mLastBuffer = std::move(mCurrentBuffer);
+        mCurrentBuffer = std::move(gemBuffer);
+    }
     return mCurrentBuffer.get();
 }
+
+void HdiDrmLayer::OnBufferReleased(const HdiLayerBuffer &buffer)
+{
+    // the imported gem handle holds the dma-buf, drop it so the allocator sees the buffer free again.
+    // an fb still on the screen lives on in mCurrentBuffer or mLastBuffer until it is replaced
+    mGemCache.remove_if([&buffer](const std::pair<DrmBufferKey, std::shared_ptr<DrmGemBuffer>> &entry) {
+        return (entry.first.dev == buffer.GetDev()) && (entry.first.ino == buffer.GetIno());
+    });
+}
 } // namespace OHOS
 } // namespace HDI
 } // namespace DISPLAY
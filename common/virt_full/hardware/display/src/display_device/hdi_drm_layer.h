@@ -15,6 +15,10 @@
 
 #ifndef HDI_DRM_LAYER_H
 #define HDI_DRM_LAYER_H
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <sys/types.h>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 #include "buffer_handle.h"
@@ -26,6 +30,23 @@ namespace OHOS {
 namespace HDI {
 namespace DISPLAY {
 const int INVALID_DRM_ID = 0;
+const uint32_t GEM_BUFFER_CACHE_SIZE = 8;
+
+// identifies an imported buffer: the dma-buf inode plus the geometry the fb was created with
+struct DrmBufferKey {
+    dev_t dev = 0;
+    ino_t ino = 0;
+    int32_t width = 0;
+    int32_t height = 0;
+    int32_t stride = 0;
+    int32_t format = 0;
+    bool operator == (const DrmBufferKey &other) const
+    {
+        return (dev == other.dev) && (ino == other.ino) && (width == other.width) && (height == other.height) &&
+            (stride == other.stride) && (format == other.format);
+    }
+};
+
 class DrmGemBuffer {
 public:
     DrmGemBuffer(int drmFd, HdiLayerBuffer &hdl);
@@ -34,10 +55,19 @@ public:
     {
         return mFdId;
     }
+    uint32_t GetDrmFormat() const
+    {
+        return mDrmFormat;
+    }
     bool IsValid();
 
 private:
     void Init(int drmFd, HdiLayerBuffer &hdl);
+    // the kernel hands out one gem handle per buffer, so the handles are counted across all layers
+    static int32_t ImportGemHandle(int drmFd, int primeFd, uint32_t &handle);
+    static void ReleaseGemHandle(int drmFd, uint32_t handle);
+    static std::mutex mGemMutex;
+    static std::unordered_map<uint32_t, uint32_t> mGemRefs;
     uint32_t mGemHandle = 0;
     uint32_t mFdId = 0;
     int mDrmFd = -1; // the fd can not close. the other module will close it.
@@ -51,9 +81,14 @@ public:
     // Return value optimization
     DrmGemBuffer *GetGemBuffer();
 
+protected:
+    void OnBufferReleased(const HdiLayerBuffer &buffer) override;
+
 private:
-    std::unique_ptr<DrmGemBuffer> mCurrentBuffer;
-    std::unique_ptr<DrmGemBuffer> mLastBuffer;
+    // most recently used first, an fb stays registered while its buffer circulates in the queue
+    std::list<std::pair<DrmBufferKey, std::shared_ptr<DrmGemBuffer>>> mGemCache;
+    std::shared_ptr<DrmGemBuffer> mCurrentBuffer;
+    std::shared_ptr<DrmGemBuffer> mLastBuffer;
 };
 } // namespace OHOS
 } // namespace HDI
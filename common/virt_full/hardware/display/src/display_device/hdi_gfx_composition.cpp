@@ -14,6 +14,7 @@
  */
 
 #include "hdi_gfx_composition.h"
+#include <algorithm>
 #include <cinttypes>
 #include <dlfcn.h>
 #include <cerrno>
@@ -27,6 +28,16 @@ using namespace OHOS::HDI::Display::Composer::V1_0;
 namespace OHOS {
 namespace HDI {
 namespace DISPLAY {
+namespace {
+// a client buffer older than this many frames is composed in full
+constexpr uint32_t MAX_BUFFER_AGE = 4;
+
+bool IsTransformed(const HdiLayer &layer)
+{
+    return (layer.GetTransFormType() != ROTATE_NONE) && (layer.GetTransFormType() != ROTATE_BUTT);
+}
+} // namespace
+
 int32_t HdiGfxComposition::Init(void)
 {
     DISPLAY_LOGD();
@@ -83,14 +94,13 @@ int32_t HdiGfxComposition::GfxModuleDeinit(void)
 bool HdiGfxComposition::CanHandle(HdiLayer &hdiLayer)
 {
     DISPLAY_LOGD();
-    (void)hdiLayer;
-    return true;
+    return !hdiLayer.IsDirectPresent();
 }
 
-bool HdiGfxComposition::UseCompositionClient(std::vector<HdiLayer *> &layers)
+bool HdiGfxComposition::UseCompositionClient(const std::vector<HdiLayer *> &layers)
 {
     int32_t layerCount = 0;
-    bool hasCompositionClient = true;
+    bool hasCompositionClient = false;
 
     for (auto &layer : layers) {
         if (!CanHandle(*layer)) {
@@ -103,7 +113,7 @@ bool HdiGfxComposition::UseCompositionClient(std::vector<HdiLayer *> &layers)
     return hasCompositionClient || (layerCount > 4);
 }
 
-int32_t HdiGfxComposition::SetLayers(std::vector<HdiLayer *> &layers, HdiLayer &clientLayer)
+int32_t HdiGfxComposition::SetLayers(const std::vector<HdiLayer *> &layers, HdiLayer &clientLayer)
 {
     DISPLAY_LOGD("layers size %{public}zd", layers.size());
     CompositionType defaultCompType = UseCompositionClient(layers) ? COMPOSITION_CLIENT : COMPOSITION_DEVICE;
@@ -120,7 +130,6 @@ int32_t HdiGfxComposition::SetLayers(std::vector<HdiLayer *> &layers, HdiLayer &
         } else {
             layer->SetDeviceSelect(defaultCompType);
         }
-	layer->SetDeviceSelect(defaultCompType);
         mCompLayers.push_back(layer);
     }
     DISPLAY_LOGD("composer layers size %{public}zd", mCompLayers.size());
@@ -145,8 +154,22 @@ void HdiGfxComposition::InitGfxSurface(ISurface &iSurface, HdiLayerBuffer &buffe
 }
 
 // now not handle the alpha of layer
-int32_t HdiGfxComposition::BlitLayer(HdiLayer &src, HdiLayer &dst)
+int32_t HdiGfxComposition::BlitLayer(HdiLayer &src, HdiLayer &dst, const IRect &area)
 {
+    IRect displayRect = src.GetLayerDisplayRect();
+    IRect dstRect;
+    if (!IntersectRect(displayRect, area, dstRect)) {
+        return DISPLAY_SUCCESS;
+    }
+    // the parts covered by other layers need not be drawn
+    const std::vector<IRect> &visible = src.GetVisibleRegion();
+    if (!visible.empty() && !IntersectRect(dstRect, BoundingRect(visible), dstRect)) {
+        return DISPLAY_SUCCESS;
+    }
+    // the crop of a transformed layer can not be cut to a part of it, the blit clips to the surface itself
+    if (IsTransformed(src)) {
+        dstRect = displayRect;
+    }
     ISurface srcSurface = { 0 };
     ISurface dstSurface = { 0 };
     GfxOpt opt = { 0 };
@@ -165,6 +188,9 @@ int32_t HdiGfxComposition::BlitLayer(HdiLayer &src, HdiLayer &dst)
     InitGfxSurface(dstSurface, *dstBuffer);
 
     opt.blendType = src.GetLayerBlenType();
+    if ((opt.blendType == BLEND_SRCOVER) && !src.GetLayerPreMulti()) {
+        opt.blendType = BLEND_AKS; // the gfx engine's straight alpha source-over
+    }
     DISPLAY_LOGD("blendType %{public}d", opt.blendType);
     opt.enPixelAlpha = true;
     opt.enableScale = true;
@@ -177,58 +203,122 @@ int32_t HdiGfxComposition::BlitLayer(HdiLayer &src, HdiLayer &dst)
     opt.rotateType = src.GetTransFormType();
     DISPLAY_LOGD(" the roate type is %{public}d", opt.rotateType);
     IRect crop = src.GetLayerCrop();
-    IRect displayRect = src.GetLayerDisplayRect();
-    DISPLAY_LOGD("crop x: %{public}d y : %{public}d w : %{public}d h: %{public}d", crop.x, crop.y, crop.w, crop.h);
-    DISPLAY_LOGD("displayRect x: %{public}d y : %{public}d w : %{public}d h : %{public}d",
-        displayRect.x, displayRect.y, displayRect.w, displayRect.h);
+    if (IsRectEmpty(crop)) {
+        crop = {0, 0, srcBuffer->GetWight(), srcBuffer->GetHeight()};
+    }
+    IRect srcRect = crop;
+    if (!IsRectEqual(dstRect, displayRect) && !IsTransformed(src)) {
+        srcRect = MapRect(dstRect, displayRect, crop);
+        (void)IntersectRect(srcRect, crop, srcRect);
+    }
+    DISPLAY_LOGD("src x: %{public}d y : %{public}d w : %{public}d h: %{public}d", srcRect.x, srcRect.y,
+        srcRect.w, srcRect.h);
+    DISPLAY_LOGD("dst x: %{public}d y : %{public}d w : %{public}d h : %{public}d",
+        dstRect.x, dstRect.y, dstRect.w, dstRect.h);
     DISPLAY_CHK_RETURN(mGfxFuncs == nullptr, DISPLAY_FAILURE, DISPLAY_LOGE("Blit: mGfxFuncs is null"));
-    return mGfxFuncs->Blit(&srcSurface, &crop, &dstSurface, &displayRect, &opt);
+    return mGfxFuncs->Blit(&srcSurface, &srcRect, &dstSurface, &dstRect, &opt);
 }
 
-int32_t HdiGfxComposition::ClearRect(HdiLayer &src, HdiLayer &dst)
+int32_t HdiGfxComposition::ClearRect(const IRect &rect, HdiLayer &dst)
 {
     ISurface dstSurface = { 0 };
     GfxOpt opt = { 0 };
     DISPLAY_LOGD();
+    if (IsRectEmpty(rect)) {
+        return DISPLAY_SUCCESS;
+    }
     HdiLayerBuffer *dstBuffer = dst.GetCurrentBuffer();
     DISPLAY_CHK_RETURN((dstBuffer == nullptr), DISPLAY_FAILURE, DISPLAY_LOGE("can not get client layer buffer"));
     InitGfxSurface(dstSurface, *dstBuffer);
-    IRect rect = src.GetLayerDisplayRect();
+    IRect fillRect = rect;
     DISPLAY_CHK_RETURN(mGfxFuncs == nullptr, DISPLAY_FAILURE, DISPLAY_LOGE("Rect: mGfxFuncs is null"));
-    return mGfxFuncs->FillRect(&dstSurface, &rect, 0, &opt);
+    return mGfxFuncs->FillRect(&dstSurface, &fillRect, 0, &opt);
 }
 
-int32_t HdiGfxComposition::Apply(bool modeSet)
+// how many frames ago the content of the buffer was composed, 0 if never
+uint32_t HdiGfxComposition::UpdateBufferAge(const HdiLayerBuffer &buffer)
 {
-    StartTrace(HITRACE_TAG_HDF, "HDI:DISP:Apply");
-    int32_t ret;
-    DISPLAY_LOGD("composer layers size %{public}zd", mCompLayers.size());
-	
-    bool needClear = false;
-    for (uint32_t i = 0; i < mCompLayers.size(); i++) {
-        HdiLayer *layer = mCompLayers[i];
-        CompositionType compType = layer->GetCompositionType();
-        if (compType == COMPOSITION_DEVICE) {
-            needClear = true;
-            break;
+    if (buffer.GetIno() == 0) {
+        return 0;
+    }
+    auto iter = std::find_if(mBufferAges.begin(), mBufferAges.end(), [&buffer](const ClientBufferAge &age) {
+        return (age.dev == buffer.GetDev()) && (age.ino == buffer.GetIno());
+    });
+    if (iter == mBufferAges.end()) {
+        if (mBufferAges.size() >= MAX_BUFFER_AGE) {
+            mBufferAges.erase(std::min_element(mBufferAges.begin(), mBufferAges.end(),
+                [](const ClientBufferAge &a, const ClientBufferAge &b) { return a.frame < b.frame; }));
         }
+        mBufferAges.push_back({buffer.GetDev(), buffer.GetIno(), mFrame});
+        return 0;
     }
+    uint64_t age = mFrame - iter->frame;
+    iter->frame = mFrame;
+    return (age > MAX_BUFFER_AGE) ? 0 : static_cast<uint32_t>(age);
+}
 
-    if (needClear) {
-        ClearRect(*mClientLayer, *mClientLayer);
+// the part of the target buffer that differs from what the layers should show
+IRect HdiGfxComposition::GetComposeArea(HdiLayer &target)
+{
+    HdiLayerBuffer *buffer = target.GetCurrentBuffer();
+    DISPLAY_CHK_RETURN((buffer == nullptr), IRect({0, 0, 0, 0}), DISPLAY_LOGE("the target layer has no buffer"));
+    IRect full = {0, 0, buffer->GetWight(), buffer->GetHeight()};
+    std::vector<IRect> frameDamage = mDamage;
+    // without a client buffer the client draws nothing
+    bool hasClient = (mClientLayer != nullptr) && (mClientLayer->GetCurrentBuffer() != nullptr);
+    if (hasClient && mClientLayer->HasBufferDamage()) {
+        for (const auto &rect : mClientLayer->GetBufferDamage()) {
+            AddRect(frameDamage, rect);
+        }
+    } else if (hasClient) {
+        AddRect(frameDamage, full);
+    }
+    mFrame++;
+    mDamageHistory.push_front(frameDamage);
+    if (mDamageHistory.size() > MAX_BUFFER_AGE) {
+        mDamageHistory.pop_back();
     }
 
+    uint32_t age = UpdateBufferAge(*buffer);
+    if ((age == 0) || (age > mDamageHistory.size())) {
+        return full;
+    }
+    std::vector<IRect> region;
+    for (uint32_t i = 0; i < age; i++) {
+        region.insert(region.end(), mDamageHistory[i].begin(), mDamageHistory[i].end());
+    }
+    IRect area;
+    if (!IntersectRect(BoundingRect(region), full, area)) {
+        return {0, 0, 0, 0};
+    }
+    // a transformed layer can not be drawn in part
+    for (auto layer : mCompLayers) {
+        IRect clip;
+        if (IsTransformed(*layer) && IntersectRect(layer->GetLayerDisplayRect(), area, clip)) {
+            return full;
+        }
+    }
+    return area;
+}
+
+// draws the layers the device composes into the target, limited to the area
+int32_t HdiGfxComposition::ComposeLayers(HdiLayer &target, const IRect &area)
+{
+    int32_t ret;
     for (uint32_t i = 0; i < mCompLayers.size(); i++) {
         HdiLayer *layer = mCompLayers[i];
         CompositionType compType = layer->GetCompositionType();
         switch (compType) {
-            case COMPOSITION_VIDEO:
-                ret = ClearRect(*layer, *mClientLayer);
+            case COMPOSITION_VIDEO: {
+                IRect rect;
+                ret = IntersectRect(layer->GetLayerDisplayRect(), area, rect) ? ClearRect(rect, target) :
+                    DISPLAY_SUCCESS;
                 DISPLAY_CHK_RETURN((ret != DISPLAY_SUCCESS), DISPLAY_FAILURE,
                     DISPLAY_LOGE("clear layer %{public}d failed", i));
                 break;
+            }
             case COMPOSITION_DEVICE:
-                ret = BlitLayer(*layer, *mClientLayer);
+                ret = BlitLayer(*layer, target, area);
                 DISPLAY_CHK_RETURN((ret != DISPLAY_SUCCESS), DISPLAY_FAILURE,
                     DISPLAY_LOGE("blit layer %{public}d failed ", i));
                 break;
@@ -237,9 +327,35 @@ int32_t HdiGfxComposition::Apply(bool modeSet)
                 break;
         }
     }
-    FinishTrace(HITRACE_TAG_HDF);
     return DISPLAY_SUCCESS;
 }
+
+int32_t HdiGfxComposition::Apply(bool modeSet)
+{
+    StartTrace(HITRACE_TAG_HDF, "HDI:DISP:Apply");
+    DISPLAY_LOGD("composer layers size %{public}zd", mCompLayers.size());
+    DISPLAY_CHK_RETURN((mClientLayer == nullptr), DISPLAY_NULL_PTR, DISPLAY_LOGE("the client layer is not set"));
+    IRect area = GetComposeArea(*mClientLayer);
+    DISPLAY_LOGD("compose area x: %{public}d y : %{public}d w : %{public}d h : %{public}d", area.x, area.y,
+        area.w, area.h);
+
+    bool needClear = false;
+    for (uint32_t i = 0; i < mCompLayers.size(); i++) {
+        HdiLayer *layer = mCompLayers[i];
+        CompositionType compType = layer->GetCompositionType();
+        if (compType == COMPOSITION_DEVICE) {
+            needClear = true;
+            break;
+        }
+    }
+
+    if (needClear) {
+        ClearRect(area, *mClientLayer);
+    }
+    int32_t ret = ComposeLayers(*mClientLayer, area);
+    FinishTrace(HITRACE_TAG_HDF);
+    return ret;
+}
 } // namespace OHOS
 } // namespace HDI
 } // namespace DISPLAY
@@ -15,6 +15,8 @@
 
 #ifndef HDI_GFX_COMPOSITION_H
 #define HDI_GFX_COMPOSITION_H
+#include <deque>
+#include <sys/types.h>
 #include "display_gfx.h"
 #include "hdi_composer.h"
 namespace OHOS {
@@ -23,24 +25,38 @@ namespace DISPLAY {
 class HdiGfxComposition : public HdiComposition {
 public:
     int32_t Init(void) override;
-    int32_t SetLayers(std::vector<HdiLayer *> &layers, HdiLayer &clientLayer) override;
+    int32_t SetLayers(const std::vector<HdiLayer *> &layers, HdiLayer &clientLayer) override;
     int32_t Apply(bool modeSet) override;
     ~HdiGfxComposition() override
     {
         (void)GfxModuleDeinit();
     }
 
+protected:
+    int32_t BlitLayer(HdiLayer &src, HdiLayer &dst, const IRect &area);
+    int32_t ClearRect(const IRect &rect, HdiLayer &dst);
+    int32_t ComposeLayers(HdiLayer &target, const IRect &area);
+    IRect GetComposeArea(HdiLayer &target);
+    HdiLayer *mClientLayer = nullptr;
+
 private:
+    // when a target buffer was last composed into, to redraw only what changed since
+    struct ClientBufferAge {
+        dev_t dev;
+        ino_t ino;
+        uint64_t frame;
+    };
     bool CanHandle(HdiLayer &hdiLayer);
-    bool UseCompositionClient(std::vector<HdiLayer *> &layers);
+    bool UseCompositionClient(const std::vector<HdiLayer *> &layers);
     void InitGfxSurface(ISurface &iSurface, HdiLayerBuffer &buffer);
-    int32_t BlitLayer(HdiLayer &src, HdiLayer &dst);
-    int32_t ClearRect(HdiLayer &src, HdiLayer &dst);
+    uint32_t UpdateBufferAge(const HdiLayerBuffer &buffer);
     int32_t GfxModuleInit(void);
     int32_t GfxModuleDeinit(void);
     void *mGfxModule = nullptr;
     GfxFuncs *mGfxFuncs = nullptr;
-    HdiLayer *mClientLayer;
+    std::deque<std::vector<IRect>> mDamageHistory; // the newest frame first
+    std::vector<ClientBufferAge> mBufferAges;
+    uint64_t mFrame = 0;
 };
 } // namespace OHOS
 } // namespace HDI
@@ -14,26 +14,20 @@
  */
 
 #include "hdi_layer.h"
+#include <algorithm>
 #include <cerrno>
-#include <fstream>
 #include <libsync.h>
 #include <securec.h>
-#include <sstream>
-#include <string>
-#include <sys/time.h>
 #include <unistd.h>
-#include "display_buffer_vdi_impl.h"
+#include "hdi_layer_dump.h"
 #include "v1_0/display_composer_type.h"
 
 namespace OHOS {
 namespace HDI {
 namespace DISPLAY {
-uint32_t HdiLayer::mIdleId = 0;
-std::unordered_set<uint32_t> HdiLayer::mIdSets;
-std::shared_ptr<IDisplayBufferVdi> g_buffer;
-constexpr int TIME_BUFFER_MAX_LEN = 15;
-constexpr int FILE_NAME_MAX_LEN = 80;
-const std::string PATH_PREFIX = "/data/local/traces/";
+uint32_t HdiLayer::mNextId = 0;
+std::deque<uint32_t> HdiLayer::mFreeIds;
+std::mutex HdiLayer::mIdMutex;
 
 HdiLayerBuffer::HdiLayerBuffer(const BufferHandle &hdl)
     : mPhyAddr(hdl.phyAddr), mHeight(hdl.height), mWidth(hdl.width), mStride(hdl.stride), mFormat(hdl.format)
@@ -44,6 +38,19 @@ HdiLayerBuffer::HdiLayerBuffer(const BufferHandle &hdl)
     if (mFd < 0) {
         DISPLAY_LOGE("the fd : %{public}d dup failed errno  %{public}d", hdl.fd, errno);
     }
+    UpdateIdentity();
+}
+
+void HdiLayerBuffer::UpdateIdentity()
+{
+    struct stat st;
+    if ((mFd < 0) || (fstat(mFd, &st) != 0)) {
+        mDev = 0;
+        mIno = 0;
+        return;
+    }
+    mDev = st.st_dev;
+    mIno = st.st_ino;
 }
 
 HdiLayerBuffer::~HdiLayerBuffer()
@@ -66,26 +73,22 @@ HdiLayerBuffer &HdiLayerBuffer::operator = (const BufferHandle &right)
     mHeight = right.height;
     mStride = right.stride;
     mFormat = right.format;
+    mHandle = right;
+    UpdateIdentity();
     return *this;
 }
 
 uint32_t HdiLayer::GetIdleId()
 {
-    const uint32_t oldIdleId = mIdleId;
+    std::lock_guard<std::mutex> lock(mIdMutex);
     uint32_t id = INVALIDE_LAYER_ID;
-    // ensure the mIdleId not INVALIDE_LAYER_ID
-    mIdleId = mIdleId % INVALIDE_LAYER_ID;
-    do {
-        auto iter = mIdSets.find(mIdleId);
-        if (iter == mIdSets.end()) {
-            id = mIdleId;
-            break;
-        }
-        mIdleId = (mIdleId + 1) % INVALIDE_LAYER_ID;
-    } while (oldIdleId != mIdleId);
-    mIdSets.emplace(id);
-    mIdleId++;
-    DISPLAY_LOGD("id %{public}d mIdleId %{public}d", id, mIdleId);
+    if ((mFreeIds.size() > LAYER_ID_REUSE_DELAY) || ((mNextId == INVALIDE_LAYER_ID) && !mFreeIds.empty())) {
+        id = mFreeIds.front();
+        mFreeIds.pop_front();
+    } else if (mNextId != INVALIDE_LAYER_ID) {
+        id = mNextId++;
+    }
+    DISPLAY_LOGD("id %{public}u free ids %{public}zu", id, mFreeIds.size());
     return id;
 }
 
@@ -103,6 +106,7 @@ int32_t HdiLayer::SetLayerRegion(IRect *rect)
     DISPLAY_CHK_RETURN((rect == nullptr), DISPLAY_NULL_PTR, DISPLAY_LOGE("in rect is nullptr"));
     DISPLAY_LOGD(" displayRect x: %{public}d y : %{public}d w : %{public}d h : %{public}d", rect->x, rect->y,
         rect->w, rect->h);
+    mGeometryChanged = mGeometryChanged || !IsRectEqual(mDisplayRect, *rect);
     mDisplayRect = *rect;
     return DISPLAY_SUCCESS;
 }
@@ -112,6 +116,7 @@ int32_t HdiLayer::SetLayerCrop(IRect *rect)
     DISPLAY_CHK_RETURN((rect == nullptr), DISPLAY_NULL_PTR, DISPLAY_LOGE("in rect is nullptr"));
     DISPLAY_LOGD("id : %{public}d crop x: %{public}d y : %{public}d w : %{public}d h : %{public}d", mId,
         rect->x, rect->y, rect->w, rect->h);
+    mGeometryChanged = mGeometryChanged || !IsRectEqual(mCrop, *rect);
     mCrop = *rect;
     return DISPLAY_SUCCESS;
 }
@@ -119,12 +124,14 @@ int32_t HdiLayer::SetLayerCrop(IRect *rect)
 void HdiLayer::SetLayerZorder(uint32_t zorder)
 {
     DISPLAY_LOGD("id : %{public}d zorder : %{public}d ", mId, zorder);
+    mGeometryChanged = mGeometryChanged || (mZorder != zorder);
     mZorder = zorder;
 }
 
 int32_t HdiLayer::SetLayerPreMulti(bool preMul)
 {
     DISPLAY_LOGD();
+    mGeometryChanged = mGeometryChanged || (mPreMul != preMul);
     mPreMul = preMul;
     return DISPLAY_SUCCESS;
 }
@@ -133,6 +140,8 @@ int32_t HdiLayer::SetLayerAlpha(LayerAlpha *alpha)
 {
     DISPLAY_CHK_RETURN((alpha == nullptr), DISPLAY_NULL_PTR, DISPLAY_LOGE("in alpha is nullptr"));
     DISPLAY_LOGD("enable alpha %{public}d galpha 0x%{public}x", alpha->enGlobalAlpha, alpha->gAlpha);
+    mGeometryChanged = mGeometryChanged || (mAlpha.enGlobalAlpha != alpha->enGlobalAlpha) ||
+        (mAlpha.enPixelAlpha != alpha->enPixelAlpha) || (mAlpha.gAlpha != alpha->gAlpha);
     mAlpha = *alpha;
     return DISPLAY_SUCCESS;
 }
@@ -140,85 +149,102 @@ int32_t HdiLayer::SetLayerAlpha(LayerAlpha *alpha)
 int32_t HdiLayer::SetLayerTransformMode(TransformType type)
 {
     DISPLAY_LOGD("TransformType %{public}d", type);
+    mGeometryChanged = mGeometryChanged || (mTransformType != type);
     mTransformType = type;
     return DISPLAY_SUCCESS;
 }
 
-int32_t HdiLayer::SetLayerDirtyRegion(IRect *region)
+int32_t HdiLayer::SetLayerDirtyRegion(uint32_t num, IRect *rects)
 {
-    DISPLAY_CHK_RETURN((region == nullptr), DISPLAY_FAILURE, DISPLAY_LOGE("the in rect is null"));
-    DISPLAY_LOGD("id : %{public}d DirtyRegion x: %{public}d y : %{public}d w : %{public}d h : %{public}d", mId,
-        region->x, region->y, region->w, region->h);
+    DISPLAY_CHK_RETURN(((num != 0) && (rects == nullptr)), DISPLAY_FAILURE, DISPLAY_LOGE("the in rect is null"));
+    DISPLAY_LOGD("id : %{public}d DirtyRegion num : %{public}u", mId, num);
+    mDamage.clear();
+    for (uint32_t i = 0; i < num; i++) {
+        AddRect(mDamage, rects[i]);
+    }
+    mDamageSet = true;
     return DISPLAY_SUCCESS;
 }
 
 int32_t HdiLayer::SetLayerVisibleRegion(uint32_t num, IRect *rect)
 {
-    DISPLAY_LOGD("id : %{public}d DirtyRegion x: %{public}d y : %{public}d w : %{public}d h : %{public}d", mId,
-        rect->x, rect->y, rect->w, rect->h);
+    DISPLAY_CHK_RETURN(((num != 0) && (rect == nullptr)), DISPLAY_FAILURE, DISPLAY_LOGE("the in rect is null"));
+    DISPLAY_LOGD("id : %{public}d VisibleRegion num : %{public}u", mId, num);
+    mVisibleRegion.clear();
+    for (uint32_t i = 0; i < num; i++) {
+        AddRect(mVisibleRegion, rect[i]);
+    }
     return DISPLAY_SUCCESS;
 }
 
-static int32_t GetFileName(char *fileName, uint32_t len, const BufferHandle *buffer)
+void HdiLayer::GetDisplayDamage(std::vector<IRect> &damage) const
 {
-    struct timeval tv;
-    char nowStr[TIME_BUFFER_MAX_LEN] = {0};
-
-    gettimeofday(&tv, nullptr);
-    if (strftime(nowStr, sizeof(nowStr), "%m-%d-%H-%M-%S", localtime(&tv.tv_sec)) == 0) {
-        DISPLAY_LOGE("strftime failed");
-        return DISPLAY_FAILURE;
-    };
-    int32_t ret = snprintf_s(fileName, len, len - 1, "hdi_layer_%s-%lld_%dx%d.img",
-        nowStr, tv.tv_usec, buffer->width, buffer->height);
-    DISPLAY_CHK_RETURN((ret < 0), DISPLAY_FAILURE, DISPLAY_LOGE("snprintf_s failed"));
-    return DISPLAY_SUCCESS;
+    if (mGeometryChanged) {
+        GetCoveredRegion(damage);
+        return;
+    }
+    if (!mContentChanged) {
+        return;
+    }
+    bool rotated = (mTransformType != ROTATE_NONE) && (mTransformType != ROTATE_BUTT);
+    if (!HasBufferDamage() || rotated || (mHdiBuffer == nullptr)) {
+        AddRect(damage, mDisplayRect);
+        return;
+    }
+    IRect src = mCrop;
+    if (IsRectEmpty(src)) {
+        src = {0, 0, mHdiBuffer->GetWight(), mHdiBuffer->GetHeight()};
+    }
+    for (const auto &rect : mDamage) {
+        IRect clip;
+        if (!IsRectEmpty(src) && IntersectRect(rect, src, clip)) {
+            AddRect(damage, MapRect(clip, src, mDisplayRect));
+        }
+    }
 }
 
-static int32_t DumpLayerBuffer(BufferHandle *buffer)
+void HdiLayer::ResetDamage()
 {
-    CHECK_NULLPOINTER_RETURN_VALUE(buffer, DISPLAY_NULL_PTR);
+    mDamage.clear();
+    mDamageSet = false;
+    mContentChanged = false;
+    mGeometryChanged = false;
+    mCommittedRect = mDisplayRect;
+}
 
-    int32_t ret = 0;
-    if (g_buffer== nullptr) {
-        IDisplayBufferVdi* dispBuf = new DisplayBufferVdiImpl();
-        DISPLAY_CHK_RETURN((dispBuf == nullptr), DISPLAY_FAILURE, DISPLAY_LOGE("dispBuf init failed"));
-        g_buffer.reset(dispBuf);
+HdiLayerBuffer *HdiLayer::GetLayerBuffer(const BufferHandle &hdl)
+{
+    struct stat st;
+    DISPLAY_CHK_RETURN((fstat(hdl.fd, &st) != 0), nullptr,
+        DISPLAY_LOGE("can not stat buffer fd %{public}d errno %{public}d", hdl.fd, errno));
+    for (auto iter = mBufferRing.begin(); iter != mBufferRing.end(); ++iter) {
+        if ((*iter)->IsSameBuffer(hdl, st)) {
+            mBufferRing.splice(mBufferRing.begin(), mBufferRing, iter);
+            // the fd is kept, the rest of the handle such as the mapping may differ
+            HdiLayerBuffer *layerBuffer = mBufferRing.front().get();
+            layerBuffer->mHandle = hdl;
+            return layerBuffer;
+        }
     }
-
-    char fileName[FILE_NAME_MAX_LEN] = {0};
-    ret = GetFileName(fileName, FILE_NAME_MAX_LEN, buffer);
-    DISPLAY_CHK_RETURN((ret != DISPLAY_SUCCESS), DISPLAY_FAILURE, DISPLAY_LOGE("GetFileName failed"));
-    DISPLAY_LOGI("fileName = %{public}s", fileName);
-
-    std::stringstream filePath;
-    filePath << PATH_PREFIX << fileName;
-    std::ofstream rawDataFile(filePath.str(), std::ofstream::binary);
-    DISPLAY_CHK_RETURN((!rawDataFile.good()), DISPLAY_FAILURE, DISPLAY_LOGE("open file failed, %{public}s",
-        std::strerror(errno)));
-
-    void *buffAddr = g_buffer->Mmap(*buffer);
-    DISPLAY_CHK_RETURN((buffAddr == nullptr), DISPLAY_FAILURE, DISPLAY_LOGE("Mmap buffer failed"));
-
-    rawDataFile.write(static_cast<const char *>(buffAddr), buffer->size);
-    rawDataFile.close();
-
-    ret = g_buffer->Unmap(*buffer);
-    DISPLAY_CHK_RETURN((ret != DISPLAY_SUCCESS), DISPLAY_FAILURE, DISPLAY_LOGE("Unmap buffer failed"));
-    return DISPLAY_SUCCESS;
+    mBufferRing.push_front(std::make_unique<HdiLayerBuffer>(hdl));
+    if (mBufferRing.size() > LAYER_BUFFER_RING_SIZE) {
+        OnBufferReleased(*mBufferRing.back());
+        mBufferRing.pop_back();
+    }
+    return mBufferRing.front().get();
 }
 
 int32_t HdiLayer::SetLayerBuffer(const BufferHandle *buffer, int32_t fence)
 {
     DISPLAY_LOGD();
     DISPLAY_CHK_RETURN((buffer == nullptr), DISPLAY_NULL_PTR, DISPLAY_LOGE("buffer is nullptr"));
-    std::unique_ptr<HdiLayerBuffer> layerbuffer = std::make_unique<HdiLayerBuffer>(*buffer);
-    mHdiBuffer = std::move(layerbuffer);
+    HdiLayerBuffer *layerBuffer = GetLayerBuffer(*buffer);
+    DISPLAY_CHK_RETURN((layerBuffer == nullptr), DISPLAY_FAILURE, DISPLAY_LOGE("can not get the layer buffer"));
+    mHdiBuffer = layerBuffer;
     mAcquireFence = dup(fence);
-    if (access("/data/hdi_dump_layer", F_OK) != -1) {
-        if (DumpLayerBuffer(const_cast<BufferHandle *>(buffer)) != DISPLAY_SUCCESS) {
-            DISPLAY_LOGE("dump layer buffer failed");
-        }
+    mContentChanged = true;
+    if (HdiLayerDumper::IsEnabled()) {
+        HdiLayerDumper::GetInstance().Dump(*buffer);
     }
     return DISPLAY_SUCCESS;
 }
@@ -226,6 +252,7 @@ int32_t HdiLayer::SetLayerBuffer(const BufferHandle *buffer, int32_t fence)
 int32_t HdiLayer::SetLayerCompositionType(CompositionType type)
 {
     DISPLAY_LOGD("CompositionType type %{public}d", type);
+    mGeometryChanged = mGeometryChanged || (mCompositionType != type);
     mCompositionType = type;
     return DISPLAY_SUCCESS;
 }
@@ -233,6 +260,7 @@ int32_t HdiLayer::SetLayerCompositionType(CompositionType type)
 int32_t HdiLayer::SetLayerBlendType(BlendType type)
 {
     DISPLAY_LOGD("BlendType type %{public}d", type);
+    mGeometryChanged = mGeometryChanged || (mBlendType != type);
     mBlendType = type;
     return DISPLAY_SUCCESS;
 }
@@ -255,14 +283,86 @@ void HdiLayer::SetPixel(const BufferHandle &handle, int x, int y, uint32_t color
     *pixel = color;
 }
 
-void HdiLayer::ClearColor(uint32_t color)
+// the bytes per pixel of the formats ClearColor can fill, 0 for the others
+static int32_t GetFillPixelBytes(int32_t format)
+{
+    switch (format) {
+        case PIXEL_FMT_RGBA_8888:
+        case PIXEL_FMT_RGBX_8888:
+        case PIXEL_FMT_BGRA_8888:
+        case PIXEL_FMT_BGRX_8888:
+            return sizeof(uint32_t);
+        case PIXEL_FMT_RGB_565:
+        case PIXEL_FMT_BGR_565:
+        case PIXEL_FMT_RGBA_4444:
+        case PIXEL_FMT_RGBX_4444:
+        case PIXEL_FMT_BGRA_4444:
+        case PIXEL_FMT_BGRX_4444:
+        case PIXEL_FMT_RGBA_5551:
+        case PIXEL_FMT_RGBX_5551:
+        case PIXEL_FMT_BGRA_5551:
+        case PIXEL_FMT_BGRX_5551:
+            return sizeof(uint16_t);
+        default:
+            return 0;
+    }
+}
+
+// whether every byte of the pixel is the same, so the fill is a memset
+static bool IsUniformColor(uint32_t color, int32_t pixelBytes)
+{
+    const uint32_t byteBits = 8;
+    const uint32_t byteMask = 0xff;
+    for (int32_t i = 1; i < pixelBytes; i++) {
+        if (((color >> (i * byteBits)) & byteMask) != (color & byteMask)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void HdiLayer::ClearColor(uint32_t color, const IRect *rect)
 {
     DISPLAY_LOGD();
-    BufferHandle &handle = mHdiBuffer->mHandle;
-    for (int32_t x = 0; x < handle.width; x++) {
-        for (int32_t y = 0; y < handle.height; y++) {
-            SetPixel(handle, x, y, color);
+    DISPLAY_CHK_RETURN_NOT_VALUE((mHdiBuffer == nullptr), DISPLAY_LOGE("the layer has no buffer"));
+    const BufferHandle &handle = mHdiBuffer->mHandle;
+    DISPLAY_CHK_RETURN_NOT_VALUE((handle.virAddr == nullptr), DISPLAY_LOGE("ClearColor viraddr is null must map it"));
+    const int32_t pixelBytes = GetFillPixelBytes(handle.format);
+    DISPLAY_CHK_RETURN_NOT_VALUE((pixelBytes == 0),
+        DISPLAY_LOGE("ClearColor do not support format %{public}d", handle.format));
+    IRect area = {0, 0, handle.width, handle.height};
+    if ((rect != nullptr) && !IntersectRect(*rect, area, area)) {
+        return;
+    }
+    if (IsRectEmpty(area)) {
+        return;
+    }
+    const size_t stride = static_cast<size_t>(std::max(handle.stride, handle.width * pixelBytes));
+    const size_t rowBytes = static_cast<size_t>(area.w) * pixelBytes;
+    const size_t start = static_cast<size_t>(area.y) * stride + static_cast<size_t>(area.x) * pixelBytes;
+    const size_t end = start + static_cast<size_t>(area.h - 1) * stride + rowBytes;
+    DISPLAY_CHK_RETURN_NOT_VALUE((handle.size < 0) || (end > static_cast<size_t>(handle.size)),
+        DISPLAY_LOGE("the buffer of %{public}d bytes is smaller than its layout", handle.size));
+    uint8_t *first = static_cast<uint8_t *>(handle.virAddr) + start;
+    if (IsUniformColor(color, pixelBytes)) {
+        const int value = static_cast<int>(color & 0xff);
+        if (rowBytes == stride) {
+            (void)memset_s(first, end - start, value, end - start);
+            return;
+        }
+        for (int32_t y = 0; y < area.h; y++) {
+            (void)memset_s(first + static_cast<size_t>(y) * stride, rowBytes, value, rowBytes);
         }
+        return;
+    }
+    // the first row is filled a pixel at a time, which the compiler widens, the others are copies of it
+    if (pixelBytes == sizeof(uint32_t)) {
+        std::fill_n(reinterpret_cast<uint32_t *>(first), area.w, color);
+    } else {
+        std::fill_n(reinterpret_cast<uint16_t *>(first), area.w, static_cast<uint16_t>(color));
+    }
+    for (int32_t y = 1; y < area.h; y++) {
+        (void)memcpy_s(first + static_cast<size_t>(y) * stride, rowBytes, first, rowBytes);
     }
 }
 
@@ -15,11 +15,15 @@
 
 #ifndef HDI_LAYER_H
 #define HDI_LAYER_H
-#include <unordered_set>
+#include <deque>
+#include <list>
 #include <memory>
+#include <mutex>
+#include <sys/stat.h>
 #include "buffer_handle.h"
 #include "v1_0/display_composer_type.h"
 #include "hdi_device_common.h"
+#include "hdi_region.h"
 #include "hdi_shared_fd.h"
 
 namespace OHOS {
@@ -28,6 +32,10 @@ namespace DISPLAY {
 using namespace OHOS::HDI::Display::Composer::V1_0;
 const uint32_t INVALIDE_LAYER_ID = 0xffffffff;
 const uint32_t FENCE_TIMEOUT = 3000;
+// a released layer id is handed out again only after this many others, so a stale id does not hit a new layer
+const size_t LAYER_ID_REUSE_DELAY = 64;
+// the buffers a layer rotates through, kept with their fd so a frame reusing one needs no dup
+const size_t LAYER_BUFFER_RING_SIZE = 4;
 struct HdiLayerBuffer {
 public:
     explicit HdiLayerBuffer(const BufferHandle &hdl);
@@ -57,9 +65,26 @@ public:
     {
         return mFd;
     }
+    // the dma-buf behind the fd, the handles and fd numbers of the caller are reused for other buffers
+    dev_t GetDev() const
+    {
+        return mDev;
+    }
+    ino_t GetIno() const
+    {
+        return mIno;
+    }
+    bool IsSameBuffer(const BufferHandle &hdl, const struct stat &st) const
+    {
+        return (mDev == st.st_dev) && (mIno == st.st_ino) && (mWidth == hdl.width) && (mHeight == hdl.height) &&
+            (mStride == hdl.stride) && (mFormat == hdl.format);
+    }
     BufferHandle mHandle;
 
 private:
+    void UpdateIdentity();
+    dev_t mDev = 0;
+    ino_t mIno = 0;
     uint64_t mPhyAddr = 0;
     int32_t mHeight = 0;
     int32_t mWidth = 0;
@@ -121,6 +146,47 @@ public:
     {
         return mDeviceSelect;
     }
+    // set when the layer is scanned out on its own plane and must not be composed
+    void SetDirectPresent(bool direct)
+    {
+        // moving between a plane and the client buffer changes what the client buffer holds
+        mGeometryChanged = mGeometryChanged || (mDirectPresent != direct);
+        mDirectPresent = direct;
+    }
+    bool IsDirectPresent() const
+    {
+        return mDirectPresent;
+    }
+
+    // the dirty region of the current buffer in buffer coordinates, an empty region means the whole buffer
+    bool HasBufferDamage() const
+    {
+        return mDamageSet && !mDamage.empty();
+    }
+    const std::vector<IRect> &GetBufferDamage() const
+    {
+        return mDamage;
+    }
+    const std::vector<IRect> &GetVisibleRegion() const
+    {
+        return mVisibleRegion;
+    }
+    bool IsContentChanged() const
+    {
+        return mContentChanged;
+    }
+    bool IsGeometryChanged() const
+    {
+        return mGeometryChanged;
+    }
+    void GetDisplayDamage(std::vector<IRect> &damage) const;
+    // where the layer is now and where it was at the last commit
+    void GetCoveredRegion(std::vector<IRect> &region) const
+    {
+        AddRect(region, mCommittedRect);
+        AddRect(region, mDisplayRect);
+    }
+    void ResetDamage();
 
     int GetAcquireFenceFd()
     {
@@ -134,7 +200,8 @@ public:
     {
         mReleaseFence = fd;
     };
-    void ClearColor(uint32_t color);
+    // fills the rect of the mapped current buffer, all of it when rect is null, color is in the buffer format
+    void ClearColor(uint32_t color, const IRect *rect = nullptr);
 
     void SetPixel(const BufferHandle &handle, int x, int y, uint32_t color);
 
@@ -145,41 +212,63 @@ public:
     virtual int32_t SetLayerPreMulti(bool preMul);
     virtual int32_t SetLayerAlpha(LayerAlpha *alpha);
     virtual int32_t SetLayerTransformMode(TransformType type);
-    virtual int32_t SetLayerDirtyRegion(IRect *region);
+    virtual int32_t SetLayerDirtyRegion(uint32_t num, IRect *rects);
     virtual int32_t SetLayerVisibleRegion(uint32_t num, IRect *rect);
     virtual int32_t SetLayerBuffer(const BufferHandle *buffer, int32_t fence);
     virtual int32_t SetLayerCompositionType(CompositionType type);
     virtual int32_t SetLayerBlendType(BlendType type);
     virtual HdiLayerBuffer *GetCurrentBuffer()
     {
-        return mHdiBuffer.get();
+        return mHdiBuffer;
     }
     virtual ~HdiLayer()
     {
-        mIdSets.erase(mId);
+        if (mId == INVALIDE_LAYER_ID) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mIdMutex);
+        mFreeIds.push_back(mId);
     }
 
+protected:
+    // the buffer drops out of the ring and its fd is closed, whatever was derived from it has to go as well
+    virtual void OnBufferReleased(const HdiLayerBuffer &) {}
+
 private:
     static uint32_t GetIdleId();
-    static uint32_t mIdleId;
-    static std::unordered_set<uint32_t> mIdSets;
+    HdiLayerBuffer *GetLayerBuffer(const BufferHandle &hdl);
+    static uint32_t mNextId;
+    // the released ids, oldest first
+    static std::deque<uint32_t> mFreeIds;
+    // the layer ids are unique across the displays, which lock independently
+    static std::mutex mIdMutex;
 
-    uint32_t mId = 0;
+    uint32_t mId = INVALIDE_LAYER_ID;
     HdiFd mAcquireFence;
     HdiFd mReleaseFence;
     LayerType mType;
 
-    IRect mDisplayRect;
-    IRect mCrop;
+    IRect mDisplayRect = {0, 0, 0, 0};
+    IRect mCrop = {0, 0, 0, 0};
     uint32_t mZorder = -1;
     bool mPreMul = false;
-    LayerAlpha mAlpha;
+    LayerAlpha mAlpha = {};
     int32_t mFenceTimeOut = FENCE_TIMEOUT;
     TransformType mTransformType = ROTATE_BUTT;
     CompositionType mCompositionType = COMPOSITION_CLIENT;
     CompositionType mDeviceSelect = COMPOSITION_CLIENT;
-    BlendType mBlendType;
-    std::unique_ptr<HdiLayerBuffer> mHdiBuffer;
+    bool mDirectPresent = false;
+    BlendType mBlendType = BLEND_NONE;
+    // what changed since the last commit
+    std::vector<IRect> mDamage;
+    std::vector<IRect> mVisibleRegion;
+    bool mDamageSet = false;
+    bool mContentChanged = true;
+    bool mGeometryChanged = true;
+    IRect mCommittedRect = {0, 0, 0, 0};
+    // most recently used first, the current buffer is always at the front
+    std::list<std::unique_ptr<HdiLayerBuffer>> mBufferRing;
+    HdiLayerBuffer *mHdiBuffer = nullptr;
 };
 
 struct SortLayersByZ {
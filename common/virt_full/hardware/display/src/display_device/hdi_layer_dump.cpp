@@ -0,0 +1,353 @@
+/*
+ * Copyright (c) 2023 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hdi_layer_dump.h"
+#include <atomic>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <poll.h>
+#include <securec.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "display_buffer_vdi_impl.h"
+#include "display_log.h"
+#include "v1_0/display_composer_type.h"
+
+namespace OHOS {
+namespace HDI {
+namespace DISPLAY {
+using namespace OHOS::HDI::Display::Composer::V1_0;
+namespace {
+constexpr int TIME_BUFFER_MAX_LEN = 15;
+constexpr int FILE_NAME_MAX_LEN = 80;
+constexpr int32_t DUMP_PIXEL_BYTES = 4;
+constexpr size_t DUMP_EVENT_BUFFER_SIZE = 1024;
+constexpr size_t DUMP_SCALE_MAX_LEN = 16;
+const char *PATH_PREFIX = "/data/local/traces/";
+// the layers are dumped while this file exists
+const char *DUMP_SWITCH_DIR = "/data";
+const char *DUMP_SWITCH_NAME = "hdi_dump_layer";
+const char *DUMP_SWITCH_PATH = "/data/hdi_dump_layer";
+std::atomic<bool> g_dumpLayer(false);
+std::atomic<uint32_t> g_dumpScale(1);
+
+// the scale is the number written into the switch file, 1 when there is none
+uint32_t ReadDumpScale()
+{
+    char text[DUMP_SCALE_MAX_LEN] = {0};
+    int fd = open(DUMP_SWITCH_PATH, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 1;
+    }
+    ssize_t len = read(fd, text, sizeof(text) - 1);
+    close(fd);
+    if (len <= 0) {
+        return 1;
+    }
+    unsigned long scale = strtoul(text, nullptr, 0);
+    if (scale == 0) {
+        return 1;
+    }
+    return (scale > DUMP_MAX_SCALE) ? DUMP_MAX_SCALE : static_cast<uint32_t>(scale);
+}
+
+// follows the creation and removal of the switch file, so the frames need not look for it
+class DumpSwitchWatcher {
+public:
+    DumpSwitchWatcher();
+    ~DumpSwitchWatcher();
+
+private:
+    void WatchThread();
+    void HandleEvents();
+    int mInotifyFd = -1;
+    // written on destruction to wake the watch thread up
+    int mStopFd = -1;
+    std::thread mThread;
+};
+
+DumpSwitchWatcher::DumpSwitchWatcher()
+{
+    mInotifyFd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    DISPLAY_CHK_RETURN_NOT_VALUE((mInotifyFd < 0), DISPLAY_LOGE("inotify_init1 failed errno %{public}d", errno));
+    uint32_t mask = IN_CREATE | IN_DELETE | IN_MOVED_TO | IN_MOVED_FROM | IN_CLOSE_WRITE;
+    if (inotify_add_watch(mInotifyFd, DUMP_SWITCH_DIR, mask) < 0) {
+        DISPLAY_LOGE("can not watch %{public}s errno %{public}d", DUMP_SWITCH_DIR, errno);
+        return;
+    }
+    mStopFd = eventfd(0, EFD_CLOEXEC);
+    DISPLAY_CHK_RETURN_NOT_VALUE((mStopFd < 0), DISPLAY_LOGE("eventfd failed errno %{public}d", errno));
+    // the switch may have been created before the watch
+    if (access(DUMP_SWITCH_PATH, F_OK) == 0) {
+        g_dumpScale = ReadDumpScale();
+        g_dumpLayer = true;
+    }
+    mThread = std::thread([this]() { WatchThread(); });
+}
+
+DumpSwitchWatcher::~DumpSwitchWatcher()
+{
+    if (mThread.joinable()) {
+        const uint64_t stop = 1;
+        if (write(mStopFd, &stop, sizeof(stop)) != sizeof(stop)) {
+            DISPLAY_LOGE("can not stop the dump watch errno %{public}d", errno);
+        }
+        mThread.join();
+    }
+    if (mStopFd >= 0) {
+        close(mStopFd);
+    }
+    if (mInotifyFd >= 0) {
+        close(mInotifyFd);
+    }
+}
+
+void DumpSwitchWatcher::WatchThread()
+{
+    struct pollfd fds[] = {
+        { mInotifyFd, POLLIN, 0 },
+        { mStopFd, POLLIN, 0 },
+    };
+    while (true) {
+        int ret = poll(fds, sizeof(fds) / sizeof(fds[0]), -1);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            DISPLAY_LOGE("poll the dump switch failed errno %{public}d", errno);
+            break;
+        }
+        if (fds[1].revents != 0) {
+            break;
+        }
+        if (fds[0].revents != 0) {
+            HandleEvents();
+        }
+    }
+}
+
+void DumpSwitchWatcher::HandleEvents()
+{
+    alignas(struct inotify_event) char events[DUMP_EVENT_BUFFER_SIZE];
+    while (true) {
+        ssize_t len = read(mInotifyFd, events, sizeof(events));
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN) {
+                DISPLAY_LOGE("read inotify events failed errno %{public}d", errno);
+            }
+            return;
+        }
+        const struct inotify_event *event = nullptr;
+        for (ssize_t pos = 0; pos < len; pos += static_cast<ssize_t>(sizeof(*event) + event->len)) {
+            event = reinterpret_cast<const struct inotify_event *>(events + pos);
+            if ((event->len == 0) || (strcmp(event->name, DUMP_SWITCH_NAME) != 0)) {
+                continue;
+            }
+            bool enable = (event->mask & (IN_CREATE | IN_MOVED_TO | IN_CLOSE_WRITE)) != 0;
+            if (enable) {
+                g_dumpScale = ReadDumpScale();
+            }
+            g_dumpLayer = enable;
+        }
+    }
+}
+
+int32_t GetFileName(char *fileName, uint32_t len, int32_t width, int32_t height)
+{
+    struct timeval tv;
+    struct tm now;
+    char nowStr[TIME_BUFFER_MAX_LEN] = {0};
+
+    gettimeofday(&tv, nullptr);
+    if ((localtime_r(&tv.tv_sec, &now) == nullptr) ||
+        (strftime(nowStr, sizeof(nowStr), "%m-%d-%H-%M-%S", &now) == 0)) {
+        DISPLAY_LOGE("strftime failed");
+        return DISPLAY_FAILURE;
+    };
+    int32_t ret = snprintf_s(fileName, len, len - 1, "hdi_layer_%s-%lld_%dx%d.img",
+        nowStr, static_cast<long long>(tv.tv_usec), width, height);
+    DISPLAY_CHK_RETURN((ret < 0), DISPLAY_FAILURE, DISPLAY_LOGE("snprintf_s failed"));
+    return DISPLAY_SUCCESS;
+}
+
+// only the 32 bit rgb formats are scaled, the others are dumped as they are
+bool IsScalable(const BufferHandle &buffer)
+{
+    switch (buffer.format) {
+        case PIXEL_FMT_RGBA_8888:
+        case PIXEL_FMT_RGBX_8888:
+        case PIXEL_FMT_BGRA_8888:
+        case PIXEL_FMT_BGRX_8888:
+            return (buffer.width > 0) && (buffer.height > 0) && (buffer.stride >= buffer.width * DUMP_PIXEL_BYTES);
+        default:
+            return false;
+    }
+}
+} // namespace
+
+bool HdiLayerDumper::IsEnabled()
+{
+    // stopped and joined at exit
+    static DumpSwitchWatcher watcher;
+    return g_dumpLayer.load(std::memory_order_relaxed);
+}
+
+HdiLayerDumper &HdiLayerDumper::GetInstance()
+{
+    static HdiLayerDumper instance;
+    static std::once_flag once;
+    std::call_once(once, [&]() {
+        if (instance.Init() != DISPLAY_SUCCESS) {
+            DISPLAY_LOGE("layer dumper init failed");
+        }
+    });
+    return instance;
+}
+
+int32_t HdiLayerDumper::Init()
+{
+    IDisplayBufferVdi *bufferVdi = new DisplayBufferVdiImpl();
+    DISPLAY_CHK_RETURN((bufferVdi == nullptr), DISPLAY_FAILURE, DISPLAY_LOGE("bufferVdi init failed"));
+    mBufferVdi.reset(bufferVdi);
+    mRunning = true;
+    mThread = std::make_unique<std::thread>([this]() { WorkThread(); });
+    DISPLAY_CHK_RETURN((mThread == nullptr), DISPLAY_FAILURE, DISPLAY_LOGE("can not create thread"));
+    return DISPLAY_SUCCESS;
+}
+
+HdiLayerDumper::~HdiLayerDumper()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mRunning = false;
+    }
+    mCondition.notify_one();
+    if (mThread != nullptr) {
+        mThread->join();
+    }
+}
+
+int32_t HdiLayerDumper::CopyBuffer(const BufferHandle &buffer, uint32_t scale, std::vector<uint8_t> &data)
+{
+    void *addr = mBufferVdi->Mmap(buffer);
+    DISPLAY_CHK_RETURN((addr == nullptr), DISPLAY_FAILURE, DISPLAY_LOGE("Mmap buffer failed"));
+    const uint8_t *src = static_cast<const uint8_t *>(addr);
+    if (scale == 1) {
+        data.assign(src, src + buffer.size);
+    } else {
+        // keeps the top left pixel of every scale x scale block
+        int32_t width = buffer.width / static_cast<int32_t>(scale);
+        int32_t height = buffer.height / static_cast<int32_t>(scale);
+        data.resize(static_cast<size_t>(width) * height * DUMP_PIXEL_BYTES);
+        uint32_t *dst = reinterpret_cast<uint32_t *>(data.data());
+        for (int32_t y = 0; y < height; y++) {
+            const uint32_t *row = reinterpret_cast<const uint32_t *>(src +
+                static_cast<size_t>(y) * scale * buffer.stride);
+            for (int32_t x = 0; x < width; x++) {
+                *dst++ = row[static_cast<size_t>(x) * scale];
+            }
+        }
+    }
+    int32_t ret = mBufferVdi->Unmap(buffer);
+    DISPLAY_CHK_RETURN((ret != DISPLAY_SUCCESS), DISPLAY_FAILURE, DISPLAY_LOGE("Unmap buffer failed"));
+    return DISPLAY_SUCCESS;
+}
+
+void HdiLayerDumper::Dump(const BufferHandle &buffer)
+{
+    DumpFrame frame;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (!mRunning) {
+            return;
+        }
+        if (mFrames.size() >= DUMP_QUEUE_SIZE) {
+            mDropped++;
+            return;
+        }
+        if (!mFreeData.empty()) {
+            frame.data = std::move(mFreeData.back());
+            mFreeData.pop_back();
+        }
+    }
+    uint32_t scale = IsScalable(buffer) ? g_dumpScale.load(std::memory_order_relaxed) : 1;
+    if ((buffer.width < static_cast<int32_t>(scale)) || (buffer.height < static_cast<int32_t>(scale))) {
+        scale = 1;
+    }
+    char fileName[FILE_NAME_MAX_LEN] = {0};
+    int32_t ret = GetFileName(fileName, FILE_NAME_MAX_LEN, buffer.width / static_cast<int32_t>(scale),
+        buffer.height / static_cast<int32_t>(scale));
+    DISPLAY_CHK_RETURN_NOT_VALUE((ret != DISPLAY_SUCCESS), DISPLAY_LOGE("GetFileName failed"));
+    frame.fileName = std::string(PATH_PREFIX) + fileName;
+    ret = CopyBuffer(buffer, scale, frame.data);
+    DISPLAY_CHK_RETURN_NOT_VALUE((ret != DISPLAY_SUCCESS), DISPLAY_LOGE("copy the layer buffer failed"));
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        // the other displays compose at the same time and may have filled the queue meanwhile
+        if (mFrames.size() >= DUMP_QUEUE_SIZE) {
+            mDropped++;
+            return;
+        }
+        mFrames.push_back(std::move(frame));
+    }
+    mCondition.notify_one();
+}
+
+void HdiLayerDumper::WorkThread()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true) {
+        mCondition.wait(lock, [this]() { return !mRunning || !mFrames.empty(); });
+        // the queued frames are still written when stopping
+        if (mFrames.empty()) {
+            break;
+        }
+        DumpFrame frame = std::move(mFrames.front());
+        mFrames.pop_front();
+        uint64_t dropped = mDropped;
+        mDropped = 0;
+        lock.unlock();
+
+        if (dropped != 0) {
+            DISPLAY_LOGI("dropped %{public}" PRIu64 " layer dumps, the disk is behind", dropped);
+        }
+        DISPLAY_LOGI("fileName = %{public}s", frame.fileName.c_str());
+        std::ofstream rawDataFile(frame.fileName, std::ofstream::binary);
+        if (rawDataFile.good()) {
+            rawDataFile.write(reinterpret_cast<const char *>(frame.data.data()), frame.data.size());
+            rawDataFile.close();
+        } else {
+            DISPLAY_LOGE("open file failed, %{public}s", std::strerror(errno));
+        }
+
+        lock.lock();
+        if (mFreeData.size() < DUMP_QUEUE_SIZE) {
+            frame.data.clear();
+            mFreeData.push_back(std::move(frame.data));
+        }
+    }
+}
+} // namespace OHOS
+} // namespace HDI
+} // namespace DISPLAY
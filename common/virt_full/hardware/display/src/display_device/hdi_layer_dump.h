@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2023 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HDI_LAYER_DUMP_H
+#define HDI_LAYER_DUMP_H
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "buffer_handle.h"
+#include "idisplay_buffer_vdi.h"
+
+namespace OHOS {
+namespace HDI {
+namespace DISPLAY {
+// the frames beyond this are dropped instead of waiting for the disk
+const size_t DUMP_QUEUE_SIZE = 4;
+const uint32_t DUMP_MAX_SCALE = 16;
+
+/*
+ * Dumps the layer buffers while /data/hdi_dump_layer exists. The composition thread only copies the buffer,
+ * scaled down by the factor written into that file if any, and a thread of its own writes the copies out.
+ */
+class HdiLayerDumper {
+public:
+    static HdiLayerDumper &GetInstance();
+    static bool IsEnabled();
+    virtual ~HdiLayerDumper();
+    void Dump(const BufferHandle &buffer);
+
+private:
+    struct DumpFrame {
+        std::string fileName;
+        std::vector<uint8_t> data;
+    };
+    HdiLayerDumper() {}
+    int32_t Init();
+    void WorkThread();
+    int32_t CopyBuffer(const BufferHandle &buffer, uint32_t scale, std::vector<uint8_t> &data);
+    std::shared_ptr<IDisplayBufferVdi> mBufferVdi;
+    std::unique_ptr<std::thread> mThread;
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::deque<DumpFrame> mFrames;
+    // the copies already written out, their memory is reused by the next frames
+    std::vector<std::vector<uint8_t>> mFreeData;
+    uint64_t mDropped = 0;
+    bool mRunning = false;
+};
+} // namespace OHOS
+} // namespace HDI
+} // namespace DISPLAY
+
+#endif // HDI_LAYER_DUMP_H
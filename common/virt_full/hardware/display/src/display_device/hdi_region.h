@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2023 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HDI_REGION_H
+#define HDI_REGION_H
+#include <algorithm>
+#include <vector>
+#include "v1_0/display_composer_type.h"
+
+namespace OHOS {
+namespace HDI {
+namespace DISPLAY {
+using namespace OHOS::HDI::Display::Composer::V1_0;
+// beyond this a region is replaced by its bounding box
+const size_t MAX_REGION_RECTS = 16;
+
+inline bool IsRectEmpty(const IRect &rect)
+{
+    return (rect.w <= 0) || (rect.h <= 0);
+}
+
+inline bool IsRectEqual(const IRect &a, const IRect &b)
+{
+    return (a.x == b.x) && (a.y == b.y) && (a.w == b.w) && (a.h == b.h);
+}
+
+inline bool IntersectRect(const IRect &a, const IRect &b, IRect &out)
+{
+    int32_t x1 = std::max(a.x, b.x);
+    int32_t y1 = std::max(a.y, b.y);
+    int32_t x2 = std::min(a.x + a.w, b.x + b.w);
+    int32_t y2 = std::min(a.y + a.h, b.y + b.h);
+    out = {x1, y1, x2 - x1, y2 - y1};
+    return !IsRectEmpty(out);
+}
+
+inline IRect BoundingRect(const std::vector<IRect> &region)
+{
+    if (region.empty()) {
+        return {0, 0, 0, 0};
+    }
+    int32_t x1 = region[0].x;
+    int32_t y1 = region[0].y;
+    int32_t x2 = region[0].x + region[0].w;
+    int32_t y2 = region[0].y + region[0].h;
+    for (const auto &rect : region) {
+        x1 = std::min(x1, rect.x);
+        y1 = std::min(y1, rect.y);
+        x2 = std::max(x2, rect.x + rect.w);
+        y2 = std::max(y2, rect.y + rect.h);
+    }
+    return {x1, y1, x2 - x1, y2 - y1};
+}
+
+inline void AddRect(std::vector<IRect> &region, const IRect &rect)
+{
+    if (IsRectEmpty(rect)) {
+        return;
+    }
+    region.push_back(rect);
+    if (region.size() > MAX_REGION_RECTS) {
+        IRect bound = BoundingRect(region);
+        region.assign(1, bound);
+    }
+}
+
+// maps a rect inside from onto to, rounding outwards to whole pixels, from must not be empty
+inline IRect MapRect(const IRect &rect, const IRect &from, const IRect &to)
+{
+    int64_t x1 = static_cast<int64_t>(rect.x - from.x) * to.w / from.w;
+    int64_t y1 = static_cast<int64_t>(rect.y - from.y) * to.h / from.h;
+    int64_t x2 = (static_cast<int64_t>(rect.x + rect.w - from.x) * to.w + from.w - 1) / from.w;
+    int64_t y2 = (static_cast<int64_t>(rect.y + rect.h - from.y) * to.h + from.h - 1) / from.h;
+    return {static_cast<int32_t>(to.x + x1), static_cast<int32_t>(to.y + y1), static_cast<int32_t>(x2 - x1),
+        static_cast<int32_t>(y2 - y1)};
+}
+} // namespace OHOS
+} // namespace HDI
+} // namespace DISPLAY
+
+#endif // HDI_REGION_H
@@ -21,6 +21,7 @@
 #include "v1_0/display_composer_type.h"
 #include "hdf_trace.h"
 #include "hdi_netlink_monitor.h"
+#include "hdi_virtual_display.h"
 
 #define DISPLAY_TRACE HdfTrace trace(__func__, "HDI:DISP:")
 
@@ -40,6 +41,7 @@ void HdiSession::Init()
     DISPLAY_LOGI("HdiSession Init begin");
     mHdiDevices = HdiDeviceInterface::DiscoveryDevice();
     DISPLAY_LOGI("HdiSession Init devices size %{public}zu", mHdiDevices.size());
+    std::unique_lock<std::shared_mutex> lock(mMutex);
     mHdiDisplays.clear();
     for (auto device : mHdiDevices) {
         auto displays = device->DiscoveryDisplay();
@@ -52,18 +54,48 @@ void HdiSession::Init()
         }
         DISPLAY_LOGI("HdiSession Init discovered display batch size %{public}zu", displays.size());
     }
+    lock.unlock();
     mNetLinkMonitor = std::make_shared<HdiNetLinkMonitor>();
     mNetLinkMonitor->Init();
     DISPLAY_LOGI("HdiSession Init end total displays %{public}zu", mHdiDisplays.size());
 }
 
+std::shared_ptr<HdiDisplay> HdiSession::FindDisplay(uint32_t devId)
+{
+    DISPLAY_CHK_RETURN((devId == INVALIDE_DISPLAY_ID), nullptr, DISPLAY_LOGE("invalide device id"));
+    std::shared_lock<std::shared_mutex> lock(mMutex);
+    auto iter = mHdiDisplays.find(devId);
+    if (iter == mHdiDisplays.end()) {
+        return nullptr;
+    }
+    return iter->second;
+}
+
+std::vector<std::shared_ptr<HdiDisplay>> HdiSession::GetDisplays()
+{
+    std::shared_lock<std::shared_mutex> lock(mMutex);
+    std::vector<std::shared_ptr<HdiDisplay>> displays;
+    for (auto &displayMap : mHdiDisplays) {
+        displays.push_back(displayMap.second);
+    }
+    return displays;
+}
+
 void HdiSession::HandleHotplug(bool plugIn)
 {
-    DISPLAY_LOGI("HdiSession HandleHotplug plugIn=%{public}d displays=%{public}zu", plugIn, mHdiDisplays.size());
+    auto displays = GetDisplays();
+    DISPLAY_LOGI("HdiSession HandleHotplug plugIn=%{public}d displays=%{public}zu", plugIn, displays.size());
     for (auto device : mHdiDevices) {
-        for (auto displayMap : mHdiDisplays) {
-            auto display = displayMap.second;
-            auto isSuccess = device->HandleHotplug(display->GetId(), plugIn);
+        for (auto display : displays) {
+            if (display->IsVirtual()) {
+                continue;
+            }
+            bool isSuccess;
+            {
+                std::unique_lock<std::shared_mutex> lock(display->GetMutex());
+                isSuccess = device->HandleHotplug(display->GetId(), plugIn);
+            }
+            // the callback may query the display again, so it runs without the display lock
             if (isSuccess == true) {
                 DoHotPlugCallback(display->GetId(), plugIn);
             }
@@ -71,15 +103,58 @@ void HdiSession::HandleHotplug(bool plugIn)
     }
 }
 
+int32_t HdiSession::CreateVirtualDisplay(uint32_t width, uint32_t height, int32_t *format, uint32_t *devId)
+{
+    DISPLAY_CHK_RETURN(((format == nullptr) || (devId == nullptr)), DISPLAY_NULL_PTR,
+        DISPLAY_LOGE("format or devId is nullptr"));
+    DISPLAY_CHK_RETURN(((width == 0) || (height == 0)), DISPLAY_PARAM_ERR,
+        DISPLAY_LOGE("invalid size %{public}ux%{public}u", width, height));
+    std::unique_lock<std::shared_mutex> lock(mMutex);
+    uint32_t count = 0;
+    for (auto &displayMap : mHdiDisplays) {
+        count += displayMap.second->IsVirtual() ? 1 : 0;
+    }
+    DISPLAY_CHK_RETURN((count >= MAX_VIRTUAL_DISPLAY_COUNT), DISPLAY_FAILURE,
+        DISPLAY_LOGE("already %{public}u virtual displays", count));
+    auto display = std::make_shared<HdiVirtualDisplay>(width, height, HdiVirtualDisplay::ChooseFormat(*format));
+    int32_t ret = display->Init();
+    DISPLAY_CHK_RETURN((ret != DISPLAY_SUCCESS), DISPLAY_FAILURE, DISPLAY_LOGE("virtual display init failed"));
+    mHdiDisplays[display->GetId()] = display;
+    *format = display->GetFormat();
+    *devId = display->GetId();
+    return DISPLAY_SUCCESS;
+}
+
+int32_t HdiSession::DestroyVirtualDisplay(uint32_t devId)
+{
+    std::unique_lock<std::shared_mutex> lock(mMutex);
+    auto iter = mHdiDisplays.find(devId);
+    DISPLAY_CHK_RETURN((iter == mHdiDisplays.end()), DISPLAY_FAILURE,
+        DISPLAY_LOGE("can not find display %{public}u", devId));
+    DISPLAY_CHK_RETURN((!iter->second->IsVirtual()), DISPLAY_PARAM_ERR,
+        DISPLAY_LOGE("display %{public}u is not virtual", devId));
+    // the calls still running on it keep it alive until they return
+    mHdiDisplays.erase(iter);
+    return DISPLAY_SUCCESS;
+}
+
 int32_t HdiSession::RegHotPlugCallback(HotPlugCallback callback, void *data)
 {
     DISPLAY_CHK_RETURN((callback == nullptr), DISPLAY_NULL_PTR, DISPLAY_LOGE("the callback is nullptr"));
-    mHotPlugCallBacks.emplace(callback, data);
-    DISPLAY_LOGI("HdiSession RegHotPlugCallback callbacks=%{public}zu displays=%{public}zu",
-        mHotPlugCallBacks.size(), mHdiDisplays.size());
-    for (auto displayMap : mHdiDisplays) {
-        auto display = displayMap.second;
-        if (display->IsConnected()) {
+    auto displays = GetDisplays();
+    {
+        std::lock_guard<std::mutex> lock(mHotPlugMutex);
+        mHotPlugCallBacks.emplace(callback, data);
+        DISPLAY_LOGI("HdiSession RegHotPlugCallback callbacks=%{public}zu displays=%{public}zu",
+            mHotPlugCallBacks.size(), displays.size());
+    }
+    for (auto display : displays) {
+        bool connected;
+        {
+            std::shared_lock<std::shared_mutex> lock(display->GetMutex());
+            connected = display->IsConnected();
+        }
+        if (connected) {
             DoHotPlugCallback(display->GetId(), true);
         }
     }
@@ -88,9 +163,14 @@ int32_t HdiSession::RegHotPlugCallback(HotPlugCallback callback, void *data)
 
 void HdiSession::DoHotPlugCallback(uint32_t devId, bool connect)
 {
+    std::unordered_map<HotPlugCallback, void *> callBacks;
+    {
+        std::lock_guard<std::mutex> lock(mHotPlugMutex);
+        callBacks = mHotPlugCallBacks;
+    }
     DISPLAY_LOGI("HdiSession DoHotPlugCallback devId=%{public}u connect=%{public}d cbCount=%{public}zu",
-        devId, connect, mHotPlugCallBacks.size());
-    for (const auto &callback : mHotPlugCallBacks) {
+        devId, connect, callBacks.size());
+    for (const auto &callback : callBacks) {
         callback.first(devId, connect, callback.second);
     }
 }
@@ -192,7 +272,7 @@ static int32_t SetDisplayClientCrop(uint32_t devId, IRect *rect)
 {
     DISPLAY_LOGD();
     DISPLAY_CHK_RETURN((rect == nullptr), DISPLAY_NULL_PTR, DISPLAY_LOGE("rect is nullptr"));
-    return DISPLAY_NOT_SUPPORT;
+    return HdiSession::GetInstance().CallDisplayFunction(devId, &HdiDisplay::SetDisplayClientCrop, rect);
 }
 
 static int32_t SetDisplayClientDestRect(uint32_t devId, IRect *rect)
@@ -211,9 +291,8 @@ static int32_t SetDisplayClientBuffer(uint32_t devId, const BufferHandle *buffer
 static int32_t SetDisplayClientDamage(uint32_t devId, uint32_t num, IRect *rect)
 {
     DISPLAY_LOGD();
-    (void)num;
     DISPLAY_CHK_RETURN((rect == nullptr), DISPLAY_NULL_PTR, DISPLAY_LOGE("rect is nullptr"));
-    return DISPLAY_NOT_SUPPORT;
+    return HdiSession::GetInstance().CallDisplayFunction(devId, &HdiDisplay::SetDisplayClientDamage, num, rect);
 }
 
 static int32_t SetDisplayVsyncEnabled(uint32_t devId, bool enabled)
@@ -245,17 +324,20 @@ static int32_t Commit(uint32_t devId, int32_t *fence)
 static int32_t CreateVirtualDisplay(uint32_t width, uint32_t height, int32_t *format, uint32_t *devId)
 {
     DISPLAY_LOGD();
-    return DISPLAY_NOT_SUPPORT;
+    return HdiSession::GetInstance().CreateVirtualDisplay(width, height, format, devId);
 }
 static int32_t DestroyVirtualDisplay(uint32_t devId)
 {
     DISPLAY_LOGD();
-    return DISPLAY_NOT_SUPPORT;
+    return HdiSession::GetInstance().DestroyVirtualDisplay(devId);
 }
 static int32_t SetVirtualDisplayBuffer(uint32_t devId, BufferHandle *buffer, int32_t releaseFence)
 {
     DISPLAY_LOGD();
-    return DISPLAY_NOT_SUPPORT;
+    DISPLAY_CHK_RETURN((buffer == nullptr), DISPLAY_NULL_PTR, DISPLAY_LOGE("buffer is nullptr"));
+    const BufferHandle *outBuffer = buffer;
+    return HdiSession::GetInstance().CallDisplayFunction(devId, &HdiDisplay::SetVirtualDisplayBuffer, outBuffer,
+        releaseFence);
 }
 
 
@@ -316,7 +398,8 @@ static int32_t SetLayerDirtyRegion(uint32_t devId, uint32_t layerId, IRect *regi
 {
     DISPLAY_LOGD();
     DISPLAY_CHK_RETURN((region == nullptr), DISPLAY_NULL_PTR, DISPLAY_LOGE("region is nullptr"));
-    return HdiSession::GetInstance().CallLayerFunction(devId, layerId, &HdiLayer::SetLayerDirtyRegion, region);
+    uint32_t num = 1;
+    return HdiSession::GetInstance().CallLayerFunction(devId, layerId, &HdiLayer::SetLayerDirtyRegion, num, region);
 }
 
 static int32_t SetLayerVisibleRegion(uint32_t devId, uint32_t layerId, uint32_t num, IRect *rect)
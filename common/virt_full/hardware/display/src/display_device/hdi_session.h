@@ -25,6 +25,7 @@
 #include "hdi_netlink_monitor.h"
 #include "v1_0/display_composer_type.h"
 #include <mutex>
+#include <shared_mutex>
 
 namespace OHOS {
 namespace HDI {
@@ -38,41 +39,64 @@ public:
     int32_t CallDisplayFunction(uint32_t devId, int32_t (HdiDisplay::*member)(Args...), Args... args)
     {
         DISPLAY_LOGD("device Id : %{public}d", devId);
-        DISPLAY_CHK_RETURN((devId == INVALIDE_DISPLAY_ID), DISPLAY_FAILURE, DISPLAY_LOGE("invalide device id"));
-        std::lock_guard<std::mutex> lock(mMutex);
-        auto iter = mHdiDisplays.find(devId);
-        DISPLAY_CHK_RETURN((iter == mHdiDisplays.end()), DISPLAY_FAILURE,
+        auto display = FindDisplay(devId);
+        DISPLAY_CHK_RETURN((display == nullptr), DISPLAY_FAILURE,
             DISPLAY_LOGE("can not find display %{public}d", devId));
-        auto display = iter->second.get();
-        return (display->*member)(std::forward<Args>(args)...);
+        std::unique_lock<std::shared_mutex> lock(display->GetMutex());
+        return (display.get()->*member)(std::forward<Args>(args)...);
+    }
+
+    // for the calls that only read the display, they run concurrently with each other
+    template<typename... Args>
+    int32_t QueryDisplayFunction(uint32_t devId, int32_t (HdiDisplay::*member)(Args...), Args... args)
+    {
+        return QueryDisplay(devId, [&](HdiDisplay &display) {
+            return (display.*member)(std::forward<Args>(args)...);
+        });
+    }
+
+    // runs several reads of one display under the same lock, e.g. a count followed by the fill
+    template<typename Func>
+    int32_t QueryDisplay(uint32_t devId, Func func)
+    {
+        DISPLAY_LOGD("device Id : %{public}d", devId);
+        auto display = FindDisplay(devId);
+        DISPLAY_CHK_RETURN((display == nullptr), DISPLAY_FAILURE,
+            DISPLAY_LOGE("can not find display %{public}d", devId));
+        std::shared_lock<std::shared_mutex> lock(display->GetMutex());
+        return func(*display);
     }
 
     template<typename... Args>
     int32_t CallLayerFunction(uint32_t devId, uint32_t layerId, int32_t (HdiLayer::*member)(Args...), Args... args)
     {
         DISPLAY_LOGD("device Id : %{public}d", devId);
-        DISPLAY_CHK_RETURN((devId == INVALIDE_DISPLAY_ID), DISPLAY_FAILURE, DISPLAY_LOGE("invalide device id"));
-        std::lock_guard<std::mutex> lock(mMutex);
-        auto iter = mHdiDisplays.find(devId);
-        DISPLAY_CHK_RETURN((iter == mHdiDisplays.end()), DISPLAY_FAILURE,
+        auto display = FindDisplay(devId);
+        DISPLAY_CHK_RETURN((display == nullptr), DISPLAY_FAILURE,
             DISPLAY_LOGE("can not find display %{public}d", devId));
-        auto display = iter->second.get();
+        std::unique_lock<std::shared_mutex> lock(display->GetMutex());
         auto layer = display->GetHdiLayer(layerId);
         DISPLAY_CHK_RETURN((layer == nullptr), DISPLAY_FAILURE,
             DISPLAY_LOGE("can not find the layer %{public}d", layerId));
         return (layer->*member)(std::forward<Args>(args)...);
     }
 
+    int32_t CreateVirtualDisplay(uint32_t width, uint32_t height, int32_t *format, uint32_t *devId);
+    int32_t DestroyVirtualDisplay(uint32_t devId);
     int32_t RegHotPlugCallback(HotPlugCallback callback, void *data);
     void DoHotPlugCallback(uint32_t devId, bool connect);
     void HandleHotplug(bool plugIn);
 
 private:
+    std::shared_ptr<HdiDisplay> FindDisplay(uint32_t devId);
+    std::vector<std::shared_ptr<HdiDisplay>> GetDisplays();
     std::shared_ptr<HdiNetLinkMonitor> mNetLinkMonitor;
     std::unordered_map<uint32_t, std::shared_ptr<HdiDisplay>> mHdiDisplays;
     std::vector<std::shared_ptr<HdiDeviceInterface>> mHdiDevices;
     std::unordered_map<HotPlugCallback, void *> mHotPlugCallBacks;
-    std::mutex mMutex;
+    // guards the display table only, every display has its own lock
+    std::shared_mutex mMutex;
+    std::mutex mHotPlugMutex;
 };
 } // namespace OHOS
 } // namespace HDI
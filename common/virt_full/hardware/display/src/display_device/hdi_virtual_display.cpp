@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2023 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hdi_virtual_display.h"
+#include <cerrno>
+#include "display_log.h"
+
+namespace OHOS {
+namespace HDI {
+namespace DISPLAY {
+HdiVirtualDisplay::HdiVirtualDisplay(uint32_t width, uint32_t height, PixelFormat format)
+    : mWidth(width), mHeight(height), mFormat(format)
+{}
+
+PixelFormat HdiVirtualDisplay::ChooseFormat(int32_t format)
+{
+    switch (format) {
+        case PIXEL_FMT_RGBA_8888:
+        case PIXEL_FMT_RGBX_8888:
+        case PIXEL_FMT_BGRA_8888:
+        case PIXEL_FMT_BGRX_8888:
+        case PIXEL_FMT_RGB_565:
+            return static_cast<PixelFormat>(format);
+        default:
+            return PIXEL_FMT_RGBA_8888;
+    }
+}
+
+int32_t HdiVirtualDisplay::Init()
+{
+    int32_t ret = HdiDisplay::Init();
+    DISPLAY_CHK_RETURN((ret != DISPLAY_SUCCESS), DISPLAY_FAILURE, DISPLAY_LOGE("init failed"));
+    auto preComp = std::make_unique<HdiWritebackComposition>();
+    DISPLAY_CHK_RETURN((preComp == nullptr), DISPLAY_FAILURE,
+        DISPLAY_LOGE("can not new HdiWritebackComposition errno %{public}d", errno));
+    ret = preComp->Init();
+    DISPLAY_CHK_RETURN((ret != DISPLAY_SUCCESS), DISPLAY_FAILURE,
+        DISPLAY_LOGE("can not init HdiWritebackComposition"));
+    mWriteback = preComp.get();
+    // there are no planes, the base composition takes no layers and applies nothing
+    mComposer = std::make_unique<HdiComposer>(std::move(preComp), std::make_unique<HdiComposition>());
+    DISPLAY_LOGI("virtual display %{public}u %{public}ux%{public}u format %{public}d", GetId(), mWidth, mHeight,
+        mFormat);
+    return DISPLAY_SUCCESS;
+}
+
+int32_t HdiVirtualDisplay::GetDisplayCapability(DisplayCapability *info)
+{
+    DISPLAY_CHK_RETURN((info == nullptr), DISPLAY_NULL_PTR, DISPLAY_LOGE("info is nullptr"));
+    info->name = "Virtual";
+    info->type = DISP_INTF_BUTT;
+    info->phyWidth = 0;
+    info->phyHeight = 0;
+    info->supportLayers = 0;
+    info->virtualDispCount = 0;
+    info->supportWriteBack = true;
+    info->propertyCount = 0;
+    return DISPLAY_SUCCESS;
+}
+
+int32_t HdiVirtualDisplay::GetDisplaySupportedModes(uint32_t *num, DisplayModeInfo *modes)
+{
+    DISPLAY_CHK_RETURN((num == nullptr), DISPLAY_NULL_PTR, DISPLAY_LOGE("num is nullptr"));
+    if (modes == nullptr) {
+        *num = 1;
+        return DISPLAY_SUCCESS;
+    }
+    DISPLAY_CHK_RETURN((*num < 1), DISPLAY_PARAM_ERR, DISPLAY_LOGE("no room for the mode"));
+    *num = 1;
+    modes[0] = {static_cast<int32_t>(mWidth), static_cast<int32_t>(mHeight), VIRTUAL_DISPLAY_FRESH_RATE, 0};
+    return DISPLAY_SUCCESS;
+}
+
+int32_t HdiVirtualDisplay::GetDisplayMode(uint32_t *modeId)
+{
+    DISPLAY_CHK_RETURN((modeId == nullptr), DISPLAY_NULL_PTR, DISPLAY_LOGE("the in modeId is nullptr"));
+    *modeId = 0;
+    return DISPLAY_SUCCESS;
+}
+
+int32_t HdiVirtualDisplay::SetDisplayMode(uint32_t modeId)
+{
+    DISPLAY_CHK_RETURN((modeId != 0), DISPLAY_PARAM_ERR, DISPLAY_LOGE("unknown mode %{public}u", modeId));
+    return DISPLAY_SUCCESS;
+}
+
+int32_t HdiVirtualDisplay::GetDisplayPowerStatus(DispPowerStatus *status)
+{
+    DISPLAY_CHK_RETURN((status == nullptr), DISPLAY_NULL_PTR, DISPLAY_LOGE("status is nullptr"));
+    *status = mPowerStatus;
+    return DISPLAY_SUCCESS;
+}
+
+int32_t HdiVirtualDisplay::SetDisplayPowerStatus(DispPowerStatus status)
+{
+    DISPLAY_LOGD("the status %{public}d ", status);
+    mPowerStatus = status;
+    return DISPLAY_SUCCESS;
+}
+
+int32_t HdiVirtualDisplay::SetVirtualDisplayBuffer(const BufferHandle *buffer, int32_t fence)
+{
+    DISPLAY_CHK_RETURN((buffer == nullptr), DISPLAY_NULL_PTR, DISPLAY_LOGE("buffer is nullptr"));
+    DISPLAY_CHK_RETURN((buffer->width < 0) || (static_cast<uint32_t>(buffer->width) < mWidth) ||
+        (buffer->height < 0) || (static_cast<uint32_t>(buffer->height) < mHeight), DISPLAY_PARAM_ERR,
+        DISPLAY_LOGE("the buffer %{public}dx%{public}d is smaller than the display", buffer->width, buffer->height));
+    return mWriteback->SetOutputBuffer(buffer, fence);
+}
+} // namespace OHOS
+} // namespace HDI
+} // namespace DISPLAY
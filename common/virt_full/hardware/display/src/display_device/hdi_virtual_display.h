@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2023 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HDI_VIRTUAL_DISPLAY_H
+#define HDI_VIRTUAL_DISPLAY_H
+#include "hdi_display.h"
+#include "hdi_writeback_composition.h"
+
+namespace OHOS {
+namespace HDI {
+namespace DISPLAY {
+const uint32_t VIRTUAL_DISPLAY_FRESH_RATE = 60;
+
+// a display without an output device, every commit is written into the buffer set by SetVirtualDisplayBuffer
+class HdiVirtualDisplay : public HdiDisplay {
+public:
+    HdiVirtualDisplay(uint32_t width, uint32_t height, PixelFormat format);
+    ~HdiVirtualDisplay() override {}
+    // the output formats the gfx composition can write, others fall back to RGBA_8888
+    static PixelFormat ChooseFormat(int32_t format);
+    int32_t Init() override;
+    int32_t GetDisplayCapability(DisplayCapability *info) override;
+    int32_t GetDisplaySupportedModes(uint32_t *num, DisplayModeInfo *modes) override;
+    int32_t GetDisplayMode(uint32_t *modeId) override;
+    int32_t SetDisplayMode(uint32_t modeId) override;
+    int32_t GetDisplayPowerStatus(DispPowerStatus *status) override;
+    int32_t SetDisplayPowerStatus(DispPowerStatus status) override;
+    int32_t SetVirtualDisplayBuffer(const BufferHandle *buffer, int32_t fence) override;
+    bool IsVirtual() const override
+    {
+        return true;
+    }
+    PixelFormat GetFormat() const
+    {
+        return mFormat;
+    }
+
+private:
+    uint32_t mWidth;
+    uint32_t mHeight;
+    PixelFormat mFormat;
+    DispPowerStatus mPowerStatus = POWER_STATUS_ON;
+    HdiWritebackComposition *mWriteback = nullptr; // owned by mComposer
+};
+} // namespace OHOS
+} // namespace HDI
+} // namespace DISPLAY
+
+#endif // HDI_VIRTUAL_DISPLAY_H
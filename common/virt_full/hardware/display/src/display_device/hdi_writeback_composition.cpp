@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2023 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hdi_writeback_composition.h"
+#include <algorithm>
+#include "display_log.h"
+#include "hitrace_meter.h"
+
+namespace OHOS {
+namespace HDI {
+namespace DISPLAY {
+int32_t HdiWritebackComposition::Init(void)
+{
+    DISPLAY_LOGD();
+    int32_t ret = HdiGfxComposition::Init();
+    DISPLAY_CHK_RETURN((ret != DISPLAY_SUCCESS), DISPLAY_FAILURE, DISPLAY_LOGE("gfx composition init failed"));
+    auto layer = std::make_unique<HdiLayer>(LAYER_TYPE_GRAPHIC);
+    ret = layer->Init();
+    DISPLAY_CHK_RETURN((ret != DISPLAY_SUCCESS), DISPLAY_FAILURE, DISPLAY_LOGE("output layer init failed"));
+    mOutputLayer = std::move(layer);
+    return DISPLAY_SUCCESS;
+}
+
+int32_t HdiWritebackComposition::SetOutputBuffer(const BufferHandle *buffer, int32_t fence)
+{
+    DISPLAY_CHK_RETURN((buffer == nullptr), DISPLAY_NULL_PTR, DISPLAY_LOGE("buffer is nullptr"));
+    int32_t ret = mOutputLayer->SetLayerBuffer(buffer, fence);
+    DISPLAY_CHK_RETURN((ret != DISPLAY_SUCCESS), DISPLAY_FAILURE, DISPLAY_LOGE("set the output buffer failed"));
+    IRect rect = {0, 0, buffer->width, buffer->height};
+    return mOutputLayer->SetLayerRegion(&rect);
+}
+
+bool HdiWritebackComposition::HasClientLayers() const
+{
+    if ((mClientLayer == nullptr) || (mClientLayer->GetCurrentBuffer() == nullptr)) {
+        return false;
+    }
+    return std::any_of(mCompLayers.begin(), mCompLayers.end(),
+        [](HdiLayer *layer) { return layer->GetCompositionType() == COMPOSITION_CLIENT; });
+}
+
+int32_t HdiWritebackComposition::Apply(bool modeSet)
+{
+    HdiLayerBuffer *output = mOutputLayer->GetCurrentBuffer();
+    DISPLAY_CHK_RETURN((output == nullptr), DISPLAY_FAILURE, DISPLAY_LOGE("the output buffer is not set"));
+    StartTrace(HITRACE_TAG_HDF, "HDI:DISP:Writeback");
+    // the consumer of the output may still be reading it
+    mOutputLayer->WaitAcquireFence();
+    IRect area = GetComposeArea(*mOutputLayer);
+    DISPLAY_LOGD("writeback area x: %{public}d y : %{public}d w : %{public}d h : %{public}d", area.x, area.y,
+        area.w, area.h);
+    // the client buffer belongs to the render service, it is only read as the bottom of the output
+    int32_t ret = HasClientLayers() ? BlitLayer(*mClientLayer, *mOutputLayer, area) : ClearRect(area, *mOutputLayer);
+    if (ret == DISPLAY_SUCCESS) {
+        ret = ComposeLayers(*mOutputLayer, area);
+    }
+    FinishTrace(HITRACE_TAG_HDF);
+    DISPLAY_CHK_RETURN((ret != DISPLAY_SUCCESS), DISPLAY_FAILURE, DISPLAY_LOGE("compose the output failed"));
+    return DISPLAY_SUCCESS;
+}
+} // namespace OHOS
+} // namespace HDI
+} // namespace DISPLAY
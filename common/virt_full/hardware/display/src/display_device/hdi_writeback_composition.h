@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2023 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HDI_WRITEBACK_COMPOSITION_H
+#define HDI_WRITEBACK_COMPOSITION_H
+#include <memory>
+#include "hdi_gfx_composition.h"
+
+namespace OHOS {
+namespace HDI {
+namespace DISPLAY {
+// composes the client buffer and the device layers into a caller supplied output buffer
+class HdiWritebackComposition : public HdiGfxComposition {
+public:
+    int32_t Init(void) override;
+    int32_t Apply(bool modeSet) override;
+    int32_t SetOutputBuffer(const BufferHandle *buffer, int32_t fence);
+
+private:
+    bool HasClientLayers() const;
+    std::unique_ptr<HdiLayer> mOutputLayer;
+};
+} // namespace OHOS
+} // namespace HDI
+} // namespace DISPLAY
+
+#endif // HDI_WRITEBACK_COMPOSITION_H
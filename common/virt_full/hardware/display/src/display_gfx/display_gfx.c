@@ -1,73 +1,1012 @@
-/*
- * Copyright (c) 2022 Unionman Co., Ltd.
- * Licensed under the Apache License, Version 2.0 (the "License");
- * you may not use this file except in compliance with the License.
- * You may obtain a copy of the License at
- *
- *     http://www.apache.org/licenses/LICENSE-2.0
- *
- * Unless required by applicable law or agreed to in writing, software
- * distributed under the License is distributed on an "AS IS" BASIS,
- * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
- * See the License for the specific language governing permissions and
- * limitations under the License.
- */
-
-#include <stdio.h>
-#include <string.h>
-#include <sys/mman.h>
-#include "display_gralloc.h"
-#include "securec.h"
-#include "display_gfx.h"
-
-GrallocFuncs *grallocFucs = NULL;
-int32_t InitGfx()
-{
-    return DISPLAY_SUCCESS;
-}
-
-int32_t DeinitGfx()
-{
-    return DISPLAY_SUCCESS;
-}
-
-int32_t FillRect(ISurface *iSurface, IRect *rect, uint32_t color, GfxOpt *opt)
-{
-    return DISPLAY_SUCCESS;
-}
-
-int32_t Blit(ISurface *srcSurface, IRect *srcRect, ISurface *dstSurface, IRect *dstRect, GfxOpt *opt)
-{
-    return DISPLAY_SUCCESS;
-}
-
-int32_t Sync(int32_t timeOut)
-{
-    return DISPLAY_SUCCESS;
-}
-
-int32_t GfxInitialize(GfxFuncs **funcs)
-{
-    GfxFuncs *gfxFuncs = (GfxFuncs *)malloc(sizeof(GfxFuncs));
-
-    errno_t eok = memset_s((void *)gfxFuncs, sizeof(GfxFuncs), 0, sizeof(GfxFuncs));
-    if (eok != EOK) {
-        free(gfxFuncs);
-        return DISPLAY_FAILURE;
-    }
-    gfxFuncs->InitGfx = InitGfx;
-    gfxFuncs->DeinitGfx = DeinitGfx;
-    gfxFuncs->FillRect = FillRect;
-    gfxFuncs->Blit = Blit;
-    gfxFuncs->Sync = Sync;
-    *funcs = gfxFuncs;
-
-    return DISPLAY_SUCCESS;
-}
-
-int32_t GfxUninitialize(GfxFuncs *funcs)
-{
-    free(funcs);
-    //DISPLAY_DEBUGLOG("%s: gfx uninitialize success", __func__);
-    return DISPLAY_SUCCESS;
-}
+/*
+ * Copyright (c) 2022 Unionman Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Software 2D engine for GPU-less guests. Surfaces come in as dma-buf fds
+ * (ISurface.phyAddr), are mapped for the duration of one operation, and the
+ * work is split into row bands shared by a small worker pool and the caller.
+ * Every operation is complete when FillRect/Blit return, so Sync has nothing
+ * left to wait for.
+ *
+ * Pixels are converted to RGBA_8888 byte order on the way in when source and
+ * destination formats differ; identical 32-bit formats are blended in place.
+ * Blend modes: BLEND_NONE/BLEND_SRC copy, BLEND_SRCOVER premultiplied
+ * source-over, BLEND_AKS coverage (straight alpha) source-over, BLEND_CLEAR,
+ * BLEND_DST. FillRect colors are 0xAARRGGBB.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/dma-buf.h>
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define GFX_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define GFX_SSE2
+#endif
+#include "display_gralloc.h"
+#include "hdf_log.h"
+#include "securec.h"
+#include "display_gfx.h"
+
+#define GFX_MAX_THREADS         4
+#define GFX_BAND_ROWS           32
+#define GFX_PARALLEL_PIXELS     (128 * 128)     /* below this the caller does it alone */
+#define GFX_FIXED_SHIFT         16
+#define GFX_FIXED_HALF          (1 << (GFX_FIXED_SHIFT - 1))
+#define GFX_ALPHA_MASK          0xFF000000U
+#define GFX_OPAQUE              0xFF
+
+enum GfxBlend {
+    GFX_BLEND_COPY,
+    GFX_BLEND_PREMUL,
+    GFX_BLEND_COVERAGE,
+};
+
+typedef struct {
+    uint8_t *base;
+    size_t size;
+    int fd;
+    uint8_t *uv;                /* chroma plane of semi-planar YUV */
+    int32_t uvStride;
+} GfxMap;
+
+typedef struct GfxJob GfxJob;
+typedef void (*GfxBandFunc)(const GfxJob *job, int32_t y0, int32_t y1);
+
+struct GfxJob {
+    GfxBandFunc func;
+    IRect clip;                 /* destination area actually touched */
+    uint8_t *dst;
+    int32_t dstStride;
+    PixelFormat dstFmt;
+    uint32_t color;             /* FillRect, already in destination format */
+    const GfxMap *src;
+    int32_t srcStride;
+    PixelFormat srcFmt;
+    IRect srcRect;              /* sampled area, clamped to the source surface */
+    IRect mapSrc;               /* srcRect -> dstRect mapping, unclipped */
+    IRect mapDst;
+    TransformType rotate;
+    enum GfxBlend blend;
+    uint8_t globalAlpha;
+};
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    pthread_mutex_t submit;     /* one operation in flight */
+    pthread_t threads[GFX_MAX_THREADS];
+    int32_t threadNum;
+    bool exit;
+    uint32_t generation;
+    const GfxJob *job;
+    int32_t bandNum;
+    int32_t nextBand;
+    int32_t bandsDone;
+} g_gfxPool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .start = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+    .submit = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static __thread uint32_t *g_scratch = NULL;
+static __thread size_t g_scratchPixels = 0;
+
+GrallocFuncs *grallocFucs = NULL;
+
+/*
+ * Pixel helpers, all on RGBA_8888 byte order (R in the lowest byte).
+ */
+
+static inline uint32_t Div255(uint32_t x)
+{
+    return (x + 128 + ((x + 128) >> 8)) >> 8; /* 128: rounding, exact for x <= 255 * 255 */
+}
+
+static inline uint32_t SwapRB(uint32_t p)
+{
+    return (p & 0xFF00FF00U) | ((p & 0xFFU) << 16) | ((p >> 16) & 0xFFU);
+}
+
+static inline uint32_t ScaleAlpha(uint32_t p, uint32_t a)
+{
+    return Div255((p & 0xFF) * a) | (Div255(((p >> 8) & 0xFF) * a) << 8) |
+        (Div255(((p >> 16) & 0xFF) * a) << 16) | (Div255((p >> 24) * a) << 24);
+}
+
+static inline uint32_t BlendPremulPixel(uint32_t d, uint32_t s)
+{
+    uint32_t inv = GFX_OPAQUE - (s >> 24);
+    uint32_t r = (s & 0xFF) + Div255((d & 0xFF) * inv);
+    uint32_t g = ((s >> 8) & 0xFF) + Div255(((d >> 8) & 0xFF) * inv);
+    uint32_t b = ((s >> 16) & 0xFF) + Div255(((d >> 16) & 0xFF) * inv);
+    uint32_t a = (s >> 24) + Div255((d >> 24) * inv);
+
+    r = (r > GFX_OPAQUE) ? GFX_OPAQUE : r;
+    g = (g > GFX_OPAQUE) ? GFX_OPAQUE : g;
+    b = (b > GFX_OPAQUE) ? GFX_OPAQUE : b;
+    return r | (g << 8) | (b << 16) | (a << 24);
+}
+
+static inline uint32_t BlendCoveragePixel(uint32_t d, uint32_t s, uint32_t sa)
+{
+    uint32_t inv = GFX_OPAQUE - sa;
+    uint32_t r = Div255((s & 0xFF) * sa + (d & 0xFF) * inv);
+    uint32_t g = Div255(((s >> 8) & 0xFF) * sa + ((d >> 8) & 0xFF) * inv);
+    uint32_t b = Div255(((s >> 16) & 0xFF) * sa + ((d >> 16) & 0xFF) * inv);
+    uint32_t a = Div255(GFX_OPAQUE * sa + (d >> 24) * inv);
+
+    return r | (g << 8) | (b << 16) | (a << 24);
+}
+
+static inline uint32_t LerpPixel(uint32_t a, uint32_t b, uint32_t w)
+{
+    uint32_t rb = ((a & 0x00FF00FFU) * (256 - w) + (b & 0x00FF00FFU) * w) >> 8; /* 256: weight scale */
+    uint32_t ag = ((a >> 8) & 0x00FF00FFU) * (256 - w) + ((b >> 8) & 0x00FF00FFU) * w;
+
+    return (rb & 0x00FF00FFU) | (ag & 0xFF00FF00U);
+}
+
+static void Fill32(uint32_t *dst, uint32_t color, int32_t n)
+{
+    int32_t i = 0;
+#if defined(GFX_NEON)
+    uint32x4_t c = vdupq_n_u32(color);
+    for (; i + 8 <= n; i += 8) {
+        vst1q_u32(dst + i, c);
+        vst1q_u32(dst + i + 4, c);
+    }
+#elif defined(GFX_SSE2)
+    __m128i c = _mm_set1_epi32((int32_t)color);
+    for (; i + 8 <= n; i += 8) {
+        _mm_storeu_si128((__m128i *)(dst + i), c);
+        _mm_storeu_si128((__m128i *)(dst + i + 4), c);
+    }
+#endif
+    for (; i < n; i++) {
+        dst[i] = color;
+    }
+}
+
+static void Fill16(uint16_t *dst, uint16_t color, int32_t n)
+{
+    int32_t i;
+
+    for (i = 0; i < n; i++) {
+        dst[i] = color;
+    }
+}
+
+/* R/B swap with optional forced alpha, also used as plain alpha fill when swap is false */
+static void CopyRow32(uint32_t *dst, const uint32_t *src, int32_t n, bool swap, uint32_t alpha)
+{
+    int32_t i = 0;
+
+    if (!swap && (alpha == 0)) {
+        (void)memcpy_s(dst, n * sizeof(uint32_t), src, n * sizeof(uint32_t));
+        return;
+    }
+#if defined(GFX_NEON)
+    for (; i + 16 <= n; i += 16) {
+        uint8x16x4_t p = vld4q_u8((const uint8_t *)(src + i));
+        if (swap) {
+            uint8x16_t t = p.val[0];
+            p.val[0] = p.val[2];
+            p.val[2] = t;
+        }
+        if (alpha != 0) {
+            p.val[3] = vdupq_n_u8(GFX_OPAQUE);
+        }
+        vst4q_u8((uint8_t *)(dst + i), p);
+    }
+#elif defined(GFX_SSE2)
+    __m128i agMask = _mm_set1_epi32((int32_t)0xFF00FF00U);
+    __m128i rbMask = _mm_set1_epi32(0x00FF00FF);
+    __m128i aMask = _mm_set1_epi32((int32_t)alpha);
+    for (; i + 4 <= n; i += 4) {
+        __m128i p = _mm_loadu_si128((const __m128i *)(src + i));
+        if (swap) {
+            __m128i rb = _mm_and_si128(p, rbMask);
+            rb = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+            p = _mm_or_si128(_mm_and_si128(p, agMask), rb);
+        }
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(p, aMask));
+    }
+#endif
+    for (; i < n; i++) {
+        dst[i] = (swap ? SwapRB(src[i]) : src[i]) | alpha;
+    }
+}
+
+static void BlendRowPremul(uint32_t *dst, const uint32_t *src, int32_t n, uint32_t ga)
+{
+    int32_t i = 0;
+#if defined(GFX_NEON)
+    uint8x8_t g = vdup_n_u8((uint8_t)ga);
+    for (; i + 8 <= n; i += 8) {
+        uint8x8x4_t s = vld4_u8((const uint8_t *)(src + i));
+        uint8x8x4_t d = vld4_u8((const uint8_t *)(dst + i));
+        int c;
+        if (ga != GFX_OPAQUE) {
+            for (c = 0; c < 4; c++) { /* 4: channels */
+                uint16x8_t t = vmull_u8(s.val[c], g);
+                s.val[c] = vraddhn_u16(t, vrshrq_n_u16(t, 8));
+            }
+        }
+        uint8x8_t inv = vmvn_u8(s.val[3]);
+        for (c = 0; c < 4; c++) { /* 4: channels */
+            uint16x8_t t = vmull_u8(d.val[c], inv);
+            d.val[c] = vqadd_u8(s.val[c], vraddhn_u16(t, vrshrq_n_u16(t, 8)));
+        }
+        vst4_u8((uint8_t *)(dst + i), d);
+    }
+#elif defined(GFX_SSE2)
+    __m128i zero = _mm_setzero_si128();
+    __m128i c128 = _mm_set1_epi16(128);
+    __m128i c255 = _mm_set1_epi16(GFX_OPAQUE);
+    __m128i g = _mm_set1_epi16((int16_t)ga);
+    for (; i + 4 <= n; i += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i half[2] = { _mm_unpacklo_epi8(s, zero), _mm_unpackhi_epi8(s, zero) };
+        __m128i dh[2] = { _mm_unpacklo_epi8(d, zero), _mm_unpackhi_epi8(d, zero) };
+        int h;
+        for (h = 0; h < 2; h++) { /* 2: two pixels per 128-bit half */
+            __m128i t;
+            if (ga != GFX_OPAQUE) {
+                t = _mm_add_epi16(_mm_mullo_epi16(half[h], g), c128);
+                half[h] = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+            }
+            __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(half[h], 0xFF), 0xFF);
+            t = _mm_add_epi16(_mm_mullo_epi16(dh[h], _mm_sub_epi16(c255, a)), c128);
+            dh[h] = _mm_add_epi16(half[h], _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8));
+        }
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(dh[0], dh[1]));
+    }
+#endif
+    for (; i < n; i++) {
+        dst[i] = BlendPremulPixel(dst[i], (ga == GFX_OPAQUE) ? src[i] : ScaleAlpha(src[i], ga));
+    }
+}
+
+static void BlendRowCoverage(uint32_t *dst, const uint32_t *src, int32_t n, uint32_t ga)
+{
+    int32_t i = 0;
+#if defined(GFX_NEON)
+    uint8x8_t g = vdup_n_u8((uint8_t)ga);
+    for (; i + 8 <= n; i += 8) {
+        uint8x8x4_t s = vld4_u8((const uint8_t *)(src + i));
+        uint8x8x4_t d = vld4_u8((const uint8_t *)(dst + i));
+        uint8x8_t sa = s.val[3];
+        int c;
+        if (ga != GFX_OPAQUE) {
+            uint16x8_t t = vmull_u8(sa, g);
+            sa = vraddhn_u16(t, vrshrq_n_u16(t, 8));
+        }
+        uint8x8_t inv = vmvn_u8(sa);
+        s.val[3] = vdup_n_u8(GFX_OPAQUE);
+        for (c = 0; c < 4; c++) { /* 4: channels */
+            uint16x8_t t = vmlal_u8(vmull_u8(s.val[c], sa), d.val[c], inv);
+            d.val[c] = vraddhn_u16(t, vrshrq_n_u16(t, 8));
+        }
+        vst4_u8((uint8_t *)(dst + i), d);
+    }
+#elif defined(GFX_SSE2)
+    __m128i zero = _mm_setzero_si128();
+    __m128i c128 = _mm_set1_epi16(128);
+    __m128i c255 = _mm_set1_epi16(GFX_OPAQUE);
+    __m128i g = _mm_set1_epi16((int16_t)ga);
+    __m128i opaque = _mm_set1_epi32((int32_t)GFX_ALPHA_MASK);
+    for (; i + 4 <= n; i += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i sh[2] = { _mm_unpacklo_epi8(s, zero), _mm_unpackhi_epi8(s, zero) };
+        __m128i so = _mm_or_si128(s, opaque);
+        __m128i soh[2] = { _mm_unpacklo_epi8(so, zero), _mm_unpackhi_epi8(so, zero) };
+        __m128i dh[2] = { _mm_unpacklo_epi8(d, zero), _mm_unpackhi_epi8(d, zero) };
+        int h;
+        for (h = 0; h < 2; h++) { /* 2: two pixels per 128-bit half */
+            __m128i t;
+            __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(sh[h], 0xFF), 0xFF);
+            if (ga != GFX_OPAQUE) {
+                t = _mm_add_epi16(_mm_mullo_epi16(a, g), c128);
+                a = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+            }
+            t = _mm_add_epi16(_mm_mullo_epi16(soh[h], a), _mm_mullo_epi16(dh[h], _mm_sub_epi16(c255, a)));
+            t = _mm_add_epi16(t, c128);
+            dh[h] = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+        }
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(dh[0], dh[1]));
+    }
+#endif
+    for (; i < n; i++) {
+        dst[i] = BlendCoveragePixel(dst[i], src[i], Div255((src[i] >> 24) * ga));
+    }
+}
+
+/*
+ * Format conversion
+ */
+
+static int32_t GfxBytesPerPixel(PixelFormat fmt)
+{
+    switch (fmt) {
+        case PIXEL_FMT_RGBA_8888:
+        case PIXEL_FMT_RGBX_8888:
+        case PIXEL_FMT_BGRA_8888:
+        case PIXEL_FMT_BGRX_8888:
+            return sizeof(uint32_t);
+        case PIXEL_FMT_RGB_565:
+            return sizeof(uint16_t);
+        case PIXEL_FMT_YCBCR_420_SP:
+        case PIXEL_FMT_YCRCB_420_SP:
+            return sizeof(uint8_t);
+        default:
+            return 0;
+    }
+}
+
+static bool GfxIsYuv(PixelFormat fmt)
+{
+    return (fmt == PIXEL_FMT_YCBCR_420_SP) || (fmt == PIXEL_FMT_YCRCB_420_SP);
+}
+
+static inline uint8_t Clamp8(int32_t v)
+{
+    return (v < 0) ? 0 : ((v > GFX_OPAQUE) ? GFX_OPAQUE : (uint8_t)v);
+}
+
+/* BT.601 limited range */
+static inline uint32_t YuvToRgba(int32_t y, int32_t u, int32_t v)
+{
+    int32_t c = 298 * (y - 16) + 128;
+    int32_t d = u - 128;
+    int32_t e = v - 128;
+
+    return Clamp8((c + 409 * e) >> 8) | (Clamp8((c - 100 * d - 208 * e) >> 8) << 8) |
+        (Clamp8((c + 516 * d) >> 8) << 16) | GFX_ALPHA_MASK;
+}
+
+static void LoadPixels(PixelFormat fmt, const uint8_t *row, const uint8_t *uv, int32_t x, int32_t n, uint32_t *out)
+{
+    int32_t i;
+
+    switch (fmt) {
+        case PIXEL_FMT_RGBA_8888:
+        case PIXEL_FMT_RGBX_8888:
+        case PIXEL_FMT_BGRA_8888:
+        case PIXEL_FMT_BGRX_8888:
+            CopyRow32(out, (const uint32_t *)row + x, n,
+                (fmt == PIXEL_FMT_BGRA_8888) || (fmt == PIXEL_FMT_BGRX_8888),
+                ((fmt == PIXEL_FMT_RGBX_8888) || (fmt == PIXEL_FMT_BGRX_8888)) ? GFX_ALPHA_MASK : 0);
+            break;
+        case PIXEL_FMT_RGB_565:
+            for (i = 0; i < n; i++) {
+                uint32_t p = ((const uint16_t *)row)[x + i];
+                uint32_t r = (p >> 11) & 0x1F;
+                uint32_t g = (p >> 5) & 0x3F;
+                uint32_t b = p & 0x1F;
+                out[i] = ((r << 3) | (r >> 2)) | (((g << 2) | (g >> 4)) << 8) |
+                    (((b << 3) | (b >> 2)) << 16) | GFX_ALPHA_MASK;
+            }
+            break;
+        case PIXEL_FMT_YCBCR_420_SP:
+        case PIXEL_FMT_YCRCB_420_SP: {
+            int32_t cb = (fmt == PIXEL_FMT_YCBCR_420_SP) ? 0 : 1;
+            for (i = 0; i < n; i++) {
+                int32_t c = (x + i) & ~1;
+                out[i] = YuvToRgba(row[x + i], uv[c + cb], uv[c + 1 - cb]);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static void LoadRow(const GfxJob *job, int32_t y, int32_t x, int32_t n, uint32_t *out)
+{
+    const uint8_t *uv = GfxIsYuv(job->srcFmt) ? (job->src->uv + (size_t)(y >> 1) * job->src->uvStride) : NULL;
+
+    LoadPixels(job->srcFmt, job->src->base + (size_t)y * job->srcStride, uv, x, n, out);
+}
+
+static void StoreRow(PixelFormat fmt, uint8_t *row, int32_t x, int32_t n, const uint32_t *in)
+{
+    int32_t i;
+
+    switch (fmt) {
+        case PIXEL_FMT_RGBA_8888:
+        case PIXEL_FMT_RGBX_8888:
+            CopyRow32((uint32_t *)row + x, in, n, false, 0);
+            break;
+        case PIXEL_FMT_BGRA_8888:
+        case PIXEL_FMT_BGRX_8888:
+            CopyRow32((uint32_t *)row + x, in, n, true, 0);
+            break;
+        case PIXEL_FMT_RGB_565:
+            for (i = 0; i < n; i++) {
+                uint32_t p = in[i];
+                ((uint16_t *)row)[x + i] = (uint16_t)(((p & 0xF8) << 8) | ((p >> 5) & 0x7E0) | ((p >> 19) & 0x1F));
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static uint32_t *GfxScratch(size_t pixels)
+{
+    uint32_t *buf = NULL;
+
+    if (pixels > g_scratchPixels) {
+        buf = (uint32_t *)realloc(g_scratch, pixels * sizeof(uint32_t));
+        if (buf == NULL) {
+            return NULL;
+        }
+        g_scratch = buf;
+        g_scratchPixels = pixels;
+    }
+    return g_scratch;
+}
+
+static void GfxScratchFree(void)
+{
+    free(g_scratch);
+    g_scratch = NULL;
+    g_scratchPixels = 0;
+}
+
+/*
+ * Band workers
+ */
+
+static void FillBand(const GfxJob *job, int32_t y0, int32_t y1)
+{
+    int32_t y;
+
+    for (y = y0; y < y1; y++) {
+        uint8_t *row = job->dst + (size_t)y * job->dstStride;
+        if (GfxBytesPerPixel(job->dstFmt) == sizeof(uint32_t)) {
+            Fill32((uint32_t *)row + job->clip.x, job->color, job->clip.w);
+        } else {
+            Fill16((uint16_t *)row + job->clip.x, (uint16_t)job->color, job->clip.w);
+        }
+    }
+}
+
+static void CombineRow(const GfxJob *job, uint8_t *row, uint32_t *pixels, uint32_t *tmp)
+{
+    int32_t x = job->clip.x;
+    int32_t n = job->clip.w;
+    uint32_t *dst = tmp;
+
+    if (job->blend == GFX_BLEND_COPY) {
+        StoreRow(job->dstFmt, row, x, n, pixels);
+        return;
+    }
+    if (job->dstFmt == PIXEL_FMT_RGBA_8888) {
+        dst = (uint32_t *)row + x;
+    } else {
+        LoadPixels(job->dstFmt, row, NULL, x, n, tmp);
+    }
+    if (job->blend == GFX_BLEND_PREMUL) {
+        BlendRowPremul(dst, pixels, n, job->globalAlpha);
+    } else {
+        BlendRowCoverage(dst, pixels, n, job->globalAlpha);
+    }
+    if (dst == tmp) {
+        StoreRow(job->dstFmt, row, x, n, tmp);
+    }
+}
+
+/* Same 32-bit layout on both sides: no conversion, copy or blend in place. */
+static void BlitDirectBand(const GfxJob *job, int32_t y0, int32_t y1)
+{
+    int32_t sx = job->srcRect.x + (job->clip.x - job->mapDst.x);
+    int32_t sy = job->srcRect.y + (y0 - job->mapDst.y);
+    int32_t y;
+
+    for (y = y0; y < y1; y++, sy++) {
+        uint32_t *dst = (uint32_t *)(job->dst + (size_t)y * job->dstStride) + job->clip.x;
+        const uint32_t *src = (const uint32_t *)(job->src->base + (size_t)sy * job->srcStride) + sx;
+        if (job->blend == GFX_BLEND_COPY) {
+            (void)memcpy_s(dst, job->clip.w * sizeof(uint32_t), src, job->clip.w * sizeof(uint32_t));
+        } else if (job->blend == GFX_BLEND_PREMUL) {
+            BlendRowPremul(dst, src, job->clip.w, job->globalAlpha);
+        } else {
+            BlendRowCoverage(dst, src, job->clip.w, job->globalAlpha);
+        }
+    }
+}
+
+static void BlitConvertBand(const GfxJob *job, int32_t y0, int32_t y1)
+{
+    int32_t sx = job->srcRect.x + (job->clip.x - job->mapDst.x);
+    int32_t sy = job->srcRect.y + (y0 - job->mapDst.y);
+    uint32_t *pixels = GfxScratch((size_t)job->clip.w * 2); /* 2: source row, destination row */
+    int32_t y;
+
+    if (pixels == NULL) {
+        return;
+    }
+    for (y = y0; y < y1; y++, sy++) {
+        LoadRow(job, sy, sx, job->clip.w, pixels);
+        CombineRow(job, job->dst + (size_t)y * job->dstStride, pixels, pixels + job->clip.w);
+    }
+}
+
+/* Source coordinate in 16.16 fixed point for destination index i of n, mapped onto len source pixels. */
+static inline int32_t MapFixed(int32_t i, int32_t n, int32_t len)
+{
+    return (int32_t)((((int64_t)i << GFX_FIXED_SHIFT) * len + ((int64_t)len << (GFX_FIXED_SHIFT - 1))) / n) -
+        GFX_FIXED_HALF;
+}
+
+static inline int32_t ClampI(int32_t v, int32_t lo, int32_t hi)
+{
+    return (v < lo) ? lo : ((v > hi) ? hi : v);
+}
+
+/* Bilinear scaling without rotation. */
+static void BlitScaleBand(const GfxJob *job, int32_t y0, int32_t y1)
+{
+    const IRect *sr = &job->srcRect;
+    int32_t n = job->clip.w;
+    uint32_t *row0 = GfxScratch((size_t)sr->w * 2 + (size_t)n * 2); /* 2: two source rows, two output rows */
+    uint32_t *row1 = row0 + sr->w;
+    uint32_t *pixels = row1 + sr->w;
+    int32_t lastY = -1;
+    int32_t y;
+    int32_t i;
+
+    if (row0 == NULL) {
+        return;
+    }
+    for (y = y0; y < y1; y++) {
+        int32_t fy = MapFixed(y - job->mapDst.y, job->mapDst.h, job->mapSrc.h) +
+            ((job->mapSrc.y - sr->y) << GFX_FIXED_SHIFT);
+        int32_t iy = ClampI(fy >> GFX_FIXED_SHIFT, 0, sr->h - 1);
+        uint32_t wy = (fy < 0) ? 0 : ((uint32_t)fy >> 8) & 0xFF;
+        if (iy != lastY) {
+            LoadRow(job, sr->y + iy, sr->x, sr->w, row0);
+            LoadRow(job, sr->y + ClampI(iy + 1, 0, sr->h - 1), sr->x, sr->w, row1);
+            lastY = iy;
+        }
+        for (i = 0; i < n; i++) {
+            int32_t fx = MapFixed(job->clip.x + i - job->mapDst.x, job->mapDst.w, job->mapSrc.w) +
+                ((job->mapSrc.x - sr->x) << GFX_FIXED_SHIFT);
+            int32_t ix = ClampI(fx >> GFX_FIXED_SHIFT, 0, sr->w - 1);
+            int32_t ix1 = ClampI(ix + 1, 0, sr->w - 1);
+            uint32_t wx = (fx < 0) ? 0 : ((uint32_t)fx >> 8) & 0xFF;
+            pixels[i] = LerpPixel(LerpPixel(row0[ix], row0[ix1], wx), LerpPixel(row1[ix], row1[ix1], wx), wy);
+        }
+        CombineRow(job, job->dst + (size_t)y * job->dstStride, pixels, pixels + n);
+    }
+}
+
+/* Rotated or partly off-surface blits, nearest sampling. */
+static void BlitSampleBand(const GfxJob *job, int32_t y0, int32_t y1)
+{
+    const IRect *ms = &job->mapSrc;
+    const IRect *md = &job->mapDst;
+    int32_t n = job->clip.w;
+    uint32_t *pixels = GfxScratch((size_t)n * 2); /* 2: source row, destination row */
+    int32_t y;
+    int32_t i;
+
+    if (pixels == NULL) {
+        return;
+    }
+    for (y = y0; y < y1; y++) {
+        int32_t v = y - md->y;
+        for (i = 0; i < n; i++) {
+            int32_t u = job->clip.x + i - md->x;
+            int64_t sx;
+            int64_t sy;
+            switch (job->rotate) {
+                case ROTATE_90:
+                    sx = (int64_t)v * ms->w / md->h;
+                    sy = (int64_t)(md->w - 1 - u) * ms->h / md->w;
+                    break;
+                case ROTATE_180:
+                    sx = (int64_t)(md->w - 1 - u) * ms->w / md->w;
+                    sy = (int64_t)(md->h - 1 - v) * ms->h / md->h;
+                    break;
+                case ROTATE_270:
+                    sx = (int64_t)(md->h - 1 - v) * ms->w / md->h;
+                    sy = (int64_t)u * ms->h / md->w;
+                    break;
+                default:
+                    sx = (int64_t)u * ms->w / md->w;
+                    sy = (int64_t)v * ms->h / md->h;
+                    break;
+            }
+            LoadRow(job, ClampI(ms->y + (int32_t)sy, job->srcRect.y, job->srcRect.y + job->srcRect.h - 1),
+                ClampI(ms->x + (int32_t)sx, job->srcRect.x, job->srcRect.x + job->srcRect.w - 1), 1, &pixels[i]);
+        }
+        CombineRow(job, job->dst + (size_t)y * job->dstStride, pixels, pixels + n);
+    }
+}
+
+/*
+ * Band scheduler
+ */
+
+static bool GfxNextBand(uint32_t generation, int32_t *band)
+{
+    bool ret = false;
+
+    pthread_mutex_lock(&g_gfxPool.lock);
+    if ((generation == g_gfxPool.generation) && (g_gfxPool.nextBand < g_gfxPool.bandNum)) {
+        *band = g_gfxPool.nextBand++;
+        ret = true;
+    }
+    pthread_mutex_unlock(&g_gfxPool.lock);
+    return ret;
+}
+
+static void GfxRunBands(const GfxJob *job, uint32_t generation)
+{
+    int32_t band;
+
+    while (GfxNextBand(generation, &band)) {
+        int32_t y0 = job->clip.y + band * GFX_BAND_ROWS;
+        int32_t y1 = y0 + GFX_BAND_ROWS;
+        job->func(job, y0, (y1 < job->clip.y + job->clip.h) ? y1 : (job->clip.y + job->clip.h));
+
+        pthread_mutex_lock(&g_gfxPool.lock);
+        if (++g_gfxPool.bandsDone == g_gfxPool.bandNum) {
+            pthread_cond_broadcast(&g_gfxPool.done);
+        }
+        pthread_mutex_unlock(&g_gfxPool.lock);
+    }
+}
+
+static void *GfxWorker(void *arg)
+{
+    uint32_t seen;
+    (void)arg;
+
+    pthread_mutex_lock(&g_gfxPool.lock);
+    seen = g_gfxPool.generation;
+    while (true) {
+        while (!g_gfxPool.exit && (g_gfxPool.generation == seen)) {
+            pthread_cond_wait(&g_gfxPool.start, &g_gfxPool.lock);
+        }
+        if (g_gfxPool.exit) {
+            break;
+        }
+        seen = g_gfxPool.generation;
+        const GfxJob *job = g_gfxPool.job;
+        pthread_mutex_unlock(&g_gfxPool.lock);
+        GfxRunBands(job, seen);
+        pthread_mutex_lock(&g_gfxPool.lock);
+    }
+    pthread_mutex_unlock(&g_gfxPool.lock);
+    GfxScratchFree();
+    return NULL;
+}
+
+static void GfxDispatch(const GfxJob *job)
+{
+    uint32_t generation;
+
+    if ((g_gfxPool.threadNum == 0) || ((int64_t)job->clip.w * job->clip.h < GFX_PARALLEL_PIXELS)) {
+        job->func(job, job->clip.y, job->clip.y + job->clip.h);
+        return;
+    }
+
+    pthread_mutex_lock(&g_gfxPool.submit);
+    pthread_mutex_lock(&g_gfxPool.lock);
+    g_gfxPool.job = job;
+    g_gfxPool.bandNum = (job->clip.h + GFX_BAND_ROWS - 1) / GFX_BAND_ROWS;
+    g_gfxPool.nextBand = 0;
+    g_gfxPool.bandsDone = 0;
+    generation = ++g_gfxPool.generation;
+    pthread_cond_broadcast(&g_gfxPool.start);
+    pthread_mutex_unlock(&g_gfxPool.lock);
+
+    GfxRunBands(job, generation);
+
+    pthread_mutex_lock(&g_gfxPool.lock);
+    while (g_gfxPool.bandsDone < g_gfxPool.bandNum) {
+        pthread_cond_wait(&g_gfxPool.done, &g_gfxPool.lock);
+    }
+    pthread_mutex_unlock(&g_gfxPool.lock);
+    pthread_mutex_unlock(&g_gfxPool.submit);
+}
+
+/*
+ * Surface mapping
+ */
+
+static void SyncSurface(const GfxMap *map, uint64_t flags)
+{
+    struct dma_buf_sync sync = { .flags = flags };
+
+    /* not every exporter implements it, mapping is still coherent then */
+    (void)ioctl(map->fd, DMA_BUF_IOCTL_SYNC, &sync);
+}
+
+static int32_t MapSurface(const ISurface *surface, GfxMap *map, bool write)
+{
+    int32_t bpp = GfxBytesPerPixel(surface->enColorFmt);
+    uint64_t access = write ? DMA_BUF_SYNC_RW : DMA_BUF_SYNC_READ;
+    size_t lumaSize;
+
+    if (bpp == 0) {
+        HDF_LOGE("%s: unsupported format %d", __func__, surface->enColorFmt);
+        return DISPLAY_NOT_SUPPORT;
+    }
+    if ((surface->width <= 0) || (surface->height <= 0) || (surface->stride < surface->width * bpp)) {
+        HDF_LOGE("%s: invalid surface %dx%d stride %d", __func__, surface->width, surface->height, surface->stride);
+        return DISPLAY_PARAM_ERR;
+    }
+
+    map->fd = (int)surface->phyAddr;
+    lumaSize = (size_t)surface->stride * surface->height;
+    map->size = lumaSize;
+    map->uvStride = (surface->cbcrStride > 0) ? surface->cbcrStride : surface->stride;
+    if (GfxIsYuv(surface->enColorFmt)) {
+        map->size += (size_t)map->uvStride * ((surface->height + 1) / 2); /* 2: chroma is subsampled vertically */
+    }
+    map->base = mmap(NULL, map->size, PROT_READ | (write ? PROT_WRITE : 0), MAP_SHARED, map->fd, 0);
+    if (map->base == MAP_FAILED) {
+        HDF_LOGE("%s: mmap fd %d size %zu failed", __func__, map->fd, map->size);
+        return DISPLAY_FD_ERR;
+    }
+    map->uv = map->base + lumaSize;
+    SyncSurface(map, DMA_BUF_SYNC_START | access);
+    return DISPLAY_SUCCESS;
+}
+
+static void UnmapSurface(GfxMap *map, bool write)
+{
+    SyncSurface(map, DMA_BUF_SYNC_END | (write ? DMA_BUF_SYNC_RW : DMA_BUF_SYNC_READ));
+    (void)munmap(map->base, map->size);
+}
+
+static bool IntersectRect(const IRect *a, int32_t w, int32_t h, IRect *out)
+{
+    int32_t x0 = (a->x > 0) ? a->x : 0;
+    int32_t y0 = (a->y > 0) ? a->y : 0;
+    int32_t x1 = (a->x + a->w < w) ? (a->x + a->w) : w;
+    int32_t y1 = (a->y + a->h < h) ? (a->y + a->h) : h;
+
+    if ((x1 <= x0) || (y1 <= y0)) {
+        return false;
+    }
+    out->x = x0;
+    out->y = y0;
+    out->w = x1 - x0;
+    out->h = y1 - y0;
+    return true;
+}
+
+/*
+ * GfxFuncs
+ */
+
+int32_t InitGfx()
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int32_t want = (cpus > 1) ? (int32_t)(cpus - 1) : 0; /* caller takes a share as well */
+
+    want = (want > GFX_MAX_THREADS) ? GFX_MAX_THREADS : want;
+    g_gfxPool.exit = false;
+    while (g_gfxPool.threadNum < want) {
+        if (pthread_create(&g_gfxPool.threads[g_gfxPool.threadNum], NULL, GfxWorker, NULL) != 0) {
+            HDF_LOGE("%s: create worker %d failed, continue with fewer", __func__, g_gfxPool.threadNum);
+            break;
+        }
+        g_gfxPool.threadNum++;
+    }
+    return DISPLAY_SUCCESS;
+}
+
+int32_t DeinitGfx()
+{
+    int32_t i;
+
+    pthread_mutex_lock(&g_gfxPool.lock);
+    g_gfxPool.exit = true;
+    pthread_cond_broadcast(&g_gfxPool.start);
+    pthread_mutex_unlock(&g_gfxPool.lock);
+    for (i = 0; i < g_gfxPool.threadNum; i++) {
+        pthread_join(g_gfxPool.threads[i], NULL);
+    }
+    g_gfxPool.threadNum = 0;
+    return DISPLAY_SUCCESS;
+}
+
+int32_t FillRect(ISurface *iSurface, IRect *rect, uint32_t color, GfxOpt *opt)
+{
+    GfxJob job = { .func = FillBand };
+    GfxMap dst;
+    uint32_t rgba;
+    int32_t ret;
+    (void)opt;
+
+    if ((iSurface == NULL) || (rect == NULL)) {
+        HDF_LOGE("%s: null param", __func__);
+        return DISPLAY_NULL_PTR;
+    }
+    if (GfxIsYuv(iSurface->enColorFmt)) {
+        HDF_LOGE("%s: can not fill yuv surface", __func__);
+        return DISPLAY_NOT_SUPPORT;
+    }
+    if (!IntersectRect(rect, iSurface->width, iSurface->height, &job.clip)) {
+        return DISPLAY_SUCCESS;
+    }
+    if ((ret = MapSurface(iSurface, &dst, true)) != DISPLAY_SUCCESS) {
+        return ret;
+    }
+
+    rgba = ((color >> 16) & 0xFF) | (color & 0xFF00) | ((color & 0xFF) << 16) | (color & GFX_ALPHA_MASK);
+    job.dst = dst.base;
+    job.dstStride = iSurface->stride;
+    job.dstFmt = iSurface->enColorFmt;
+    StoreRow(job.dstFmt, (uint8_t *)&job.color, 0, 1, &rgba);
+    GfxDispatch(&job);
+
+    UnmapSurface(&dst, true);
+    return DISPLAY_SUCCESS;
+}
+
+static int32_t GfxSelectBlend(const GfxOpt *opt, enum GfxBlend *blend)
+{
+    switch (opt->blendType) {
+        case BLEND_NONE:
+        case BLEND_SRC:
+            *blend = GFX_BLEND_COPY;
+            return DISPLAY_SUCCESS;
+        case BLEND_SRCOVER:
+            *blend = GFX_BLEND_PREMUL;
+            return DISPLAY_SUCCESS;
+        case BLEND_AKS:
+            *blend = GFX_BLEND_COVERAGE;
+            return DISPLAY_SUCCESS;
+        case BLEND_CLEAR:
+        case BLEND_DST:
+            return DISPLAY_SUCCESS;     /* handled by Blit without touching the source */
+        default:
+            HDF_LOGE("%s: unsupported blend type %d", __func__, opt->blendType);
+            return DISPLAY_NOT_SUPPORT;
+    }
+}
+
+static void GfxSelectBand(GfxJob *job, bool srcClipped)
+{
+    bool scaled = (job->mapSrc.w != job->mapDst.w) || (job->mapSrc.h != job->mapDst.h);
+    bool srcAlpha = (job->srcFmt == PIXEL_FMT_RGBA_8888) || (job->srcFmt == PIXEL_FMT_BGRA_8888);
+
+    /* formats without alpha over anything is a copy, unless faded by global alpha */
+    if ((job->blend != GFX_BLEND_COPY) && (job->globalAlpha == GFX_OPAQUE) && !srcAlpha) {
+        job->blend = GFX_BLEND_COPY;
+    }
+
+    if ((job->rotate != ROTATE_NONE) || srcClipped) {
+        job->func = BlitSampleBand;
+    } else if (scaled) {
+        job->func = BlitScaleBand;
+    } else if ((job->srcFmt == job->dstFmt) && (GfxBytesPerPixel(job->srcFmt) == sizeof(uint32_t)) &&
+        ((job->blend == GFX_BLEND_COPY) || srcAlpha)) {
+        job->func = BlitDirectBand;
+    } else {
+        job->func = BlitConvertBand;
+    }
+}
+
+int32_t Blit(ISurface *srcSurface, IRect *srcRect, ISurface *dstSurface, IRect *dstRect, GfxOpt *opt)
+{
+    GfxJob job = { 0 };
+    GfxMap src;
+    GfxMap dst;
+    int32_t ret;
+
+    if ((srcSurface == NULL) || (srcRect == NULL) || (dstSurface == NULL) || (dstRect == NULL) || (opt == NULL)) {
+        HDF_LOGE("%s: null param", __func__);
+        return DISPLAY_NULL_PTR;
+    }
+    if ((GfxBytesPerPixel(dstSurface->enColorFmt) == 0) || GfxIsYuv(dstSurface->enColorFmt) || opt->enableRop) {
+        HDF_LOGE("%s: unsupported destination format %d or rop", __func__, dstSurface->enColorFmt);
+        return DISPLAY_NOT_SUPPORT;
+    }
+    if ((ret = GfxSelectBlend(opt, &job.blend)) != DISPLAY_SUCCESS) {
+        return ret;
+    }
+    if (opt->blendType == BLEND_CLEAR) {
+        return FillRect(dstSurface, dstRect, 0, opt);
+    }
+    if ((opt->blendType == BLEND_DST) || (srcRect->w <= 0) || (srcRect->h <= 0) ||
+        !IntersectRect(dstRect, dstSurface->width, dstSurface->height, &job.clip) ||
+        !IntersectRect(srcRect, srcSurface->width, srcSurface->height, &job.srcRect)) {
+        return DISPLAY_SUCCESS;
+    }
+
+    job.mapSrc = *srcRect;
+    job.mapDst = *dstRect;
+    if (!opt->enableScale) {
+        /* the source covers the destination turned back by the rotation */
+        bool swap = (opt->rotateType == ROTATE_90) || (opt->rotateType == ROTATE_270);
+        job.mapSrc.w = swap ? dstRect->h : dstRect->w;
+        job.mapSrc.h = swap ? dstRect->w : dstRect->h;
+    }
+    job.rotate = opt->rotateType;
+    job.globalAlpha = opt->enGlobalAlpha ? srcSurface->alpha0 : GFX_OPAQUE;
+    job.srcFmt = srcSurface->enColorFmt;
+    job.srcStride = srcSurface->stride;
+    job.dstFmt = dstSurface->enColorFmt;
+    job.dstStride = dstSurface->stride;
+    GfxSelectBand(&job, (job.srcRect.x != srcRect->x) || (job.srcRect.y != srcRect->y) ||
+        (job.srcRect.w != job.mapSrc.w) || (job.srcRect.h != job.mapSrc.h));
+
+    if ((ret = MapSurface(srcSurface, &src, false)) != DISPLAY_SUCCESS) {
+        return ret;
+    }
+    if ((ret = MapSurface(dstSurface, &dst, true)) != DISPLAY_SUCCESS) {
+        UnmapSurface(&src, false);
+        return ret;
+    }
+    job.src = &src;
+    job.dst = dst.base;
+    GfxDispatch(&job);
+
+    UnmapSurface(&dst, true);
+    UnmapSurface(&src, false);
+    return DISPLAY_SUCCESS;
+}
+
+int32_t Sync(int32_t timeOut)
+{
+    (void)timeOut;
+    return DISPLAY_SUCCESS;     /* FillRect and Blit finish before returning */
+}
+
+int32_t GfxInitialize(GfxFuncs **funcs)
+{
+    GfxFuncs *gfxFuncs = (GfxFuncs *)malloc(sizeof(GfxFuncs));
+
+    errno_t eok = memset_s((void *)gfxFuncs, sizeof(GfxFuncs), 0, sizeof(GfxFuncs));
+    if (eok != EOK) {
+        free(gfxFuncs);
+        return DISPLAY_FAILURE;
+    }
+    gfxFuncs->InitGfx = InitGfx;
+    gfxFuncs->DeinitGfx = DeinitGfx;
+    gfxFuncs->FillRect = FillRect;
+    gfxFuncs->Blit = Blit;
+    gfxFuncs->Sync = Sync;
+    *funcs = gfxFuncs;
+
+    return DISPLAY_SUCCESS;
+}
+
+int32_t GfxUninitialize(GfxFuncs *funcs)
+{
+    free(funcs);
+    //DISPLAY_DEBUGLOG("%s: gfx uninitialize success", __func__);
+    return DISPLAY_SUCCESS;
+}
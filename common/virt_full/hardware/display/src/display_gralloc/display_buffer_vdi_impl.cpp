@@ -78,43 +78,62 @@ int32_t DisplayBufferVdiImpl::InvalidateCache(const BufferHandle& handle) const
 int32_t DisplayBufferVdiImpl::IsSupportedAlloc(const std::vector<VerifyAllocInfo>& infos,
     std::vector<bool>& supporteds) const
 {
-    return DISPLAY_NOT_SUPPORT;
+    supporteds.resize(infos.size());
+    for (size_t i = 0; i < infos.size(); i++) {
+        supporteds[i] = GbmIsSupportedAlloc(&infos[i]);
+    }
+    return HDF_SUCCESS;
 }
 
 int32_t DisplayBufferVdiImpl::RegisterBuffer(const BufferHandle& handle)
 {
-    DISPLAY_LOGE("%s is not supported", __func__);
-    return DISPLAY_NOT_SUPPORT;
+    return GbmRegisterBuffer(&handle);
 }
 
 int32_t DisplayBufferVdiImpl::SetMetadata(const BufferHandle& handle, uint32_t key, const std::vector<uint8_t>& value)
 {
-    DISPLAY_LOGE("%s is not supported", __func__);
-    return DISPLAY_NOT_SUPPORT;
+    DISPLAY_CHK_RETURN((value.size() > UINT32_MAX), HDF_ERR_INVALID_PARAM, DISPLAY_LOGE("the value is too large"));
+    return GbmSetMetadata(&handle, key, value.data(), static_cast<uint32_t>(value.size()));
 }
 
 int32_t DisplayBufferVdiImpl::GetMetadata(const BufferHandle& handle, uint32_t key, std::vector<uint8_t>& value)
 {
-    DISPLAY_LOGE("%s is not supported", __func__);
-    return DISPLAY_NOT_SUPPORT;
+    uint32_t size = 0;
+    int32_t ret = GbmGetMetadata(&handle, key, nullptr, &size);
+    DISPLAY_CHK_RETURN((ret != HDF_SUCCESS), ret, DISPLAY_LOGD("get the size of metadata %{public}u failed", key));
+    value.resize(size);
+    ret = GbmGetMetadata(&handle, key, value.data(), &size);
+    // the region is shared, the value may have changed since its size was read
+    value.resize((ret == HDF_SUCCESS) ? size : 0);
+    return ret;
 }
 
 int32_t DisplayBufferVdiImpl::ListMetadataKeys(const BufferHandle& handle, std::vector<uint32_t>& keys)
 {
-    DISPLAY_LOGE("%s is not supported", __func__);
-    return DISPLAY_NOT_SUPPORT;
+    uint32_t num = 0;
+    int32_t ret = GbmListMetadataKeys(&handle, nullptr, &num);
+    DISPLAY_CHK_RETURN((ret != HDF_SUCCESS), ret, DISPLAY_LOGE("get the metadata count failed"));
+    keys.resize(num);
+    ret = GbmListMetadataKeys(&handle, keys.data(), &num);
+    keys.resize((ret == HDF_SUCCESS) ? num : 0);
+    return ret;
 }
 
 int32_t DisplayBufferVdiImpl::EraseMetadataKey(const BufferHandle& handle, uint32_t key)
 {
-    DISPLAY_LOGE("%s is not supported", __func__);
-    return DISPLAY_NOT_SUPPORT;
+    return GbmEraseMetadataKey(&handle, key);
 }
 
 int32_t DisplayBufferVdiImpl::GetImageLayout(const BufferHandle& handle, ImageLayout& layout) const
 {
-    DISPLAY_LOGE("%s is not supported", __func__);
-    return DISPLAY_NOT_SUPPORT;
+    struct gbm_plane_layout planes[GBM_MAX_PLANES];
+    uint32_t num = GbmGetImageLayout(&handle, planes, GBM_MAX_PLANES);
+    DISPLAY_CHK_RETURN((num == 0), HDF_ERR_NOT_SUPPORT, DISPLAY_LOGE("the buffer has no known layout"));
+    layout.planes.resize(num);
+    for (uint32_t i = 0; i < num; i++) {
+        layout.planes[i] = {planes[i].offset, planes[i].stride, planes[i].rows};
+    }
+    return HDF_SUCCESS;
 }
 
 extern "C" IDisplayBufferVdi* CreateDisplayBufferVdi()
@@ -15,16 +15,22 @@
 
 #include "display_gralloc_gbm.h"
 #include <cstdio>
+#include <algorithm>
 #include <unistd.h>
 #include <cerrno>
+#include <atomic>
 #include <cinttypes>
 #include <climits>
+#include <cstdlib>
 #include <cstring>
+#include <ctime>
 #include <fcntl.h>
 #include <pthread.h>
 #include <sys/mman.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 #include <xf86drm.h>
+#include <unordered_map>
 #include <securec.h>
 #include <linux/dma-buf.h>
 #include "drm_fourcc.h"
@@ -44,6 +50,44 @@ using namespace OHOS::HDI::Display::Buffer::V1_0;
 const char *g_drmFileNode = "/dev/dri/card0";
 static GrallocManager *g_grallocManager = nullptr;
 static pthread_mutex_t g_lock;
+// held for reading while a buffer is created on the gbm device, so uninitializing waits before destroying it
+static pthread_rwlock_t g_deviceLock = PTHREAD_RWLOCK_INITIALIZER;
+// the freed buffers are sharded by size and format, so allocations of different buffers do not wait on each other
+const uint32_t GRALLOC_POOL_SHARDS = 8;
+// the freed buffers beyond this go back to the kernel
+const uint64_t GRALLOC_POOL_MAX_SIZE = 64 * 1024 * 1024;
+// a freed buffer not reused within this time goes back to the kernel
+const uint64_t GRALLOC_POOL_EXPIRE_MS = 3000;
+// how often an allocation or free looks for expired buffers in all the shards
+const uint64_t GRALLOC_POOL_SWEEP_MS = 500;
+static GbmPoolShard g_poolShards[GRALLOC_POOL_SHARDS];
+static std::atomic<uint64_t> g_poolSize(0);
+static std::atomic<uint64_t> g_poolSweepTime(0);
+// only the allocating process pools, a mapper client never allocates and must give its handles back
+static std::atomic<bool> g_poolEnabled(false);
+// the metadata region of a buffer, written by its producer before the buffer is queued
+const uint32_t METADATA_REGION_SIZE = 4096;
+const uint32_t METADATA_MAX_KEYS = 32;
+const uint32_t METADATA_MAGIC = 0x4D455441;
+using MetadataEntry = struct {
+    uint32_t key;
+    uint32_t offset;
+    uint32_t size;
+};
+const uint32_t METADATA_DATA_SIZE =
+    METADATA_REGION_SIZE - sizeof(uint32_t) * 3 - sizeof(MetadataEntry) * METADATA_MAX_KEYS; // 3: the header words
+using MetadataRegion = struct {
+    uint32_t magic;
+    uint32_t count;
+    uint32_t used;
+    MetadataEntry entries[METADATA_MAX_KEYS];
+    uint8_t data[METADATA_DATA_SIZE];
+};
+static_assert(sizeof(MetadataRegion) == METADATA_REGION_SIZE, "the metadata region must fill its pages");
+static pthread_mutex_t g_metadataLock;
+// the direction of the cpu access opened on each mapping
+static pthread_mutex_t g_syncLock;
+static std::unordered_map<void *, uint64_t> g_openAccess;
 
 using PixelFormatConvertTbl = struct {
     uint32_t drmFormat;
@@ -227,45 +271,282 @@ static void DeInitGbmDevice(GrallocManager *grallocManager)
     grallocManager->gbmDevice = nullptr;
 }
 
-static int32_t DmaBufferSync(const BufferHandle *handle, bool start)
+// the direction of a cpu access, the mapping allows both whatever the usage says
+static uint64_t GetSyncDirection(const BufferHandle *handle)
 {
-    DISPLAY_LOGD();
-    struct dma_buf_sync syncPrm;
-    errno_t eok = memset_s(&syncPrm, sizeof(syncPrm), 0, sizeof(syncPrm));
-    DISPLAY_CHK_RETURN((eok != EOK), HDF_ERR_INVALID_PARAM, DISPLAY_LOGE("dma buffer sync memset_s failed"));
-
+    uint64_t direction = 0;
     if (handle->usage & HBM_USE_CPU_WRITE) {
-        syncPrm.flags |= DMA_BUF_SYNC_WRITE;
+        direction |= DMA_BUF_SYNC_WRITE;
     }
-
     if (handle->usage & HBM_USE_CPU_READ) {
-        syncPrm.flags |= DMA_BUF_SYNC_READ;
+        direction |= DMA_BUF_SYNC_READ;
     }
+    return (direction == 0) ? DMA_BUF_SYNC_RW : direction;
+}
 
-    if (start) {
-        syncPrm.flags |= DMA_BUF_SYNC_START;
-    } else {
-        syncPrm.flags |= DMA_BUF_SYNC_END;
-    }
+// only the buffers allocated as cached memory need cache maintenance around cpu access
+static bool NeedDmaBufferSync(const BufferHandle *handle)
+{
+    return ((handle->usage & HBM_USE_MEM_MMZ_CACHE) != 0) && (handle->virAddr != nullptr);
+}
+
+static int32_t DmaBufferSync(int fd, uint64_t flags)
+{
+    struct dma_buf_sync syncPrm = { flags };
     int retry = 6;
     int ret;
     do {
-        ret = ioctl(handle->fd, DMA_BUF_IOCTL_SYNC, &syncPrm);
-    } while ((retry--) && (ret != -EAGAIN) && (ret != -EINTR));
+        ret = ioctl(fd, DMA_BUF_IOCTL_SYNC, &syncPrm);
+    } while ((ret < 0) && ((errno == EAGAIN) || (errno == EINTR)) && (retry-- > 0));
+    DISPLAY_CHK_RETURN((ret < 0), HDF_ERR_DEVICE_BUSY,
+        DISPLAY_LOGE("sync 0x%{public}" PRIx64 " failed errno %{public}d", flags, errno));
+    return HDF_SUCCESS;
+}
+
+// the direction of the cpu access open on a mapping, taken out so the ioctls run without the lock
+static uint64_t TakeOpenAccess(void *virAddr)
+{
+    pthread_mutex_lock(&g_syncLock);
+    uint64_t direction = 0;
+    auto iter = g_openAccess.find(virAddr);
+    if (iter != g_openAccess.end()) {
+        direction = iter->second;
+        g_openAccess.erase(iter);
+    }
+    pthread_mutex_unlock(&g_syncLock);
+    return direction;
+}
+
+static void SetOpenAccess(void *virAddr, uint64_t direction)
+{
+    pthread_mutex_lock(&g_syncLock);
+    g_openAccess[virAddr] = direction;
+    pthread_mutex_unlock(&g_syncLock);
+}
+
+// every DMA_BUF_SYNC_START is matched by an END with the same direction before the next START
+static int32_t BeginCpuAccess(const BufferHandle *handle)
+{
+    uint64_t open = TakeOpenAccess(handle->virAddr);
+    if (open != 0) {
+        (void)DmaBufferSync(handle->fd, DMA_BUF_SYNC_END | open);
+    }
+    uint64_t direction = GetSyncDirection(handle);
+    int32_t ret = DmaBufferSync(handle->fd, DMA_BUF_SYNC_START | direction);
+    if (ret == HDF_SUCCESS) {
+        SetOpenAccess(handle->virAddr, direction);
+    }
+    return ret;
+}
+
+static int32_t EndCpuAccess(const BufferHandle *handle, bool onlyOpen)
+{
+    uint64_t open = TakeOpenAccess(handle->virAddr);
+    if (open == 0) {
+        if (onlyOpen) {
+            return HDF_SUCCESS;
+        }
+        // a flush without an invalidate before it, the END still needs its START
+        open = GetSyncDirection(handle);
+        int32_t ret = DmaBufferSync(handle->fd, DMA_BUF_SYNC_START | open);
+        DISPLAY_CHK_RETURN((ret != HDF_SUCCESS), ret, DISPLAY_LOGE("begin cpu access failed"));
+    }
+    return DmaBufferSync(handle->fd, DMA_BUF_SYNC_END | open);
+}
+
+static void CloseBufferHandle(BufferHandle *handle);
+
+static uint64_t GetMonotonicMs(void)
+{
+    struct timespec ts = {0};
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    const uint64_t msPerSec = 1000;
+    const uint64_t nsPerMs = 1000000;
+    return static_cast<uint64_t>(ts.tv_sec) * msPerSec + static_cast<uint64_t>(ts.tv_nsec) / nsPerMs;
+}
+
+static GbmPoolShard *LockPoolShard(int32_t width, int32_t height, int32_t format)
+{
+    const uint32_t prime = 31;
+    uint32_t hash = static_cast<uint32_t>(width) * prime + static_cast<uint32_t>(height);
+    hash = hash * prime + static_cast<uint32_t>(format);
+    GbmPoolShard *shard = &g_poolShards[hash % GRALLOC_POOL_SHARDS];
+    pthread_mutex_lock(&shard->lock);
+    if (shard->head.next == nullptr) {
+        DListHeadInit(&shard->head);
+    }
+    return shard;
+}
+
+static void ReleasePoolEntry(GbmPoolEntry *poolEntry)
+{
+    g_poolSize -= static_cast<uint64_t>(poolEntry->buffer->size);
+    CloseBufferHandle(poolEntry->buffer);
+    free(poolEntry->buffer);
+    free(poolEntry);
+}
+
+// releases the expired buffers of a locked shard, or all of them when forced
+static void TrimPoolShard(GbmPoolShard *shard, bool force)
+{
+    uint64_t now = GetMonotonicMs();
+    GbmPoolEntry *pos = nullptr;
+    GbmPoolEntry *tmp = nullptr;
+    DLIST_FOR_EACH_ENTRY_SAFE(pos, tmp, &shard->head, GbmPoolEntry, entry) {
+        if (!force && (now - pos->freeTime < GRALLOC_POOL_EXPIRE_MS)) {
+            break;
+        }
+        DListRemove(&pos->entry);
+        ReleasePoolEntry(pos);
+    }
+}
+
+static void TrimPool(bool force)
+{
+    for (uint32_t i = 0; i < GRALLOC_POOL_SHARDS; i++) {
+        GbmPoolShard *shard = &g_poolShards[i];
+        pthread_mutex_lock(&shard->lock);
+        if (shard->head.next != nullptr) {
+            TrimPoolShard(shard, force);
+        }
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
 
-    if (ret < 0) {
-        DISPLAY_LOGE("sync failed");
-        return HDF_ERR_DEVICE_BUSY;
+// the buffers of a size no longer allocated expire too, not only those of the shard in use
+static void SweepPool(void)
+{
+    if (g_poolSize == 0) {
+        return;
+    }
+    uint64_t now = GetMonotonicMs();
+    uint64_t last = g_poolSweepTime;
+    if ((now - last < GRALLOC_POOL_SWEEP_MS) || !g_poolSweepTime.compare_exchange_strong(last, now)) {
+        return;
+    }
+    TrimPool(false);
+}
+
+// whether no other fd, mapping or process refers to the dma-buf any more
+static bool IsBufferExclusive(int fd)
+{
+    char path[PATH_MAX] = {0};
+    if (snprintf_s(path, sizeof(path), sizeof(path) - 1, "/proc/self/fdinfo/%d", fd) < 0) {
+        return false;
     }
+    FILE *fp = fopen(path, "r");
+    if (fp == nullptr) {
+        return false;
+    }
+    const char *countKey = "count:";
+    char line[LINE_MAX] = {0};
+    long count = 0;
+    while (fgets(line, sizeof(line), fp) != nullptr) {
+        if (strncmp(line, countKey, strlen(countKey)) == 0) {
+            count = strtol(line + strlen(countKey), nullptr, 10); // 10: decimal
+            break;
+        }
+    }
+    (void)fclose(fp);
+    return count == 1;
+}
+
+// a reused buffer must not show what its last user drew
+static int32_t ClearBuffer(const BufferHandle *buffer)
+{
+    void *virAddr = mmap(nullptr, buffer->size, PROT_READ | PROT_WRITE, MAP_SHARED, buffer->fd, 0);
+    DISPLAY_CHK_RETURN((virAddr == MAP_FAILED), HDF_FAILURE,
+        DISPLAY_LOGE("mmap failed errno %{public}s, fd : %{public}d", strerror(errno), buffer->fd));
+    (void)memset_s(virAddr, buffer->size, 0, buffer->size);
+    (void)munmap(virAddr, buffer->size);
     return HDF_SUCCESS;
 }
 
-static void InitBufferHandle(struct gbm_bo *bo, int fd, const AllocInfo *info, PriBufferHandle *buffer)
+static bool PutPoolBuffer(BufferHandle *buffer)
+{
+    uint64_t size = static_cast<uint64_t>(buffer->size);
+    if (!g_poolEnabled || (buffer->reserveFds > 1) || (buffer->fd < 0) || (size > GRALLOC_POOL_MAX_SIZE) ||
+        !IsBufferExclusive(buffer->fd)) {
+        return false;
+    }
+    GbmPoolEntry *poolEntry = (GbmPoolEntry *)malloc(sizeof(GbmPoolEntry));
+    DISPLAY_CHK_RETURN((poolEntry == nullptr), false, DISPLAY_LOGE("pool entry malloc failed"));
+    poolEntry->buffer = buffer;
+    poolEntry->freeTime = GetMonotonicMs();
+    GbmPoolShard *shard = LockPoolShard(buffer->width, buffer->height, buffer->format);
+    TrimPoolShard(shard, false);
+    if (g_poolSize.fetch_add(size) + size > GRALLOC_POOL_MAX_SIZE) {
+        g_poolSize -= size;
+        pthread_mutex_unlock(&shard->lock);
+        free(poolEntry);
+        return false;
+    }
+    DListInsertTail(&poolEntry->entry, &shard->head);
+    pthread_mutex_unlock(&shard->lock);
+    return true;
+}
+
+static BufferHandle *TakePoolBuffer(const AllocInfo *info)
+{
+    GbmPoolShard *shard = LockPoolShard(static_cast<int32_t>(info->width), static_cast<int32_t>(info->height),
+        static_cast<int32_t>(info->format));
+    TrimPoolShard(shard, false);
+    GbmPoolEntry *found = nullptr;
+    GbmPoolEntry *pos = nullptr;
+    DLIST_FOR_EACH_ENTRY(pos, &shard->head, GbmPoolEntry, entry) {
+        if ((pos->buffer->width == static_cast<int32_t>(info->width)) &&
+            (pos->buffer->height == static_cast<int32_t>(info->height)) &&
+            (pos->buffer->format == static_cast<int32_t>(info->format))) {
+            found = pos;
+            break;
+        }
+    }
+    if (found != nullptr) {
+        DListRemove(&found->entry);
+    }
+    pthread_mutex_unlock(&shard->lock);
+    if (found == nullptr) {
+        return nullptr;
+    }
+    BufferHandle *buffer = found->buffer;
+    if (ClearBuffer(buffer) != HDF_SUCCESS) {
+        ReleasePoolEntry(found);
+        return nullptr;
+    }
+    if (buffer->reserveFds > 0) {
+        // drops the metadata of the last user, the region is set up again on its next use
+        const uint32_t magic = 0;
+        (void)pwrite(buffer->reserve[0], &magic, sizeof(magic), 0);
+    }
+    g_poolSize -= static_cast<uint64_t>(buffer->size);
+    free(found);
+    buffer->usage = info->usage;
+    return buffer;
+}
+
+static int CreateMetadataRegion(void)
+{
+    int fd = memfd_create("gralloc_metadata", MFD_CLOEXEC);
+    DISPLAY_CHK_RETURN((fd < 0), -1, DISPLAY_LOGE("memfd_create failed errno %{public}d", errno));
+    if (ftruncate(fd, METADATA_REGION_SIZE) != 0) {
+        DISPLAY_LOGE("ftruncate failed errno %{public}d", errno);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void InitBufferHandle(struct gbm_bo *bo, int fd, int metadataFd, const AllocInfo *info,
+    PriBufferHandle *buffer)
 {
     BufferHandle *bufferHandle = &(buffer->hdl);
     bufferHandle->fd = fd;
     bufferHandle->reserveFds = 0;
     bufferHandle->reserveInts = 0;
+    if (metadataFd >= 0) {
+        bufferHandle->reserve[0] = metadataFd;
+        bufferHandle->reserveFds = 1;
+    }
     bufferHandle->stride = hdi_gbm_bo_get_stride(bo);
     bufferHandle->width = hdi_gbm_bo_get_width(bo);
     bufferHandle->height = hdi_gbm_bo_get_height(bo);
@@ -275,39 +556,35 @@ static void InitBufferHandle(struct gbm_bo *bo, int fd, const AllocInfo *info, P
     bufferHandle->size = hdi_gbm_bo_get_size(bo);
 }
 
-int32_t GbmAllocMem(const AllocInfo *info, BufferHandle **buffer)
+static int32_t CreateBuffer(struct gbm_device *gbmDevice, const AllocInfo *info, uint32_t drmFmt,
+    BufferHandle **buffer)
 {
-    DISPLAY_CHK_RETURN((info == nullptr), HDF_FAILURE, DISPLAY_LOGE("info is null"));
-    DISPLAY_CHK_RETURN((buffer == nullptr), HDF_FAILURE, DISPLAY_LOGE("buffer is null"));
     PriBufferHandle *priBuffer = nullptr;
-    uint32_t drmFmt = ConvertFormatToDrm(static_cast<PixelFormat>(info->format));
-    DISPLAY_CHK_RETURN((drmFmt == INVALID_PIXEL_FMT), HDF_ERR_NOT_SUPPORT,
-        DISPLAY_LOGE("format %{public}d can not support", info->format));
-    DISPLAY_LOGD("requeset width %{public}d, heigt %{public}d, format %{public}d",
-        info->width, info->height, drmFmt);
-
-        GRALLOC_LOCK();
-    GrallocManager *grallocManager = GetGrallocManager();
-    DISPLAY_CHK_RETURN((grallocManager == nullptr), HDF_ERR_INVALID_PARAM, DISPLAY_LOGE("gralloc manager failed");
-        GRALLOC_UNLOCK());
-    struct gbm_bo *bo =
-        hdi_gbm_bo_create(grallocManager->gbmDevice, info->width, info->height, drmFmt, ConvertUsageToGbm(info->usage));
-    DISPLAY_CHK_RETURN((bo == nullptr), HDF_DEV_ERR_NO_MEMORY, DISPLAY_LOGE("gbm create bo failed"); \
-        GRALLOC_UNLOCK());
+    // called with g_deviceLock read locked, the dumb buffer ioctls need no lock of ours
+    uint64_t gbmUsage = ConvertUsageToGbm(info->usage);
+    struct gbm_bo *bo = hdi_gbm_bo_create(gbmDevice, info->width, info->height, drmFmt, gbmUsage);
+    if (bo == nullptr) {
+        // short of memory, give the freed buffers back to the kernel and try again
+        TrimPool(true);
+        bo = hdi_gbm_bo_create(gbmDevice, info->width, info->height, drmFmt, gbmUsage);
+    }
+    DISPLAY_CHK_RETURN((bo == nullptr), HDF_DEV_ERR_NO_MEMORY, DISPLAY_LOGE("gbm create bo failed"));
 
     int fd = hdi_gbm_bo_get_fd(bo);
     DISPLAY_CHK_RETURN((fd < 0), HDF_ERR_BAD_FD, DISPLAY_LOGE("gbm can not get fd"); \
-        hdi_gbm_bo_destroy(bo); \
-        GRALLOC_UNLOCK());
+        hdi_gbm_bo_destroy(bo));
 
+    // without it the buffer works, only its metadata calls fail
+    int metadataFd = CreateMetadataRegion();
     errno_t eok = EOK;
-    priBuffer = (PriBufferHandle *)malloc(sizeof(PriBufferHandle));
+    const size_t handleSize = sizeof(PriBufferHandle) + sizeof(int32_t);
+    priBuffer = (PriBufferHandle *)malloc(handleSize);
     if (priBuffer == nullptr) {
         DISPLAY_LOGE("bufferhandle malloc failed");
         goto error;
     }
 
-    eok = memset_s(priBuffer, sizeof(PriBufferHandle), 0, sizeof(PriBufferHandle));
+    eok = memset_s(priBuffer, handleSize, 0, handleSize);
     if (eok != EOK) {
         DISPLAY_LOGE("memset_s failed");
         goto error;
@@ -315,21 +592,53 @@ int32_t GbmAllocMem(const AllocInfo *info, BufferHandle **buffer)
     DISPLAY_CHK_RETURN((eok != EOK), DISPLAY_PARAM_ERR, DISPLAY_LOGE("memset_s failed"); \
         goto error);
 
-    InitBufferHandle(bo, fd, info, priBuffer);
+    InitBufferHandle(bo, fd, metadataFd, info, priBuffer);
     *buffer = &priBuffer->hdl;
     hdi_gbm_bo_destroy(bo);
-    GRALLOC_UNLOCK();
     return HDF_SUCCESS;
 error:
     close(fd);
+    if (metadataFd >= 0) {
+        close(metadataFd);
+    }
     hdi_gbm_bo_destroy(bo);
     if (priBuffer != nullptr) {
         free(priBuffer);
     }
-    GRALLOC_UNLOCK();
     return HDF_FAILURE;
 }
 
+int32_t GbmAllocMem(const AllocInfo *info, BufferHandle **buffer)
+{
+    DISPLAY_CHK_RETURN((info == nullptr), HDF_FAILURE, DISPLAY_LOGE("info is null"));
+    DISPLAY_CHK_RETURN((buffer == nullptr), HDF_FAILURE, DISPLAY_LOGE("buffer is null"));
+    uint32_t drmFmt = ConvertFormatToDrm(static_cast<PixelFormat>(info->format));
+    DISPLAY_CHK_RETURN((drmFmt == INVALID_PIXEL_FMT), HDF_ERR_NOT_SUPPORT,
+        DISPLAY_LOGE("format %{public}d can not support", info->format));
+    DISPLAY_LOGD("requeset width %{public}d, heigt %{public}d, format %{public}d",
+        info->width, info->height, drmFmt);
+
+    g_poolEnabled = true;
+    SweepPool();
+    BufferHandle *pooled = TakePoolBuffer(info);
+    if (pooled != nullptr) {
+        DISPLAY_LOGD("reuse the freed buffer fd %{public}d", pooled->fd);
+        *buffer = pooled;
+        return HDF_SUCCESS;
+    }
+
+    pthread_rwlock_rdlock(&g_deviceLock);
+    GRALLOC_LOCK();
+    GrallocManager *grallocManager = GetGrallocManager();
+    DISPLAY_CHK_RETURN((grallocManager == nullptr), HDF_ERR_INVALID_PARAM, DISPLAY_LOGE("gralloc manager failed");
+        GRALLOC_UNLOCK(); pthread_rwlock_unlock(&g_deviceLock));
+    struct gbm_device *gbmDevice = grallocManager->gbmDevice;
+    GRALLOC_UNLOCK();
+    int32_t ret = CreateBuffer(gbmDevice, info, drmFmt, buffer);
+    pthread_rwlock_unlock(&g_deviceLock);
+    return ret;
+}
+
 static void CloseBufferHandle(BufferHandle *handle)
 {
     DISPLAY_CHK_RETURN_NOT_VALUE((handle == nullptr), DISPLAY_LOGE("buffer is null"));
@@ -353,6 +662,11 @@ void GbmFreeMem(BufferHandle *buffer)
     if ((buffer->virAddr != nullptr) && (GbmUnmap(buffer) != HDF_SUCCESS)) {
         DISPLAY_LOGE("freeMem unmap buffer failed");
     }
+    // kept for reuse when nothing else refers to it any more, which is why it is unmapped first
+    if (PutPoolBuffer(buffer)) {
+        SweepPool();
+        return;
+    }
     CloseBufferHandle(buffer);
     free(buffer);
 }
@@ -389,6 +703,9 @@ int32_t GbmUnmap(BufferHandle *buffer)
         DISPLAY_LOGE("virAddr is nullptr , has not map the buffer");
         return HDF_ERR_INVALID_PARAM;
     }
+    if (NeedDmaBufferSync(buffer) && (EndCpuAccess(buffer, true) != HDF_SUCCESS)) {
+        DISPLAY_LOGE("end the cpu access failed");
+    }
     int ret = munmap(buffer->virAddr, buffer->size);
     if (ret != 0) {
         DISPLAY_LOGE("munmap failed err: %{public}s", strerror(errno));
@@ -401,29 +718,294 @@ int32_t GbmUnmap(BufferHandle *buffer)
 int32_t GbmInvalidateCache(BufferHandle *buffer)
 {
     DISPLAY_LOGD();
-    return DmaBufferSync(buffer, true);
+    DISPLAY_CHK_RETURN((buffer == nullptr), HDF_FAILURE, DISPLAY_LOGE("buffer is null"));
+    if (!NeedDmaBufferSync(buffer)) {
+        return HDF_SUCCESS;
+    }
+    return BeginCpuAccess(buffer);
 }
 
 int32_t GbmFlushCache(BufferHandle *buffer)
 {
     DISPLAY_LOGD();
-    return DmaBufferSync(buffer, false);
+    DISPLAY_CHK_RETURN((buffer == nullptr), HDF_FAILURE, DISPLAY_LOGE("buffer is null"));
+    if (!NeedDmaBufferSync(buffer)) {
+        return HDF_SUCCESS;
+    }
+    return EndCpuAccess(buffer, false);
+}
+
+bool GbmIsSupportedAlloc(const VerifyAllocInfo *info)
+{
+    DISPLAY_CHK_RETURN((info == nullptr), false, DISPLAY_LOGE("info is null"));
+    if ((info->width == 0) || (info->height == 0)) {
+        return false;
+    }
+    uint32_t drmFmt = ConvertFormatToDrm(static_cast<PixelFormat>(info->format));
+    return (drmFmt != DRM_FORMAT_INVALID) && hdi_gbm_format_supported(drmFmt);
+}
+
+uint32_t GbmGetImageLayout(const BufferHandle *buffer, struct gbm_plane_layout *planes, uint32_t num)
+{
+    DISPLAY_CHK_RETURN(((buffer == nullptr) || (planes == nullptr)), 0, DISPLAY_LOGE("buffer or planes is null"));
+    DISPLAY_CHK_RETURN(((buffer->height <= 0) || (buffer->stride <= 0)), 0, DISPLAY_LOGE("the buffer is empty"));
+    uint32_t drmFmt = ConvertFormatToDrm(static_cast<PixelFormat>(buffer->format));
+    DISPLAY_CHK_RETURN((drmFmt == DRM_FORMAT_INVALID), 0, DISPLAY_LOGE("the format is not supported"));
+    return hdi_gbm_get_plane_layout(drmFmt, buffer->height, buffer->stride, planes, num);
+}
+
+int32_t GbmRegisterBuffer(const BufferHandle *buffer)
+{
+    DISPLAY_CHK_RETURN((buffer == nullptr), HDF_ERR_INVALID_PARAM, DISPLAY_LOGE("buffer is null"));
+    DISPLAY_CHK_RETURN((buffer->fd < 0), HDF_ERR_BAD_FD, DISPLAY_LOGE("the buffer has no fd"));
+    struct gbm_plane_layout planes[GBM_MAX_PLANES];
+    uint32_t num = GbmGetImageLayout(buffer, planes, GBM_MAX_PLANES);
+    DISPLAY_CHK_RETURN((num == 0), HDF_ERR_NOT_SUPPORT, DISPLAY_LOGE("the buffer has no known layout"));
+    const struct gbm_plane_layout &last = planes[num - 1];
+    uint64_t end = static_cast<uint64_t>(last.offset) + static_cast<uint64_t>(last.stride) * last.rows;
+    DISPLAY_CHK_RETURN((buffer->size < 0) || (end > static_cast<uint64_t>(buffer->size)), HDF_ERR_INVALID_PARAM,
+        DISPLAY_LOGE("the buffer size %{public}d is smaller than its layout", buffer->size));
+    if (buffer->reserveFds > 0) {
+        struct stat st = {};
+        DISPLAY_CHK_RETURN((fstat(buffer->reserve[0], &st) != 0) || (st.st_size < METADATA_REGION_SIZE),
+            HDF_ERR_INVALID_PARAM, DISPLAY_LOGE("the metadata region of the buffer is invalid"));
+    }
+    return HDF_SUCCESS;
+}
+
+// a region written by another process is trusted no further than its bounds
+// any process holding the buffer may write the region at any time, so each field is read once into a local
+// and only the checked copy is used
+static uint32_t LoadShared(const uint32_t &value)
+{
+    return __atomic_load_n(&value, __ATOMIC_RELAXED);
+}
+
+static bool LoadMetadataHeader(const MetadataRegion *region, uint32_t &count, uint32_t &used)
+{
+    count = LoadShared(region->count);
+    used = LoadShared(region->used);
+    return (LoadShared(region->magic) == METADATA_MAGIC) && (count <= METADATA_MAX_KEYS) &&
+        (used <= METADATA_DATA_SIZE);
+}
+
+// 'used' is the checked copy of the header, so a valid entry lies within the data
+static bool LoadMetadataEntry(const MetadataRegion *region, uint32_t index, uint32_t used, MetadataEntry &entry)
+{
+    entry.key = LoadShared(region->entries[index].key);
+    entry.offset = LoadShared(region->entries[index].offset);
+    entry.size = LoadShared(region->entries[index].size);
+    return (entry.offset <= used) && (entry.size <= used - entry.offset);
+}
+
+static bool IsMetadataValid(const MetadataRegion *region)
+{
+    uint32_t count = 0;
+    uint32_t used = 0;
+    if (!LoadMetadataHeader(region, count, used)) {
+        return false;
+    }
+    MetadataEntry entry;
+    for (uint32_t i = 0; i < count; i++) {
+        if (!LoadMetadataEntry(region, i, used, entry)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static MetadataRegion *MapMetadata(const BufferHandle *buffer)
+{
+    DISPLAY_CHK_RETURN((buffer == nullptr), nullptr, DISPLAY_LOGE("buffer is null"));
+    DISPLAY_CHK_RETURN(((buffer->reserveFds < 1) || (buffer->reserve[0] < 0)), nullptr,
+        DISPLAY_LOGE("the buffer has no metadata region"));
+    void *addr = mmap(nullptr, METADATA_REGION_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, buffer->reserve[0], 0);
+    DISPLAY_CHK_RETURN((addr == MAP_FAILED), nullptr, DISPLAY_LOGE("mmap metadata failed errno %{public}d", errno));
+    auto region = static_cast<MetadataRegion *>(addr);
+    if (!IsMetadataValid(region)) {
+        region->magic = METADATA_MAGIC;
+        region->count = 0;
+        region->used = 0;
+    }
+    return region;
+}
+
+static void UnmapMetadata(MetadataRegion *region)
+{
+    if (munmap(region, METADATA_REGION_SIZE) != 0) {
+        DISPLAY_LOGE("munmap metadata failed errno %{public}d", errno);
+    }
+}
+
+// the index of the key with its checked entry, -1 when it is missing or its entry is broken
+static int32_t FindMetadata(const MetadataRegion *region, uint32_t count, uint32_t used, uint32_t key,
+    MetadataEntry &entry)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        if (LoadShared(region->entries[i].key) != key) {
+            continue;
+        }
+        if (!LoadMetadataEntry(region, i, used, entry) || (entry.key != key)) {
+            DISPLAY_LOGE("the metadata %{public}u is broken", key);
+            return -1;
+        }
+        return static_cast<int32_t>(i);
+    }
+    return -1;
+}
+
+// moves the values behind the removed one forward, so the free space stays in one piece.
+// 'removed' is the checked entry at index, count and used are updated to what is written back
+static void RemoveMetadata(MetadataRegion *region, uint32_t index, const MetadataEntry &removed, uint32_t &count,
+    uint32_t &used)
+{
+    const uint32_t end = removed.offset + removed.size;
+    if (memmove_s(region->data + removed.offset, METADATA_DATA_SIZE - removed.offset, region->data + end,
+        used - end) != EOK) {
+        DISPLAY_LOGE("memmove_s failed");
+    }
+    used -= removed.size;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t offset = LoadShared(region->entries[i].offset);
+        if (offset > removed.offset) {
+            region->entries[i].offset = offset - removed.size;
+        }
+    }
+    count--;
+    region->entries[index] = region->entries[count];
+    region->used = used;
+    region->count = count;
+}
+
+int32_t GbmSetMetadata(const BufferHandle *buffer, uint32_t key, const uint8_t *value, uint32_t size)
+{
+    DISPLAY_CHK_RETURN(((value == nullptr) || (size == 0)), HDF_ERR_INVALID_PARAM, DISPLAY_LOGE("value is empty"));
+    pthread_mutex_lock(&g_metadataLock);
+    MetadataRegion *region = MapMetadata(buffer);
+    DISPLAY_CHK_RETURN((region == nullptr), HDF_FAILURE, pthread_mutex_unlock(&g_metadataLock));
+    uint32_t count = 0;
+    uint32_t used = 0;
+    MetadataEntry entry = {0, 0, 0};
+    int32_t index = -1;
+    int32_t ret = HDF_SUCCESS;
+    if (!LoadMetadataHeader(region, count, used)) {
+        DISPLAY_LOGE("the metadata region is broken");
+        ret = HDF_FAILURE;
+    } else {
+        index = FindMetadata(region, count, used, key, entry);
+        if (((index < 0) && (count >= METADATA_MAX_KEYS)) || (size > METADATA_DATA_SIZE - (used - entry.size))) {
+            DISPLAY_LOGE("no room for the metadata %{public}u of %{public}u bytes", key, size);
+            ret = HDF_DEV_ERR_NO_MEMORY;
+        }
+    }
+    if (ret == HDF_SUCCESS) {
+        if (index >= 0) {
+            RemoveMetadata(region, static_cast<uint32_t>(index), entry, count, used);
+        }
+        region->entries[count] = {key, used, size};
+        (void)memcpy_s(region->data + used, METADATA_DATA_SIZE - used, value, size);
+        region->used = used + size;
+        region->count = count + 1;
+    }
+    UnmapMetadata(region);
+    pthread_mutex_unlock(&g_metadataLock);
+    return ret;
+}
+
+int32_t GbmGetMetadata(const BufferHandle *buffer, uint32_t key, uint8_t *value, uint32_t *size)
+{
+    DISPLAY_CHK_RETURN((size == nullptr), HDF_ERR_INVALID_PARAM, DISPLAY_LOGE("size is null"));
+    pthread_mutex_lock(&g_metadataLock);
+    MetadataRegion *region = MapMetadata(buffer);
+    DISPLAY_CHK_RETURN((region == nullptr), HDF_FAILURE, pthread_mutex_unlock(&g_metadataLock));
+    uint32_t count = 0;
+    uint32_t used = 0;
+    MetadataEntry entry = {0, 0, 0};
+    int32_t index = -1;
+    if (LoadMetadataHeader(region, count, used)) {
+        index = FindMetadata(region, count, used, key, entry);
+    }
+    int32_t ret = HDF_SUCCESS;
+    if (index < 0) {
+        DISPLAY_LOGD("no metadata %{public}u", key);
+        ret = HDF_FAILURE;
+    } else if (value == nullptr) {
+        // asks for the size only
+        *size = entry.size;
+    } else if (*size < entry.size) {
+        DISPLAY_LOGE("no room for the metadata %{public}u", key);
+        ret = HDF_ERR_INVALID_PARAM;
+    } else {
+        (void)memcpy_s(value, *size, region->data + entry.offset, entry.size);
+        *size = entry.size;
+    }
+    UnmapMetadata(region);
+    pthread_mutex_unlock(&g_metadataLock);
+    return ret;
+}
+
+int32_t GbmListMetadataKeys(const BufferHandle *buffer, uint32_t *keys, uint32_t *num)
+{
+    DISPLAY_CHK_RETURN((num == nullptr), HDF_ERR_INVALID_PARAM, DISPLAY_LOGE("num is null"));
+    pthread_mutex_lock(&g_metadataLock);
+    MetadataRegion *region = MapMetadata(buffer);
+    DISPLAY_CHK_RETURN((region == nullptr), HDF_FAILURE, pthread_mutex_unlock(&g_metadataLock));
+    uint32_t count = 0;
+    uint32_t used = 0;
+    if (!LoadMetadataHeader(region, count, used)) {
+        count = 0;
+    }
+    if (keys != nullptr) {
+        *num = std::min(*num, count);
+        for (uint32_t i = 0; i < *num; i++) {
+            keys[i] = LoadShared(region->entries[i].key);
+        }
+    } else {
+        *num = count;
+    }
+    UnmapMetadata(region);
+    pthread_mutex_unlock(&g_metadataLock);
+    return HDF_SUCCESS;
+}
+
+int32_t GbmEraseMetadataKey(const BufferHandle *buffer, uint32_t key)
+{
+    pthread_mutex_lock(&g_metadataLock);
+    MetadataRegion *region = MapMetadata(buffer);
+    DISPLAY_CHK_RETURN((region == nullptr), HDF_FAILURE, pthread_mutex_unlock(&g_metadataLock));
+    uint32_t count = 0;
+    uint32_t used = 0;
+    MetadataEntry entry = {0, 0, 0};
+    int32_t index = -1;
+    if (LoadMetadataHeader(region, count, used)) {
+        index = FindMetadata(region, count, used, key, entry);
+    }
+    if (index >= 0) {
+        RemoveMetadata(region, static_cast<uint32_t>(index), entry, count, used);
+    }
+    UnmapMetadata(region);
+    pthread_mutex_unlock(&g_metadataLock);
+    DISPLAY_CHK_RETURN((index < 0), HDF_FAILURE, DISPLAY_LOGD("no metadata %{public}u", key));
+    return HDF_SUCCESS;
 }
 
 int32_t GbmGrallocUninitialize(void)
 {
     DISPLAY_LOGD();
+    pthread_rwlock_wrlock(&g_deviceLock);
     GRALLOC_LOCK();
     GrallocManager *grallocManager = GetGrallocManager();
     DISPLAY_CHK_RETURN((grallocManager == nullptr), HDF_ERR_INVALID_PARAM, DISPLAY_LOGE("gralloc manager failed"); \
-        GRALLOC_UNLOCK());
+        GRALLOC_UNLOCK(); pthread_rwlock_unlock(&g_deviceLock));
     grallocManager->referCount--;
     if (grallocManager->referCount < 0) {
+        TrimPool(true);
         DeInitGbmDevice(grallocManager);
         free(g_grallocManager);
         g_grallocManager = nullptr;
     }
     GRALLOC_UNLOCK();
+    pthread_rwlock_unlock(&g_deviceLock);
     return HDF_SUCCESS;
 }
 
@@ -15,9 +15,11 @@
 
 #ifndef DISPLAY_GRALLOC_GBM_H
 #define DISPLAY_GRALLOC_GBM_H
+#include <pthread.h>
 #include "buffer_handle.h"
 #include "hdf_dlist.h"
 #include "hdf_log.h"
+#include "hi_gbm.h"
 #include "v1_0/display_buffer_type.h"
 
 namespace OHOS {
@@ -38,6 +40,18 @@ using GbmBoList = struct {
     int fd;
 };
 
+// a freed buffer kept for the next allocation of the same size and format
+using GbmPoolEntry = struct {
+    struct DListHead entry;
+    BufferHandle *buffer;
+    uint64_t freeTime;
+};
+
+using GbmPoolShard = struct {
+    pthread_mutex_t lock;
+    struct DListHead head; // the oldest first
+};
+
 int32_t GbmAllocMem(const AllocInfo *info, BufferHandle **buffer);
 void GbmFreeMem(BufferHandle *buffer);
 void *GbmMmap(BufferHandle *buffer);
@@ -46,6 +60,14 @@ int32_t GbmInvalidateCache(BufferHandle *buffer);
 int32_t GbmFlushCache(BufferHandle *buffer);
 int32_t GbmGrallocUninitialize(void);
 int32_t GbmGrallocInitialize(void);
+bool GbmIsSupportedAlloc(const VerifyAllocInfo *info);
+int32_t GbmRegisterBuffer(const BufferHandle *buffer);
+uint32_t GbmGetImageLayout(const BufferHandle *buffer, struct gbm_plane_layout *planes, uint32_t num);
+// the metadata lives in a shared region passed along with the buffer as its first reserve fd
+int32_t GbmSetMetadata(const BufferHandle *buffer, uint32_t key, const uint8_t *value, uint32_t size);
+int32_t GbmGetMetadata(const BufferHandle *buffer, uint32_t key, uint8_t *value, uint32_t *size);
+int32_t GbmListMetadataKeys(const BufferHandle *buffer, uint32_t *keys, uint32_t *num);
+int32_t GbmEraseMetadataKey(const BufferHandle *buffer, uint32_t key);
 
 #ifdef GRALLOC_LOCK_DEBUG
 #define GRALLOC_LOCK(format, ...)                                                                                    \
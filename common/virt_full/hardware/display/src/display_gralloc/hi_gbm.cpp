@@ -204,6 +204,36 @@ int hdi_gbm_bo_get_fd(struct gbm_bo *bo)
         DISPLAY_LOGE("drmPrimeHandleToFD  failed ret: %{public}d  errno: %{public}d", ret, errno));
     return fd;
 }
+
+bool hdi_gbm_format_supported(uint32_t format)
+{
+    return GetFormatInfo(format) != nullptr;
+}
+
+// the planes of a buffer laid out by hdi_gbm_bo_create, returns how many there are
+uint32_t hdi_gbm_get_plane_layout(uint32_t format, uint32_t height, uint32_t stride, struct gbm_plane_layout *planes,
+    uint32_t num)
+{
+    const FormatInfo *fmtInfo = GetFormatInfo(format);
+    DISPLAY_CHK_RETURN((fmtInfo == nullptr), 0, DISPLAY_LOGE("formt: 0x%{public}x can not get layout info", format));
+    DISPLAY_CHK_RETURN(((planes == nullptr) || (num == 0)), 0, DISPLAY_LOGE("no room for the planes"));
+    if (fmtInfo->planes == nullptr) {
+        planes[0] = {0, stride, height};
+        return 1;
+    }
+    const PlaneLayoutInfo *layout = fmtInfo->planes;
+    uint32_t count = (layout->numPlanes < MAX_PLANES) ? layout->numPlanes : MAX_PLANES;
+    count = (count < num) ? count : num;
+    uint32_t offset = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        // the chroma planes of the planar formats are half as wide, the semi-planar ones interleave it at full width
+        uint32_t planeStride = ((i > 0) && (layout->numPlanes > 2)) ? (stride / 2) : stride;
+        uint32_t size = DIV_ROUND_UP(stride * height * layout->radio[i], layout->radio[0]);
+        planes[i] = {offset, planeStride, (planeStride == 0) ? 0 : (size / planeStride)};
+        offset += size;
+    }
+    return count;
+}
 } // namespace DISPLAY
 } // namespace HDI
 } // namespace OHOS
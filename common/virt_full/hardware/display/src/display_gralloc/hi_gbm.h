@@ -23,6 +23,15 @@ namespace DISPLAY {
 struct gbm_device;
 struct gbm_bo;
 
+const uint32_t GBM_MAX_PLANES = 3U;
+
+// where a plane starts in the buffer, the bytes per row and the rows
+struct gbm_plane_layout {
+    uint32_t offset;
+    uint32_t stride;
+    uint32_t rows;
+};
+
 enum gbm_bo_flags {
     /* *
      * Buffer is going to be presented to the screen using an API such as KMS
@@ -94,6 +103,9 @@ uint32_t hdi_gbm_bo_get_height(struct gbm_bo *bo);
 uint32_t hdi_gbm_bo_get_size(struct gbm_bo *bo);
 void hdi_gbm_bo_destroy(struct gbm_bo *bo);
 int hdi_gbm_bo_get_fd(struct gbm_bo *bo);
+bool hdi_gbm_format_supported(uint32_t format);
+uint32_t hdi_gbm_get_plane_layout(uint32_t format, uint32_t height, uint32_t stride, struct gbm_plane_layout *planes,
+    uint32_t num);
 } // namespace DISPLAY
 } // namespace HDI
 } // namespace OHOS
@@ -37,10 +37,227 @@
 #include "los_vm_lock.h"
 #include "los_hw.h"
 #include "los_atomic.h"
+#include "los_memory.h"
+#include "los_mux.h"
 #include "los_vm_common.h"
 #include "los_process_pri.h"
 #include "target_config.h"
 
+#define MMZ_SECTION_SIZE            0x100000    /* ARM short-descriptor section */
+#define MMZ_SECTION_PAGES           (MMZ_SECTION_SIZE >> PAGE_SHIFT)
+#define MMZ_SMALL_CLASS_PAGES       16          /* up to 64K, power-of-two classes */
+#define MMZ_LARGE_CLASS_PAGES       16          /* above, 64K granularity */
+#define MMZ_POOL_CACHE_MAX          0x1000000   /* keep at most 16M of freed buffers */
+
+/*
+ * Physically contiguous block owned by the pool. Blocks in use are mapped
+ * into exactly one user region; freed blocks are kept on an LRU list so that
+ * buffer churn of the same size reuses them without going to the buddy
+ * allocator. The pool holds one reference on every page, so MmzMap users
+ * never drop them to zero.
+ */
+typedef struct {
+    LOS_DL_LIST node;
+    VOID *kvaddr;
+    PADDR_T paddr;
+    UINT32 nPages;
+    BOOL cached;            /* last user mapping was cached */
+    UINT32 cpuStart;        /* [cpuStart, cpuEnd) is owned by CPU, bytes */
+    UINT32 cpuEnd;
+    BOOL cpuExact;          /* FALSE once the CPU range is only a hull */
+    UINT32 pid;             /* owner while in use */
+    LosVmSpace *space;
+    VADDR_T vaddr;
+} MmzBlock;
+
+static LosMux g_mmzPoolMux;
+static LOS_DL_LIST g_mmzFreeBlocks;
+static LOS_DL_LIST g_mmzUsedBlocks;
+static MmzStat g_mmzStat;
+
+static UINT32 MmzClassPages(UINT32 nPages)
+{
+    UINT32 pages = 1;
+
+    if (nPages >= MMZ_SECTION_PAGES) {
+        return ROUNDUP(nPages, MMZ_SECTION_PAGES);
+    }
+    if (nPages > MMZ_SMALL_CLASS_PAGES) {
+        return ROUNDUP(nPages, MMZ_LARGE_CLASS_PAGES);
+    }
+    while (pages < nPages) {
+        pages <<= 1;
+    }
+    return pages;
+}
+
+static BOOL MmzBlockBusy(const MmzBlock *block)
+{
+    LosVmPage *vmPage = NULL;
+    UINT32 i;
+
+    /* someone still holds a MmzMap mapping of it */
+    for (i = 0; i < block->nPages; i++) {
+        vmPage = LOS_VmPageGet(block->paddr + (i << PAGE_SHIFT));
+        if ((vmPage == NULL) || (LOS_AtomicRead(&vmPage->refCounts) > 1)) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static MmzBlock *MmzBlockCreate(UINT32 nPages)
+{
+    MmzBlock *block = NULL;
+    LosVmPage *vmPage = NULL;
+    UINT32 i;
+
+    block = LOS_MemAlloc(m_aucSysMem0, sizeof(MmzBlock));
+    if (block == NULL) {
+        return NULL;
+    }
+    block->kvaddr = LOS_PhysPagesAllocContiguous(nPages);
+    if (block->kvaddr == NULL) {
+        (VOID)LOS_MemFree(m_aucSysMem0, block);
+        return NULL;
+    }
+    block->paddr = LOS_PaddrQuery(block->kvaddr);
+    block->nPages = nPages;
+    block->cached = FALSE;
+    block->space = NULL;
+    for (i = 0; i < nPages; i++) {
+        vmPage = LOS_VmPageGet(block->paddr + (i << PAGE_SHIFT));
+        LOS_AtomicSet(&vmPage->refCounts, 1);
+    }
+    return block;
+}
+
+static VOID MmzBlockDestroy(MmzBlock *block)
+{
+    LosVmPage *vmPage = NULL;
+    UINT32 i;
+
+    for (i = 0; i < block->nPages; i++) {
+        vmPage = LOS_VmPageGet(block->paddr + (i << PAGE_SHIFT));
+        LOS_AtomicSet(&vmPage->refCounts, 0);
+    }
+    LOS_PhysPagesFreeContiguous(block->kvaddr, block->nPages);
+    (VOID)LOS_MemFree(m_aucSysMem0, block);
+}
+
+/* Cached lines of the old user must not land on top of a later uncached user. */
+static VOID MmzBlockRecycle(MmzBlock *block)
+{
+    if (block->cached) {
+        DCacheFlushRange((UINTPTR)block->kvaddr, (UINTPTR)block->kvaddr + (block->nPages << PAGE_SHIFT));
+        block->cached = FALSE;
+    }
+    block->space = NULL;
+    block->vaddr = 0;
+    LOS_ListDelete(&block->node);
+    LOS_ListTailInsert(&g_mmzFreeBlocks, &block->node);
+    g_mmzStat.usedBlocks--;
+    g_mmzStat.usedBytes -= block->nPages << PAGE_SHIFT;
+    g_mmzStat.cachedBlocks++;
+    g_mmzStat.cachedBytes += block->nPages << PAGE_SHIFT;
+}
+
+/* Owner exited or unmapped the buffer without MMZ_FREE, take the block back. */
+static BOOL MmzBlockOrphaned(const MmzBlock *block)
+{
+    LosProcessCB *processCB = OS_PCB_FROM_PID(block->pid);
+    PADDR_T paddr;
+
+    if (block->space == NULL) {
+        return FALSE;   /* being set up */
+    }
+    if (OsProcessIsInactive(processCB) || (processCB->vmSpace != block->space)) {
+        return TRUE;
+    }
+    if (LOS_ArchMmuQuery(&block->space->archMmu, block->vaddr, &paddr, NULL) != LOS_OK) {
+        return TRUE;
+    }
+    return (paddr != block->paddr);
+}
+
+static VOID MmzPoolReclaim(VOID)
+{
+    MmzBlock *block = NULL;
+    MmzBlock *next = NULL;
+
+    LOS_DL_LIST_FOR_EACH_ENTRY_SAFE(block, next, &g_mmzUsedBlocks, MmzBlock, node) {
+        if (MmzBlockOrphaned(block)) {
+            MmzBlockRecycle(block);
+        }
+    }
+}
+
+/* Shrink the cache down to 'limit' bytes, least recently freed first. */
+static VOID MmzPoolTrim(UINT32 limit)
+{
+    MmzBlock *block = NULL;
+    MmzBlock *next = NULL;
+
+    /* orphans count as cache too, so they age out with it */
+    MmzPoolReclaim();
+    LOS_DL_LIST_FOR_EACH_ENTRY_SAFE(block, next, &g_mmzFreeBlocks, MmzBlock, node) {
+        if (g_mmzStat.cachedBytes <= limit) {
+            break;
+        }
+        if (MmzBlockBusy(block)) {
+            continue;
+        }
+        LOS_ListDelete(&block->node);
+        g_mmzStat.cachedBlocks--;
+        g_mmzStat.cachedBytes -= block->nPages << PAGE_SHIFT;
+        MmzBlockDestroy(block);
+    }
+}
+
+static MmzBlock *MmzPoolGet(UINT32 nPages)
+{
+    MmzBlock *block = NULL;
+
+    LOS_DL_LIST_FOR_EACH_ENTRY(block, &g_mmzFreeBlocks, MmzBlock, node) {
+        if ((block->nPages == nPages) && !MmzBlockBusy(block)) {
+            LOS_ListDelete(&block->node);
+            g_mmzStat.cachedBlocks--;
+            g_mmzStat.cachedBytes -= nPages << PAGE_SHIFT;
+            g_mmzStat.poolHits++;
+            goto DONE;
+        }
+    }
+
+    block = MmzBlockCreate(nPages);
+    if (block == NULL) {
+        /* give the buddy allocator everything we hold and retry once */
+        MmzPoolTrim(0);
+        block = MmzBlockCreate(nPages);
+        if (block == NULL) {
+            return NULL;
+        }
+    }
+
+DONE:
+    LOS_ListAdd(&g_mmzUsedBlocks, &block->node);
+    g_mmzStat.allocCount++;
+    g_mmzStat.usedBlocks++;
+    g_mmzStat.usedBytes += nPages << PAGE_SHIFT;
+    return block;
+}
+
+static MmzBlock *MmzPoolFind(PADDR_T paddr)
+{
+    MmzBlock *block = NULL;
+
+    LOS_DL_LIST_FOR_EACH_ENTRY(block, &g_mmzUsedBlocks, MmzBlock, node) {
+        if (block->paddr == paddr) {
+            return block;
+        }
+    }
+    return NULL;
+}
+
 static int MmzOpen(struct file *filep)
 {
     return 0;
@@ -48,9 +265,37 @@ static int MmzOpen(struct file *filep)
 
 static int MmzClose(struct file *filep)
 {
+    /* exiting owners close the device, pick up what earlier ones left behind */
+    (VOID)LOS_MuxAcquire(&g_mmzPoolMux);
+    MmzPoolTrim(MMZ_POOL_CACHE_MAX);
+    (VOID)LOS_MuxRelease(&g_mmzPoolMux);
     return 0;
 }
 
+/*
+ * Buffers of 1M and more get a section aligned user address, so the MMU maps
+ * them with 1M sections instead of one small page entry per 4K.
+ */
+static LosVmMapRegion *MmzRegionAlloc(LosVmSpace *space, UINT32 size, UINT32 vmFlags)
+{
+    LosVmMapRegion *region = NULL;
+    VADDR_T vaddr;
+
+    if (size < MMZ_SECTION_SIZE) {
+        return LOS_RegionAlloc(space, 0, size, vmFlags, 0);
+    }
+
+    (VOID)LOS_MuxAcquire(&space->regionMux);
+    region = LOS_RegionAlloc(space, 0, size + MMZ_SECTION_SIZE, vmFlags, 0);
+    if (region != NULL) {
+        vaddr = ROUNDUP(region->range.base, MMZ_SECTION_SIZE);
+        (VOID)LOS_RegionFree(space, region);
+        region = LOS_RegionAlloc(space, vaddr, size, vmFlags, 0);
+    }
+    (VOID)LOS_MuxRelease(&space->regionMux);
+    return (region != NULL) ? region : LOS_RegionAlloc(space, 0, size, vmFlags, 0);
+}
+
 static ssize_t MmzAlloc(int cmd, unsigned long arg)
 {
     UINT32 vmFlags = VM_MAP_REGION_FLAG_PERM_USER |
@@ -60,11 +305,8 @@ static ssize_t MmzAlloc(int cmd, unsigned long arg)
     MmzMemory *mmzm = (MmzMemory *)arg;
     LosVmSpace *curVmSpace = OsCurrProcessGet()->vmSpace;
     LosVmMapRegion *vmRegion;
-    VOID *kvaddr;
-    PADDR_T paddr;
-    VADDR_T vaddr;
-    UINT32 size = ROUNDUP(mmzm->size, PAGE_SIZE);
-    LosVmPage *vmPage = NULL;
+    MmzBlock *block = NULL;
+    UINT32 nPages = MmzClassPages(ROUNDUP(mmzm->size, PAGE_SIZE) >> PAGE_SHIFT);
 
     switch (cmd) {
         case MMZ_CACHE_TYPE:
@@ -77,42 +319,44 @@ static ssize_t MmzAlloc(int cmd, unsigned long arg)
             PRINT_ERR("%s %d: %d\n", __func__, __LINE__, cmd);
             return -EINVAL;
     }
-    vmRegion = LOS_RegionAlloc(curVmSpace, 0, size, vmFlags, 0);
+    vmRegion = MmzRegionAlloc(curVmSpace, nPages << PAGE_SHIFT, vmFlags);
     if (vmRegion == NULL) {
-        PRINT_ERR("cmd: %d, size: %#x vaddr alloc failed\n", cmd, size);
+        PRINT_ERR("cmd: %d, size: %#x vaddr alloc failed\n", cmd, nPages << PAGE_SHIFT);
         return -ENOMEM;
     }
+    /* pages belong to the pool, region teardown must only unmap them */
+    LOS_SetRegionTypeDev(vmRegion);
 
-    kvaddr = (void *)LOS_PhysPagesAllocContiguous(size >> PAGE_SHIFT);
-    if (kvaddr == NULL) {
+    (VOID)LOS_MuxAcquire(&g_mmzPoolMux);
+    block = MmzPoolGet(nPages);
+    if (block == NULL) {
+        (VOID)LOS_MuxRelease(&g_mmzPoolMux);
         LOS_RegionFree(curVmSpace, vmRegion);
-        PRINT_ERR("size: %#x paddr alloc failed\n", size);
+        PRINT_ERR("size: %#x paddr alloc failed\n", nPages << PAGE_SHIFT);
         return -ENOMEM;
     }
 
-    paddr = LOS_PaddrQuery(kvaddr);
-    mmzm->paddr = paddr;
-    vaddr = vmRegion->range.base;
-    while (size > 0) {
-        vmPage = LOS_VmPageGet(paddr);
-        if (vmPage == NULL) {
-            LOS_RegionFree(curVmSpace, vmRegion);
-            VM_ERR("Page is NULL");
-            return -EINVAL;
-        }
-        LOS_AtomicInc(&vmPage->refCounts);
-
-        status = LOS_ArchMmuMap(&curVmSpace->archMmu, vaddr, paddr, 1, vmFlags);
-        if (status <= 0) {
-            VM_ERR("LOS_ArchMmuMap failed: %d", status);
-            LOS_RegionFree(curVmSpace, vmRegion);
-            return status;
-        }
-
-        paddr += PAGE_SIZE;
-        vaddr += PAGE_SIZE;
-        size -= PAGE_SIZE;
+    /* one call for the whole range, aligned 1M chunks become sections */
+    status = LOS_ArchMmuMap(&curVmSpace->archMmu, vmRegion->range.base, block->paddr, nPages, vmFlags);
+    if (status <= 0) {
+        VM_ERR("LOS_ArchMmuMap failed: %d", status);
+        (VOID)LOS_MuxRelease(&g_mmzPoolMux);
+        LOS_RegionFree(curVmSpace, vmRegion);
+        (VOID)LOS_MuxAcquire(&g_mmzPoolMux);
+        MmzBlockRecycle(block);
+        (VOID)LOS_MuxRelease(&g_mmzPoolMux);
+        return status;
     }
+    block->cached = (cmd == MMZ_CACHE_TYPE);
+    block->cpuStart = 0;
+    block->cpuEnd = nPages << PAGE_SHIFT;
+    block->cpuExact = TRUE;
+    block->pid = OsCurrProcessGet()->processID;
+    block->space = curVmSpace;
+    block->vaddr = vmRegion->range.base;
+    (VOID)LOS_MuxRelease(&g_mmzPoolMux);
+
+    mmzm->paddr = block->paddr;
     mmzm->vaddr = (void *)vmRegion->range.base;
     return LOS_OK;
 }
@@ -180,7 +424,14 @@ static ssize_t MmzUnMap(unsigned long arg)
 {
     LosVmSpace *curVmSpace = OsCurrProcessGet()->vmSpace;
     MmzMemory *mmzm = (MmzMemory *)arg;
-    return OsUnMMap(curVmSpace, (VADDR_T)mmzm->vaddr, mmzm->size);
+    ssize_t ret;
+
+    ret = OsUnMMap(curVmSpace, (VADDR_T)mmzm->vaddr, mmzm->size);
+    /* unmapping the owner's mapping without MMZ_FREE orphans the block */
+    (VOID)LOS_MuxAcquire(&g_mmzPoolMux);
+    MmzPoolTrim(MMZ_POOL_CACHE_MAX);
+    (VOID)LOS_MuxRelease(&g_mmzPoolMux);
+    return ret;
 }
 
 static ssize_t MmzFree(unsigned long arg)
@@ -188,6 +439,7 @@ static ssize_t MmzFree(unsigned long arg)
     MmzMemory *mmzm = (MmzMemory *)arg;
     LosVmSpace *curVmSpace = OsCurrProcessGet()->vmSpace;
     LosVmMapRegion *region = NULL;
+    MmzBlock *block = NULL;
     STATUS_T ret = LOS_OK;
 
     (VOID)LOS_MuxAcquire(&curVmSpace->regionMux);
@@ -208,24 +460,181 @@ static ssize_t MmzFree(unsigned long arg)
     if (ret) {
         PRINT_ERR("free region failed, ret = %d", ret);
         ret = -EINVAL;
+        goto DONE;
+    }
+
+    (VOID)LOS_MuxAcquire(&g_mmzPoolMux);
+    block = MmzPoolFind((PADDR_T)mmzm->paddr);
+    if ((block != NULL) && (block->space == curVmSpace)) {
+        MmzBlockRecycle(block);
+        MmzPoolTrim(MMZ_POOL_CACHE_MAX);
     }
+    (VOID)LOS_MuxRelease(&g_mmzPoolMux);
 
 DONE:
     (VOID)LOS_MuxRelease(&curVmSpace->regionMux);
     return ret;
 }
 
+/*
+ * Cache ownership of a buffer. Invalidate hands a range to the CPU, flush
+ * hands it back to the device. The range ioctls trust this protocol and skip
+ * maintenance that cannot change anything: flushing a range the CPU never
+ * took, or invalidating one it still holds. The legacy whole-buffer ioctls
+ * are always performed, since their users write without invalidating first.
+ */
+static VOID MmzOwnerToCpu(MmzBlock *block, UINT32 start, UINT32 end)
+{
+    if (block->cpuStart >= block->cpuEnd) {
+        block->cpuStart = start;
+        block->cpuEnd = end;
+        block->cpuExact = TRUE;
+        return;
+    }
+    if ((end < block->cpuStart) || (start > block->cpuEnd)) {
+        block->cpuExact = FALSE;
+    }
+    block->cpuStart = (start < block->cpuStart) ? start : block->cpuStart;
+    block->cpuEnd = (end > block->cpuEnd) ? end : block->cpuEnd;
+}
+
+static VOID MmzOwnerToDevice(MmzBlock *block, UINT32 start, UINT32 end)
+{
+    if ((end <= block->cpuStart) || (start >= block->cpuEnd)) {
+        return;
+    }
+    if ((start <= block->cpuStart) && (end >= block->cpuEnd)) {
+        block->cpuStart = 0;
+        block->cpuEnd = 0;
+        block->cpuExact = TRUE;
+    } else if (start <= block->cpuStart) {
+        block->cpuStart = end;
+    } else if (end >= block->cpuEnd) {
+        block->cpuEnd = start;
+    } else {
+        block->cpuExact = FALSE;
+    }
+}
+
+static BOOL MmzCacheOpRedundant(const MmzBlock *block, UINT32 start, UINT32 end, BOOL toDevice)
+{
+    if (toDevice) {
+        return (end <= block->cpuStart) || (start >= block->cpuEnd);
+    }
+    return block->cpuExact && (start >= block->cpuStart) && (end <= block->cpuEnd);
+}
+
+static MmzBlock *MmzBlockLookup(const LosVmSpace *space, VADDR_T vaddr)
+{
+    MmzBlock *block = NULL;
+
+    LOS_DL_LIST_FOR_EACH_ENTRY(block, &g_mmzUsedBlocks, MmzBlock, node) {
+        if ((block->space == space) && (vaddr >= block->vaddr) &&
+            (vaddr < block->vaddr + (block->nPages << PAGE_SHIFT))) {
+            return block;
+        }
+    }
+    return NULL;
+}
+
+static ssize_t MmzCacheSync(VADDR_T vaddr, UINT32 size, BOOL toDevice, BOOL lazy)
+{
+    LosVmSpace *curVmSpace = OsCurrProcessGet()->vmSpace;
+    MmzBlock *block = NULL;
+    UINT32 start;
+    UINT32 end;
+    BOOL skip = FALSE;
+
+    (VOID)LOS_MuxAcquire(&g_mmzPoolMux);
+    block = MmzBlockLookup(curVmSpace, vaddr);
+    if (block != NULL) {
+        start = vaddr - block->vaddr;
+        end = ((block->nPages << PAGE_SHIFT) - start < size) ? (block->nPages << PAGE_SHIFT) : (start + size);
+        size = end - start;
+        /* uncached mappings have nothing to maintain */
+        skip = !block->cached || (lazy && MmzCacheOpRedundant(block, start, end, toDevice));
+        if (toDevice) {
+            MmzOwnerToDevice(block, start, end);
+        } else {
+            MmzOwnerToCpu(block, start, end);
+        }
+        g_mmzStat.cacheOpsSkipped += skip ? 1 : 0;
+    }
+    (VOID)LOS_MuxRelease(&g_mmzPoolMux);
+
+    if (skip || (size == 0)) {
+        return LOS_OK;
+    }
+    if (toDevice) {
+        DCacheFlushRange(vaddr, vaddr + size);
+    } else {
+        DCacheInvRange(vaddr, vaddr + size);
+    }
+    return LOS_OK;
+}
+
 static ssize_t MmzFlush(unsigned long arg)
 {
     MmzMemory *mmzm = (MmzMemory *)arg;
-    DCacheFlushRange((unsigned int)mmzm->vaddr, (UINT32)mmzm->vaddr + mmzm->size);
-    return LOS_OK;
+    return MmzCacheSync((VADDR_T)mmzm->vaddr, mmzm->size, TRUE, FALSE);
 }
 
 static ssize_t MmzInvalidate(unsigned long arg)
 {
     MmzMemory *mmzm = (MmzMemory *)arg;
-    DCacheInvRange((unsigned int)mmzm->vaddr, (UINT32)mmzm->vaddr + mmzm->size);
+    return MmzCacheSync((VADDR_T)mmzm->vaddr, mmzm->size, FALSE, FALSE);
+}
+
+static ssize_t MmzFlushRange(unsigned long arg)
+{
+    MmzRange *range = (MmzRange *)arg;
+    return MmzCacheSync((VADDR_T)range->vaddr + range->offset, range->size, TRUE, TRUE);
+}
+
+static ssize_t MmzInvalidateRange(unsigned long arg)
+{
+    MmzRange *range = (MmzRange *)arg;
+    return MmzCacheSync((VADDR_T)range->vaddr + range->offset, range->size, FALSE, TRUE);
+}
+
+/*
+ * Pool usage plus how fragmented free physical memory is: fragPermille is the
+ * share of free pages sitting in buddy blocks too small for a 1M request.
+ */
+static ssize_t MmzGetStat(unsigned long arg)
+{
+    MmzStat *stat = (MmzStat *)arg;
+    struct VmPhysSeg *seg = NULL;
+    struct VmFreeList *list = NULL;
+    UINT32 freePages = 0;
+    UINT32 smallPages = 0;
+    UINT32 intSave;
+    UINT32 order;
+    INT32 segID;
+
+    (VOID)LOS_MuxAcquire(&g_mmzPoolMux);
+    *stat = g_mmzStat;
+    (VOID)LOS_MuxRelease(&g_mmzPoolMux);
+
+    stat->maxFreeOrder = 0;
+    for (segID = 0; segID < g_vmPhysSegNum; segID++) {
+        seg = &g_vmPhysSeg[segID];
+        LOS_SpinLockSave(&seg->freeListLock, &intSave);
+        for (order = 0; order < VM_LIST_ORDER_MAX; order++) {
+            list = &seg->freeList[order];
+            if (list->listCnt == 0) {
+                continue;
+            }
+            freePages += list->listCnt << order;
+            if ((1U << order) < MMZ_SECTION_PAGES) {
+                smallPages += list->listCnt << order;
+            }
+            stat->maxFreeOrder = (order > stat->maxFreeOrder) ? order : stat->maxFreeOrder;
+        }
+        LOS_SpinUnlockRestore(&seg->freeListLock, intSave);
+    }
+    stat->freePages = freePages;
+    stat->fragPermille = (freePages == 0) ? 0 : (UINT32)(((UINT64)smallPages * 1000) / freePages); /* 1000: permille */
     return LOS_OK;
 }
 
@@ -247,6 +656,12 @@ static ssize_t MmzIoctl(struct file *filep, int cmd, unsigned long arg)
             return MmzFlush(arg);
         case MMZ_INVALIDATE_TYPE:
             return MmzInvalidate(arg);
+        case MMZ_STAT_TYPE:
+            return MmzGetStat(arg);
+        case MMZ_FLUSH_RANGE_TYPE:
+            return MmzFlushRange(arg);
+        case MMZ_INVALIDATE_RANGE_TYPE:
+            return MmzInvalidateRange(arg);
         default:
             PRINT_ERR("%s %d: %d\n", __func__, __LINE__, cmd);
             return -EINVAL;
@@ -262,5 +677,10 @@ static const struct file_operations_vfs g_mmzDevOps = {
 
 int DevMmzRegister(void)
 {
+    if (LOS_MuxInit(&g_mmzPoolMux, NULL) != LOS_OK) {
+        return -ENOMEM;
+    }
+    LOS_ListInit(&g_mmzFreeBlocks);
+    LOS_ListInit(&g_mmzUsedBlocks);
     return register_driver(MMZ_NODE, &g_mmzDevOps, 0666, 0); /* 0666: file mode */
 }
@@ -45,6 +45,9 @@ typedef enum {
     FLUSH_CACHE,
     FLUSH_NOCACHE,
     INVALIDATE,
+    STAT,                           /* query pool and fragmentation statistics */
+    FLUSH_RANGE,                    /* hand part of a buffer to the device */
+    INVALIDATE_RANGE,               /* hand part of a buffer to the CPU */
     MMZ_MAX
 } MMZ_TYPE;
 
@@ -54,6 +57,25 @@ typedef struct {
     int32_t size;
 } MmzMemory;
 
+typedef struct {
+    void *vaddr;                    /* buffer start, as returned by allocation */
+    uint32_t offset;
+    uint32_t size;
+} MmzRange;
+
+typedef struct {
+    uint32_t allocCount;            /* allocations since boot */
+    uint32_t poolHits;              /* allocations served by recycled buffers */
+    uint32_t usedBlocks;
+    uint32_t usedBytes;             /* including size-class rounding */
+    uint32_t cachedBlocks;          /* freed buffers kept for reuse */
+    uint32_t cachedBytes;
+    uint32_t freePages;             /* free physical pages of the system */
+    uint32_t maxFreeOrder;          /* largest free buddy block, 2^order pages */
+    uint32_t fragPermille;          /* free pages unusable for 1M allocations */
+    uint32_t cacheOpsSkipped;       /* flush/invalidate found nothing to do */
+} MmzStat;
+
 #define MMZ_IOC_MAGIC               'M'
 #define MMZ_CACHE_TYPE              _IOR(MMZ_IOC_MAGIC, MMZ_CACHE, MmzMemory)
 #define MMZ_NOCACHE_TYPE            _IOR(MMZ_IOC_MAGIC, MMZ_NOCACHE, MmzMemory)
@@ -64,6 +86,9 @@ typedef struct {
 #define MMZ_FLUSH_CACHE_TYPE        _IOR(MMZ_IOC_MAGIC, FLUSH_CACHE, MmzMemory)
 #define MMZ_FLUSH_NOCACHE_TYPE      _IOR(MMZ_IOC_MAGIC, FLUSH_NOCACHE, MmzMemory)
 #define MMZ_INVALIDATE_TYPE         _IOR(MMZ_IOC_MAGIC, INVALIDATE, MmzMemory)
+#define MMZ_STAT_TYPE               _IOR(MMZ_IOC_MAGIC, STAT, MmzStat)
+#define MMZ_FLUSH_RANGE_TYPE        _IOR(MMZ_IOC_MAGIC, FLUSH_RANGE, MmzRange)
+#define MMZ_INVALIDATE_RANGE_TYPE   _IOR(MMZ_IOC_MAGIC, INVALIDATE_RANGE, MmzRange)
 
 #define MMZ_NODE                    "/dev/mmz"
 
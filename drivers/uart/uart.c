@@ -40,13 +40,14 @@ static int32_t Hi35xxRead(struct UartHost *host, uint8_t *data, uint32_t size)
     if (udd->state != UART_STATE_USEABLE) {
         return HDF_FAILURE;
     }
-    if ((udd->flags & UART_FLG_RD_BLOCK) && (PL011UartRxBufEmpty(udd))) {
-        (void)LOS_EventRead(&udd->wait.stEvent, 0x1, LOS_WAITMODE_OR, LOS_WAIT_FOREVER);
+    /*
+     * recv publishes data before writing the event, so check-then-wait never
+     * misses a wakeup; the event is consumed on wakeup and re-checked.
+     */
+    while ((udd->flags & UART_FLG_RD_BLOCK) && (PL011UartRxBufEmpty(udd))) {
+        (void)LOS_EventRead(&udd->wait.stEvent, 0x1, LOS_WAITMODE_OR | LOS_WAITMODE_CLR, LOS_WAIT_FOREVER);
     }
     ret = Pl011Read(udd, (char *)data, size);
-    if ((udd->flags & UART_FLG_RD_BLOCK) && (PL011UartRxBufEmpty(udd))) {
-        (void)LOS_EventClear(&udd->wait.stEvent, ~(0x1));
-    }
     return ret;
 }
 
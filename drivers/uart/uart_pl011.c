@@ -19,6 +19,7 @@
 #include "hdf_log.h"
 #include "osal_io.h"
 #include "osal_irq.h"
+#include "osal_mem.h"
 #include "osal_time.h"
 #include "uart_if.h"
 #include "uart_pl011.h"
@@ -28,6 +29,48 @@
 #define UART_WAIT_MS      10
 #define IBRD_COEFFICIENTS 16
 #define FBRD_COEFFICIENTS 8
+
+/*
+ * Once the interrupt is requested, TX is queued into a ring and fed to FIFO by
+ * the TX interrupt, writers only wait when the ring is full. Without interrupt
+ * TX falls back to UartPutsReg.
+ *
+ * There is no DMA controller wired to PL011 on QEMU virt, so the "DMA" mode
+ * only retunes the FIFO level interrupts: RX trigger is raised to 7/8 and RX is
+ * drained straight into recv like the normal mode, TX refills at 1/8. Bulk
+ * transfers should go through virtio-console (drivers/virtio/virtconsole.c) instead.
+ */
+/* feed TX FIFO from tx buf, mask TX interrupt when nothing left. Called with lock held */
+static void Pl011TxFill(struct UartPl011Port *port)
+{
+    struct UartDmaTransfer *udt = port->txUdt;
+    uint32_t imsc;
+
+    while ((udt->tail != udt->head) && !(OSAL_READB(port->physBase + UART_FR) & UART_FR_TXFF)) {
+        OSAL_WRITEB(udt->buf[udt->tail], port->physBase + UART_DR);
+        udt->tail = (udt->tail + 1) % udt->size;
+    }
+
+    imsc = OSAL_READW(port->physBase + UART_IMSC);
+    if (udt->tail == udt->head) {
+        imsc &= ~UART_IMSC_TX;
+    } else {
+        imsc |= UART_IMSC_TX;
+    }
+    OSAL_WRITEW(imsc, port->physBase + UART_IMSC);
+}
+
+static void Pl011TxIrq(struct UartPl011Port *port)
+{
+    struct UartDmaTransfer *udt = port->txUdt;
+    uint32_t intSave;
+
+    OsalSpinLockIrqSave(&udt->lock, &intSave);
+    Pl011TxFill(port);
+    OsalSpinUnlockIrqRestore(&udt->lock, &intSave);
+    (void)LOS_EventWrite(&udt->wait, UART_DMA_EVENT_TX_DONE);
+}
+
 static uint32_t Pl011Irq(uint32_t irq, void *data)
 {
     uint32_t status;
@@ -44,23 +87,26 @@ static uint32_t Pl011Irq(uint32_t irq, void *data)
     }
     port = (struct UartPl011Port *)udd->private;
     status = OSAL_READW(port->physBase + UART_MIS);
+    if ((status & UART_MIS_TX) && (port->flags & PL011_FLG_TX_RING)) {
+        Pl011TxIrq(port);
+    }
     if (status & (UART_MIS_RX | UART_IMSC_TIMEOUT)) {
+        /* FIFO level or receive timeout: drain everything, one recv per FIFO_SIZE */
         do {
             fr = OSAL_READB(port->physBase + UART_FR);
-            if (fr & UART_FR_RXFE) {
-                break;
+            if (!(fr & UART_FR_RXFE)) {
+                buf[count] = OSAL_READB(port->physBase + UART_DR);
+                if ((udd->num == CONSOLE_UART) && CheckMagicKey(buf[count], CONSOLE_SERIAL)) {
+                    continue;
+                }
+                count++;
             }
-            buf[count++] = OSAL_READB(port->physBase + UART_DR);
-            if (udd->num != CONSOLE_UART) {
-                continue;
+            if ((count == FIFO_SIZE) || ((fr & UART_FR_RXFE) && (count > 0))) {
+                udd->recv(udd, buf, count);
+                count = 0;
             }
-            if (CheckMagicKey(buf[count - 1], CONSOLE_SERIAL)) {
-                goto end;
-            }
-        } while (count < FIFO_SIZE);
-        udd->recv(udd, buf, count);
+        } while (!(fr & UART_FR_RXFE));
     }
-end:
     /* clear all interrupt */
     OSAL_WRITEW(0xFFFF, port->physBase + UART_CLR);
     return HDF_SUCCESS;
@@ -215,6 +261,109 @@ static int32_t Pl011ConfigIn(struct UartDriverData *udd)
     return HDF_SUCCESS;
 }
 
+static struct UartDmaTransfer *Pl011DmaAlloc(uint32_t size)
+{
+    struct UartDmaTransfer *udt = (struct UartDmaTransfer *)OsalMemCalloc(sizeof(*udt));
+
+    if (udt == NULL) {
+        return NULL;
+    }
+    udt->buf = (char *)OsalMemCalloc(size);
+    if (udt->buf == NULL) {
+        OsalMemFree(udt);
+        return NULL;
+    }
+    udt->size = size;
+    (void)OsalSpinInit(&udt->lock);
+    (void)LOS_EventInit(&udt->wait);
+    return udt;
+}
+
+static void Pl011DmaFree(struct UartDmaTransfer *udt)
+{
+    (void)LOS_EventDestroy(&udt->wait);
+    (void)OsalSpinDestroy(&udt->lock);
+    OsalMemFree(udt->buf);
+    OsalMemFree(udt);
+}
+
+/* let queued data go out, then stop feeding FIFO from the ring */
+static void Pl011TxRingStop(struct UartPl011Port *port)
+{
+    struct UartDmaTransfer *udt = port->txUdt;
+    uint32_t intSave;
+
+    while (udt->tail != udt->head) {
+        OsalMSleep(UART_WAIT_MS);
+    }
+    OsalSpinLockIrqSave(&udt->lock, &intSave);
+    OSAL_WRITEW(OSAL_READW(port->physBase + UART_IMSC) & ~UART_IMSC_TX, port->physBase + UART_IMSC);
+    port->flags &= ~PL011_FLG_TX_RING;
+    OsalSpinUnlockIrqRestore(&udt->lock, &intSave);
+}
+
+static int32_t Pl011DmaStartUp(struct UartDriverData *udd, int32_t dir)
+{
+    struct UartPl011Port *port = NULL;
+    uint32_t ifls;
+
+    if (udd == NULL || udd->private == NULL) {
+        HDF_LOGE("%s: invalid parameter", __func__);
+        return HDF_ERR_INVALID_PARAM;
+    }
+    port = (struct UartPl011Port *)udd->private;
+    if (!(port->flags & PL011_FLG_IRQ_REQUESTED)) {
+        HDF_LOGE("%s: irq not requested", __func__);
+        return HDF_FAILURE;
+    }
+
+    if (dir == UART_DMA_DIR_RX) {
+        port->flags |= PL011_FLG_DMA_RX_REQUESTED;
+        /* fewer, larger bursts; the timeout interrupt catches the rest */
+        ifls = (OSAL_READW(port->physBase + UART_IFLS) & ~UART_IFLS_RX_MASK) | UART_IFLS_RX7_8;
+        OSAL_WRITEW(ifls, port->physBase + UART_IFLS);
+    } else {
+        if (!(port->flags & PL011_FLG_TX_RING)) {
+            HDF_LOGE("%s: tx ring not allocated", __func__);
+            return HDF_FAILURE;
+        }
+        /* refill when FIFO is almost empty */
+        ifls = (OSAL_READW(port->physBase + UART_IFLS) & ~UART_IFLS_TX_MASK) | UART_IFLS_TX1_8;
+        OSAL_WRITEW(ifls, port->physBase + UART_IFLS);
+        port->flags |= PL011_FLG_DMA_TX_REQUESTED;
+    }
+    return HDF_SUCCESS;
+}
+
+static int32_t Pl011DmaShutDown(struct UartDriverData *udd, int32_t dir)
+{
+    struct UartPl011Port *port = NULL;
+    struct UartDmaTransfer *udt = NULL;
+    uint32_t intSave;
+    uint32_t ifls;
+
+    if (udd == NULL || udd->private == NULL) {
+        HDF_LOGE("%s: invalid parameter", __func__);
+        return HDF_ERR_INVALID_PARAM;
+    }
+    port = (struct UartPl011Port *)udd->private;
+
+    if ((dir == UART_DMA_DIR_RX) && (port->flags & PL011_FLG_DMA_RX_REQUESTED)) {
+        ifls = (OSAL_READW(port->physBase + UART_IFLS) & ~UART_IFLS_RX_MASK) | UART_IFLS_RX4_8;
+        OSAL_WRITEW(ifls, port->physBase + UART_IFLS);
+        port->flags &= ~PL011_FLG_DMA_RX_REQUESTED;
+    } else if ((dir == UART_DMA_DIR_TX) && (port->flags & PL011_FLG_DMA_TX_REQUESTED)) {
+        /* the ring stays in use, only the refill level goes back */
+        udt = port->txUdt;
+        OsalSpinLockIrqSave(&udt->lock, &intSave);
+        ifls = (OSAL_READW(port->physBase + UART_IFLS) & ~UART_IFLS_TX_MASK) | UART_IFLS_TX7_8;
+        OSAL_WRITEW(ifls, port->physBase + UART_IFLS);
+        port->flags &= ~PL011_FLG_DMA_TX_REQUESTED;
+        OsalSpinUnlockIrqRestore(&udt->lock, &intSave);
+    }
+    return HDF_SUCCESS;
+}
+
 static int32_t Pl011StartUp(struct UartDriverData *udd)
 {
     int32_t ret;
@@ -243,16 +392,29 @@ static int32_t Pl011StartUp(struct UartDriverData *udd)
     OSAL_WRITEW(0x0, port->physBase + UART_IMSC);
     /* interrupt trigger line RX: 4/8, TX 7/8 */
     OSAL_WRITEW(UART_IFLS_RX4_8 | UART_IFLS_TX7_8, port->physBase + UART_IFLS);
-    if (!(udd->flags & UART_FLG_DMA_RX)) {
-        if (!(port->flags & PL011_FLG_IRQ_REQUESTED)) {
-            ret = OsalRegisterIrq(port->irqNum, 0, Pl011Irq, "uart_pl011", udd);
-            if (ret == 0) {
-                port->flags |= PL011_FLG_IRQ_REQUESTED;
-                /* enable rx and timeout interrupt */
-                OSAL_WRITEW(UART_IMSC_RX | UART_IMSC_TIMEOUT, port->physBase + UART_IMSC);
-            }
+    /* DMA mode is interrupt paced too, see Pl011DmaStartUp */
+    if (!(port->flags & PL011_FLG_IRQ_REQUESTED)) {
+        ret = OsalRegisterIrq(port->irqNum, 0, Pl011Irq, "uart_pl011", udd);
+        if (ret == 0) {
+            port->flags |= PL011_FLG_IRQ_REQUESTED;
+            /* enable rx and timeout interrupt */
+            OSAL_WRITEW(UART_IMSC_RX | UART_IMSC_TIMEOUT, port->physBase + UART_IMSC);
         }
     }
+    /* tx ring is kept until Pl011ShutDown, where the interrupt is surely gone */
+    if ((port->flags & PL011_FLG_IRQ_REQUESTED) && !(port->flags & PL011_FLG_TX_RING)) {
+        if ((port->txUdt == NULL) && ((port->txUdt = Pl011DmaAlloc(TX_DMA_BUF_SIZE)) == NULL)) {
+            HDF_LOGE("%s: alloc tx buf failed, write synchronously", __func__);
+        } else {
+            port->flags |= PL011_FLG_TX_RING;
+        }
+    }
+    if ((udd->flags & UART_FLG_DMA_RX) && (Pl011DmaStartUp(udd, UART_DMA_DIR_RX) != HDF_SUCCESS)) {
+        udd->flags &= ~UART_FLG_DMA_RX;
+    }
+    if ((udd->flags & UART_FLG_DMA_TX) && (Pl011DmaStartUp(udd, UART_DMA_DIR_TX) != HDF_SUCCESS)) {
+        udd->flags &= ~UART_FLG_DMA_TX;
+    }
     cr = OSAL_READW(port->physBase + UART_CR);
     cr |= UART_CR_EN | UART_CR_RX_EN | UART_CR_TX_EN;
     OSAL_WRITEL(cr, port->physBase + UART_CR);
@@ -274,12 +436,19 @@ static int32_t Pl011ShutDown(struct UartDriverData *udd)
         HDF_LOGE("%s: port is null", __func__);
         return HDF_ERR_INVALID_PARAM;
     }
+    if (port->flags & PL011_FLG_TX_RING) {
+        Pl011TxRingStop(port);
+    }
     OSAL_WRITEW(0, port->physBase + UART_IMSC);
     OSAL_WRITEW(0xFFFF, port->physBase + UART_CLR);
     if (port->flags & PL011_FLG_IRQ_REQUESTED) {
         OsalUnregisterIrq(port->irqNum, udd);
         port->flags &= ~PL011_FLG_IRQ_REQUESTED;
     }
+    if (port->txUdt != NULL) {
+        Pl011DmaFree(port->txUdt);
+        port->txUdt = NULL;
+    }
 
     reg_tmp = OSAL_READW(port->physBase + UART_CR);
     reg_tmp &= ~UART_CR_TX_EN;
@@ -300,6 +469,46 @@ static int32_t Pl011ShutDown(struct UartDriverData *udd)
     return HDF_SUCCESS;
 }
 
+static inline uint32_t Pl011TxRoom(const struct UartDmaTransfer *udt)
+{
+    return (udt->tail + udt->size - udt->head - 1) % udt->size;
+}
+
+static inline void Pl011TxPut(struct UartDmaTransfer *udt, char c)
+{
+    udt->buf[udt->head] = c;
+    udt->head = (udt->head + 1) % udt->size;
+}
+
+/* queue and return, only wait when tx buf is full. '\n' is expanded as UartPutsReg does */
+static int32_t Pl011RingStartTx(struct UartPl011Port *port, const char *buf, size_t count)
+{
+    struct UartDmaTransfer *udt = port->txUdt;
+    uint32_t intSave;
+    size_t i = 0;
+
+    while (i < count) {
+        OsalSpinLockIrqSave(&udt->lock, &intSave);
+        for (; i < count; i++) {
+            if (Pl011TxRoom(udt) < ((buf[i] == '\n') ? 2 : 1)) {
+                break;
+            }
+            if (buf[i] == '\n') {
+                Pl011TxPut(udt, '\r');
+            }
+            Pl011TxPut(udt, buf[i]);
+        }
+        Pl011TxFill(port);
+        OsalSpinUnlockIrqRestore(&udt->lock, &intSave);
+
+        if (i < count) {
+            (void)LOS_EventRead(&udt->wait, UART_DMA_EVENT_TX_DONE, LOS_WAITMODE_OR | LOS_WAITMODE_CLR,
+                LOS_WAIT_FOREVER);
+        }
+    }
+    return HDF_SUCCESS;
+}
+
 static int32_t Pl011StartTx(struct UartDriverData *udd, const char *buf, size_t count)
 {
     struct UartPl011Port *port = NULL;
@@ -313,6 +522,9 @@ static int32_t Pl011StartTx(struct UartDriverData *udd, const char *buf, size_t
         HDF_LOGE("%s: port is null", __func__);
         return HDF_ERR_INVALID_PARAM;
     }
+    if (port->flags & PL011_FLG_TX_RING) {
+        return Pl011RingStartTx(port, buf, count);
+    }
     /* UART_WITH_LOCK: there is a spinlock in the function to write reg in order. */
     (void)UartPutsReg(port->physBase, buf, count, UART_WITH_LOCK);
     return HDF_SUCCESS;
@@ -333,6 +545,9 @@ static int32_t Pl011Config(struct UartDriverData *udd)
         return HDF_ERR_INVALID_PARAM;
     }
     /* wait for send finish */
+    while ((port->flags & PL011_FLG_TX_RING) && (port->txUdt->tail != port->txUdt->head)) {
+        OsalMSleep(UART_WAIT_MS);
+    }
     do {
         fr = OSAL_READB(port->physBase + UART_FR);
         if (!(fr & UART_FR_BUSY)) {
@@ -348,53 +563,47 @@ struct UartOps g_pl011Uops = {
     .ShutDown       = Pl011ShutDown,
     .StartTx        = Pl011StartTx,
     .Config         = Pl011Config,
-    .DmaStartUp     = NULL,
-    .DmaShutDown    = NULL,
+    .DmaStartUp     = Pl011DmaStartUp,
+    .DmaShutDown    = Pl011DmaShutDown,
 };
 
+/*
+ * rxTransfer is a single-producer (interrupt handler) single-consumer (reader) ring.
+ * Each side owns one index and reads the other with acquire semantic, so neither
+ * needs a lock. One byte is kept empty to tell full from empty.
+ */
 int32_t Pl011Read(struct UartDriverData *udd, char *buf, size_t count)
 {
+    struct UartTransfer *transfer = NULL;
     uint32_t wp;
     uint32_t rp;
+    uint32_t len;
     uint32_t upperHalf;
-    uint32_t lowerHalf = 0;
-    unsigned long data;
 
     if (udd == NULL || buf == NULL || count == 0 || udd->rxTransfer == NULL) {
         HDF_LOGE("%s: invalid parameter", __func__);
         return HDF_ERR_INVALID_PARAM;
     }
-    wp = udd->rxTransfer->wp;
-    rp = udd->rxTransfer->rp;
-    data = (unsigned long)(udd->rxTransfer->data);
-
-    if (rp == wp) {
+    transfer = udd->rxTransfer;
+    rp = transfer->rp;
+    /* pairs with the release in PL011UartRecvNotify: data before wp is visible */
+    wp = __atomic_load_n(&transfer->wp, __ATOMIC_ACQUIRE);
+
+    len = (wp + BUF_SIZE - rp) % BUF_SIZE;
+    len = (count < len) ? count : len;
+    if (len == 0) {
         return 0; // buffer empty
     }
-
-    if (rp < wp) { // rp behind
-        upperHalf = (count > (wp - rp)) ? (wp - rp) : count;
-        if (upperHalf > 0 && memcpy_s(buf, upperHalf, (void *)(data + rp), upperHalf) != EOK) {
-            return HDF_ERR_IO;
-        }
-        rp += upperHalf;
-    } else { // wp behind
-        count = (count > (BUF_SIZE - rp + wp)) ? (BUF_SIZE - rp + wp) : count;
-        upperHalf = (count > (BUF_SIZE - rp)) ? (BUF_SIZE - rp) : count;
-        lowerHalf = (count > (BUF_SIZE - rp)) ? (count - (BUF_SIZE - rp)) : 0;
-        if (upperHalf > 0 && memcpy_s(buf, upperHalf, (void *)(data + rp), upperHalf) != EOK) {
-            return HDF_ERR_IO;
-        }
-        if (lowerHalf > 0 && memcpy_s(buf + upperHalf, lowerHalf, (void *)(data), lowerHalf) != EOK) {
-            return HDF_ERR_IO;
-        }
-        rp += upperHalf;
-        if (rp >= BUF_SIZE) {
-            rp = lowerHalf;
-        }
+    upperHalf = (len > (BUF_SIZE - rp)) ? (BUF_SIZE - rp) : len;
+    if (memcpy_s(buf, count, transfer->data + rp, upperHalf) != EOK) {
+        return HDF_ERR_IO;
+    }
+    if (len > upperHalf && memcpy_s(buf + upperHalf, count - upperHalf, transfer->data, len - upperHalf) != EOK) {
+        return HDF_ERR_IO;
     }
-    udd->rxTransfer->rp = rp;
-    return (upperHalf + lowerHalf);
+    /* data copied out before the producer can reuse the space */
+    __atomic_store_n(&transfer->rp, (rp + len) % BUF_SIZE, __ATOMIC_RELEASE);
+    return len;
 }
 
 static int32_t Pl011Notify(struct wait_queue_head *wait)
@@ -409,54 +618,47 @@ static int32_t Pl011Notify(struct wait_queue_head *wait)
 
 int32_t PL011UartRecvNotify(struct UartDriverData *udd, const char *buf, size_t count)
 {
+    struct UartTransfer *transfer = NULL;
     uint32_t wp;
     uint32_t rp;
+    uint32_t room;
     uint32_t upperHalf;
-    uint32_t lowerHalf = 0;
-    unsigned long data;
 
     if (udd == NULL || buf == NULL || count == 0 || udd->rxTransfer == NULL) {
         HDF_LOGE("%s: invalid parameter", __func__);
         return HDF_ERR_INVALID_PARAM;
     }
-    wp = udd->rxTransfer->wp;
-    rp = udd->rxTransfer->rp;
-    data = (unsigned long)(udd->rxTransfer->data);
-
-    if (wp < rp) { // wp behind
-        upperHalf = (count > (rp - wp - 1)) ? (rp - wp - 1) : count;
-        if (upperHalf > 0 && memcpy_s((void *)(data + wp), upperHalf, buf, upperHalf) != EOK) {
-            return HDF_ERR_IO;
-        }
-        wp += upperHalf;
-    } else { // rp behind
-        count = (count > ((BUF_SIZE - wp) + rp - 1)) ? (BUF_SIZE - wp) + rp - 1 : count;
-        upperHalf = (count > (BUF_SIZE - wp)) ? (BUF_SIZE - wp) : count;
-        lowerHalf = (count > (BUF_SIZE - wp)) ? (count - (BUF_SIZE - wp)) : 0;
-        if (upperHalf > 0 && memcpy_s((void *)(data + wp), upperHalf, buf, upperHalf) != EOK) {
-            return HDF_ERR_IO;
-        }
-        if (lowerHalf > 0 && memcpy_s((void *)(data), lowerHalf, buf + upperHalf, lowerHalf) != EOK) {
-            return HDF_ERR_IO;
-        }
-        wp += upperHalf;
-        if (wp >= BUF_SIZE) {
-            wp = lowerHalf;
-        }
+    transfer = udd->rxTransfer;
+    wp = transfer->wp;
+    /* pairs with the release in Pl011Read: reader is done with the space */
+    rp = __atomic_load_n(&transfer->rp, __ATOMIC_ACQUIRE);
+
+    room = (rp + BUF_SIZE - wp - 1) % BUF_SIZE;
+    if (count > room) {
+        transfer->flags |= BUF_OVERFLOWED;
+        count = room;
+    }
+    upperHalf = (count > (BUF_SIZE - wp)) ? (BUF_SIZE - wp) : count;
+    if (upperHalf > 0 && memcpy_s(transfer->data + wp, BUF_SIZE - wp, buf, upperHalf) != EOK) {
+        return HDF_ERR_IO;
+    }
+    if (count > upperHalf && memcpy_s(transfer->data, BUF_SIZE, buf + upperHalf, count - upperHalf) != EOK) {
+        return HDF_ERR_IO;
     }
+    /* publish data before waking up the reader */
+    __atomic_store_n(&transfer->wp, (wp + count) % BUF_SIZE, __ATOMIC_RELEASE);
 
     if (Pl011Notify(&udd->wait) != HDF_SUCCESS) {
         HDF_LOGE("%s: Pl011 notify err", __func__);
         return HDF_FAILURE;
     }
-    udd->rxTransfer->wp = wp;
-    return (upperHalf + lowerHalf);
+    return count;
 }
 
 bool PL011UartRxBufEmpty(struct UartDriverData *udd)
 {
     struct UartTransfer *transfer = udd->rxTransfer;
-    return (transfer->wp == transfer->rp);
+    return (__atomic_load_n(&transfer->wp, __ATOMIC_ACQUIRE) == __atomic_load_n(&transfer->rp, __ATOMIC_ACQUIRE));
 }
 
 struct UartOps *Pl011GetOps(void)
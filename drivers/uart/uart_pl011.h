@@ -17,6 +17,8 @@
 #define UART_PL011_H
 
 #include "console.h"
+#include "los_event.h"
+#include "osal_spinlock.h"
 #include "poll.h"
 #include "uart_if.h"
 
@@ -55,6 +57,8 @@ extern "C" {
 #define UART_IFLS_TX1_8        (0x00 << 0)
 #define UART_IFLS_TX4_8        (0x02 << 0)
 #define UART_IFLS_TX7_8        (0x04 << 0)
+#define UART_IFLS_RX_MASK      (0x07 << 3)
+#define UART_IFLS_TX_MASK      (0x07 << 0)
 
 #define UART_CR_CTS            (0x01 << 15)
 #define UART_CR_RTS            (0x01 << 14)
@@ -101,7 +105,7 @@ extern "C" {
 #define UART_INFO              (0x01 << 1)
 
 /* DMA buf size: 4K */
-#define RX_DMA_BUF_SIZE        0x1000
+#define TX_DMA_BUF_SIZE        0x1000
 
 /* receive buf default size: 16K */
 #define BUF_SIZE               0x4000
@@ -159,15 +163,21 @@ struct UartDmaTransfer {
     uint32_t channel;
     /* dma created task id */
     uint32_t thread_id;
-    /* dma receive buf head */
+    /* dma buf head, where the producer writes */
     uint32_t head;
-    /* dma receive buf tail */
+    /* dma buf tail, where the consumer reads */
     uint32_t tail;
     /* dma receive buf cycled flag */
     uint32_t flags;
 #define BUF_CIRCLED (1 << 0)
-    /* dma receive buf, should be cache aligned */
+    /* dma buf, should be cache aligned */
     char *buf;
+    uint32_t size;
+    /* protect head/tail against the interrupt handler */
+    OSAL_DECLARE_SPINLOCK(lock);
+    /* writers wait here for free space of tx buf */
+    EVENT_CB_S wait;
+#define UART_DMA_EVENT_TX_DONE 0x1
 };
 
 struct UartPl011Port {
@@ -179,7 +189,9 @@ struct UartPl011Port {
 #define PL011_FLG_IRQ_REQUESTED    (1 << 0)
 #define PL011_FLG_DMA_RX_REQUESTED (1 << 1)
 #define PL011_FLG_DMA_TX_REQUESTED (1 << 2)
+#define PL011_FLG_TX_RING          (1 << 3)
     struct UartDmaTransfer *rxUdt;
+    struct UartDmaTransfer *txUdt;
     struct UartDriverData *udd;
 };
 
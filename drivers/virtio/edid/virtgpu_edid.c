@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2022 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * EDID mode parsing shared by the LiteOS-A and LiteOS-M virtio gpu drivers.
+ */
+#include <string.h>
+#include "virtgpu_edid.h"
+
+#define EDID_BLOCK_SIZE         128
+#define EDID_HEADER_SIZE        8
+#define EDID_ESTABLISHED        35
+#define EDID_STD_TIMING         38
+#define EDID_STD_TIMING_NUM     8
+#define EDID_STD_TIMING_UNUSED  0x01
+#define EDID_STD_HRES_BASE      31
+#define EDID_STD_HRES_UNIT      8
+#define EDID_STD_ASPECT_SHIFT   6
+#define EDID_DETAILED_TIMING    54
+#define EDID_DETAILED_LEN       18
+#define EDID_DETAILED_NUM       4
+#define EDID_DTD_HACTIVE_LO     2
+#define EDID_DTD_HACTIVE_HI     4
+#define EDID_DTD_VACTIVE_LO     5
+#define EDID_DTD_VACTIVE_HI     7
+#define EDID_DTD_HI_MASK        0xF0
+#define EDID_DTD_HI_SHIFT       4
+
+static bool EdidValid(const uint8_t *edid, uint32_t size)
+{
+    static const uint8_t header[EDID_HEADER_SIZE] = { 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00 };
+    uint8_t sum = 0;
+    int i;
+
+    if ((size < EDID_BLOCK_SIZE) || (memcmp(edid, header, sizeof(header)) != 0)) {
+        return false;
+    }
+    for (i = 0; i < EDID_BLOCK_SIZE; i++) {
+        sum += edid[i];
+    }
+    return sum == 0;
+}
+
+/* detailed timing descriptors, first one is the preferred timing */
+static void ParseEdidDetailed(const uint8_t *edid, VirtgpuAddMode addMode)
+{
+    const uint8_t *d = NULL;
+    uint32_t w, h;
+    int i;
+
+    for (i = 0; i < EDID_DETAILED_NUM; i++) {
+        d = edid + EDID_DETAILED_TIMING + i * EDID_DETAILED_LEN;
+        if ((d[0] == 0) && (d[1] == 0)) {   /* pixel clock 0: display descriptor */
+            continue;
+        }
+        w = d[EDID_DTD_HACTIVE_LO] | ((d[EDID_DTD_HACTIVE_HI] & EDID_DTD_HI_MASK) << EDID_DTD_HI_SHIFT);
+        h = d[EDID_DTD_VACTIVE_LO] | ((d[EDID_DTD_VACTIVE_HI] & EDID_DTD_HI_MASK) << EDID_DTD_HI_SHIFT);
+        addMode(w, h);
+    }
+}
+
+static void ParseEdidStandard(const uint8_t *edid, VirtgpuAddMode addMode)
+{
+    /* aspect ratio 16:10, 4:3, 5:4, 16:9 as numerator/denominator of height/width */
+    static const uint8_t aspect[][2] = { {10, 16}, {3, 4}, {4, 5}, {9, 16} };
+    const uint8_t *s = NULL;
+    uint32_t w, a;
+    int i;
+
+    for (i = 0; i < EDID_STD_TIMING_NUM; i++) {
+        s = edid + EDID_STD_TIMING + i * 2;
+        if ((s[0] == EDID_STD_TIMING_UNUSED) && (s[1] == EDID_STD_TIMING_UNUSED)) {
+            continue;
+        }
+        w = (s[0] + EDID_STD_HRES_BASE) * EDID_STD_HRES_UNIT;
+        a = s[1] >> EDID_STD_ASPECT_SHIFT;
+        addMode(w, w * aspect[a][0] / aspect[a][1]);
+    }
+}
+
+static void ParseEdidEstablished(const uint8_t *edid, VirtgpuAddMode addMode)
+{
+    static const struct {
+        uint8_t byte;
+        uint8_t bit;
+        uint16_t width;
+        uint16_t height;
+    } established[] = {
+        { 0, 5, 640, 480 },
+        { 0, 0, 800, 600 },
+        { 1, 3, 1024, 768 },
+        { 1, 0, 1280, 1024 },
+    };
+    uint32_t i;
+
+    for (i = 0; i < sizeof(established) / sizeof(established[0]); i++) {
+        if (edid[EDID_ESTABLISHED + established[i].byte] & (1 << established[i].bit)) {
+            addMode(established[i].width, established[i].height);
+        }
+    }
+}
+
+bool VirtgpuParseEdid(const uint8_t *edid, uint32_t size, VirtgpuAddMode addMode)
+{
+    if (!EdidValid(edid, size)) {
+        return false;
+    }
+
+    ParseEdidDetailed(edid, addMode);
+    ParseEdidStandard(edid, addMode);
+    ParseEdidEstablished(edid, addMode);
+    return true;
+}
@@ -0,0 +1,26 @@
+/*
+ * Copyright (c) 2022 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __VIRTGPU_EDID_H__
+#define __VIRTGPU_EDID_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef void (*VirtgpuAddMode)(uint32_t width, uint32_t height);
+
+/* calls addMode for every mode announced in the base EDID block, false if the block is invalid */
+bool VirtgpuParseEdid(const uint8_t *edid, uint32_t size, VirtgpuAddMode addMode);
+
+#endif
@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2022 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __VIRTGPU_H__
+#define __VIRTGPU_H__
+
+/* virtio-gpu specific fb ioctls on /dev/fb0, shared by the liteos_a and liteos_m drivers */
+
+#include "stdint.h"
+#include "fb.h"
+
+/*
+ * Report region drawn since last call, uint32_t[4] as x, y, width, height.
+ * Only reported regions are transferred. Until a client reports, the whole
+ * screen is refreshed every period; liteos_m then refreshes on demand only.
+ */
+#define VIRTGPU_FBIO_DAMAGE     _FBIOC(0x0020)
+#define VIRTGPU_FBIO_GET_MODES  _FBIOC(0x0021)  /* get struct VirtgpuModeList */
+#define VIRTGPU_FBIO_SET_MODE   _FBIOC(0x0022)  /* switch to mode of given index in VirtgpuModeList */
+
+#define VIRTGPU_MAX_MODES       16
+
+struct VirtgpuModeList {
+    uint32_t num;
+    uint32_t current;           /* index of active mode */
+    struct {
+        uint32_t width;
+        uint32_t height;
+    } modes[VIRTGPU_MAX_MODES];
+};
+
+#endif
@@ -0,0 +1,566 @@
+/*
+ * Copyright (c) 2022 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * Simple virtio-console driver, exported as a HDF UART host(/dev/uartdev-N).
+ * It drives the single console port every virtio-console has, MULTIPORT and
+ * its control queues are out of scope. Data moves in whole buffers instead of
+ * trapping per byte:
+ *  - RX buffers stay posted, readers copy straight out of used buffers and
+ *    re-post them, so a slow reader throttles the host instead of losing data.
+ *  - TX copies into free buffers and returns, completion is reaped in IRQ.
+ *    The queue is kicked before waiting for free buffers, and once per write.
+ */
+
+#include "los_event.h"
+#include "los_vm_iomap.h"
+#include "device_resource_if.h"
+#include "hdf_device_desc.h"
+#include "osal.h"
+#include "osal_io.h"
+#include "poll.h"
+#include "uart_core.h"
+#include "uart_dev.h"
+#include "uart_if.h"
+#include "virtmmio.h"
+
+#define VIRTMMIO_CONSOLE_NAME   "virtconsole"
+#define VIRTQ_RX_QSZ            16
+#define VIRTQ_TX_QSZ            16
+#define RX_BUF_SIZE             256
+#define TX_BUF_SIZE             512
+#define VIRTCON_DFT_NUM         1       /* /dev/uartdev-0 is PL011 */
+#define VIRTCON_DFT_BAUDRATE    115200  /* meaningless, only for GetBaud */
+
+#define VIRTCON_RX_QUEUE        0
+#define VIRTCON_TX_QUEUE        1
+
+#define EVENT_RX                0x1
+#define EVENT_TX                0x2
+
+#define VIRTCON_STATE_CLOSED    0
+#define VIRTCON_STATE_OPENED    1
+
+struct Virtcon {
+    struct VirtmmioDev      dev;
+
+    uint32_t                num;
+    int32_t                 count;      /* open count */
+    int32_t                 state;
+    bool                    rdBlock;
+
+    wait_queue_head_t       wait;       /* event EVENT_RX/EVENT_TX, and poll */
+    OSAL_DECLARE_MUTEX(rxMutex);        /* one reader at a time owns RX queue */
+    uint32_t                rxOffset;   /* consumed bytes of the oldest used buffer */
+
+    OSAL_DECLARE_SPINLOCK(txLock);      /* protect TX free list and avail ring */
+    uint16_t                txFreeHead;
+    uint16_t                txFreeNum;
+
+    char                    rxBuf[VIRTQ_RX_QSZ][RX_BUF_SIZE];
+    char                    txBuf[VIRTQ_TX_QSZ][TX_BUF_SIZE];
+};
+
+static bool Feature0(uint32_t features, uint32_t *supported, void *dev)
+{
+    (void)features;
+    (void)supported;
+    (void)dev;
+
+    return true;
+}
+
+static bool Feature1(uint32_t features, uint32_t *supported, void *dev)
+{
+    (void)dev;
+    if (features & VIRTIO_F_VERSION_1) {
+        *supported |= VIRTIO_F_VERSION_1;
+    } else {
+        HDF_LOGE("[%s]virtio-console has no VERSION_1 feature", __func__);
+        return false;
+    }
+
+    return true;
+}
+
+static void PopulateRxQueue(struct Virtcon *con)
+{
+    struct Virtq *q = &con->dev.vq[VIRTCON_RX_QUEUE];
+    uint16_t i;
+
+    for (i = 0; i < q->qsz; i++) {
+        q->desc[i].pAddr = VMM_TO_DMA_ADDR((VADDR_T)con->rxBuf[i]);
+        q->desc[i].len = RX_BUF_SIZE;
+        q->desc[i].flag = VIRTQ_DESC_F_WRITE;
+        q->avail->ring[i] = i;
+    }
+    DSB;
+    q->avail->index = q->qsz;
+}
+
+static void PopulateTxQueue(struct Virtcon *con)
+{
+    struct Virtq *q = &con->dev.vq[VIRTCON_TX_QUEUE];
+    uint16_t i;
+
+    /* free descriptors are chained through 'next' */
+    for (i = 0; i < q->qsz; i++) {
+        q->desc[i].pAddr = VMM_TO_DMA_ADDR((VADDR_T)con->txBuf[i]);
+        q->desc[i].flag = 0;
+        q->desc[i].next = i + 1;
+    }
+    con->txFreeHead = 0;
+    con->txFreeNum = q->qsz;
+}
+
+static bool RxEmpty(struct Virtcon *con)
+{
+    struct Virtq *q = &con->dev.vq[VIRTCON_RX_QUEUE];
+
+    return q->last == __atomic_load_n(&q->used->index, __ATOMIC_ACQUIRE);
+}
+
+static uint32_t VirtconIRQhandle(uint32_t swIrq, void *dev)
+{
+    (void)swIrq;
+    struct Virtcon *con = dev;
+    struct Virtq *q = &con->dev.vq[VIRTCON_TX_QUEUE];
+    uint32_t intSave;
+    uint32_t events = 0;
+    uint16_t id;
+
+    if (!(OSAL_READL(con->dev.base + VIRTMMIO_REG_INTERRUPTSTATUS) & VIRTMMIO_IRQ_NOTIFY_USED)) {
+        return 1;
+    }
+
+    OsalSpinLockIrqSave(&con->txLock, &intSave);
+    while (q->last != q->used->index) {
+        DSB;
+        id = q->used->ring[q->last % q->qsz].id;
+        q->desc[id].next = con->txFreeHead;
+        con->txFreeHead = id;
+        con->txFreeNum++;
+        q->last++;
+        events |= EVENT_TX;
+    }
+    OsalSpinUnlockIrqRestore(&con->txLock, &intSave);
+
+    if (!RxEmpty(con)) {
+        events |= EVENT_RX;
+    }
+    if (events) {
+        (void)LOS_EventWrite(&con->wait.stEvent, events);
+    }
+    if (events & EVENT_RX) {
+        notify_poll(&con->wait);
+    }
+
+    OSAL_WRITEL(VIRTMMIO_IRQ_NOTIFY_USED, con->dev.base + VIRTMMIO_REG_INTERRUPTACK);
+    return 0;
+}
+
+static void VirtconDeInit(struct Virtcon *con)
+{
+    if (con->dev.irq & ~_IRQ_MASK) {
+        OsalUnregisterIrq(con->dev.irq & _IRQ_MASK, con);
+    }
+    if (con->rxMutex.realMutex) {
+        OsalMutexDestroy(&con->rxMutex);
+    }
+    (void)LOS_EventDestroy(&con->wait.stEvent);
+    LOS_DmaMemFree(con);
+}
+
+static int VirtconInitDevAux(struct Virtcon *con)
+{
+    int32_t ret;
+
+    if ((ret = OsalMutexInit(&con->rxMutex)) != HDF_SUCCESS) {
+        HDF_LOGE("[%s]initialize mutex failed: %d", __func__, ret);
+        return ret;
+    }
+    (void)OsalSpinInit(&con->txLock);
+    (void)LOS_EventInit(&con->wait.stEvent);
+    spin_lock_init(&con->wait.lock);
+    LOS_ListInit(&con->wait.poll_queue);
+
+    ret = OsalRegisterIrq(con->dev.irq, OSAL_IRQF_TRIGGER_NONE,
+                          (OsalIRQHandle)VirtconIRQhandle, VIRTMMIO_CONSOLE_NAME, con);
+    if (ret != HDF_SUCCESS) {
+        HDF_LOGE("[%s]register IRQ failed: %d", __func__, ret);
+        return ret;
+    }
+    con->dev.irq |= ~_IRQ_MASK;
+
+    return HDF_SUCCESS;
+}
+
+static struct Virtcon *VirtconInitDev(void)
+{
+    struct Virtcon *con = NULL;
+    VADDR_T base;
+    uint16_t qsz[VIRTQ_NUM];
+    int32_t len;
+
+    /* NOTE: For simplicity, alloc all these data from physical continuous memory. */
+    len = sizeof(struct Virtcon) + VirtqSize(VIRTQ_RX_QSZ) + VirtqSize(VIRTQ_TX_QSZ);
+    con = LOS_DmaMemAlloc(NULL, len, sizeof(UINTPTR), DMA_CACHE);
+    if (con == NULL) {
+        HDF_LOGE("[%s]alloc console memory failed", __func__);
+        return NULL;
+    }
+    (void)memset_s(con, len, 0, len);
+
+    if (!VirtmmioDiscover(VIRTMMIO_DEVICE_ID_CONSOLE, &con->dev)) {
+        goto ERR_OUT;
+    }
+
+    VirtmmioInitBegin(&con->dev);
+
+    if (!VirtmmioNegotiate(&con->dev, Feature0, Feature1, con)) {
+        goto ERR_OUT1;
+    }
+
+    base = ALIGN((VADDR_T)con + sizeof(struct Virtcon), VIRTQ_ALIGN_DESC);
+    qsz[VIRTCON_RX_QUEUE] = VIRTQ_RX_QSZ;
+    qsz[VIRTCON_TX_QUEUE] = VIRTQ_TX_QSZ;
+    if (VirtmmioConfigQueue(&con->dev, base, qsz, VIRTQ_NUM) == 0) {
+        goto ERR_OUT1;
+    }
+    PopulateRxQueue(con);
+    PopulateTxQueue(con);
+
+    if (VirtconInitDevAux(con) != HDF_SUCCESS) {
+        goto ERR_OUT1;
+    }
+
+    VritmmioInitEnd(&con->dev);
+    OSAL_WRITEL(VIRTCON_RX_QUEUE, con->dev.base + VIRTMMIO_REG_QUEUENOTIFY);
+    return con;
+
+ERR_OUT1:
+    VirtmmioInitFailed(&con->dev);
+ERR_OUT:
+    VirtconDeInit(con);
+    return NULL;
+}
+
+
+/*
+ * UART host methods
+ */
+
+static int32_t VirtconRead(struct UartHost *host, uint8_t *data, uint32_t size)
+{
+    struct Virtcon *con = NULL;
+    struct Virtq *q = NULL;
+    struct VirtqUsedElem *elem = NULL;
+    uint32_t done = 0;
+    uint32_t len;
+    bool repost = false;
+
+    if (host == NULL || host->priv == NULL || data == NULL) {
+        HDF_LOGE("[%s]invalid parameter", __func__);
+        return HDF_ERR_INVALID_PARAM;
+    }
+    con = host->priv;
+    q = &con->dev.vq[VIRTCON_RX_QUEUE];
+    if (con->state != VIRTCON_STATE_OPENED) {
+        return HDF_FAILURE;
+    }
+
+    /* device publishes used index after data, so check-then-wait never misses a wakeup */
+    while (con->rdBlock && RxEmpty(con)) {
+        (void)LOS_EventRead(&con->wait.stEvent, EVENT_RX, LOS_WAITMODE_OR | LOS_WAITMODE_CLR, LOS_WAIT_FOREVER);
+    }
+
+    if (OsalMutexLock(&con->rxMutex) != HDF_SUCCESS) {
+        return HDF_FAILURE;
+    }
+    while ((done < size) && !RxEmpty(con)) {
+        elem = &q->used->ring[q->last % q->qsz];
+        len = elem->len - con->rxOffset;
+        len = (len > size - done) ? (size - done) : len;
+        (void)memcpy_s(data + done, size - done, con->rxBuf[elem->id] + con->rxOffset, len);
+        done += len;
+        con->rxOffset += len;
+        if (con->rxOffset < elem->len) {
+            break;
+        }
+
+        /* buffer drained, give it back */
+        q->avail->ring[q->avail->index % q->qsz] = elem->id;
+        DSB;
+        q->avail->index++;
+        q->last++;
+        con->rxOffset = 0;
+        repost = true;
+    }
+    if (repost) {
+        OSAL_WRITEL(VIRTCON_RX_QUEUE, con->dev.base + VIRTMMIO_REG_QUEUENOTIFY);
+    }
+    (void)OsalMutexUnlock(&con->rxMutex);
+
+    return done;
+}
+
+static int32_t VirtconWrite(struct UartHost *host, uint8_t *data, uint32_t size)
+{
+    struct Virtcon *con = NULL;
+    struct Virtq *q = NULL;
+    uint32_t intSave;
+    uint32_t done = 0;
+    uint32_t len;
+    uint16_t id;
+    bool kick = false;
+
+    if (host == NULL || host->priv == NULL || data == NULL) {
+        HDF_LOGE("[%s]invalid parameter", __func__);
+        return HDF_ERR_INVALID_PARAM;
+    }
+    con = host->priv;
+    q = &con->dev.vq[VIRTCON_TX_QUEUE];
+    if (con->state != VIRTCON_STATE_OPENED) {
+        return HDF_FAILURE;
+    }
+
+    while (done < size) {
+        OsalSpinLockIrqSave(&con->txLock, &intSave);
+        if (con->txFreeNum == 0) {
+            OsalSpinUnlockIrqRestore(&con->txLock, &intSave);
+            /* buffers come back only after the device has seen them */
+            if (kick) {
+                OSAL_WRITEL(VIRTCON_TX_QUEUE, con->dev.base + VIRTMMIO_REG_QUEUENOTIFY);
+                kick = false;
+            }
+            (void)LOS_EventRead(&con->wait.stEvent, EVENT_TX, LOS_WAITMODE_OR | LOS_WAITMODE_CLR,
+                LOS_WAIT_FOREVER);
+            continue;
+        }
+        id = con->txFreeHead;
+        con->txFreeHead = q->desc[id].next;
+        con->txFreeNum--;
+        OsalSpinUnlockIrqRestore(&con->txLock, &intSave);
+
+        len = ((size - done) > TX_BUF_SIZE) ? TX_BUF_SIZE : (size - done);
+        (void)memcpy_s(con->txBuf[id], TX_BUF_SIZE, data + done, len);
+        q->desc[id].len = len;
+        done += len;
+
+        OsalSpinLockIrqSave(&con->txLock, &intSave);
+        q->avail->ring[q->avail->index % q->qsz] = id;
+        DSB;
+        q->avail->index++;
+        OsalSpinUnlockIrqRestore(&con->txLock, &intSave);
+        kick = true;
+    }
+    if (kick) {
+        OSAL_WRITEL(VIRTCON_TX_QUEUE, con->dev.base + VIRTMMIO_REG_QUEUENOTIFY);
+    }
+
+    return HDF_SUCCESS;
+}
+
+static int32_t VirtconGetBaud(struct UartHost *host, uint32_t *baudRate)
+{
+    if (host == NULL || baudRate == NULL) {
+        HDF_LOGE("[%s]invalid parameter", __func__);
+        return HDF_ERR_INVALID_PARAM;
+    }
+    *baudRate = VIRTCON_DFT_BAUDRATE;
+    return HDF_SUCCESS;
+}
+
+static int32_t VirtconSetBaud(struct UartHost *host, uint32_t baudRate)
+{
+    (void)host;
+    (void)baudRate;
+    return HDF_SUCCESS;     /* no wire, any rate is fine */
+}
+
+static int32_t VirtconGetAttribute(struct UartHost *host, struct UartAttribute *attribute)
+{
+    if (host == NULL || attribute == NULL) {
+        HDF_LOGE("[%s]invalid parameter", __func__);
+        return HDF_ERR_INVALID_PARAM;
+    }
+    (void)memset_s(attribute, sizeof(*attribute), 0, sizeof(*attribute));
+    attribute->dataBits = UART_ATTR_DATABIT_8;
+    attribute->parity = UART_ATTR_PARITY_NONE;
+    attribute->stopBits = UART_ATTR_STOPBIT_1;
+    return HDF_SUCCESS;
+}
+
+static int32_t VirtconSetAttribute(struct UartHost *host, struct UartAttribute *attribute)
+{
+    (void)host;
+    (void)attribute;
+    return HDF_ERR_NOT_SUPPORT;
+}
+
+static int32_t VirtconSetTransMode(struct UartHost *host, enum UartTransMode mode)
+{
+    struct Virtcon *con = NULL;
+
+    if (host == NULL || host->priv == NULL) {
+        HDF_LOGE("[%s]invalid parameter", __func__);
+        return HDF_ERR_INVALID_PARAM;
+    }
+    con = host->priv;
+    if (mode == UART_MODE_RD_BLOCK) {
+        con->rdBlock = true;
+    } else if (mode == UART_MODE_RD_NONBLOCK) {
+        con->rdBlock = false;
+        (void)LOS_EventWrite(&con->wait.stEvent, EVENT_RX);
+    }
+    return HDF_SUCCESS;
+}
+
+static int32_t VirtconInit(struct UartHost *host)
+{
+    struct Virtcon *con = NULL;
+
+    if (host == NULL || host->priv == NULL) {
+        HDF_LOGE("[%s]invalid parameter", __func__);
+        return HDF_ERR_INVALID_PARAM;
+    }
+    con = host->priv;
+    con->state = VIRTCON_STATE_OPENED;
+    con->count++;
+    return HDF_SUCCESS;
+}
+
+static int32_t VirtconDeinit(struct UartHost *host)
+{
+    struct Virtcon *con = NULL;
+
+    if (host == NULL || host->priv == NULL) {
+        HDF_LOGE("[%s]invalid parameter", __func__);
+        return HDF_ERR_INVALID_PARAM;
+    }
+    con = host->priv;
+    if ((--con->count) == 0) {
+        con->state = VIRTCON_STATE_CLOSED;
+    }
+    return HDF_SUCCESS;
+}
+
+static int32_t VirtconPollEvent(struct UartHost *host, void *filep, void *table)
+{
+    struct Virtcon *con = NULL;
+
+    if (host == NULL || host->priv == NULL) {
+        HDF_LOGE("[%s]host is NULL", __func__);
+        return HDF_FAILURE;
+    }
+    con = host->priv;
+    if (con->state != VIRTCON_STATE_OPENED) {
+        return -EFAULT;
+    }
+
+    poll_wait((struct file *)filep, &con->wait, (poll_table *)table);
+
+    if (!RxEmpty(con)) {
+        return POLLIN | POLLRDNORM;
+    }
+    return 0;
+}
+
+static struct UartHostMethod g_virtconMethod = {
+    .Init = VirtconInit,
+    .Deinit = VirtconDeinit,
+    .Read = VirtconRead,
+    .Write = VirtconWrite,
+    .SetBaud = VirtconSetBaud,
+    .GetBaud = VirtconGetBaud,
+    .SetAttribute = VirtconSetAttribute,
+    .GetAttribute = VirtconGetAttribute,
+    .SetTransMode = VirtconSetTransMode,
+    .pollEvent = VirtconPollEvent,
+};
+
+
+/*
+ * HDF entry
+ */
+
+static int32_t HdfVirtconBind(struct HdfDeviceObject *device)
+{
+    if (device == NULL) {
+        HDF_LOGE("[%s]device is null", __func__);
+        return HDF_ERR_INVALID_OBJECT;
+    }
+    return (UartHostCreate(device) == NULL) ? HDF_FAILURE : HDF_SUCCESS;
+}
+
+static int32_t HdfVirtconInit(struct HdfDeviceObject *device)
+{
+    struct DeviceResourceIface *iface = DeviceResourceGetIfaceInstance(HDF_CONFIG_SOURCE);
+    struct UartHost *host = NULL;
+    struct Virtcon *con = NULL;
+
+    if (device == NULL) {
+        HDF_LOGE("[%s]device is null", __func__);
+        return HDF_ERR_INVALID_OBJECT;
+    }
+    if ((host = UartHostFromDevice(device)) == NULL) {
+        HDF_LOGE("[%s]host is null", __func__);
+        return HDF_FAILURE;
+    }
+    if ((con = VirtconInitDev()) == NULL) {
+        return HDF_DEV_ERR_NO_DEVICE;
+    }
+
+    con->num = VIRTCON_DFT_NUM;
+    con->rdBlock = true;
+    if ((iface != NULL) && (iface->GetUint32 != NULL) && (device->property != NULL)) {
+        (void)iface->GetUint32(device->property, "num", &con->num, VIRTCON_DFT_NUM);
+    }
+
+    host->priv = con;
+    host->num = con->num;
+    host->method = &g_virtconMethod;
+    UartAddDev(host);
+    return HDF_SUCCESS;
+}
+
+static void HdfVirtconRelease(struct HdfDeviceObject *device)
+{
+    struct UartHost *host = NULL;
+
+    if (device == NULL) {
+        HDF_LOGE("[%s]device is null", __func__);
+        return;
+    }
+    if ((host = UartHostFromDevice(device)) == NULL) {
+        HDF_LOGE("[%s]host is null", __func__);
+        return;
+    }
+    if (host->priv != NULL) {
+        UartRemoveDev(host);
+        VirtconDeInit(host->priv);
+        host->priv = NULL;
+    }
+    UartHostDestroy(host);
+}
+
+struct HdfDriverEntry g_virtconEntry = {
+    .moduleVersion = 1,
+    .moduleName = "HDF_VIRTIO_CONSOLE",
+    .Bind = HdfVirtconBind,
+    .Init = HdfVirtconInit,
+    .Release = HdfVirtconRelease,
+};
+
+HDF_INIT(g_virtconEntry);
@@ -14,22 +14,39 @@
  */
 /*
  * Simple virtio-mmio gpu driver, without hardware accelarator.
- * Using only synchronous request/response, no IRQ.
+ * Control commands are fenced and completed by IRQ, so callers sleep
+ * instead of spinning and refresh commands are pipelined.
  */
 
 #include "osal.h"
 #include "osal_io.h"
 #include "hdf_device_desc.h"
+#include "dmac_core.h"
 #include "fb.h"
+#include "los_hw.h"
 #include "los_vm_phys.h"
 #include "los_vm_iomap.h"
+#include "user_copy.h"
 #include "virtmmio.h"
+#include "virtgpu.h"
+#include "virtgpu_edid.h"
 
 #define VIRTIO_GPU_F_EDID   (1 << 1)
+#define VIRTMMIO_GPU_NAME   "virtgpu"
 
-#define VIRTQ_CONTROL_QSZ   4
+/*
+ * Control queue is split into CMD_SLOTS fixed descriptor groups. Every group
+ * has CMD_SLOT_ENTRIES descriptors: request, optional data, response and one
+ * spare to keep queue size a power of 2. Used ring id / CMD_SLOT_ENTRIES is
+ * the slot index.
+ */
+#define VIRTQ_CONTROL_QSZ   64
 #define VIRTQ_CURSOR_QSZ    2
-#define NORMAL_CMD_ENTRIES  2
+#define CMD_SLOT_ENTRIES    4
+#define CMD_SLOTS           (VIRTQ_CONTROL_QSZ / CMD_SLOT_ENTRIES)
+#define CMD_REQ_MAX         64
+#define CMD_SLOT_NONE       0xFFFF
+#define EVENT_SLOT_FREE     (1U << CMD_SLOTS)   /* bit 0 ~ CMD_SLOTS-1: slot completion */
 
 #define FB_WIDTH_DFT        800
 #define FB_HEIGHT_DFT       480
@@ -98,6 +115,14 @@ struct VirtgpuRect {
     uint32_t height;
 };
 
+struct VirtgpuConfig {
+#define VIRTIO_GPU_EVENT_DISPLAY (1 << 0)
+    uint32_t eventsRead;
+    uint32_t eventsClear;
+    uint32_t numScanouts;
+    uint32_t numCapsets;
+};
+
 struct VirtgpuResourceFlush {
     struct VirtgpuCtrlHdr hdr;
     struct VirtgpuRect r;
@@ -113,26 +138,69 @@ struct VirtgpuTransferToHost2D {
     uint32_t padding;
 };
 
+struct VirtgpuMemEntry {
+    uint64_t addr;
+    uint32_t length;
+    uint32_t padding;
+};
+
+/* Requests are copied in, so callers need not keep them after submit. */
+struct VirtgpuCmdSlot {
+    uint8_t                         req[CMD_REQ_MAX];
+    struct VirtgpuMemEntry          data;
+    struct VirtgpuCtrlHdr           resp;       /* used if caller does not care response body */
+    volatile struct VirtgpuCtrlHdr  *result;    /* where device write response to */
+    uint64_t                        fence;
+    uint16_t                        next;       /* free list link */
+    bool                            waited;     /* someone sleep for it, so do not recycle in IRQ */
+};
+
+/* one control queue command: optional data & response buffers must be physical continuous */
+struct VirtgpuCmd {
+    const void      *req;
+    size_t          reqSize;
+    const void      *data;
+    size_t          dataSize;
+    volatile void   *resp;
+    size_t          respSize;
+    uint64_t        fence;      /* output: fence ID assigned to this command */
+};
+
 struct Virtgpu {
     struct VirtmmioDev      dev;
     OSAL_DECLARE_TIMER(timer);          /* refresh timer */
 
-    struct VirtgpuRect      screen;
+    struct VirtgpuRect      screen;     /* current mode */
     uint8_t                 *fb;        /* frame buffer */
+    size_t                  fbSize;     /* allocated at boot for preferred mode, never move */
     bool                    edid;
+    struct VirtgpuModeList  modes;
+    OSAL_DECLARE_MUTEX(modeMutex);      /* serialize mode query & set */
 
-    /*
-     * Normal operations(timer refresh) request/response buffers.
-     * We do not wait for their completion, so they must be static memory.
-     * When an operation happened, the last one must already done.
-     * Response is shared and ignored.
-     *
-     * control queue 4 descs: 0-trans_req 1-trans_resp 2-flush_req 3-flush_resp
-     *                        0-... (30Hz is enough to avoid override)
-     */
+    /* Normal operations(timer refresh) request templates, copied into a slot every refresh. */
     struct VirtgpuResourceFlush     flushReq;
     struct VirtgpuTransferToHost2D  transReq;
-    struct VirtgpuCtrlHdr           resp;
+    uint64_t                        refreshFence;   /* fence of last submitted refresh */
+
+    /*
+     * Framebuffer is mapped cacheable to user, so CPU cache must be cleaned
+     * before transfer. Clients report their drawing through VIRTGPU_FBIO_DAMAGE,
+     * or the whole screen is treated as damaged every refresh.
+     */
+    struct VirtgpuRect              damage;
+    bool                            damageReport;   /* client ever reported damage */
+
+    /* mode switch sets 'refreshStop' then waits out a timer callback that is still 'refreshing' */
+    bool                            refreshStop;
+    bool                            refreshing;
+
+    OSAL_DECLARE_SPINLOCK(lock);        /* protect free list, fence, avail ring and refresh state */
+    DmacEvent               event;      /* slot completion & slot free notification */
+    uint16_t                freeHead;
+    uint16_t                freeNum;
+    uint64_t                fenceSeq;   /* last submitted fence */
+    uint64_t                fenceDone;  /* last completed fence */
+    struct VirtgpuCmdSlot   slots[CMD_SLOTS];
 };
 static struct Virtgpu *g_virtGpu;   /* fb module need this data, using global for simplicity */
 
@@ -175,96 +243,229 @@ static bool Feature1(uint32_t features, uint32_t *supported, void *dev)
     return true;
 }
 
-static bool NotifyAndWaitResponse(unsigned queue, struct Virtq *q, const void *req, volatile void *resp)
+static bool CheckResponse(const void *req, const volatile struct VirtgpuCtrlHdr *resp)
 {
     const struct VirtgpuCtrlHdr *a = req;
-    volatile struct VirtgpuCtrlHdr *b = resp;
-
-    /* always use desc[0] [1] ([2]) for request-wait-response */
-    q->avail->ring[q->avail->index % q->qsz] = 0;
-    DSB;
-    q->avail->index++;
-    OSAL_WRITEL(queue, g_virtGpu->dev.base + VIRTMMIO_REG_QUEUENOTIFY);
-
-    /* spin for response */
-    while ((q->last == q->used->index) ||
-           ((a->flags == VIRTIO_GPU_FLAG_FENCE) && (a->fenceId != b->fenceId))) {
-        DSB;
-    }
-    q->last++;
 
-    if ((b->type < VIRTIO_GPU_RESP_OK_NODATA) || (b->type > VIRTIO_GPU_RESP_OK_EDID)) {
-        HDF_LOGE("[%s]virtio-gpu command=0x%x error=0x%x: %s", __func__, a->type, b->type, ErrString(b->type));
+    if ((resp->type < VIRTIO_GPU_RESP_OK_NODATA) || (resp->type > VIRTIO_GPU_RESP_OK_EDID)) {
+        HDF_LOGE("[%s]virtio-gpu command=0x%x error=0x%x: %s", __func__, a->type, resp->type,
+                 ErrString(resp->type));
         return false;
     }
 
     return true;
 }
 
-static bool RequestResponse(unsigned queue, const void *req, size_t reqSize, volatile void *resp, size_t respSize)
+static void InitCmdSlots(struct Virtgpu *gpu)
+{
+    uint16_t i;
+
+    for (i = 0; i < CMD_SLOTS; i++) {
+        gpu->slots[i].next = i + 1;
+    }
+    gpu->slots[CMD_SLOTS - 1].next = CMD_SLOT_NONE;
+    gpu->freeHead = 0;
+    gpu->freeNum = CMD_SLOTS;
+}
+
+/* must hold gpu->lock */
+static void PutCmdSlot(struct Virtgpu *gpu, uint16_t i)
 {
-    struct Virtq *q = &g_virtGpu->dev.vq[queue];
-    uint16_t idx = 0;
+    gpu->slots[i].next = gpu->freeHead;
+    gpu->freeHead = i;
+    gpu->freeNum++;
+}
 
-    /* NOTE: We need these data physical continuous. They came from kernel stack, so they must. */
-    q->desc[idx].pAddr = VMM_TO_DMA_ADDR((VADDR_T)req);
-    q->desc[idx].len = reqSize;
+/* Timer refresh can not wait, it just gives up when all slots are in flight. */
+static uint16_t GetCmdSlot(struct Virtgpu *gpu, bool canWait)
+{
+    uint32_t intSave;
+    uint16_t i;
+
+    while (1) {
+        OsalSpinLockIrqSave(&gpu->lock, &intSave);
+        if (gpu->freeNum > 0) {
+            i = gpu->freeHead;
+            gpu->freeHead = gpu->slots[i].next;
+            gpu->freeNum--;
+            OsalSpinUnlockIrqRestore(&gpu->lock, &intSave);
+            return i;
+        }
+        OsalSpinUnlockIrqRestore(&gpu->lock, &intSave);
+
+        if (!canWait) {
+            return CMD_SLOT_NONE;
+        }
+        (void)DmaEventWait(&gpu->event, EVENT_SLOT_FREE, HDF_WAIT_FOREVER);
+    }
+}
+
+static void FillCmdSlotDesc(struct Virtq *q, struct VirtgpuCmdSlot *slot, uint16_t head,
+                            const struct VirtgpuCmd *cmd)
+{
+    uint16_t idx = head;
+
+    q->desc[idx].pAddr = VMM_TO_DMA_ADDR((VADDR_T)slot->req);
+    q->desc[idx].len = cmd->reqSize;
     q->desc[idx].flag = VIRTQ_DESC_F_NEXT;
     q->desc[idx].next = idx + 1;
     idx++;
-    q->desc[idx].pAddr = VMM_TO_DMA_ADDR((VADDR_T)resp);
-    q->desc[idx].len = respSize;
+    if (cmd->data) {
+        (void)memcpy_s(&slot->data, sizeof(slot->data), cmd->data, cmd->dataSize);
+        q->desc[idx].pAddr = VMM_TO_DMA_ADDR((VADDR_T)&slot->data);
+        q->desc[idx].len = cmd->dataSize;
+        q->desc[idx].flag = VIRTQ_DESC_F_NEXT;
+        q->desc[idx].next = idx + 1;
+        idx++;
+    }
+    /* NOTE: Response body came from kernel stack, so it must be physical continuous. */
+    q->desc[idx].pAddr = VMM_TO_DMA_ADDR((VADDR_T)slot->result);
+    q->desc[idx].len = cmd->resp ? cmd->respSize : sizeof(slot->resp);
     q->desc[idx].flag = VIRTQ_DESC_F_WRITE;
+}
 
-    return NotifyAndWaitResponse(queue, q, req, resp);
+/*
+ * Put one fenced command into control queue. If 'wait', sleep until IRQ report
+ * its completion and check the response; otherwise IRQ recycles the slot.
+ */
+static bool SubmitCommand(struct Virtgpu *gpu, struct VirtgpuCmd *cmd, bool wait, bool notify)
+{
+    struct Virtq *q = &gpu->dev.vq[0];
+    struct VirtgpuCmdSlot *slot = NULL;
+    struct VirtgpuCtrlHdr *hdr = NULL;
+    uint32_t intSave, bit, ev;
+    uint16_t i;
+    bool ret = false;
+
+    if ((cmd->reqSize > CMD_REQ_MAX) || (cmd->dataSize > sizeof(slot->data))) {
+        HDF_LOGE("[%s]command too large: %zu %zu", __func__, cmd->reqSize, cmd->dataSize);
+        return false;
+    }
+    if ((i = GetCmdSlot(gpu, wait)) == CMD_SLOT_NONE) {
+        return false;
+    }
+
+    slot = &gpu->slots[i];
+    (void)memcpy_s(slot->req, sizeof(slot->req), cmd->req, cmd->reqSize);
+    slot->result = cmd->resp ? cmd->resp : &slot->resp;
+    slot->waited = wait;
+    FillCmdSlotDesc(q, slot, i * CMD_SLOT_ENTRIES, cmd);
+
+    OsalSpinLockIrqSave(&gpu->lock, &intSave);
+    hdr = (struct VirtgpuCtrlHdr *)slot->req;
+    hdr->flags |= VIRTIO_GPU_FLAG_FENCE;
+    hdr->fenceId = ++gpu->fenceSeq;
+    slot->fence = cmd->fence = hdr->fenceId;
+    q->avail->ring[q->avail->index % q->qsz] = i * CMD_SLOT_ENTRIES;
+    DSB;
+    q->avail->index++;
+    OsalSpinUnlockIrqRestore(&gpu->lock, &intSave);
+
+    if (notify) {
+        OSAL_WRITEL(0, gpu->dev.base + VIRTMMIO_REG_QUEUENOTIFY);
+    }
+    if (!wait) {
+        return true;
+    }
+
+    bit = 1U << i;
+    if ((ev = DmaEventWait(&gpu->event, bit, HDF_WAIT_FOREVER)) != bit) {
+        HDF_LOGE("[%s]FATAL: wait event failed: %u", __func__, ev);
+        return false;   /* slot leaked, device may still write it */
+    }
+    ret = CheckResponse(slot->req, slot->result);
+
+    OsalSpinLockIrqSave(&gpu->lock, &intSave);
+    PutCmdSlot(gpu, i);
+    OsalSpinUnlockIrqRestore(&gpu->lock, &intSave);
+    (void)DmaEventSignal(&gpu->event, EVENT_SLOT_FREE);
+    return ret;
+}
+
+static bool RequestResponse(const void *req, size_t reqSize, volatile void *resp, size_t respSize)
+{
+    struct VirtgpuCmd cmd = {
+        .req = req,
+        .reqSize = reqSize,
+        .resp = resp,
+        .respSize = respSize,
+    };
+
+    return SubmitCommand(g_virtGpu, &cmd, true, true);
 }
 
 static bool RequestDataResponse(const void *req, size_t reqSize, const void *data,
                                 size_t dataSize, volatile void *resp, size_t respSize)
 {
-    struct Virtq *q = &g_virtGpu->dev.vq[0];
-    uint16_t idx = 0;
-
-    q->desc[idx].pAddr = VMM_TO_DMA_ADDR((VADDR_T)req);
-    q->desc[idx].len = reqSize;
-    q->desc[idx].flag = VIRTQ_DESC_F_NEXT;
-    q->desc[idx].next = idx + 1;
-    idx++;
-    q->desc[idx].pAddr = VMM_TO_DMA_ADDR((VADDR_T)data);
-    q->desc[idx].len = dataSize;
-    q->desc[idx].flag = VIRTQ_DESC_F_NEXT;
-    q->desc[idx].next = idx + 1;
-    idx++;
-    q->desc[idx].pAddr = VMM_TO_DMA_ADDR((VADDR_T)resp);
-    q->desc[idx].len = respSize;
-    q->desc[idx].flag = VIRTQ_DESC_F_WRITE;
+    struct VirtgpuCmd cmd = {
+        .req = req,
+        .reqSize = reqSize,
+        .data = data,
+        .dataSize = dataSize,
+        .resp = resp,
+        .respSize = respSize,
+    };
 
-    return NotifyAndWaitResponse(0, q, req, resp);
+    return SubmitCommand(g_virtGpu, &cmd, true, true);
 }
 
 /* For normal display refresh, do not wait response */
-static void RequestNoResponse(unsigned queue, const void *req, size_t reqSize, bool notify)
+static bool RequestNoResponse(const void *req, size_t reqSize, bool notify, uint64_t *fence)
 {
-    struct Virtq *q = &g_virtGpu->dev.vq[queue];
-    uint16_t head = q->last % q->qsz;   /* `last` record next writable desc entry for request */
+    struct VirtgpuCmd cmd = {
+        .req = req,
+        .reqSize = reqSize,
+    };
 
-    /* QEMU is busy for the full queue, give up this request */
-    if (abs(q->avail->index - (volatile uint16_t)q->used->index) >= VIRTQ_CONTROL_QSZ) {
-        return;
+    if (!SubmitCommand(g_virtGpu, &cmd, false, notify)) {
+        return false;
+    }
+    if (fence) {
+        *fence = cmd.fence;
     }
+    return true;
+}
 
-    /* other fields initiated by PopulateVirtQ */
-    q->desc[head].pAddr = VMM_TO_DMA_ADDR((VADDR_T)req);
-    q->desc[head].len = reqSize;
-    q->last += NORMAL_CMD_ENTRIES;
+static uint32_t VirtgpuIRQhandle(uint32_t swIrq, void *dev)
+{
+    (void)swIrq;
+    struct Virtgpu *gpu = dev;
+    struct Virtq *q = &gpu->dev.vq[0];
+    struct VirtgpuCmdSlot *slot = NULL;
+    uint32_t status, intSave;
+    uint32_t events = 0;
+    uint16_t i;
+
+    /* config change(display event) is only acked here, and re-probed by next mode query */
+    status = OSAL_READL(gpu->dev.base + VIRTMMIO_REG_INTERRUPTSTATUS);
+    if (!(status & (VIRTMMIO_IRQ_NOTIFY_USED | VIRTMMIO_IRQ_CONFIG_CHANGED))) {
+        return 1;
+    }
 
-    q->avail->ring[q->avail->index % q->qsz] = head;
-    DSB;
-    q->avail->index++;
+    OsalSpinLockIrqSave(&gpu->lock, &intSave);
+    while (q->last != q->used->index) {
+        DSB;
+        i = q->used->ring[q->last % q->qsz].id / CMD_SLOT_ENTRIES;
+        slot = &gpu->slots[i];
+        if (slot->fence > gpu->fenceDone) {
+            gpu->fenceDone = slot->fence;
+        }
+        if (slot->waited) {
+            events |= 1U << i;
+        } else {
+            (void)CheckResponse(slot->req, slot->result);
+            PutCmdSlot(gpu, i);
+            events |= EVENT_SLOT_FREE;
+        }
+        q->last++;
+    }
+    OsalSpinUnlockIrqRestore(&gpu->lock, &intSave);
 
-    if (notify) {
-        OSAL_WRITEL(queue, g_virtGpu->dev.base + VIRTMMIO_REG_QUEUENOTIFY);
+    OSAL_WRITEL(status, gpu->dev.base + VIRTMMIO_REG_INTERRUPTACK);
+    if (events) {
+        (void)DmaEventSignal(&gpu->event, events);
     }
+    return 0;
 }
 
 #define VIRTIO_GPU_MAX_SCANOUTS 16
@@ -276,31 +477,45 @@ struct VirtgpuRespDisplayInfo {
         uint32_t flags;
     } pmodes[VIRTIO_GPU_MAX_SCANOUTS];
 };
-static void CMDGetDisplayInfo(void)
+static bool CMDGetDisplayInfo(struct VirtgpuRect *r)
 {
     struct VirtgpuCtrlHdr req = {
         .type = VIRTIO_GPU_CMD_GET_DISPLAY_INFO
     };
     struct VirtgpuRespDisplayInfo resp = { 0 };
 
-    if (!RequestResponse(0, &req, sizeof(req), &resp, sizeof(resp))) {
-        goto DEFAULT;
+    if (!RequestResponse(&req, sizeof(req), &resp, sizeof(resp))) {
+        return false;
     }
 
-    if (resp.pmodes[0].enabled) {
-        g_virtGpu->screen = resp.pmodes[0].r;
-        return;
-    } else {
+    if (!resp.pmodes[0].enabled) {
         HDF_LOGE("[%s]scanout 0 not enabled", __func__);
+        return false;
     }
+    *r = resp.pmodes[0].r;
+    return true;
+}
+
+/* only modes fit in boot-time framebuffer are usable, so fbmem never move */
+static void AddMode(uint32_t width, uint32_t height)
+{
+    struct VirtgpuModeList *list = &g_virtGpu->modes;
+    uint32_t i;
 
-DEFAULT:
-    g_virtGpu->screen.x = g_virtGpu->screen.y = 0;
-    g_virtGpu->screen.width = FB_WIDTH_DFT;
-    g_virtGpu->screen.height = FB_HEIGHT_DFT;
+    if ((width == 0) || (height == 0) || (list->num >= VIRTGPU_MAX_MODES) ||
+        (width * height * PIXEL_BYTES > g_virtGpu->fbSize)) {
+        return;
+    }
+    for (i = 0; i < list->num; i++) {
+        if ((list->modes[i].width == width) && (list->modes[i].height == height)) {
+            return;
+        }
+    }
+    list->modes[list->num].width = width;
+    list->modes[list->num].height = height;
+    list->num++;
 }
 
-/* reserved for future use */
 struct VirtgpuGetEdid {
     struct VirtgpuCtrlHdr hdr;
     uint32_t scanout;
@@ -319,12 +534,39 @@ static void CMDGetEdid(void)
     };
     struct VirtgpuRespEdid resp = { 0 };
 
-    if (!RequestResponse(0, &req, sizeof(req), &resp, sizeof(resp))) {
-        goto DEFAULT;
+    if (!RequestResponse(&req, sizeof(req), &resp, sizeof(resp))) {
+        return;
     }
+    if (!VirtgpuParseEdid(resp.edid, MIN(resp.size, sizeof(resp.edid)), AddMode)) {
+        HDF_LOGE("[%s]invalid EDID, size=%u", __func__, resp.size);
+    }
+}
 
-DEFAULT:
-    return;
+/* host preferred mode first, then current mode, then what EDID announced */
+static void VirtgpuProbeModes(void)
+{
+    struct VirtgpuRect r;
+
+    g_virtGpu->modes.num = 0;
+    if (CMDGetDisplayInfo(&r)) {
+        AddMode(r.width, r.height);
+    }
+    AddMode(g_virtGpu->screen.width, g_virtGpu->screen.height);
+    if (g_virtGpu->edid) {
+        CMDGetEdid();
+    }
+}
+
+/* host changed display(e.g. window resized) since last probe */
+static bool DisplayChanged(void)
+{
+    VADDR_T conf = g_virtGpu->dev.base + VIRTMMIO_REG_CONFIG;
+
+    if (OSAL_READL(conf + offsetof(struct VirtgpuConfig, eventsRead)) & VIRTIO_GPU_EVENT_DISPLAY) {
+        OSAL_WRITEL(VIRTIO_GPU_EVENT_DISPLAY, conf + offsetof(struct VirtgpuConfig, eventsClear));
+        return true;
+    }
+    return false;
 }
 
 struct VirtgpuResourceCreate2D {
@@ -345,7 +587,7 @@ static bool CMDResourceCreate2D(uint32_t resourceId)
     };
     struct VirtgpuCtrlHdr resp = { 0 };
 
-    return RequestResponse(0, &req, sizeof(req), &resp, sizeof(resp));
+    return RequestResponse(&req, sizeof(req), &resp, sizeof(resp));
 }
 
 struct VirtgpuSetScanout {
@@ -354,30 +596,29 @@ struct VirtgpuSetScanout {
     uint32_t scanoutId;
     uint32_t resourceId;
 };
-static bool CMDSetScanout(const struct VirtgpuRect *r)
+/* resourceId 0 disable the scanout */
+static bool CMDSetScanout(const struct VirtgpuRect *r, uint32_t resourceId)
 {
     struct VirtgpuSetScanout req = {
         .hdr.type = VIRTIO_GPU_CMD_SET_SCANOUT,
         .r = *r,
-        .resourceId = RESOURCEID_FB
+        .resourceId = resourceId
     };
     struct VirtgpuCtrlHdr resp = { 0 };
 
-    return RequestResponse(0, &req, sizeof(req), &resp, sizeof(resp));
+    return RequestResponse(&req, sizeof(req), &resp, sizeof(resp));
 }
 
 static bool CMDTransferToHost(uint32_t resourceId, const struct VirtgpuRect *r)
 {
     struct VirtgpuTransferToHost2D req = {
         .hdr.type = VIRTIO_GPU_CMD_TRANSFER_TO_HOST_2D,
-        .hdr.flags = VIRTIO_GPU_FLAG_FENCE,
-        .hdr.fenceId = r->x + r->y + r->width + r->height,
         .r = *r,
         .resourceId = resourceId,
     };
     struct VirtgpuCtrlHdr resp = { 0 };
 
-    return RequestResponse(0, &req, sizeof(req), &resp, sizeof(resp));
+    return RequestResponse(&req, sizeof(req), &resp, sizeof(resp));
 }
 
 static bool CMDResourceFlush(void)
@@ -389,7 +630,7 @@ static bool CMDResourceFlush(void)
     };
     struct VirtgpuCtrlHdr resp = { 0 };
 
-    return RequestResponse(0, &req, sizeof(req), &resp, sizeof(resp));
+    return RequestResponse(&req, sizeof(req), &resp, sizeof(resp));
 }
 
 struct VirtgpuResourceAttachBacking {
@@ -397,11 +638,7 @@ struct VirtgpuResourceAttachBacking {
     uint32_t resourceId;
     uint32_t nrEntries;
 };
-struct VirtgpuMemEntry {
-    uint64_t addr;
-    uint32_t length;
-    uint32_t padding;
-};                                  /* vaddr's physical address should be continuous */
+                                    /* vaddr's physical address should be continuous */
 static bool CMDResourceAttachBacking(uint32_t resourceId, uint64_t vaddr, uint32_t len)
 {
     struct VirtgpuResourceAttachBacking req = {
@@ -418,11 +655,161 @@ static bool CMDResourceAttachBacking(uint32_t resourceId, uint64_t vaddr, uint32
     return RequestDataResponse(&req, sizeof(req), &data, sizeof(data), &resp, sizeof(resp));
 }
 
+struct VirtgpuResourceUnref {
+    struct VirtgpuCtrlHdr hdr;
+    uint32_t resourceId;
+    uint32_t padding;
+};
+static bool CMDResourceUnref(uint32_t resourceId)
+{
+    struct VirtgpuResourceUnref req = {
+        .hdr.type = VIRTIO_GPU_CMD_RESOURCE_UNREF,
+        .resourceId = resourceId
+    };
+    struct VirtgpuCtrlHdr resp = { 0 };
+
+    return RequestResponse(&req, sizeof(req), &resp, sizeof(resp));
+}
+
+static bool RefreshInFlight(struct Virtgpu *gpu)
+{
+    uint32_t intSave;
+    bool busy;
+
+    OsalSpinLockIrqSave(&gpu->lock, &intSave);
+    busy = gpu->fenceDone < gpu->refreshFence;
+    OsalSpinUnlockIrqRestore(&gpu->lock, &intSave);
+    return busy;
+}
+
+static void UnionRect(struct VirtgpuRect *dst, const struct VirtgpuRect *r)
+{
+    uint32_t right, bottom;
+
+    if ((dst->width == 0) || (dst->height == 0)) {
+        *dst = *r;
+        return;
+    }
+    right = MAX(dst->x + dst->width, r->x + r->width);
+    bottom = MAX(dst->y + dst->height, r->y + r->height);
+    dst->x = MIN(dst->x, r->x);
+    dst->y = MIN(dst->y, r->y);
+    dst->width = right - dst->x;
+    dst->height = bottom - dst->y;
+}
+
+static void AddDamage(struct Virtgpu *gpu, const struct VirtgpuRect *r)
+{
+    uint32_t intSave;
+
+    OsalSpinLockIrqSave(&gpu->lock, &intSave);
+    UnionRect(&gpu->damage, r);
+    gpu->damageReport = true;
+    OsalSpinUnlockIrqRestore(&gpu->lock, &intSave);
+}
+
+static bool TakeDamage(struct Virtgpu *gpu, struct VirtgpuRect *r)
+{
+    uint32_t intSave;
+    bool ret = true;
+
+    OsalSpinLockIrqSave(&gpu->lock, &intSave);
+    if (!gpu->damageReport) {
+        *r = gpu->screen;
+    } else if ((gpu->damage.width == 0) || (gpu->damage.height == 0)) {
+        ret = false;
+    } else {
+        *r = gpu->damage;
+        gpu->damage.width = gpu->damage.height = 0;
+    }
+    OsalSpinUnlockIrqRestore(&gpu->lock, &intSave);
+    return ret;
+}
+
+/* clean CPU cache of rows covering 'r', so device see what user drawn through cached mapping */
+static void CleanFbCache(const struct Virtgpu *gpu, const struct VirtgpuRect *r)
+{
+    uint32_t stride = gpu->screen.width * PIXEL_BYTES;
+    VADDR_T start = (VADDR_T)gpu->fb + r->y * stride + r->x * PIXEL_BYTES;
+    VADDR_T end = (VADDR_T)gpu->fb + (r->y + r->height - 1) * stride + (r->x + r->width) * PIXEL_BYTES;
+
+    DCacheFlushRange(ROUNDDOWN(start, CACHE_ALIGNED_SIZE), ROUNDUP(end, CACHE_ALIGNED_SIZE));
+}
+
+/* transfer & flush are queued back to back with one notify, device handles them in order */
+static void RefreshDamage(struct Virtgpu *gpu)
+{
+    struct VirtgpuRect r;
+
+    /* QEMU has not finished last refresh, skip this one instead of piling up */
+    if (RefreshInFlight(gpu) || !TakeDamage(gpu, &r)) {
+        return;
+    }
+
+    CleanFbCache(gpu, &r);
+    gpu->transReq.r = r;
+    gpu->transReq.offset = r.y * gpu->screen.width * PIXEL_BYTES + r.x * PIXEL_BYTES;
+    gpu->flushReq.r = r;
+    if (!RequestNoResponse(&gpu->transReq, sizeof(gpu->transReq), false, NULL)) {
+        if (gpu->damageReport) {
+            AddDamage(gpu, &r);     /* try again next time */
+        }
+        return;
+    }
+    (void)RequestNoResponse(&gpu->flushReq, sizeof(gpu->flushReq), false, &gpu->refreshFence);
+    OSAL_WRITEL(0, gpu->dev.base + VIRTMMIO_REG_QUEUENOTIFY);
+}
+
+/* false if the screen is being reconfigured, otherwise RefreshLeave must follow */
+static bool RefreshEnter(struct Virtgpu *gpu)
+{
+    uint32_t intSave;
+    bool ret;
+
+    OsalSpinLockIrqSave(&gpu->lock, &intSave);
+    ret = !gpu->refreshStop;
+    gpu->refreshing = ret;
+    OsalSpinUnlockIrqRestore(&gpu->lock, &intSave);
+    return ret;
+}
+
+static void RefreshLeave(struct Virtgpu *gpu)
+{
+    uint32_t intSave;
+
+    OsalSpinLockIrqSave(&gpu->lock, &intSave);
+    gpu->refreshing = false;
+    OsalSpinUnlockIrqRestore(&gpu->lock, &intSave);
+}
+
+/* timer delete does not wait for a running callback, so fence it off before touching screen or resource */
+static void RefreshStop(struct Virtgpu *gpu)
+{
+    uint32_t intSave;
+    bool busy;
+
+    OsalSpinLockIrqSave(&gpu->lock, &intSave);
+    gpu->refreshStop = true;
+    busy = gpu->refreshing;
+    OsalSpinUnlockIrqRestore(&gpu->lock, &intSave);
+    while (busy) {
+        OsalMSleep(1);
+        OsalSpinLockIrqSave(&gpu->lock, &intSave);
+        busy = gpu->refreshing;
+        OsalSpinUnlockIrqRestore(&gpu->lock, &intSave);
+    }
+}
+
 static void NormOpsRefresh(uintptr_t arg)
 {
     (void)arg;
-    RequestNoResponse(0, &g_virtGpu->transReq, sizeof(g_virtGpu->transReq), false);
-    RequestNoResponse(0, &g_virtGpu->flushReq, sizeof(g_virtGpu->flushReq), true);
+    struct Virtgpu *gpu = g_virtGpu;
+
+    if (!RefreshEnter(gpu)) {
+        return;
+    }
+    RefreshDamage(gpu);
+    RefreshLeave(gpu);
 }
 
 /* fit user-space page size mmap */
@@ -431,31 +818,8 @@ static inline size_t VirtgpuFbPageSize(void)
     return ALIGN(g_virtGpu->screen.width * g_virtGpu->screen.height * PIXEL_BYTES, PAGE_SIZE);
 }
 
-static void PopulateVirtQ(void)
+static void InitRefreshRequests(void)
 {
-    struct Virtq *q = NULL;
-    int i, n;
-    uint16_t qsz;
-
-    for (n = 0; n < VIRTQ_NUM; n++) {
-        if (n) {
-            qsz = VIRTQ_CURSOR_QSZ;
-        } else {
-            qsz = VIRTQ_CONTROL_QSZ;
-        }
-        q = &g_virtGpu->dev.vq[n];
-
-        for (i = 0; i < qsz; i += NORMAL_CMD_ENTRIES) {
-            q->desc[i].flag = VIRTQ_DESC_F_NEXT;
-            q->desc[i].next = i + 1;
-            q->desc[i + 1].pAddr = VMM_TO_DMA_ADDR((VADDR_T)&g_virtGpu->resp);
-            q->desc[i + 1].len = sizeof(g_virtGpu->resp);
-            q->desc[i + 1].flag = VIRTQ_DESC_F_WRITE;
-        }
-        /* change usage to record our next writable index */
-        q->last = 0;
-    }
-
     g_virtGpu->transReq.hdr.type = VIRTIO_GPU_CMD_TRANSFER_TO_HOST_2D;
     g_virtGpu->transReq.r = g_virtGpu->screen;
     g_virtGpu->transReq.resourceId = RESOURCEID_FB;
@@ -476,9 +840,15 @@ static bool VirtgpuBeginNormDisplay(void)
         return false;
     }
 
-    /* now we can fix queue entries to avoid redundant when do normal OPs */
-    PopulateVirtQ();
+    InitRefreshRequests();
+    g_virtGpu->refreshStop = false;
 
+    /* framebuffer can be modified at any time, so we need a full screen refresh timer */
+    ret = OsalTimerCreate(&g_virtGpu->timer, GPU_DFT_RATE, NormOpsRefresh, 0);
+    if (ret != HDF_SUCCESS) {
+        HDF_LOGE("[%s]create timer failed: %d", __func__, ret);
+        return false;
+    }
     if ((ret = OsalTimerStartLoop(&g_virtGpu->timer)) != HDF_SUCCESS) {
         HDF_LOGE("[%s]start timer failed: %d\n", __func__, ret);
         return false;
@@ -492,8 +862,14 @@ static void VirtgpuDeInit(struct Virtgpu *gpu)
     if (gpu->timer.realTimer) {
         OsalTimerDelete(&gpu->timer);
     }
+    if (gpu->dev.irq & ~_IRQ_MASK) {
+        OsalUnregisterIrq(gpu->dev.irq & _IRQ_MASK, gpu);
+    }
+    if (gpu->modeMutex.realMutex) {
+        OsalMutexDestroy(&gpu->modeMutex);
+    }
     if (gpu->fb) {
-        LOS_PhysPagesFreeContiguous(gpu->fb, VirtgpuFbPageSize() / PAGE_SIZE);
+        LOS_PhysPagesFreeContiguous(gpu->fb, gpu->fbSize / PAGE_SIZE);
     }
     LOS_DmaMemFree(gpu);
     g_virtGpu = NULL;
@@ -513,6 +889,7 @@ static struct Virtgpu *VirtgpuInitDev(void)
         HDF_LOGE("[%s]alloc gpu memory failed", __func__);
         return NULL;
     }
+    memset_s(gpu, len, 0, len);
 
     if (!VirtmmioDiscover(VIRTMMIO_DEVICE_ID_GPU, &gpu->dev)) {
         goto ERR_OUT;
@@ -531,16 +908,27 @@ static struct Virtgpu *VirtgpuInitDev(void)
         goto ERR_OUT1;
     }
 
-    /* framebuffer can be modified at any time, so we need a full screen refresh timer */
-    ret = OsalTimerCreate(&gpu->timer, GPU_DFT_RATE, NormOpsRefresh, 0);
-    if (ret != HDF_SUCCESS) {
-        HDF_LOGE("[%s]create timer failed: %d", __func__, ret);
+    if ((ret = OsalMutexInit(&gpu->modeMutex)) != HDF_SUCCESS) {
+        HDF_LOGE("[%s]initialize mutex failed: %d", __func__, ret);
         goto ERR_OUT1;
     }
 
-    for (int i = 0; i < VIRTQ_NUM; i++) {   /* hint device not using IRQ */
-        gpu->dev.vq[i].avail->flag = VIRTQ_AVAIL_F_NO_INTERRUPT;
+    InitCmdSlots(gpu);
+    if ((ret = OsalSpinInit(&gpu->lock)) != HDF_SUCCESS) {
+        HDF_LOGE("[%s]initialize spin lock failed: %d", __func__, ret);
+        goto ERR_OUT1;
+    }
+    if ((ret = DmaEventInit(&gpu->event)) != HDF_SUCCESS) {
+        HDF_LOGE("[%s]initialize event control block failed: %#x", __func__, ret);
+        goto ERR_OUT1;
+    }
+    ret = OsalRegisterIrq(gpu->dev.irq, OSAL_IRQF_TRIGGER_NONE, (OsalIRQHandle)VirtgpuIRQhandle,
+                          VIRTMMIO_GPU_NAME, gpu);
+    if (ret != HDF_SUCCESS) {
+        HDF_LOGE("[%s]register IRQ failed: %d", __func__, ret);
+        goto ERR_OUT1;
     }
+    gpu->dev.irq |= ~_IRQ_MASK;
 
     VritmmioInitEnd(&gpu->dev);             /* now virt queue can be used */
     return gpu;
@@ -627,7 +1015,7 @@ static bool VirtgpuInitResourceHelper(uint32_t resourceId)
 
     if (resourceId == RESOURCEID_FB) {
         struct VirtgpuRect r = { 0, 0, w, h };
-        return CMDSetScanout(&r);
+        return CMDSetScanout(&r, RESOURCEID_FB);
     }
     return true;
 }
@@ -640,6 +1028,7 @@ static bool VirtgpuInitResource(void)
         HDF_LOGE("[%s]alloc framebuffer memory fail", __func__);
         return false;
     }
+    g_virtGpu->fbSize = VirtgpuFbPageSize();
     if (!VirtgpuInitResourceHelper(RESOURCEID_FB)) {
         return false;
     }
@@ -653,18 +1042,69 @@ int up_fbinitialize(int display)
         return -1;
     }
 
-    CMDGetDisplayInfo();
-    if (g_virtGpu->edid) {
-        CMDGetEdid();
+    if (!CMDGetDisplayInfo(&g_virtGpu->screen)) {
+        g_virtGpu->screen.x = g_virtGpu->screen.y = 0;
+        g_virtGpu->screen.width = FB_WIDTH_DFT;
+        g_virtGpu->screen.height = FB_HEIGHT_DFT;
     }
 
     if (!VirtgpuInitResource()) {
         return -1;
     }
 
+    VirtgpuProbeModes();
+    (void)DisplayChanged();     /* clear pending event, we are up to date */
     return 0;
 }
 
+/*
+ * Re-create the scanout resource at a new size on the same backing memory,
+ * so user mappings stay valid but must re-query plane info for new stride.
+ * Smaller modes cut per-frame transfer bandwidth.
+ */
+static int VirtgpuSetMode(uint32_t index)
+{
+    struct Virtgpu *gpu = g_virtGpu;
+    struct VirtgpuRect off = { 0 };
+    struct VirtgpuRect old = gpu->screen;
+    uint32_t intSave;
+    int ret = 0;
+
+    if (index >= gpu->modes.num) {
+        HDF_LOGE("[%s]invalid mode index: %u", __func__, index);
+        return -1;
+    }
+    if ((gpu->modes.modes[index].width == old.width) && (gpu->modes.modes[index].height == old.height)) {
+        return 0;
+    }
+
+    /* sync commands below are queued after all in-flight refresh */
+    RefreshStop(gpu);
+    (void)OsalTimerDelete(&gpu->timer);
+    (void)CMDSetScanout(&off, 0);
+    (void)CMDResourceUnref(RESOURCEID_FB);
+
+    gpu->screen.width = gpu->modes.modes[index].width;
+    gpu->screen.height = gpu->modes.modes[index].height;
+    if (!VirtgpuInitResourceHelper(RESOURCEID_FB)) {
+        HDF_LOGE("[%s]set mode %ux%u failed, restore %ux%u", __func__,
+                 gpu->screen.width, gpu->screen.height, old.width, old.height);
+        (void)CMDResourceUnref(RESOURCEID_FB);
+        gpu->screen = old;
+        (void)VirtgpuInitResourceHelper(RESOURCEID_FB);
+        ret = -1;
+    }
+
+    OsalSpinLockIrqSave(&gpu->lock, &intSave);
+    gpu->damage.width = gpu->damage.height = 0;
+    OsalSpinUnlockIrqRestore(&gpu->lock, &intSave);
+
+    if (!VirtgpuBeginNormDisplay()) {
+        return -1;
+    }
+    return ret;
+}
+
 static int FbGetVideoInfo(struct fb_vtable_s *vtable, struct fb_videoinfo_s *vinfo)
 {
     (void)vtable;
@@ -728,7 +1168,7 @@ static ssize_t FbMmap(struct fb_vtable_s *vtable, LosVmMapRegion *region)
     (void)vtable;
     int n;
 
-    if ((region->range.size + (region->pgOff << PAGE_SHIFT)) > VirtgpuFbPageSize()) {
+    if ((region->range.size + (region->pgOff << PAGE_SHIFT)) > g_virtGpu->fbSize) {
         HDF_LOGE("[%s]mmap size + pgOff exceed framebuffer size", __func__);
         return -1;
     }
@@ -737,7 +1177,9 @@ static ssize_t FbMmap(struct fb_vtable_s *vtable, LosVmMapRegion *region)
         return -1;
     }
 
-    region->regionFlags |= VM_MAP_REGION_FLAG_UNCACHED;
+    /* cacheable for fast CPU rendering, NormOpsRefresh clean damaged region before transfer */
+    region->regionFlags &= ~VM_MAP_REGION_FLAG_CACHE_MASK;
+    region->regionFlags |= VM_MAP_REGION_FLAG_CACHED;
     n = LOS_ArchMmuMap(&region->space->archMmu, region->range.base,
                         VMM_TO_DMA_ADDR((VADDR_T)g_virtGpu->fb + (region->pgOff << PAGE_SHIFT)),
                         region->range.size >> PAGE_SHIFT, region->regionFlags);
@@ -749,6 +1191,70 @@ static ssize_t FbMmap(struct fb_vtable_s *vtable, LosVmMapRegion *region)
     return 0;
 }
 
+static int FbReportDamage(unsigned long arg)
+{
+    struct VirtgpuRect r;
+
+    if (LOS_ArchCopyFromUser(&r, (const void *)arg, sizeof(r)) != 0) {
+        return -1;
+    }
+    if ((r.x >= g_virtGpu->screen.width) || (r.y >= g_virtGpu->screen.height) ||
+        (r.width == 0) || (r.height == 0)) {
+        return -1;
+    }
+    r.width = MIN(r.width, g_virtGpu->screen.width - r.x);
+    r.height = MIN(r.height, g_virtGpu->screen.height - r.y);
+
+    AddDamage(g_virtGpu, &r);
+    return 0;
+}
+
+static int FbGetModes(unsigned long arg)
+{
+    struct VirtgpuModeList *list = &g_virtGpu->modes;
+    uint32_t i;
+
+    if (DisplayChanged()) {
+        VirtgpuProbeModes();
+    }
+    for (i = 0; i < list->num; i++) {
+        if ((list->modes[i].width == g_virtGpu->screen.width) &&
+            (list->modes[i].height == g_virtGpu->screen.height)) {
+            list->current = i;
+        }
+    }
+
+    return (LOS_ArchCopyToUser((void *)arg, list, sizeof(*list)) == 0) ? 0 : -1;
+}
+
+static int FbIoctl(struct fb_vtable_s *vtable, int cmd, unsigned long arg)
+{
+    (void)vtable;
+    int ret;
+
+    switch (cmd) {
+        case VIRTGPU_FBIO_DAMAGE:
+            return FbReportDamage(arg);
+        case VIRTGPU_FBIO_GET_MODES:
+        case VIRTGPU_FBIO_SET_MODE:
+            break;
+        default:
+            HDF_LOGE("[%s]unsupported ioctl: %#x", __func__, cmd);
+            return -1;
+    }
+
+    if (OsalMutexLock(&g_virtGpu->modeMutex) != HDF_SUCCESS) {
+        return -1;
+    }
+    if (cmd == VIRTGPU_FBIO_GET_MODES) {
+        ret = FbGetModes(arg);
+    } else {
+        ret = VirtgpuSetMode((uint32_t)arg);
+    }
+    (void)OsalMutexUnlock(&g_virtGpu->modeMutex);
+    return ret;
+}
+
 /* used to happy video/fb.h configure */
 static int FbDummy(struct fb_vtable_s *v, int *s)
 {
@@ -780,6 +1286,7 @@ static struct fb_vtable_s g_virtGpuFbOps = {
 # endif
     .fb_pan_display = (int (*)(struct fb_vtable_s *, struct fb_overlayinfo_s *))FbDummy,
 #endif
+    .fb_ioctl = FbIoctl,
     .fb_mmap = FbMmap
 };
 
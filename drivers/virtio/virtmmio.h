@@ -67,6 +67,7 @@
 #define VIRTMMIO_VERSION                    2
 #define VIRTMMIO_DEVICE_ID_NET              1
 #define VIRTMMIO_DEVICE_ID_BLK              2
+#define VIRTMMIO_DEVICE_ID_CONSOLE          3
 #define VIRTMMIO_DEVICE_ID_RNG              4
 #define VIRTMMIO_DEVICE_ID_GPU              16
 #define VIRTMMIO_DEVICE_ID_INPUT            18
@@ -78,6 +79,7 @@
 #define NUM_VIRTIO_TRANSPORTS               32
 
 #define VIRTMMIO_IRQ_NOTIFY_USED            (1 << 0)
+#define VIRTMMIO_IRQ_CONFIG_CHANGED         (1 << 1)
 
 struct VirtqDesc {
     uint64_t pAddr;
@@ -22,9 +22,12 @@
 #include "hdf_device_desc.h"
 #include "securec.h"
 #include "los_compiler.h"
+#include "los_interrupt.h"
 #include "los_memory.h"
 #include "fb.h"
 #include "virtmmio.h"
+#include "virtgpu.h"
+#include "virtgpu_edid.h"
 
 #define VIRTIO_GPU_F_EDID   (1 << 1)
 
@@ -99,6 +102,14 @@ struct VirtgpuRect {
     uint32_t height;
 };
 
+struct VirtgpuConfig {
+#define VIRTIO_GPU_EVENT_DISPLAY (1 << 0)
+    uint32_t eventsRead;
+    uint32_t eventsClear;
+    uint32_t numScanouts;
+    uint32_t numCapsets;
+};
+
 struct VirtgpuResourceFlush {
     struct VirtgpuCtrlHdr hdr;
     struct VirtgpuRect r;
@@ -116,11 +127,17 @@ struct VirtgpuTransferToHost2D {
 
 struct Virtgpu {
     struct VirtmmioDev      dev;
-    OSAL_DECLARE_TIMER(timer);          /* refresh timer */
+    OSAL_DECLARE_TIMER(timer);          /* full screen refresh, deferred damage once client report it */
+    bool                    refreshStop;    /* timer callback must not touch queue or resource */
 
-    struct VirtgpuRect      screen;
+    struct VirtgpuRect      screen;     /* current mode */
     uint8_t                 *fb;        /* frame buffer */
+    size_t                  fbSize;     /* allocated at boot for preferred mode, never move */
     bool                    edid;
+    struct VirtgpuModeList  modes;
+    bool                    damageReport;   /* client report damage, refresh on demand */
+    struct VirtgpuRect      damage;     /* reported while previous refresh in flight, picked up by timer */
+    OSAL_DECLARE_MUTEX(ioctlMutex);     /* serialize mode ops & on-demand refresh */
 
     /*
      * Normal operations(timer refresh) request/response buffers.
@@ -129,7 +146,8 @@ struct Virtgpu {
      * Response is shared and ignored.
      *
      * control queue 4 descs: 0-trans_req 1-trans_resp 2-flush_req 3-flush_resp
-     *                        0-... (30Hz is enough to avoid override)
+     *                        0-... (30Hz is enough to avoid override, on-demand
+     *                        refresh is deferred while the previous pair is in flight)
      */
     struct VirtgpuResourceFlush     flushReq;
     struct VirtgpuTransferToHost2D  transReq;
@@ -277,7 +295,7 @@ struct VirtgpuRespDisplayInfo {
         uint32_t flags;
     } pmodes[VIRTIO_GPU_MAX_SCANOUTS];
 };
-static void CMDGetDisplayInfo(void)
+static bool CMDGetDisplayInfo(struct VirtgpuRect *r)
 {
     struct VirtgpuCtrlHdr req = {
         .type = VIRTIO_GPU_CMD_GET_DISPLAY_INFO
@@ -285,23 +303,37 @@ static void CMDGetDisplayInfo(void)
     struct VirtgpuRespDisplayInfo resp = { 0 };
 
     if (!RequestResponse(0, &req, sizeof(req), &resp, sizeof(resp))) {
-        goto DEFAULT;
+        return false;
     }
 
-    if (resp.pmodes[0].enabled) {
-        g_virtGpu->screen = resp.pmodes[0].r;
-        return;
-    } else {
+    if (!resp.pmodes[0].enabled) {
         HDF_LOGE("[%s]scanout 0 not enabled", __func__);
+        return false;
     }
+    *r = resp.pmodes[0].r;
+    return true;
+}
+
+/* only modes fit in boot-time framebuffer are usable, so fbmem never move */
+static void AddMode(uint32_t width, uint32_t height)
+{
+    struct VirtgpuModeList *list = &g_virtGpu->modes;
+    uint32_t i;
 
-DEFAULT:
-    g_virtGpu->screen.x = g_virtGpu->screen.y = 0;
-    g_virtGpu->screen.width = FB_WIDTH_DFT;
-    g_virtGpu->screen.height = FB_HEIGHT_DFT;
+    if ((width == 0) || (height == 0) || (list->num >= VIRTGPU_MAX_MODES) ||
+        (width * height * PIXEL_BYTES > g_virtGpu->fbSize)) {
+        return;
+    }
+    for (i = 0; i < list->num; i++) {
+        if ((list->modes[i].width == width) && (list->modes[i].height == height)) {
+            return;
+        }
+    }
+    list->modes[list->num].width = width;
+    list->modes[list->num].height = height;
+    list->num++;
 }
 
-/* reserved for future use */
 struct VirtgpuGetEdid {
     struct VirtgpuCtrlHdr hdr;
     uint32_t scanout;
@@ -321,11 +353,38 @@ static void CMDGetEdid(void)
     struct VirtgpuRespEdid resp = { 0 };
 
     if (!RequestResponse(0, &req, sizeof(req), &resp, sizeof(resp))) {
-        goto DEFAULT;
+        return;
+    }
+    if (!VirtgpuParseEdid(resp.edid, (resp.size < sizeof(resp.edid)) ? resp.size : sizeof(resp.edid), AddMode)) {
+        HDF_LOGE("[%s]invalid EDID, size=%u", __func__, resp.size);
+    }
+}
+
+/* host preferred mode first, then current mode, then what EDID announced */
+static void VirtgpuProbeModes(void)
+{
+    struct VirtgpuRect r;
+
+    g_virtGpu->modes.num = 0;
+    if (CMDGetDisplayInfo(&r)) {
+        AddMode(r.width, r.height);
     }
+    AddMode(g_virtGpu->screen.width, g_virtGpu->screen.height);
+    if (g_virtGpu->edid) {
+        CMDGetEdid();
+    }
+}
+
+/* host changed display(e.g. window resized) since last probe */
+static bool DisplayChanged(void)
+{
+    VADDR_T conf = g_virtGpu->dev.base + VIRTMMIO_REG_CONFIG;
 
-DEFAULT:
-    return;
+    if (OSAL_READL(conf + offsetof(struct VirtgpuConfig, eventsRead)) & VIRTIO_GPU_EVENT_DISPLAY) {
+        OSAL_WRITEL(VIRTIO_GPU_EVENT_DISPLAY, conf + offsetof(struct VirtgpuConfig, eventsClear));
+        return true;
+    }
+    return false;
 }
 
 struct VirtgpuResourceCreate2D {
@@ -355,12 +414,13 @@ struct VirtgpuSetScanout {
     uint32_t scanoutId;
     uint32_t resourceId;
 };
-static bool CMDSetScanout(const struct VirtgpuRect *r)
+/* resourceId 0 disable the scanout */
+static bool CMDSetScanout(const struct VirtgpuRect *r, uint32_t resourceId)
 {
     struct VirtgpuSetScanout req = {
         .hdr.type = VIRTIO_GPU_CMD_SET_SCANOUT,
         .r = *r,
-        .resourceId = RESOURCEID_FB
+        .resourceId = resourceId
     };
     struct VirtgpuCtrlHdr resp = { 0 };
 
@@ -421,13 +481,95 @@ static bool CMDResourceAttachBacking(uint32_t resourceId, uint64_t vaddr, uint32
     return RequestDataResponse(&req, sizeof(req), &data, sizeof(data), &resp, sizeof(resp));
 }
 
-static void NormOpsRefresh(uintptr_t arg)
+struct VirtgpuResourceUnref {
+    struct VirtgpuCtrlHdr hdr;
+    uint32_t resourceId;
+    uint32_t padding;
+};
+static bool CMDResourceUnref(uint32_t resourceId)
+{
+    struct VirtgpuResourceUnref req = {
+        .hdr.type = VIRTIO_GPU_CMD_RESOURCE_UNREF,
+        .resourceId = resourceId
+    };
+    struct VirtgpuCtrlHdr resp = { 0 };
+
+    return RequestResponse(0, &req, sizeof(req), &resp, sizeof(resp));
+}
+
+static void UnionRect(struct VirtgpuRect *dst, const struct VirtgpuRect *r)
+{
+    uint32_t right, bottom;
+
+    if ((dst->width == 0) || (dst->height == 0)) {
+        *dst = *r;
+        return;
+    }
+    right = (dst->x + dst->width > r->x + r->width) ? (dst->x + dst->width) : (r->x + r->width);
+    bottom = (dst->y + dst->height > r->y + r->height) ? (dst->y + dst->height) : (r->y + r->height);
+    dst->x = (dst->x < r->x) ? dst->x : r->x;
+    dst->y = (dst->y < r->y) ? dst->y : r->y;
+    dst->width = right - dst->x;
+    dst->height = bottom - dst->y;
+}
+
+/* must hold LOS_IntLock */
+static void SubmitRefresh(void)
 {
-    (void)arg;
     RequestNoResponse(0, &g_virtGpu->transReq, sizeof(g_virtGpu->transReq), false);
     RequestNoResponse(0, &g_virtGpu->flushReq, sizeof(g_virtGpu->flushReq), true);
 }
 
+/* must hold LOS_IntLock. Request buffers are shared, so they are rewritten only after previous pair consumed. */
+static void SubmitDamage(void)
+{
+    struct Virtq *q = &g_virtGpu->dev.vq[0];
+    struct VirtgpuRect *r = &g_virtGpu->damage;
+
+    if ((r->width == 0) || (r->height == 0) || (q->avail->index != q->used->index)) {
+        return;
+    }
+    g_virtGpu->transReq.r = *r;
+    g_virtGpu->transReq.offset = (r->y * g_virtGpu->screen.width + r->x) * PIXEL_BYTES;
+    g_virtGpu->flushReq.r = *r;
+    r->width = r->height = 0;
+    SubmitRefresh();
+}
+
+static void NormOpsRefresh(uintptr_t arg)
+{
+    UINT32 intSave;
+
+    (void)arg;
+    /* checked and submitted atomically, so VirtgpuEndNormDisplay sees either nothing or a whole pair */
+    intSave = LOS_IntLock();
+    if (!g_virtGpu->refreshStop) {
+        if (g_virtGpu->damageReport) {
+            SubmitDamage();
+        } else {
+            SubmitRefresh();
+        }
+    }
+    LOS_IntRestore(intSave);
+}
+
+/*
+ * Transfer & flush only the changed region, reuse the normal OPs buffers.
+ * Never wait for QEMU: while previous pair is in flight, the region is merged
+ * and left to the next timer tick.
+ */
+static void DamageRefresh(const struct VirtgpuRect *r)
+{
+    UINT32 intSave;
+
+    intSave = LOS_IntLock();
+    UnionRect(&g_virtGpu->damage, r);
+    if (!g_virtGpu->refreshStop) {
+        SubmitDamage();
+    }
+    LOS_IntRestore(intSave);
+}
+
 /* fit user-space page size mmap */
 static inline size_t VirtgpuFbPageSize(void)
 {
@@ -461,6 +603,7 @@ static void PopulateVirtQ(void)
 
     g_virtGpu->transReq.hdr.type = VIRTIO_GPU_CMD_TRANSFER_TO_HOST_2D;
     g_virtGpu->transReq.r = g_virtGpu->screen;
+    g_virtGpu->transReq.offset = 0;
     g_virtGpu->transReq.resourceId = RESOURCEID_FB;
 
     g_virtGpu->flushReq.hdr.type = VIRTIO_GPU_CMD_RESOURCE_FLUSH;
@@ -481,7 +624,18 @@ static bool VirtgpuBeginNormDisplay(void)
 
     /* now we can fix queue entries to avoid redundant when do normal OPs */
     PopulateVirtQ();
+    g_virtGpu->damage.width = g_virtGpu->damage.height = 0;
+    g_virtGpu->refreshStop = false;
 
+    /*
+     * framebuffer can be modified at any time, so we need a full screen refresh timer.
+     * Once client report damage, it only submits what was deferred behind an in-flight refresh.
+     */
+    ret = OsalTimerCreate(&g_virtGpu->timer, GPU_DFT_RATE, NormOpsRefresh, 0);
+    if (ret != HDF_SUCCESS) {
+        HDF_LOGE("[%s]create timer failed: %d\n", __func__, ret);
+        return false;
+    }
     if ((ret = OsalTimerStartLoop(&g_virtGpu->timer)) != HDF_SUCCESS) {
         HDF_LOGE("[%s]start timer failed: %d\n", __func__, ret);
         return false;
@@ -496,6 +650,9 @@ static void VirtgpuDeInit(struct Virtgpu *gpu)
     if (gpu->timer.realTimer) {
         OsalTimerDelete(&gpu->timer);
     }
+    if (gpu->ioctlMutex.realMutex) {
+        OsalMutexDestroy(&gpu->ioctlMutex);
+    }
     if (gpu->fb) {
         LOS_MemFree(OS_SYS_MEM_ADDR, gpu->fb);
     }
@@ -540,10 +697,8 @@ static struct Virtgpu *VirtgpuInitDev(void)
         goto ERR_OUT1;
     }
 
-    /* framebuffer can be modified at any time, so we need a full screen refresh timer */
-    ret = OsalTimerCreate(&gpu->timer, GPU_DFT_RATE, NormOpsRefresh, 0);
-    if (ret != HDF_SUCCESS) {
-        HDF_LOGE("[%s]create timer failed: %d\n", __func__, ret);
+    if ((ret = OsalMutexInit(&gpu->ioctlMutex)) != HDF_SUCCESS) {
+        HDF_LOGE("[%s]initialize mutex failed: %d\n", __func__, ret);
         goto ERR_OUT1;
     }
 
@@ -639,7 +794,7 @@ static bool VirtgpuInitResourceHelper(uint32_t resourceId)
 
     if (resourceId == RESOURCEID_FB) {
         struct VirtgpuRect r = { 0, 0, w, h };
-        return CMDSetScanout(&r);
+        return CMDSetScanout(&r, RESOURCEID_FB);
     }
     return true;
 }
@@ -654,6 +809,7 @@ static bool VirtgpuInitResource(void)
         HDF_LOGE("[%s]alloc framebuffer memory fail", __func__);
         return false;
     }
+    g_virtGpu->fbSize = VirtgpuFbPageSize();
     if (!VirtgpuInitResourceHelper(RESOURCEID_FB)) {
         return false;
     }
@@ -667,18 +823,81 @@ int up_fbinitialize(int display)
         return -1;
     }
 
-    CMDGetDisplayInfo();
-    if (g_virtGpu->edid) {
-        CMDGetEdid();
+    if (!CMDGetDisplayInfo(&g_virtGpu->screen)) {
+        g_virtGpu->screen.x = g_virtGpu->screen.y = 0;
+        g_virtGpu->screen.width = FB_WIDTH_DFT;
+        g_virtGpu->screen.height = FB_HEIGHT_DFT;
     }
 
     if (!VirtgpuInitResource()) {
         return -1;
     }
 
+    VirtgpuProbeModes();
+    (void)DisplayChanged();     /* clear pending event, we are up to date */
     return 0;
 }
 
+/* wait for in-flight refresh and switch control queue back to request-wait-response usage */
+static void VirtgpuEndNormDisplay(void)
+{
+    struct Virtq *q = &g_virtGpu->dev.vq[0];
+    UINT32 intSave;
+
+    /* a callback already fired may still be queued behind us, keep it off the resource being replaced */
+    intSave = LOS_IntLock();
+    g_virtGpu->refreshStop = true;
+    LOS_IntRestore(intSave);
+    if (g_virtGpu->timer.realTimer) {
+        (void)OsalTimerDelete(&g_virtGpu->timer);
+    }
+    while (q->avail->index != q->used->index) {
+        DSB;
+    }
+    q->last = q->used->index;
+}
+
+/*
+ * Re-create the scanout resource at a new size on the same backing memory,
+ * so fb_register recorded fbmem stays valid but users must re-query plane
+ * info for new stride. Smaller modes cut per-frame transfer bandwidth.
+ */
+static int VirtgpuSetMode(uint32_t index)
+{
+    struct Virtgpu *gpu = g_virtGpu;
+    struct VirtgpuRect off = { 0 };
+    struct VirtgpuRect old = gpu->screen;
+    int ret = 0;
+
+    if (index >= gpu->modes.num) {
+        HDF_LOGE("[%s]invalid mode index: %u", __func__, index);
+        return -1;
+    }
+    if ((gpu->modes.modes[index].width == old.width) && (gpu->modes.modes[index].height == old.height)) {
+        return 0;
+    }
+
+    VirtgpuEndNormDisplay();
+    (void)CMDSetScanout(&off, 0);
+    (void)CMDResourceUnref(RESOURCEID_FB);
+
+    gpu->screen.width = gpu->modes.modes[index].width;
+    gpu->screen.height = gpu->modes.modes[index].height;
+    if (!VirtgpuInitResourceHelper(RESOURCEID_FB)) {
+        HDF_LOGE("[%s]set mode %ux%u failed, restore %ux%u", __func__,
+                 gpu->screen.width, gpu->screen.height, old.width, old.height);
+        (void)CMDResourceUnref(RESOURCEID_FB);
+        gpu->screen = old;
+        (void)VirtgpuInitResourceHelper(RESOURCEID_FB);
+        ret = -1;
+    }
+
+    if (!VirtgpuBeginNormDisplay()) {
+        return -1;
+    }
+    return ret;
+}
+
 static int FbGetVideoInfo(struct fb_vtable_s *vtable, struct fb_videoinfo_s *vinfo)
 {
     (void)vtable;
@@ -737,6 +956,81 @@ static int FbRelease(struct fb_vtable_s *vtable)
     return 0;
 }
 
+static int FbGetModes(struct VirtgpuModeList *out)
+{
+    struct VirtgpuModeList *list = &g_virtGpu->modes;
+    uint32_t i;
+
+    if (out == NULL) {
+        return -1;
+    }
+    if (DisplayChanged()) {
+        VirtgpuEndNormDisplay();
+        VirtgpuProbeModes();
+        if (!VirtgpuBeginNormDisplay()) {
+            return -1;
+        }
+    }
+    for (i = 0; i < list->num; i++) {
+        if ((list->modes[i].width == g_virtGpu->screen.width) &&
+            (list->modes[i].height == g_virtGpu->screen.height)) {
+            list->current = i;
+        }
+    }
+
+    *out = *list;
+    return 0;
+}
+
+static int FbReportDamage(const uint32_t *damage)
+{
+    struct VirtgpuRect *s = &g_virtGpu->screen;
+    struct VirtgpuRect r;
+
+    if (damage == NULL) {
+        return -1;
+    }
+    if ((damage[0] >= s->width) || (damage[1] >= s->height)) {
+        return 0;
+    }
+    r.x = damage[0];
+    r.y = damage[1];
+    r.width = (damage[2] > s->width - r.x) ? (s->width - r.x) : damage[2];
+    r.height = (damage[3] > s->height - r.y) ? (s->height - r.y) : damage[3];
+    if ((r.width == 0) || (r.height == 0)) {
+        return 0;
+    }
+
+    /* client tells us what changed, periodic full screen refresh is no longer needed */
+    g_virtGpu->damageReport = true;
+    DamageRefresh(&r);
+    return 0;
+}
+
+static int FbIoctl(struct fb_vtable_s *vtable, int cmd, unsigned long arg)
+{
+    (void)vtable;
+    int ret;
+
+    if ((cmd != VIRTGPU_FBIO_DAMAGE) && (cmd != VIRTGPU_FBIO_GET_MODES) && (cmd != VIRTGPU_FBIO_SET_MODE)) {
+        HDF_LOGE("[%s]unsupported ioctl: %#x", __func__, cmd);
+        return -1;
+    }
+
+    if (OsalMutexLock(&g_virtGpu->ioctlMutex) != HDF_SUCCESS) {
+        return -1;
+    }
+    if (cmd == VIRTGPU_FBIO_DAMAGE) {
+        ret = FbReportDamage((const uint32_t *)arg);
+    } else if (cmd == VIRTGPU_FBIO_GET_MODES) {
+        ret = FbGetModes((struct VirtgpuModeList *)arg);
+    } else {
+        ret = VirtgpuSetMode((uint32_t)arg);
+    }
+    (void)OsalMutexUnlock(&g_virtGpu->ioctlMutex);
+    return ret;
+}
+
 /* used to happy video/fb.h configure */
 static int FbDummy(struct fb_vtable_s *v, int *s)
 {
@@ -768,6 +1062,7 @@ static struct fb_vtable_s g_virtGpuFbOps = {
 # endif
     .fb_pan_display = (int (*)(struct fb_vtable_s *, struct fb_overlayinfo_s *))FbDummy,
 #endif
+    .fb_ioctl = FbIoctl,
 };
 
 struct fb_vtable_s *up_fbgetvplane(int display, int vplane)
@@ -19,6 +19,7 @@
 #include "hdf_log.h"
 #include "display_type.h"
 #include "fb.h"
+#include "virtgpu.h"
 
 #define DEV_ID             0
 #define LAYER_ID           0
@@ -35,9 +36,9 @@ struct LayerPrivate {
     int32_t  pitch;
     void     *fbAddr;
     uint32_t fbSize;
-    void     *layerAddr;
     PixelFormat pixFmt;
     struct fb_mem *fbmem;
+    IRect    dirty;
 };
 
 static struct LayerPrivate *GetLayerInstance(void)
@@ -118,6 +119,10 @@ static int32_t CreateLayer(uint32_t devId, const LayerInfo *layerInfo, uint32_t
     }
 
     SetBackground();
+    priv->dirty.x = 0;
+    priv->dirty.y = 0;
+    priv->dirty.w = priv->width;
+    priv->dirty.h = priv->height;
     *layerId = LAYER_ID;
     HDF_LOGI("%s: open layer success", __func__);
     return DISPLAY_SUCCESS;
@@ -138,14 +143,8 @@ static int32_t CloseLayer(uint32_t devId, uint32_t layerId)
         fb_close(priv->fbmem);
 		priv->fbmem = NULL;
     }
-    if (priv->layerAddr != NULL) {
-        free(priv->layerAddr);
-        priv->layerAddr = NULL;
-    }
-    if (priv->fbAddr != NULL) {
-        free(priv->fbAddr);
-        priv->fbAddr = NULL;
-    }
+    /* fbAddr is the scanout memory owned by virtgpu, never free it */
+    priv->fbAddr = NULL;
     priv->fd = -1;
 
     return DISPLAY_SUCCESS;
@@ -171,6 +170,56 @@ static int32_t GetDisplayInfo(uint32_t devId, DisplayInfo *dispInfo)
     return DISPLAY_SUCCESS;
 }
 
+static int32_t SetLayerDirtyRegion(uint32_t devId, uint32_t layerId, IRect *region)
+{
+    if (region == NULL) {
+        HDF_LOGE("%s: region is null", __func__);
+        return DISPLAY_NULL_PTR;
+    }
+    if (devId != DEV_ID) {
+        HDF_LOGE("%s: devId invalid", __func__);
+        return DISPLAY_FAILURE;
+    }
+    if (layerId != LAYER_ID) {
+        HDF_LOGE("%s: layerId invalid", __func__);
+        return DISPLAY_FAILURE;
+    }
+    struct LayerPrivate *priv = GetLayerInstance();
+    if (region->x < 0 || region->y < 0 || region->w <= 0 || region->h <= 0 ||
+        (uint32_t)region->x >= priv->width || (uint32_t)region->y >= priv->height) {
+        HDF_LOGE("%s: region invalid", __func__);
+        return DISPLAY_PARAM_ERR;
+    }
+    priv->dirty = *region;
+    return DISPLAY_SUCCESS;
+}
+
+static int32_t CopyDirtyRegion(const struct LayerPrivate *priv, const LayerBuffer *buffer)
+{
+    const IRect *r = &priv->dirty;
+    uint32_t w = ((uint32_t)(r->x + r->w) > priv->width) ? (priv->width - r->x) : (uint32_t)r->w;
+    uint32_t h = ((uint32_t)(r->y + r->h) > priv->height) ? (priv->height - r->y) : (uint32_t)r->h;
+    uint32_t len = w * BITS_PER_PIXEL / BITS_TO_BYTE;
+    uint32_t offset = r->y * priv->pitch + r->x * BITS_PER_PIXEL / BITS_TO_BYTE;
+    uint8_t *dst = (uint8_t *)priv->fbAddr + offset;
+    const uint8_t *src = (const uint8_t *)buffer->data.virAddr + r->y * buffer->pitch +
+                         r->x * BITS_PER_PIXEL / BITS_TO_BYTE;
+    uint32_t i;
+    int32_t ret;
+
+    for (i = 0; i < h; i++) {
+        ret = memcpy_s(dst, priv->fbSize - offset, src, len);
+        if (ret != EOK) {
+            HDF_LOGE("%s: memcpy_s fail, ret %d", __func__, ret);
+            return ret;
+        }
+        dst += priv->pitch;
+        src += buffer->pitch;
+        offset += priv->pitch;
+    }
+    return DISPLAY_SUCCESS;
+}
+
 static int32_t Flush(uint32_t devId, uint32_t layerId, LayerBuffer *buffer)
 {
     int32_t ret;
@@ -189,10 +238,19 @@ static int32_t Flush(uint32_t devId, uint32_t layerId, LayerBuffer *buffer)
 
     struct LayerPrivate *priv = GetLayerInstance();
 
-    ret = memcpy_s(priv->fbAddr, priv->fbSize, buffer->data.virAddr, priv->fbSize);
-    if (ret != EOK) {
-        HDF_LOGE("%s: memcpy_s fail, ret %d", __func__, ret);
-        return ret;
+    /* single layer renders into scanout memory directly, only foreign buffer need a copy */
+    if (buffer->data.virAddr != priv->fbAddr) {
+        ret = CopyDirtyRegion(priv, buffer);
+        if (ret != DISPLAY_SUCCESS) {
+            return ret;
+        }
+    }
+
+    /* let virtio-gpu transfer only what changed, on demand */
+    uint32_t damage[] = { priv->dirty.x, priv->dirty.y, priv->dirty.w, priv->dirty.h };
+    if (fb_ioctl(priv->fbmem, VIRTGPU_FBIO_DAMAGE, (unsigned long)(uintptr_t)damage) != 0) {
+        HDF_LOGE("%s: report damage fail", __func__);
+        return DISPLAY_FAILURE;
     }
     return DISPLAY_SUCCESS;
 }
@@ -221,13 +279,9 @@ static int32_t GetLayerBuffer(uint32_t devId, uint32_t layerId, LayerBuffer *buf
     buffer->height = priv->height;
     buffer->pixFormat = priv->pixFmt;
     buffer->pitch = priv->pitch;
-    buffer->data.virAddr = malloc(priv->fbSize);
-    if (buffer->data.virAddr == NULL) {
-        HDF_LOGE("%s: malloc failure", __func__);
-        return DISPLAY_FAILURE;
-    }
-    priv->layerAddr = buffer->data.virAddr;
-    (void)memset_s(buffer->data.virAddr, priv->fbSize, 0x00, priv->fbSize);
+    /* the only layer, so hand out scanout memory instead of a shadow buffer */
+    buffer->data.virAddr = priv->fbAddr;
+    (void)memset_s(buffer->data.virAddr, priv->pitch * priv->height, 0x00, priv->pitch * priv->height);
     HDF_LOGD("%s: fenceId = %d, width = %d, height = %d, pixFormat = %d, pitch = %d", __func__, buffer->fenceId,
         buffer->width, buffer->height, buffer->pixFormat, buffer->pitch);   
 
@@ -251,6 +305,7 @@ int32_t LayerInitialize(LayerFuncs **funcs)
     lFuncs->GetDisplayInfo = GetDisplayInfo;
     lFuncs->CreateLayer = CreateLayer;
     lFuncs->CloseLayer = CloseLayer;
+    lFuncs->SetLayerDirtyRegion = SetLayerDirtyRegion;
     lFuncs->Flush = Flush;
     lFuncs->GetLayerBuffer = GetLayerBuffer;
     *funcs = lFuncs;
@@ -58,6 +58,6 @@ void DispDev::UpdateFBBuffer()
 
 void DispDev::Flush(const OHOS::Rect& flushRect)
 {
-    FbdevFlush();
+    FbdevFlush(flushRect);
 }
 } // namespace OHOS
@@ -45,8 +45,21 @@ constexpr const ImagePixelFormat LAYER_PIXEL_FORMAT = IMAGE_PIXEL_FORMAT_ARGB888
 constexpr const uint8_t BITS_PER_BYTE = 8;
 static LiteSurfaceData g_devSurfaceData = {};
 
-void FbdevFlush(void)
+static void SetLayerDirtyRegion(IRect rect)
 {
+    if (g_display.layerFuncs->SetLayerDirtyRegion != nullptr) {
+        int32_t ret = g_display.layerFuncs->SetLayerDirtyRegion(g_display.devId, g_display.layerId, &rect);
+        if (ret != DISPLAY_SUCCESS) {
+            GRAPHIC_LOGE("setLayerDirtyRegion fail");
+            return;
+        }
+    }
+}
+
+void FbdevFlush(const Rect& flushRect)
+{
+    IRect rect = {flushRect.GetLeft(), flushRect.GetTop(), flushRect.GetWidth(), flushRect.GetHeight()};
+    SetLayerDirtyRegion(rect);
     if (g_display.layerFuncs->Flush != nullptr) {
         int32_t ret =
             g_display.layerFuncs->Flush(g_display.devId, g_display.layerId, &g_display.buffer);
@@ -121,18 +134,6 @@ static void SetLayerVisible(bool visibled)
     }
 }
 
-static void SetLayerDirtyRegion(void)
-{
-    IRect rect = {0, 0, g_layerInfo.width, g_layerInfo.height};
-    if (g_display.layerFuncs->SetLayerDirtyRegion != nullptr) {
-        int32_t ret = g_display.layerFuncs->SetLayerDirtyRegion(g_display.devId, g_display.layerId, &rect);
-        if (ret != DISPLAY_SUCCESS) {
-            GRAPHIC_LOGE("setLayerDirtyRegion fail");
-            return;
-        }
-    }
-}
-
 static void AllocDisplayBuffer(void)
 {
     if (g_display.layerFuncs->GetLayerBuffer != nullptr) {
@@ -150,7 +151,7 @@ void FbdevInit(void)
     DisplayInit();
     OpenLayer();
     SetLayerVisible(true);
-    SetLayerDirtyRegion();
+    SetLayerDirtyRegion({0, 0, g_layerInfo.width, g_layerInfo.height});
     AllocDisplayBuffer();
     uintptr_t phyAddr = g_display.buffer.data.phyAddr;
     g_devSurfaceData.phyAddr = reinterpret_cast<uint8_t*>(phyAddr);
@@ -17,6 +17,7 @@
 #define GRAPHIC_LITE_HI_FBDEV_H
 
 #include "gfx_utils/pixel_format_utils.h"
+#include "gfx_utils/rect.h"
 
 namespace OHOS {
 enum LayerRotateType {
@@ -58,8 +59,8 @@ void FbdevInit(void);
 void FbdevClose(void);
 
 /**
- * @brief flush
+ * @brief flush the changed region
  */
-void FbdevFlush(void);
+void FbdevFlush(const Rect& flushRect);
 } // namespace OHOS
 #endif // GRAPHIC_LITE_HI_FBDEV_H